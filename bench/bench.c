@@ -92,8 +92,14 @@ bg_bench_result_t bg_bench_run(const bg_bench_config_t *cfg)
     uint32_t channels = (uint32_t)n;
     size_t   raw_size = (size_t)w * h * n;
 
-    /* Allocate encode buffer (2x raw + margin) */
-    size_t enc_cap = raw_size * 2 + 1024 * 1024;
+    /* Allocate encode buffer (worst case for this size and quality) */
+    uint64_t enc_bound = 0;
+    if (bitgrain_encode_bound(width, height, channels >= 3 ? channels : 1, (uint8_t)cfg->quality, &enc_bound) != 0) {
+        fprintf(stderr, "[bench] unsupported image '%s'\n", cfg->image_path);
+        stbi_image_free(pixels_orig);
+        return res;
+    }
+    size_t enc_cap = (size_t)enc_bound;
     uint8_t *enc_buf = (uint8_t *)malloc(enc_cap);
     uint8_t *dec_buf = (uint8_t *)malloc(raw_size);
     if (!enc_buf || !dec_buf) {
@@ -1,12 +1,14 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #include "bg_utils.h"
 #include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
 
-int parse_bg_header(const uint8_t *buf, uint32_t *width, uint32_t *height, uint32_t *channels)
+int parse_bg_header(const uint8_t *buf, size_t size, uint32_t *width, uint32_t *height, uint32_t *channels)
 {
-    if (buf[0] != 'B' || buf[1] != 'G') return -1;
+    if (size < 11 || buf[0] != 'B' || buf[1] != 'G') return -1;
     uint8_t ver = buf[2];
-    if (ver < 1 || ver > 19) return -1;
+    if (ver < 1 || ver > 22) return -1;
     *width   = (uint32_t)buf[3] | ((uint32_t)buf[4]<<8) | ((uint32_t)buf[5]<<16) | ((uint32_t)buf[6]<<24);
     *height  = (uint32_t)buf[7] | ((uint32_t)buf[8]<<8) | ((uint32_t)buf[9]<<16) | ((uint32_t)buf[10]<<24);
     /* v1=gray(1ch), v2=RGB(3ch), v3=RGBA(4ch), v4/v6/v8/v10/v12/v14/v16/v18=YCbCr420→RGB(3ch), v5/v7/v9/v11/v13/v15/v17/v19=YCbCr420A→RGBA(4ch) */
@@ -30,6 +32,18 @@ int parse_bg_header(const uint8_t *buf, uint32_t *width, uint32_t *height, uint3
         case 17: *channels = 4; break; /* very aggressive perceptual profile decodes to RGBA */
         case 18: *channels = 3; break; /* ultra profile decodes to RGB */
         case 19: *channels = 4; break; /* ultra profile decodes to RGBA */
+        case 20:                       /* chunked container: channels follow the plane profile */
+            if (size < 16 || buf[12] < 4 || buf[12] > 19) return -1;
+            *channels = (buf[12] & 1) ? 4 : 3;
+            break;
+        case 21:                       /* sequence: channels stored in the header; decodes frame 0 */
+            if (size < 276 || (buf[13] != 1 && buf[13] != 3 && buf[13] != 4)) return -1;
+            *channels = buf[13];
+            break;
+        case 22:                       /* lossless: channels stored in the header */
+            if (size < 16 || (buf[12] != 1 && buf[12] != 3 && buf[12] != 4)) return -1;
+            *channels = buf[12];
+            break;
         default: return -1;
     }
     return 0;
@@ -42,3 +56,18 @@ int check_image_size(uint32_t width, uint32_t height, uint32_t channels)
     if (bytes > BITGRAIN_MAX_PIXEL_BYTES) return -1;
     return 0;
 }
+
+uint8_t *bg_read_file(const char *path, long *fsize)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    if (fseek(f, 0, SEEK_END) != 0) { fclose(f); return NULL; }
+    *fsize = ftell(f);
+    if (*fsize <= 0 || *fsize > (long)BITGRAIN_MAX_BG_FILE) { fclose(f); return NULL; }
+    rewind(f);
+    uint8_t *buf = (uint8_t *)malloc((size_t)*fsize);
+    if (!buf) { fclose(f); return NULL; }
+    if (fread(buf, 1, (size_t)*fsize, f) != (size_t)*fsize) { fclose(f); free(buf); return NULL; }
+    fclose(f);
+    return buf;
+}
@@ -2,12 +2,16 @@
 #ifndef BITGRAIN_BG_UTILS_H
 #define BITGRAIN_BG_UTILS_H
 
+#include <stddef.h>
 #include <stdint.h>
 
-/* Parse .bg header (11 bytes). Sets *channels (1, 3, or 4). Returns 0 on success. */
-int parse_bg_header(const uint8_t *buf, uint32_t *width, uint32_t *height, uint32_t *channels);
+/* Parse .bg header (11 bytes; 16 for the v20 container). Sets *channels (1, 3, or 4). Returns 0 on success. */
+int parse_bg_header(const uint8_t *buf, size_t size, uint32_t *width, uint32_t *height, uint32_t *channels);
 
 /* Check image dimensions against limits. Returns 0 if OK. */
 int check_image_size(uint32_t width, uint32_t height, uint32_t channels);
 
+/* Read a whole .bg file (at most BITGRAIN_MAX_BG_FILE bytes). Returns a malloc'd buffer, sets *fsize. */
+uint8_t *bg_read_file(const char *path, long *fsize);
+
 #endif
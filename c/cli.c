@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: GPL-3.0-or-later */
 #define _POSIX_C_SOURCE 200809L
 #include "cli.h"
+#include "encoder.h"
 #include "platform.h"
 #include "config.h"
 #include <stdio.h>
@@ -33,15 +34,22 @@ static void usage_encode(const char *prog)
         "  --quality, -q <1-100>  Encode quality (default 85)\n"
         "  --threads, -t <n>      Worker threads (default runtime)\n"
         "  --deterministic        Alias for --threads 1\n"
+        "  --chunked              Write chunked container (TOC for range reads)\n"
+        "  --lossless             Lossless encode (exact pixels; quality ignored)\n"
+        "  --max-size <bytes>     Highest quality that fits (suffix K or M; replaces --quality)\n"
+        "  --target-ssim <0-1>    Lowest quality whose luma SSIM reaches the target\n"
+        "  --target-psnr <dB>     Lowest quality whose luma PSNR reaches the target\n"
         "  --overwrite, -y        Overwrite existing files\n"
         "  --help                 This help\n\n"
         "Examples:\n"
         "  %s encode photo.jpg                  # → photo.bg\n"
         "  %s encode photo.jpg -o photo.bg\n"
         "  %s encode ./images -o ./out --quality 80\n"
+        "  %s encode photo.jpg --max-size 60K\n"
+        "  %s encode photo.jpg --target-ssim 0.95\n"
         "  cat photo.jpg | %s encode - -o out.bg\n"
         "  cat photo.jpg | %s encode - -o -  > out.bg\n",
-        prog, prog, prog, prog, prog, prog);
+        prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
 static void usage_decode(const char *prog)
@@ -67,6 +75,24 @@ static void usage_decode(const char *prog)
         prog, prog, prog, prog, prog, prog);
 }
 
+static void usage_verify(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s verify [options] <input.bg|->...\n\n"
+        "  Check .bg file(s) for corruption or truncation without decoding pixels:\n"
+        "  header, plane lengths, every Huffman symbol, block counts, coefficient\n"
+        "  ranges and the trailer. Prints '<file>: ok' per valid file; for a bad file,\n"
+        "  the byte offset and reason go to stderr. Exit status 1 if any file fails.\n\n"
+        "Options:\n"
+        "  --threads, -t <n>      Worker threads (default runtime)\n"
+        "  --help                 This help\n\n"
+        "Examples:\n"
+        "  %s verify photo.bg\n"
+        "  %s verify ./incoming\n"
+        "  cat photo.bg | %s verify -\n",
+        prog, prog, prog, prog);
+}
+
 static void usage_roundtrip(const char *prog)
 {
     fprintf(stderr,
@@ -96,14 +122,15 @@ void cli_usage(const char *prog)
         "Usage:\n"
         "  %s encode   [options] <input> [-o <output>]\n"
         "  %s decode   [options] <input> [-o <output>]\n"
-        "  %s roundtrip [options] <input> [-o <output>]\n\n"
+        "  %s roundtrip [options] <input> [-o <output>]\n"
+        "  %s verify   [options] <input.bg>...\n\n"
         "  Use '-' as input or output for stdin/stdout.\n\n"
         "Legacy flags (still supported):\n"
         "  %s -i <in> -o <out>              encode\n"
         "  %s -d -i <file.bg> -o <out>      decode\n"
         "  %s -cd -i <image> -o <out>       roundtrip\n\n"
         "Run '%s <command> --help' for command-specific options.\n",
-        prog, prog, prog, prog, prog, prog, prog);
+        prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
 /* ------------------------------------------------------------------ */
@@ -188,6 +215,8 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
         ctx->decode_mode = 1;
     else if (strcmp(subcmd, "roundtrip") == 0)
         ctx->round_trip = 1;
+    else if (strcmp(subcmd, "verify") == 0)
+        ctx->verify_mode = 1;
     /* else: encode (default) */
 
     const char *output_path = NULL;
@@ -200,6 +229,7 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
         if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) {
             if (ctx->decode_mode)       usage_decode(argv[0]);
             else if (ctx->round_trip)   usage_roundtrip(argv[0]);
+            else if (ctx->verify_mode)  usage_verify(argv[0]);
             else                        usage_encode(argv[0]);
             path_list_free(&input_specs);
             return -2;
@@ -251,6 +281,50 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
             continue;
         }
 
+        /* --chunked */
+        if (strcmp(a, "--chunked") == 0) {
+            ctx->chunked = 1;
+            continue;
+        }
+
+        /* --lossless */
+        if (strcmp(a, "--lossless") == 0) {
+            ctx->lossless = 1;
+            continue;
+        }
+
+        /* --max-size <bytes>[K|M] */
+        if (strcmp(a, "--max-size") == 0 && i + 1 < argc) {
+            char *end = NULL;
+            unsigned long long n = strtoull(argv[++i], &end, 10);
+            unsigned long long mult = 1;
+            if (*end == 'K' || *end == 'k') { mult = 1024; end++; }
+            else if (*end == 'M' || *end == 'm') { mult = 1024 * 1024; end++; }
+            /* Range-check before scaling so a huge count cannot wrap past the limit. */
+            if (end == argv[i] || *end != '\0' || n == 0 || n > UINT32_MAX / mult) {
+                fprintf(stderr, "Error: invalid --max-size '%s'.\n", argv[i]);
+                path_list_free(&input_specs);
+                return -1;
+            }
+            ctx->max_size = (uint32_t)(n * mult);
+            continue;
+        }
+
+        /* --target-ssim <0-1> / --target-psnr <dB> */
+        if ((strcmp(a, "--target-ssim") == 0 || strcmp(a, "--target-psnr") == 0) && i + 1 < argc) {
+            int ssim = strcmp(a, "--target-ssim") == 0;
+            char *end = NULL;
+            double v = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(v > 0.0) || (ssim && v > 1.0) || v > 99.0) {
+                fprintf(stderr, "Error: invalid %s '%s'.\n", a, argv[i]);
+                path_list_free(&input_specs);
+                return -1;
+            }
+            ctx->target_metric = ssim ? BITGRAIN_METRIC_SSIM : BITGRAIN_METRIC_PSNR;
+            ctx->target_value = v;
+            continue;
+        }
+
         /* --overwrite / -y */
         if (strcmp(a, "--overwrite") == 0 || strcmp(a, "-y") == 0) {
             ctx->overwrite = 1;
@@ -273,6 +347,24 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
         return -1;
     }
 
+    if (ctx->chunked && ctx->lossless) {
+        fprintf(stderr, "Error: --chunked cannot be combined with --lossless.\n");
+        path_list_free(&input_specs);
+        return -1;
+    }
+
+    if (ctx->max_size && (ctx->chunked || ctx->lossless)) {
+        fprintf(stderr, "Error: --max-size cannot be combined with --chunked or --lossless.\n");
+        path_list_free(&input_specs);
+        return -1;
+    }
+
+    if (ctx->target_value > 0.0 && (ctx->chunked || ctx->lossless || ctx->max_size)) {
+        fprintf(stderr, "Error: --target-ssim/--target-psnr cannot be combined with --chunked, --lossless or --max-size.\n");
+        path_list_free(&input_specs);
+        return -1;
+    }
+
     if (input_specs.n == 0) {
         fprintf(stderr, "Error: missing input. Run '%s %s --help'.\n", argv[0], subcmd);
         path_list_free(&input_specs);
@@ -284,6 +376,8 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
         path_list_push(&ctx->expanded, "-");
         path_list_free(&input_specs);
         ctx->multi = 0;
+        if (ctx->verify_mode)
+            return 0;
         if (ctx->use_stdout) {
             ctx->output_path = "-";
         } else if (output_path) {
@@ -297,7 +391,7 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
     }
 
     /* Expand filesystem paths */
-    int expand_bg_only = ctx->decode_mode;
+    int expand_bg_only = ctx->decode_mode || ctx->verify_mode;
     for (size_t k = 0; k < input_specs.n; k++) {
         if (path_list_append_from_spec(&ctx->expanded, input_specs.paths[k], expand_bg_only) != 0)
             fprintf(stderr, "Warning: skipping invalid or unreadable path '%s'.\n", input_specs.paths[k]);
@@ -306,11 +400,13 @@ int cli_parse_subcommand(int argc, char **argv, cli_ctx_t *ctx, const char *subc
 
     if (ctx->expanded.n == 0) {
         fprintf(stderr, "Error: no %s found in the given path(s).\n",
-                ctx->decode_mode ? ".bg files" : "image files");
+                expand_bg_only ? ".bg files" : "image files");
         return -1;
     }
 
     ctx->multi = (ctx->expanded.n > 1);
+    if (ctx->verify_mode)
+        return 0;
 
     if (resolve_output(ctx, output_path) != 0) {
         path_list_free(&ctx->expanded);
@@ -17,9 +17,15 @@ typedef struct {
     int overwrite;
     int decode_mode;
     int round_trip;
+    int verify_mode;           /* verify: structural check only, no output */
     int quality;
     int jpeg_out_quality;
     int show_metrics;
+    int chunked;               /* encode: write v20 chunked container (TOC up front) */
+    int lossless;              /* encode: write v22 lossless stream (quality ignored) */
+    uint32_t max_size;         /* encode: byte budget per image; quality is searched (0 = off) */
+    int target_metric;         /* encode: BITGRAIN_METRIC_* for target_value */
+    double target_value;       /* encode: luma quality target; lowest quality reaching it (0 = off) */
     int threads;               /* worker threads; 0 = runtime default */
     int use_stdin;             /* input is stdin ("-") */
     int use_stdout;            /* output is stdout ("-") */
@@ -9,5 +9,7 @@
 #define BITGRAIN_MAX_PIXEL_BYTES (2ULL * 1024 * 1024 * 1024)
 #define BITGRAIN_MAX_BG_FILE     (2ULL * 1024 * 1024 * 1024)
 #define BITGRAIN_OUT_BUF_MARGIN  (1024 * 1024)
+/* Extra bytes over bitgrain_encode_bound for the v20 chunked container (container.rs). */
+#define BITGRAIN_CHUNKED_BOUND_EXTRA 356
 
 #endif
@@ -72,17 +72,7 @@ static uint8_t *read_bg(const char *cur_in, int use_stdin,
         return buf;
     }
 
-    FILE *f = fopen(cur_in, "rb");
-    if (!f) return NULL;
-    if (fseek(f, 0, SEEK_END) != 0) { fclose(f); return NULL; }
-    *fsize = ftell(f);
-    if (*fsize <= 0 || *fsize > (long)BITGRAIN_MAX_BG_FILE) { fclose(f); return NULL; }
-    rewind(f);
-    uint8_t *buf = (uint8_t *)malloc((size_t)*fsize);
-    if (!buf) { fclose(f); return NULL; }
-    if (fread(buf, 1, (size_t)*fsize, f) != (size_t)*fsize) { fclose(f); free(buf); return NULL; }
-    fclose(f);
-    return buf;
+    return bg_read_file(cur_in, fsize);
 }
 
 int decode_cli_run(const cli_ctx_t *ctx)
@@ -143,7 +133,7 @@ int decode_cli_run(const cli_ctx_t *ctx)
         }
 
         uint32_t width, height, channels;
-        if (fsize < 11 || parse_bg_header(bg_buf, &width, &height, &channels) != 0) {
+        if (fsize < 11 || parse_bg_header(bg_buf, (size_t)fsize, &width, &height, &channels) != 0) {
             fprintf(stderr, "Error: '%s' is not a valid .bg or is corrupt.\n", cur_in);
             free(bg_buf);
             free(cur_out_owned);
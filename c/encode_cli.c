@@ -101,8 +101,25 @@ int encode_cli_run(const cli_ctx_t *ctx)
             continue;
         }
 
+        if (ctx->chunked && channels == 1) {
+            fprintf(stderr, "Error: --chunked needs RGB or RGBA input; '%s' is grayscale.\n", cur_in);
+            bitgrain_image_free(pixels);
+            free(cur_out_owned);
+            enc_failed = 1;
+            if (!ctx->multi) break;
+            continue;
+        }
+
         uint64_t raw_bytes = (uint64_t)width * height * channels;
         uint64_t out_cap = raw_bytes * 2 + BITGRAIN_OUT_BUF_MARGIN;
+        if (ctx->max_size)
+            out_cap = ctx->max_size;
+        else if (ctx->target_value > 0.0)
+            bitgrain_encode_bound(width, height, channels, 100, &out_cap);
+        else if (ctx->lossless)
+            bitgrain_encode_lossless_bound(width, height, channels, &out_cap);
+        else if (bitgrain_encode_bound(width, height, channels, (uint8_t)ctx->quality, &out_cap) == 0 && ctx->chunked)
+            out_cap += BITGRAIN_CHUNKED_BOUND_EXTRA;
         if (out_cap > BITGRAIN_MAX_BG_FILE) out_cap = BITGRAIN_MAX_BG_FILE;
         uint8_t *out_buf = (uint8_t *)malloc((size_t)out_cap);
         if (!out_buf) {
@@ -114,8 +131,21 @@ int encode_cli_run(const cli_ctx_t *ctx)
         }
 
         int32_t out_len = 0;
+        uint8_t used_quality = 0;
+        double reached = 0.0;
         int ret;
-        if (channels == 4)
+        if (ctx->max_size)
+            ret = bitgrain_encode_target_size(pixels, width, height, channels, ctx->max_size, out_buf, (uint32_t)out_cap, &out_len, &used_quality);
+        else if (ctx->target_value > 0.0)
+            ret = bitgrain_encode_target_quality(pixels, width, height, channels, (uint32_t)ctx->target_metric, ctx->target_value,
+                                                 out_buf, (uint32_t)out_cap, &out_len, &used_quality, &reached);
+        else if (ctx->lossless)
+            ret = bitgrain_encode_lossless(pixels, width, height, channels, out_buf, (uint32_t)out_cap, &out_len, NULL, 0);
+        else if (ctx->chunked && channels == 4)
+            ret = bitgrain_encode_rgba_chunked(pixels, width, height, out_buf, (int32_t)out_cap, &out_len, (uint8_t)ctx->quality, NULL, 0);
+        else if (ctx->chunked && channels == 3)
+            ret = bitgrain_encode_rgb_chunked(pixels, width, height, out_buf, (int32_t)out_cap, &out_len, (uint8_t)ctx->quality, NULL, 0);
+        else if (channels == 4)
             ret = bitgrain_encode_rgba(pixels, width, height, out_buf, (int32_t)out_cap, &out_len, (uint8_t)ctx->quality);
         else if (channels == 3)
             ret = bitgrain_encode_rgb(pixels, width, height, out_buf, (int32_t)out_cap, &out_len, (uint8_t)ctx->quality);
@@ -124,7 +154,7 @@ int encode_cli_run(const cli_ctx_t *ctx)
         bitgrain_image_free(pixels);
 
         if (ret != 0) {
-            fprintf(stderr, "Error: encoder failed '%s'.\n", cur_in);
+            fprintf(stderr, "Error: encoder failed '%s': %s.\n", cur_in, bitgrain_last_error_message());
             free(out_buf);
             free(cur_out_owned);
             enc_failed = 1;
@@ -165,8 +195,16 @@ int encode_cli_run(const cli_ctx_t *ctx)
                 continue;
             }
             fclose(out);
-            fprintf(stderr, "%s -> %s  (%u×%u, %d bytes)\n",
-                    cur_in, cur_out, width, height, (int)out_len);
+            if (ctx->max_size)
+                fprintf(stderr, "%s -> %s  (%u×%u, %d bytes, quality %u)\n",
+                        cur_in, cur_out, width, height, (int)out_len, used_quality);
+            else if (ctx->target_value > 0.0)
+                fprintf(stderr, "%s -> %s  (%u×%u, %d bytes, quality %u, %s %.4g)\n",
+                        cur_in, cur_out, width, height, (int)out_len, used_quality,
+                        ctx->target_metric == BITGRAIN_METRIC_SSIM ? "SSIM" : "PSNR", reached);
+            else
+                fprintf(stderr, "%s -> %s  (%u×%u, %d bytes)\n",
+                        cur_in, cur_out, width, height, (int)out_len);
         }
 
         free(out_buf);
@@ -167,6 +167,8 @@ int roundtrip_cli_run(const cli_ctx_t *ctx)
 
         uint64_t raw_bytes = (uint64_t)width * height * channels;
         uint64_t out_cap = raw_bytes * 2 + BITGRAIN_OUT_BUF_MARGIN;
+        if (bitgrain_encode_bound(width, height, channels, (uint8_t)ctx->quality, &out_cap) == 0 && icc_in)
+            out_cap += 8 + icc_in_len; /* "BGx", type, u32 length, profile */
         if (out_cap > BITGRAIN_MAX_BG_FILE) out_cap = BITGRAIN_MAX_BG_FILE;
         uint8_t *out_buf = (uint8_t *)malloc((size_t)out_cap);
         if (!out_buf) {
@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#include "verify_cli.h"
+#include "encoder.h"
+#include "image_loader.h"
+#include "bg_utils.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int verify_cli_run(const cli_ctx_t *ctx)
+{
+    int failed = 0;
+    for (size_t idx = 0; idx < ctx->expanded.n; idx++) {
+        const char *cur_in = ctx->expanded.paths[idx];
+        uint8_t *buf;
+        long fsize = 0;
+
+        if (strcmp(cur_in, "-") == 0) {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            size_t len = 0;
+            buf = bitgrain_read_stream(stdin, &len);
+            fsize = (long)len;
+        } else {
+            buf = bg_read_file(cur_in, &fsize);
+        }
+        if (!buf || fsize <= 0 || fsize > INT32_MAX) {
+            fprintf(stderr, "%s: could not read\n", cur_in);
+            free(buf);
+            failed = 1;
+            continue;
+        }
+
+        uint32_t offset = 0;
+        if (bitgrain_validate(buf, (int32_t)fsize, &offset) == 0) {
+            printf("%s: ok\n", cur_in);
+        } else {
+            fprintf(stderr, "%s: invalid at byte %u: %s\n", cur_in, offset, bitgrain_last_error_message());
+            failed = 1;
+        }
+        free(buf);
+    }
+    fflush(stdout);
+    return failed;
+}
@@ -0,0 +1,10 @@
+/* SPDX-License-Identifier: GPL-3.0-or-later */
+#ifndef BITGRAIN_VERIFY_CLI_H
+#define BITGRAIN_VERIFY_CLI_H
+
+#include "cli.h"
+
+/* Validate every .bg in ctx without decoding. Returns 0 if all are valid, 1 otherwise. */
+int verify_cli_run(const cli_ctx_t *ctx);
+
+#endif
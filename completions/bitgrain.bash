@@ -18,18 +18,22 @@ _bitgrain()
     local w
     for w in "${COMP_WORDS[@]:1}"; do
         case "$w" in
-            encode|decode|roundtrip) subcmd="$w"; break ;;
+            encode|decode|roundtrip|verify) subcmd="$w"; break ;;
         esac
     done
 
     local global_flags="-h -v --help --version"
     local legacy_flags="-i -o -d -cd -q -Q -t -m -y --quality --output-quality --threads --deterministic --metrics --overwrite"
-    local encode_flags="-o --output -q --quality -t --threads --deterministic -y --overwrite -h --help -v --version"
+    local encode_flags="-o --output -q --quality -t --threads --deterministic --chunked --lossless --max-size --target-ssim --target-psnr -y --overwrite -h --help -v --version"
     local decode_flags="-o --output -Q --output-quality -t --threads --deterministic -y --overwrite -h --help -v --version"
     local roundtrip_flags="-o --output -q --quality -Q --output-quality -t --threads --deterministic -m --metrics -y --overwrite -h --help -v --version"
+    local verify_flags="-t --threads -h --help -v --version"
     local quality_values="50 60 70 75 80 85 90 95 100"
     local thread_values="1 2 4 8 16"
-    local subcommands="encode decode roundtrip"
+    local size_values="32K 64K 100K 200K 500K 1M"
+    local ssim_values="0.90 0.95 0.98 0.99"
+    local psnr_values="30 35 40 45"
+    local subcommands="encode decode roundtrip verify"
 
     # Handle --opt=value forms.
     case "$cur" in
@@ -64,6 +68,18 @@ _bitgrain()
             COMPREPLY=( $(compgen -W "$thread_values" -- "$cur") )
             return 0
             ;;
+        --max-size)
+            COMPREPLY=( $(compgen -W "$size_values" -- "$cur") )
+            return 0
+            ;;
+        --target-ssim)
+            COMPREPLY=( $(compgen -W "$ssim_values" -- "$cur") )
+            return 0
+            ;;
+        --target-psnr)
+            COMPREPLY=( $(compgen -W "$psnr_values" -- "$cur") )
+            return 0
+            ;;
         -i)
             COMPREPLY=( $(compgen -f -- "$cur") )
             COMPREPLY+=( $(compgen -d -- "$cur") )
@@ -90,6 +106,7 @@ _bitgrain()
             encode)    COMPREPLY=( $(compgen -W "$encode_flags" -- "$cur") ) ;;
             decode)    COMPREPLY=( $(compgen -W "$decode_flags" -- "$cur") ) ;;
             roundtrip) COMPREPLY=( $(compgen -W "$roundtrip_flags" -- "$cur") ) ;;
+            verify)    COMPREPLY=( $(compgen -W "$verify_flags" -- "$cur") ) ;;
         esac
         return 0
     fi
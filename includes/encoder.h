@@ -13,9 +13,35 @@ enum {
     BITGRAIN_ERR_INVALID_ARG = 1,
     BITGRAIN_ERR_DECODE_FAILED = 2,
     BITGRAIN_ERR_THREAD_INIT = 3,
+    BITGRAIN_ERR_NEED_DATA = 4,
+    BITGRAIN_ERR_SINK = 5,
     BITGRAIN_ERR_PANIC = 100
 };
 
+/* Pixel layouts for bitgrain_decode_to_format() and bitgrain_encode_from_format().
+ * X = padding byte (255 on decode, ignored on encode). */
+enum {
+    BITGRAIN_PIXEL_RGB = 0,
+    BITGRAIN_PIXEL_RGBA = 1,
+    BITGRAIN_PIXEL_BGR = 2,
+    BITGRAIN_PIXEL_BGRA = 3,
+    BITGRAIN_PIXEL_RGBX = 4,
+    BITGRAIN_PIXEL_BGRX = 5
+};
+
+/* Resampling filters for bitgrain_decode_resized(). */
+enum {
+    BITGRAIN_FILTER_BOX = 0,
+    BITGRAIN_FILTER_TRIANGLE = 1,
+    BITGRAIN_FILTER_LANCZOS3 = 2
+};
+
+/* Quality metrics for bitgrain_encode_target_quality(), measured on luma. */
+enum {
+    BITGRAIN_METRIC_PSNR = 0,   /* dB */
+    BITGRAIN_METRIC_SSIM = 1    /* 0..1, mean over 8x8 blocks */
+};
+
 /*
  * Encode a grayscale image (8 bpp) to .bg stream.
  * quality: 1–100 (higher = less quantization), 0 = default 85.
@@ -56,6 +82,82 @@ int bitgrain_encode_rgba(
     int32_t *out_len,
     uint8_t quality);
 
+/*
+ * Output buffers: if out_capacity is too small the encoders fail with
+ * BITGRAIN_ERR_INVALID_ARG and still set *out_len to the size needed.
+ *
+ * bitgrain_encode_bound: worst-case stream size of bitgrain_encode_grayscale
+ * (channels 1), _rgb (3) or _rgba (4) for this size and quality (0 = 85),
+ * without ICC trailer, derived from the quant tables. A buffer of *out_bound
+ * bytes never runs short.
+ */
+int bitgrain_encode_bound(
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint8_t quality,
+    uint64_t *out_bound);
+
+/*
+ * Encode packed pixels (channels 1, 3 or 4) at the highest quality whose
+ * stream is at most max_bytes (and out_capacity) bytes. Color conversion and
+ * DCT run once; each candidate quality only re-quantizes and re-sizes, so the
+ * search costs little more than one encode. The chosen quality is stored in
+ * *out_quality when out_quality is non-NULL. Fails with
+ * BITGRAIN_ERR_INVALID_ARG if quality 1 does not fit.
+ */
+int bitgrain_encode_target_size(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint32_t max_bytes,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t *out_quality);
+
+/*
+ * Encode packed pixels (channels 1, 3 or 4) at the lowest quality whose luma
+ * PSNR or SSIM (metric: BITGRAIN_METRIC_*) reaches target. Color conversion
+ * and DCT run once; the search scores candidates from the quantized
+ * coefficients, and only the chosen one is decoded and measured (stepping up
+ * if it falls short). Quality 100 is used when no quality reaches the target.
+ * The quality and its measured value are stored in *out_quality and
+ * *out_value when non-NULL.
+ */
+int bitgrain_encode_target_quality(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint32_t metric,
+    double target,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t *out_quality,
+    double *out_value);
+
+/*
+ * Quality ladder: encode packed pixels (channels 1, 3 or 4) at n qualities
+ * (0 = 85) sharing one color conversion + DCT pass; quantization and Huffman
+ * for each quality run concurrently on the worker pool. outs[i] holds
+ * out_capacities[i] bytes (buffers must not overlap) and receives qualities[i];
+ * out_lens[i] gets its length, or the size needed if the buffer was short
+ * (the call then fails with BITGRAIN_ERR_INVALID_ARG).
+ */
+int bitgrain_encode_multi(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    const uint8_t *qualities,
+    uint32_t n,
+    uint8_t *const *outs,
+    const uint32_t *out_capacities,
+    int32_t *out_lens);
+
 /*
  * Configure global worker thread count for the codec internals (Rayon).
  * Call before encode/decode to guarantee effect.
@@ -90,6 +192,80 @@ int bitgrain_decode(
     uint32_t *out_height,
     uint32_t *out_channels);
 
+/*
+ * Decode into a BITGRAIN_PIXEL_* layout with rows stride bytes apart
+ * (stride 0 = tightly packed; bytes past each row's pixels are not written).
+ * out_capacity must be >= stride*(height-1) + width*bytes_per_pixel.
+ * Alpha formats get 255 for opaque streams; grayscale is replicated to R, G, B.
+ */
+int bitgrain_decode_to_format(
+    const uint8_t *buffer,
+    int32_t size,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t pixel_format,
+    uint32_t stride,
+    uint32_t *out_width,
+    uint32_t *out_height);
+
+/*
+ * Decode resized to target_w×target_h with a BITGRAIN_FILTER_* filter, tightly
+ * packed with the stream's channel count (out_capacity >= target_w*target_h*4 always
+ * suffices). v4–v20 streams use a scaled IDCT (1/8, 1/4 or 1/2, the smallest that
+ * still covers the target) and resample each 16-row band as it is decoded, so no
+ * full-size image is held; other versions decode at full size and resample.
+ * Channels, alpha included, are filtered independently.
+ */
+int bitgrain_decode_resized(
+    const uint8_t *buffer,
+    int32_t size,
+    uint32_t target_w,
+    uint32_t target_h,
+    uint32_t filter,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t *out_channels);
+
+/*
+ * Decode only the region_w×region_h rectangle at (x, y), tightly packed with the
+ * stream's channel count (out_capacity >= region_w*region_h*channels).
+ * out_width/out_height receive the full image size. For v4–v20 streams, entropy
+ * data is parsed down to the region's last row but dequantization, IDCT and color
+ * conversion run only on the region's blocks; other versions decode whole and crop.
+ * A region outside the image fails with BITGRAIN_ERR_DECODE_FAILED.
+ */
+int bitgrain_decode_region(
+    const uint8_t *buffer,
+    int32_t size,
+    uint32_t x,
+    uint32_t y,
+    uint32_t region_w,
+    uint32_t region_h,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t *out_width,
+    uint32_t *out_height,
+    uint32_t *out_channels);
+
+/*
+ * Decode a v4–v20 stream to planar YUV 4:2:0 without color conversion.
+ * y and a are width×height, u (Cb) and v (Cr) are ((width+1)/2)×((height+1)/2);
+ * rows of each plane are *_stride bytes apart (stride >= plane width).
+ * a may be NULL to skip alpha; for streams without alpha it is filled with 255.
+ * Pass y = NULL to only query out_width/out_height/out_channels (3, or 4 with alpha).
+ * The out_* pointers may be NULL. Other versions fail with BITGRAIN_ERR_DECODE_FAILED.
+ */
+int bitgrain_decode_yuv(
+    const uint8_t *buffer,
+    int32_t size,
+    uint8_t *y, uint32_t y_stride,
+    uint8_t *u, uint32_t u_stride,
+    uint8_t *v, uint32_t v_stride,
+    uint8_t *a, uint32_t a_stride,
+    uint32_t *out_width,
+    uint32_t *out_height,
+    uint32_t *out_channels);
+
 /*
  * Decode a .bg stream to grayscale (version 1 only).
  */
@@ -101,6 +277,51 @@ int bitgrain_decode_grayscale(
     uint32_t *out_width,
     uint32_t *out_height);
 
+/*
+ * Check that buffer holds one complete, well-formed .bg stream without decoding
+ * pixels: header, plane lengths (TOC, frame index), every Huffman symbol, block
+ * counts, coefficient ranges and the trailer. Returns 0 if valid; otherwise -1
+ * with BITGRAIN_ERR_DECODE_FAILED, the reason in bitgrain_last_error_message()
+ * and the byte offset where parsing stopped in *out_error_offset (may be NULL).
+ */
+int bitgrain_validate(const uint8_t *buffer, int32_t size, uint32_t *out_error_offset);
+
+/*
+ * Encode BITGRAIN_PIXEL_* pixels with rows stride bytes apart (stride 0 = tightly
+ * packed), read in place without a repacking copy. RGBA/BGRA are stored with alpha
+ * (version 19); RGB, BGR, RGBX and BGRX as version 18.
+ * quality: 1–100, 0 = default 85.
+ */
+int bitgrain_encode_from_format(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t pixel_format,
+    uint32_t stride,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t quality);
+
+/*
+ * Encode planar YUV 4:2:0 (BT.601 full range, as bitgrain_decode_yuv returns it)
+ * without color conversion. y and a are width×height, u (Cb) and v (Cr) are
+ * ((width+1)/2)×((height+1)/2); rows are *_stride bytes apart (stride >= plane width).
+ * a may be NULL (version 18); with alpha the stream is version 19.
+ * quality: 1–100, 0 = default 85.
+ */
+int bitgrain_encode_yuv420(
+    const uint8_t *y, uint32_t y_stride,
+    const uint8_t *u, uint32_t u_stride,
+    const uint8_t *v, uint32_t v_stride,
+    const uint8_t *a, uint32_t a_stride,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t quality);
+
 /*
  * Encode RGB with optional ICC profile. icc may be NULL (no ICC).
  */
@@ -145,6 +366,373 @@ int bitgrain_decode_icc(
 
 void bitgrain_free_icc(uint8_t *icc, uint32_t len);
 
+/*
+ * Encode RGB / RGBA into the chunked container (version 20): same plane coding
+ * as bitgrain_encode_rgb/_rgba, plus a table of contents right after the header
+ * so readers can locate planes and metadata with one range request.
+ * icc may be NULL (no ICC).
+ */
+int bitgrain_encode_rgb_chunked(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t quality,
+    const uint8_t *icc,
+    uint32_t icc_len);
+
+int bitgrain_encode_rgba_chunked(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t quality,
+    const uint8_t *icc,
+    uint32_t icc_len);
+
+/*
+ * Encode RGB / RGBA with custom quantization tables (64 entries each, natural
+ * row-major order, values 1..32767). Output is a version 20 container that
+ * carries the tables ("DQT " chunks); decoders use them as-is. quality still
+ * selects the AC sparsify strength and is stored in the header. Alpha uses the
+ * luma table.
+ */
+int bitgrain_encode_rgb_tables(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t quality,
+    const uint16_t *luma_table,
+    const uint16_t *chroma_table,
+    const uint8_t *icc,
+    uint32_t icc_len);
+
+int bitgrain_encode_rgba_tables(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    uint8_t quality,
+    const uint16_t *luma_table,
+    const uint16_t *chroma_table,
+    const uint8_t *icc,
+    uint32_t icc_len);
+
+/*
+ * Lossless encode (version 22) of grayscale, RGB or RGBA (channels 1, 3, 4):
+ * YCoCg-R color transform, median edge prediction and adaptive Rice coding in
+ * independent 64-row strips. bitgrain_decode() restores the exact pixels.
+ * The stream never exceeds bitgrain_encode_lossless_bound, i.e.
+ * width*height*channels + 16 + 5*ceil(height/64) bytes (+ 8 + icc_len with ICC).
+ * icc may be NULL.
+ */
+int bitgrain_encode_lossless(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint8_t *out_buffer,
+    uint32_t out_capacity,
+    int32_t *out_len,
+    const uint8_t *icc,
+    uint32_t icc_len);
+
+/* Worst-case bitgrain_encode_lossless output size (channels 1, 3 or 4), without ICC. */
+int bitgrain_encode_lossless_bound(
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint64_t *out_bound);
+
+/* One TOC entry. offset is absolute from the start of the .bg stream. */
+typedef struct {
+    uint8_t tag[4];      /* FourCC: "PLNE", "DQT ", "ICCP", ... unknown tags may be skipped */
+    uint32_t offset;
+    uint32_t length;
+    uint32_t info;       /* PLNE: plane index 0=Y 1=Cb 2=Cr 3=A; DQT: 0=luma 1=chroma */
+} bitgrain_chunk_t;
+
+/*
+ * Bytes needed to read the header + full TOC of a version 20 stream.
+ * buffer needs at least the first 16 bytes.
+ */
+int bitgrain_container_toc_size(
+    const uint8_t *buffer,
+    int32_t size,
+    uint32_t *out_toc_size);
+
+/*
+ * Read the TOC of a version 20 stream. buffer may be a file prefix of at least
+ * bitgrain_container_toc_size() bytes. Writes up to max_chunks entries;
+ * *out_count receives the total chunk count.
+ */
+int bitgrain_container_toc(
+    const uint8_t *buffer,
+    int32_t size,
+    bitgrain_chunk_t *out_chunks,
+    uint32_t max_chunks,
+    uint32_t *out_count);
+
+/*
+ * Multi-image archive (.bga): many images, one set of quant tables, and an
+ * index sorted by id. Readers take the whole archive as a buffer (typically an
+ * mmap'd file); opening it is O(1) and lookups are a binary search.
+ */
+typedef struct BitgrainArchiveBuilder bitgrain_archive_builder_t;
+
+typedef struct {
+    uint64_t id;
+    uint64_t offset;     /* entry payload offset in the archive */
+    uint32_t length;     /* entry payload length */
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;   /* 1, 3 or 4; decoded size = width*height*channels */
+} bitgrain_archive_entry_t;
+
+/* quality: 1–100, 0 = default 85. Returns NULL on failure. */
+bitgrain_archive_builder_t *bitgrain_archive_builder_new(uint8_t quality);
+
+/* Encode one image (channels 1, 3 or 4) under id. Ids must be unique. */
+int bitgrain_archive_builder_add(
+    bitgrain_archive_builder_t *builder,
+    uint64_t id,
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels);
+
+/* Exact size of the archive bitgrain_archive_builder_finish will write. */
+int bitgrain_archive_builder_size(const bitgrain_archive_builder_t *builder, uint64_t *out_size);
+
+/* Write the archive. Fails on duplicate ids or if out_capacity is too small. */
+int bitgrain_archive_builder_finish(
+    bitgrain_archive_builder_t *builder,
+    uint8_t *out_buffer,
+    uint64_t out_capacity,
+    uint64_t *out_len);
+
+void bitgrain_archive_builder_free(bitgrain_archive_builder_t *builder);
+
+int bitgrain_archive_count(const uint8_t *buffer, uint64_t size, uint32_t *out_count);
+
+/* Find id in the index without decoding. Fails with BITGRAIN_ERR_INVALID_ARG if absent. */
+int bitgrain_archive_lookup(
+    const uint8_t *buffer,
+    uint64_t size,
+    uint64_t id,
+    bitgrain_archive_entry_t *out_entry);
+
+/* Decode one image by id. out_entry may be NULL. */
+int bitgrain_archive_decode(
+    const uint8_t *buffer,
+    uint64_t size,
+    uint64_t id,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    bitgrain_archive_entry_t *out_entry);
+
+/*
+ * Decode n images on the worker pool. outs[i] (out_capacity bytes each, must
+ * not overlap) receives ids[i]; results[i] is BITGRAIN_OK or an error code.
+ * Returns -1 if any entry failed; the others are still decoded.
+ */
+int bitgrain_archive_decode_batch(
+    const uint8_t *buffer,
+    uint64_t size,
+    const uint64_t *ids,
+    uint32_t n,
+    uint8_t *const *outs,
+    uint32_t out_capacity,
+    int32_t *results);
+
+/*
+ * Multi-frame sequences (version 21): frames share one set of quant tables and
+ * a frame index. Delta frames carry a skip bitmap per plane and only code the
+ * 8x8 blocks whose quantized coefficients changed. bitgrain_decode() on a
+ * sequence returns its first frame.
+ */
+typedef struct BitgrainSequenceEncoder bitgrain_sequence_encoder_t;
+typedef struct BitgrainSequenceDecoder bitgrain_sequence_decoder_t;
+
+/*
+ * channels: 1, 3 or 4. quality: 1–100, 0 = default 85.
+ * keyframe_interval: a keyframe every N frames, 0 = only the first frame.
+ * Returns NULL on failure.
+ */
+bitgrain_sequence_encoder_t *bitgrain_sequence_encoder_new(
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint8_t quality,
+    uint32_t keyframe_interval);
+
+/* Encode one frame of width*height*channels bytes. */
+int bitgrain_sequence_encoder_push(bitgrain_sequence_encoder_t *encoder, const uint8_t *image);
+
+/* Exact size of the stream bitgrain_sequence_encoder_finish will write. */
+int bitgrain_sequence_encoder_size(const bitgrain_sequence_encoder_t *encoder, uint64_t *out_size);
+
+int bitgrain_sequence_encoder_finish(
+    const bitgrain_sequence_encoder_t *encoder,
+    uint8_t *out_buffer,
+    uint64_t out_capacity,
+    uint64_t *out_len);
+
+void bitgrain_sequence_encoder_free(bitgrain_sequence_encoder_t *encoder);
+
+/* buffer is borrowed and must stay valid until bitgrain_sequence_decoder_free. */
+bitgrain_sequence_decoder_t *bitgrain_sequence_decoder_new(const uint8_t *buffer, uint64_t size);
+
+/* Any output pointer may be NULL. Frame size = width*height*channels. */
+int bitgrain_sequence_decoder_info(
+    const bitgrain_sequence_decoder_t *decoder,
+    uint32_t *out_width,
+    uint32_t *out_height,
+    uint32_t *out_channels,
+    uint32_t *out_frames);
+
+/* Decode the next frame; out_frame (may be NULL) receives its index. Fails at end of sequence. */
+int bitgrain_sequence_decoder_next(
+    bitgrain_sequence_decoder_t *decoder,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t *out_frame);
+
+/* Make frame the next one returned; replays from the nearest earlier keyframe. */
+int bitgrain_sequence_decoder_seek(bitgrain_sequence_decoder_t *decoder, uint32_t frame);
+
+void bitgrain_sequence_decoder_free(bitgrain_sequence_decoder_t *decoder);
+
+/*
+ * Row-streaming encoder: push rows as they are produced; every 16-row band is
+ * color converted and coded right away, so memory tracks the image width, not
+ * its area. Output is byte-identical to bitgrain_encode_grayscale/_rgb/_rgba
+ * (versions 1, 18, 19).
+ *
+ * Bytes go to a caller sink. write receives the stream in order; return 0 on
+ * success, anything else aborts the encode with BITGRAIN_ERR_SINK. write_at
+ * (optional) overwrites bytes already written: with it, luma bytes are passed on
+ * as each band is coded and the luma length is patched at finish. Without it the
+ * luma payload is held compressed until finish. Cb, Cr and alpha are always held
+ * compressed until finish, since they follow luma in the stream.
+ */
+typedef struct {
+    int (*write)(void *user, const uint8_t *data, uint64_t len);
+    int (*write_at)(void *user, uint64_t offset, const uint8_t *data, uint64_t len);
+    void *user;
+} bitgrain_sink_t;
+
+typedef struct BitgrainEncoder bitgrain_encoder_t;
+
+/* channels: 1, 3 or 4. quality: 1–100, 0 = default 85. sink is copied; the header is written now. */
+bitgrain_encoder_t *bitgrain_encoder_new(
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint8_t quality,
+    const bitgrain_sink_t *sink);
+
+/* n_rows rows of width*channels bytes, stride bytes apart (0 = packed). */
+int bitgrain_encoder_push_rows(
+    bitgrain_encoder_t *encoder,
+    const uint8_t *rows,
+    uint32_t n_rows,
+    uint32_t stride);
+
+/* After all height rows: write the remaining planes. The encoder is spent afterwards. */
+int bitgrain_encoder_finish(bitgrain_encoder_t *encoder);
+
+void bitgrain_encoder_free(bitgrain_encoder_t *encoder);
+
+/*
+ * One-shot encode of packed pixels (channels 1, 3 or 4) to a sink: the header
+ * and then each plane go to write as soon as they are coded, so no output
+ * buffer has to be sized. write_at is not used. Same bytes as the buffer encoders.
+ */
+int bitgrain_encode_to_sink(
+    const uint8_t *image,
+    uint32_t width,
+    uint32_t height,
+    uint32_t channels,
+    uint8_t quality,
+    const bitgrain_sink_t *sink);
+
+/*
+ * Streaming decoder: feed the .bg stream as it arrives and pull finished rows.
+ * Handles versions 1–3 (legacy RLE), 4–20 (Huffman, chunked) and 22 (lossless).
+ * Rows come out in 16-row bands once every plane has reached them (64-row strips
+ * for lossless); since planes are stored one after another, the first band is
+ * ready while the last plane is still arriving. Earlier planes wait as compressed
+ * input and are decoded one band at a time, so memory stays near the compressed
+ * size plus one band. Consumed input is released as decoding advances.
+ */
+typedef struct BitgrainDecoder bitgrain_decoder_t;
+
+bitgrain_decoder_t *bitgrain_decoder_new(void);
+
+/*
+ * Append size bytes. Fails with BITGRAIN_ERR_DECODE_FAILED on a corrupt or
+ * unsupported header or layout; corrupt plane data fails read_rows instead.
+ */
+int bitgrain_decoder_feed(bitgrain_decoder_t *decoder, const uint8_t *data, uint64_t size);
+
+/* Fails with BITGRAIN_ERR_NEED_DATA until the header has been fed. */
+int bitgrain_decoder_info(
+    const bitgrain_decoder_t *decoder,
+    uint32_t *out_width,
+    uint32_t *out_height,
+    uint32_t *out_channels);
+
+/*
+ * Copy up to max_rows finished rows (width*channels bytes each, in order) into
+ * out_pixels. *out_rows receives the count; 0 means feed more data first.
+ */
+int bitgrain_decoder_read_rows(
+    bitgrain_decoder_t *decoder,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t max_rows,
+    uint32_t *out_rows);
+
+/*
+ * One-shot decode of a complete stream (same contract as bitgrain_decode and
+ * bitgrain_decode_to_format) through the decoder's scratch buffers. They grow to
+ * the largest image seen and are kept until bitgrain_decoder_free, so repeated
+ * decodes on one decoder do not allocate. Independent of feed/read_rows; use one
+ * decoder per thread.
+ */
+int bitgrain_decoder_decode(
+    bitgrain_decoder_t *decoder,
+    const uint8_t *buffer,
+    int32_t size,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t *out_width,
+    uint32_t *out_height,
+    uint32_t *out_channels);
+
+int bitgrain_decoder_decode_to_format(
+    bitgrain_decoder_t *decoder,
+    const uint8_t *buffer,
+    int32_t size,
+    uint8_t *out_pixels,
+    uint32_t out_capacity,
+    uint32_t pixel_format,
+    uint32_t stride,
+    uint32_t *out_width,
+    uint32_t *out_height);
+
+void bitgrain_decoder_free(bitgrain_decoder_t *decoder);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,7 @@
 #include "roundtrip_cli.h"
 #include "decode_cli.h"
 #include "encode_cli.h"
+#include "verify_cli.h"
 
 static void print_global_help(const char *prog)
 {
@@ -19,12 +20,14 @@ static void print_global_help(const char *prog)
         "Usage:\n"
         "  %s encode   [options] <input> [-o <output>]\n"
         "  %s decode   [options] <input> [-o <output>]\n"
-        "  %s roundtrip [options] <input> [-o <output>]\n\n"
+        "  %s roundtrip [options] <input> [-o <output>]\n"
+        "  %s verify   [options] <input.bg>...\n\n"
         "  Use '-' as input or output for stdin/stdout.\n\n"
         "Commands:\n"
         "  encode     Compress image(s) to .bg format\n"
         "  decode     Decompress .bg file(s) to image\n"
-        "  roundtrip  Encode + decode in memory (no .bg written)\n\n"
+        "  roundtrip  Encode + decode in memory (no .bg written)\n"
+        "  verify     Check .bg file(s) for corruption without decoding\n\n"
         "Options (all commands):\n"
         "  -o <path>            Output file or directory\n"
         "  --quality <1-100>    Encode quality (default 85)\n"
@@ -34,6 +37,11 @@ static void print_global_help(const char *prog)
         "  Env: BITGRAIN_THREADS / BITGRAIN_THREADS_CAP\n"
         "  --overwrite          Overwrite existing files\n"
         "  --metrics            Print PSNR/SSIM (roundtrip only)\n"
+        "  --chunked            Write chunked .bg container (encode only)\n"
+        "  --lossless           Lossless .bg (encode only; quality ignored)\n"
+        "  --max-size <bytes>   Highest quality that fits, suffix K/M (encode only)\n"
+        "  --target-ssim <0-1>  Lowest quality reaching luma SSIM (encode only)\n"
+        "  --target-psnr <dB>   Lowest quality reaching luma PSNR (encode only)\n"
         "  --help               Show this help\n"
         "  --version            Show version\n\n"
         "Short flags (legacy):\n"
@@ -44,10 +52,11 @@ static void print_global_help(const char *prog)
         "  %s encode photo.jpg              # → photo.bg\n"
         "  %s decode photo.bg -o photo.png\n"
         "  %s roundtrip photo.jpg -o out.jpg --quality 90 --metrics\n"
+        "  %s verify ./incoming\n"
         "  cat photo.jpg | %s encode - -o out.bg\n"
         "  %s decode photo.bg -o -  | display\n"
         "  %s encode ./images -o ./compressed --quality 80\n",
-        prog, prog, prog, prog, prog, prog, prog, prog, prog, prog);
+        prog, prog, prog, prog, prog, prog, prog, prog, prog, prog, prog, prog);
 }
 
 /* Detect if argv[1] is a known subcommand. */
@@ -56,7 +65,8 @@ static int is_subcommand(const char *s)
     if (!s) return 0;
     return (strcmp(s, "encode") == 0 ||
             strcmp(s, "decode") == 0 ||
-            strcmp(s, "roundtrip") == 0);
+            strcmp(s, "roundtrip") == 0 ||
+            strcmp(s, "verify") == 0);
 }
 
 int main(int argc, char **argv)
@@ -117,6 +127,8 @@ int main(int argc, char **argv)
     int ret;
     if (ctx.round_trip)
         ret = roundtrip_cli_run(&ctx);
+    else if (ctx.verify_mode)
+        ret = verify_cli_run(&ctx);
     else if (ctx.decode_mode)
         ret = decode_cli_run(&ctx);
     else
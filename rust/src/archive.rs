@@ -0,0 +1,284 @@
+//! Multi-image archive (.bga).
+//!
+//! Packs many small images into one file with a single set of quant tables and
+//! a sorted index, so per-image overhead is one 32-byte index entry plus a few
+//! varint bytes instead of a full .bg header and four u32 plane prefixes.
+//! Huffman tables are the fixed JPEG tables of the plane profile and need no storage.
+//!
+//! Layout:
+//!   [0..4)     "BGA" + 1
+//!   [4..8)     entry count (u32 LE)
+//!   [8]        plane profile (v4..v19 version byte; alpha comes from each entry)
+//!   [9]        quality
+//!   [10..12)   reserved (0)
+//!   [12..140)  luma quant table   (64 × u16 LE, natural order)
+//!   [140..268) chroma quant table (64 × u16 LE, natural order)
+//!   [268..)    index: count × 32-byte entries, sorted by id, ids unique
+//!              id(u64) + offset(u64, absolute) + length(u32) + width(u32) + height(u32)
+//!              + channels(u8: 1, 3 or 4) + reserved[3]
+//!   ...        entry payloads: one LEB128 length per plane, then the plane payloads
+//!              (bare Huffman data as in v20 `PLNE` chunks; Y | Y Cb Cr | Y Cb Cr A)
+//!
+//! Opening an archive only reads the fixed header, so it is O(1) on an mmap'd
+//! file; lookups binary-search the index in place.
+
+use crate::bitstream::{push_varint, read_varint};
+use crate::container;
+use crate::decoder;
+use crate::encoder::{self, PlaneTables};
+use rayon::prelude::*;
+
+pub const BGA_MAGIC: [u8; 4] = *b"BGA\x01";
+pub const BGA_HEADER_SIZE: usize = 12 + 2 * container::QUANT_TABLE_SIZE;
+pub const BGA_INDEX_ENTRY_SIZE: usize = 32;
+const BGA_MAX_DIM: u32 = 65536;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct ArchiveEntry {
+    pub id: u64,
+    pub offset: u64,
+    pub length: u32,
+    pub width: u32,
+    pub height: u32,
+    pub channels: u32,
+}
+
+impl ArchiveEntry {
+    /// Bytes needed to decode this entry.
+    pub fn pixel_len(&self) -> usize {
+        self.width as usize * self.height as usize * self.channels as usize
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Builder
+// ---------------------------------------------------------------------------
+
+/// Encodes images one at a time, then writes the archive with a sorted index.
+pub struct ArchiveBuilder {
+    quality: u8,
+    tables: PlaneTables,
+    entries: Vec<(ArchiveEntry, Vec<u8>)>,
+}
+
+impl ArchiveBuilder {
+    pub fn new(quality: u8) -> Self {
+        let q = if quality == 0 { 85 } else { quality };
+        Self { quality: q, tables: PlaneTables::for_quality(q), entries: Vec::new() }
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+
+    /// Encode and queue one image (1 = gray, 3 = RGB, 4 = RGBA). Duplicate ids are
+    /// reported by `write`.
+    pub fn add(&mut self, id: u64, image: &[u8], width: usize, height: usize, channels: u32) -> bool {
+        if width == 0 || height == 0 || width > BGA_MAX_DIM as usize || height > BGA_MAX_DIM as usize {
+            return false;
+        }
+        if image.len() < width * height * channels as usize {
+            return false;
+        }
+        let planes: Vec<Vec<u8>> = match channels {
+            1 => vec![encoder::encode_luma_plane(image, width, height, &self.tables)],
+            3 => encoder::encode_ycbcr_planes(image, width, height, &self.tables).into(),
+            4 => encoder::encode_ycbcra_planes(image, width, height, &self.tables).into(),
+            _ => return false,
+        };
+        let mut payload = Vec::with_capacity(planes.iter().map(|p| p.len() + 3).sum());
+        for p in &planes {
+            push_varint(&mut payload, p.len());
+        }
+        for p in &planes {
+            payload.extend_from_slice(p);
+        }
+        let entry = ArchiveEntry {
+            id,
+            offset: 0,
+            length: payload.len() as u32,
+            width: width as u32,
+            height: height as u32,
+            channels,
+        };
+        self.entries.push((entry, payload));
+        true
+    }
+
+    /// Total bytes `write` will produce.
+    pub fn encoded_len(&self) -> usize {
+        BGA_HEADER_SIZE
+            + self.entries.len() * BGA_INDEX_ENTRY_SIZE
+            + self.entries.iter().map(|e| e.1.len()).sum::<usize>()
+    }
+
+    /// Sort by id and write the archive. Returns None on duplicate ids or if `out` is too small.
+    pub fn write(&mut self, out: &mut [u8]) -> Option<usize> {
+        let total = self.encoded_len();
+        if out.len() < total || self.entries.len() > u32::MAX as usize {
+            return None;
+        }
+        self.entries.sort_unstable_by_key(|e| e.0.id);
+        if self.entries.windows(2).any(|w| w[0].0.id == w[1].0.id) {
+            return None;
+        }
+
+        out[0..4].copy_from_slice(&BGA_MAGIC);
+        out[4..8].copy_from_slice(&(self.entries.len() as u32).to_le_bytes());
+        out[8] = encoder::BG_PROFILE_YUV420;
+        out[9] = self.quality;
+        out[10..12].fill(0);
+        let qt = 12 + container::QUANT_TABLE_SIZE;
+        out[12..qt].copy_from_slice(&container::quant_table_bytes(&self.tables.luma));
+        out[qt..BGA_HEADER_SIZE].copy_from_slice(&container::quant_table_bytes(&self.tables.chroma));
+
+        let mut offset = (BGA_HEADER_SIZE + self.entries.len() * BGA_INDEX_ENTRY_SIZE) as u64;
+        for (i, (e, payload)) in self.entries.iter().enumerate() {
+            let p = BGA_HEADER_SIZE + i * BGA_INDEX_ENTRY_SIZE;
+            let rec = &mut out[p..p + BGA_INDEX_ENTRY_SIZE];
+            rec[0..8].copy_from_slice(&e.id.to_le_bytes());
+            rec[8..16].copy_from_slice(&offset.to_le_bytes());
+            rec[16..20].copy_from_slice(&e.length.to_le_bytes());
+            rec[20..24].copy_from_slice(&e.width.to_le_bytes());
+            rec[24..28].copy_from_slice(&e.height.to_le_bytes());
+            rec[28] = e.channels as u8;
+            rec[29..32].fill(0);
+            let start = offset as usize;
+            out[start..start + payload.len()].copy_from_slice(payload);
+            offset += payload.len() as u64;
+        }
+        Some(total)
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Reader
+// ---------------------------------------------------------------------------
+
+/// Read-only view of an archive (typically an mmap'd file). Borrowed, zero-copy.
+pub struct Archive<'a> {
+    buf: &'a [u8],
+    count: usize,
+    profile: &'static decoder::PlaneProfile,
+    luma_q: [i16; 64],
+    chroma_q: [i16; 64],
+}
+
+impl<'a> Archive<'a> {
+    /// Validate header, tables and index bounds. Entries are checked when decoded.
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < BGA_HEADER_SIZE || buf[0..4] != BGA_MAGIC {
+            return None;
+        }
+        let count = u32::from_le_bytes(buf[4..8].try_into().unwrap()) as usize;
+        let profile = decoder::plane_profile(buf[8])?;
+        let qt = 12 + container::QUANT_TABLE_SIZE;
+        let luma_q = container::parse_quant_table(&buf[12..qt])?;
+        let chroma_q = container::parse_quant_table(&buf[qt..BGA_HEADER_SIZE])?;
+        if buf.len() < BGA_HEADER_SIZE + count * BGA_INDEX_ENTRY_SIZE {
+            return None;
+        }
+        Some(Self { buf, count, profile, luma_q, chroma_q })
+    }
+
+    pub fn len(&self) -> usize {
+        self.count
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.count == 0
+    }
+
+    /// Index entry `i` (0-based, ascending id order).
+    pub fn entry(&self, i: usize) -> ArchiveEntry {
+        let p = BGA_HEADER_SIZE + i * BGA_INDEX_ENTRY_SIZE;
+        let r = &self.buf[p..p + BGA_INDEX_ENTRY_SIZE];
+        let u32_at = |o: usize| u32::from_le_bytes(r[o..o + 4].try_into().unwrap());
+        ArchiveEntry {
+            id: u64::from_le_bytes(r[0..8].try_into().unwrap()),
+            offset: u64::from_le_bytes(r[8..16].try_into().unwrap()),
+            length: u32_at(16),
+            width: u32_at(20),
+            height: u32_at(24),
+            channels: r[28] as u32,
+        }
+    }
+
+    fn id_at(&self, i: usize) -> u64 {
+        let p = BGA_HEADER_SIZE + i * BGA_INDEX_ENTRY_SIZE;
+        u64::from_le_bytes(self.buf[p..p + 8].try_into().unwrap())
+    }
+
+    /// Binary search the index for `id`.
+    pub fn lookup(&self, id: u64) -> Option<ArchiveEntry> {
+        let (mut lo, mut hi) = (0usize, self.count);
+        while lo < hi {
+            let mid = lo + (hi - lo) / 2;
+            let cur = self.id_at(mid);
+            if cur == id {
+                return Some(self.entry(mid));
+            }
+            if cur < id { lo = mid + 1; } else { hi = mid; }
+        }
+        None
+    }
+
+    /// Decode one entry into `out` (at least `entry.pixel_len()` bytes).
+    pub fn decode_entry(&self, e: &ArchiveEntry, out: &mut [u8]) -> bool {
+        if e.width == 0 || e.height == 0 || e.width > BGA_MAX_DIM || e.height > BGA_MAX_DIM {
+            return false;
+        }
+        let n_planes = match e.channels { 1 | 3 | 4 => e.channels as usize, _ => return false };
+        let start = e.offset as usize;
+        let end = match start.checked_add(e.length as usize) {
+            Some(end) if end <= self.buf.len() => end,
+            _ => return false,
+        };
+        let data = &self.buf[start..end];
+
+        let mut pos = 0usize;
+        let mut lens = [0usize; 4];
+        for len in lens.iter_mut().take(n_planes) {
+            *len = match read_varint(data, &mut pos) { Some(v) => v, None => return false };
+        }
+        let mut planes: Vec<&[u8]> = Vec::with_capacity(n_planes);
+        for &len in lens.iter().take(n_planes) {
+            if pos + len > data.len() {
+                return false;
+            }
+            planes.push(&data[pos..pos + len]);
+            pos += len;
+        }
+        decoder::decode_payload_planes(
+            &mut decoder::DecodeScratch::default(),
+            &planes,
+            e.width as usize,
+            e.height as usize,
+            &self.luma_q,
+            &self.chroma_q,
+            &self.profile,
+            out,
+        )
+    }
+
+    /// Look up and decode one image by id.
+    pub fn decode(&self, id: u64, out: &mut [u8]) -> Option<ArchiveEntry> {
+        let e = self.lookup(id)?;
+        if self.decode_entry(&e, out) { Some(e) } else { None }
+    }
+
+    /// Decode `jobs[i].0` into `jobs[i].1` across the Rayon pool. Returns per-job results.
+    pub fn decode_batch(&self, jobs: &mut [(u64, &mut [u8])]) -> Vec<Option<ArchiveEntry>> {
+        let mut results = vec![None; jobs.len()];
+        jobs.par_iter_mut()
+            .zip(results.par_iter_mut())
+            .for_each(|((id, out), res)| {
+                *res = self.decode(*id, out);
+            });
+        results
+    }
+}
@@ -8,25 +8,78 @@ pub fn write_byte(buffer: &mut [u8], position: &mut i32, value: u8) {
     *position += 1;
 }
 
-/// Write bytes to buffer and advance position.
+/// Write bytes to buffer and advance position. Past the end of `buffer` nothing is
+/// written but `position` still advances (as in `write_byte`), so after an encode
+/// it holds the size the stream needs.
 #[inline]
 pub fn write_bytes(buffer: &mut [u8], position: &mut i32, data: &[u8]) {
     let pos = *position as usize;
     let end = pos.saturating_add(data.len());
-    if end > buffer.len() 
-    {
-        panic!(
-            "bitgrain: encode buffer exhausted (need {} bytes at pos {}, cap {})",
-            data.len(),
-            pos,
-            buffer.len()
-        );
-    }
-    
-    if !data.is_empty() 
-    {
+    if end <= buffer.len() && !data.is_empty() {
         buffer[pos..end].copy_from_slice(data);
     }
-    
     *position += data.len() as i32;
 }
+
+/// Append `v` as LEB128 (7 bits per byte, low bits first).
+#[inline]
+pub fn push_varint(out: &mut Vec<u8>, mut v: usize) {
+    while v >= 0x80 {
+        out.push((v as u8) | 0x80);
+        v >>= 7;
+    }
+    out.push(v as u8);
+}
+
+/// Read a LEB128 value written by `push_varint` (at most 5 bytes).
+#[inline]
+pub fn read_varint(buf: &[u8], pos: &mut usize) -> Option<usize> {
+    let mut v = 0usize;
+    for shift in (0..35).step_by(7) {
+        let b = *buf.get(*pos)?;
+        *pos += 1;
+        v |= ((b & 0x7F) as usize) << shift;
+        if b & 0x80 == 0 {
+            return Some(v);
+        }
+    }
+    None
+}
+
+/// Destination of an encoded stream.
+pub trait Sink {
+    /// Append bytes. Returning false aborts the encode.
+    fn write(&mut self, data: &[u8]) -> bool;
+
+    /// Whether `write_at` may be used to patch bytes already written.
+    fn can_write_at(&self) -> bool {
+        false
+    }
+
+    /// Overwrite `data.len()` bytes at stream offset `offset`.
+    fn write_at(&mut self, _offset: u64, _data: &[u8]) -> bool {
+        false
+    }
+}
+
+impl Sink for Vec<u8> {
+    fn write(&mut self, data: &[u8]) -> bool {
+        self.extend_from_slice(data);
+        true
+    }
+
+    fn can_write_at(&self) -> bool {
+        true
+    }
+
+    fn write_at(&mut self, offset: u64, data: &[u8]) -> bool {
+        let at = offset as usize;
+        match self.get_mut(at..at + data.len()) {
+            Some(dst) => {
+                dst.copy_from_slice(data);
+                true
+            }
+            None => false,
+        }
+    }
+}
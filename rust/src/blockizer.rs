@@ -13,31 +13,45 @@ impl Blockizer {
 
     /// Generate 8×8 blocks from a grayscale plane. Parallel via Rayon.
     pub fn generate_blocks(&self, image: &[u8]) -> Vec<Block> {
-        let w = self.width;
-        let h = self.height;
-        let blocks_wide = (w + 7) / 8;
-        let blocks_high = (h + 7) / 8;
-        let num_blocks = blocks_wide * blocks_high;
+        self.generate_blocks_strided(image, self.width)
+    }
+
+    /// Same as `generate_blocks` for a plane whose rows are `stride` bytes apart.
+    pub fn generate_blocks_strided(&self, image: &[u8], stride: usize) -> Vec<Block> {
+        let blocks_wide = (self.width + 7) / 8;
+        let num_blocks = blocks_wide * ((self.height + 7) / 8);
 
         (0..num_blocks)
             .into_par_iter()
-            .map(|idx| {
-                let bx = (idx % blocks_wide) * 8;
-                let by = (idx / blocks_wide) * 8;
-                let mut block = [0i16; 64];
-                for y in 0..8 {
-                    let iy = (by + y).min(h.saturating_sub(1));
-                    let row_base = iy * w;
-                    for x in 0..8 {
-                        let ix = (bx + x).min(w.saturating_sub(1));
-                        block[y * 8 + x] = image[row_base + ix] as i16 - 128;
-                    }
-                }
-                Block { data: block }
-            })
+            .map(|idx| self.block_at(image, stride, (idx % blocks_wide) * 8, (idx / blocks_wide) * 8))
             .collect()
     }
 
+    /// Sequential `generate_blocks_strided` into `out` (one slot per block, row-major),
+    /// for callers that already split the work (e.g. per band).
+    pub fn fill_blocks_strided(&self, image: &[u8], stride: usize, out: &mut [Block]) {
+        let blocks_wide = (self.width + 7) / 8;
+        for (idx, block) in out.iter_mut().enumerate() {
+            *block = self.block_at(image, stride, (idx % blocks_wide) * 8, (idx / blocks_wide) * 8);
+        }
+    }
+
+    /// Level-shifted 8×8 block at (bx, by); edge pixels repeat past the plane.
+    #[inline]
+    fn block_at(&self, image: &[u8], stride: usize, bx: usize, by: usize) -> Block {
+        let (w, h) = (self.width, self.height);
+        let mut block = [0i16; 64];
+        for y in 0..8 {
+            let iy = (by + y).min(h.saturating_sub(1));
+            let row_base = iy * stride;
+            for x in 0..8 {
+                let ix = (bx + x).min(w.saturating_sub(1));
+                block[y * 8 + x] = image[row_base + ix] as i16 - 128;
+            }
+        }
+        Block { data: block }
+    }
+
     /// Generate blocks for one channel from interleaved RGB. Parallel via Rayon.
     pub fn generate_blocks_rgb(&self, image: &[u8], channel: usize) -> Vec<Block> {
         self.generate_blocks_interleaved_par(image, 3, channel)
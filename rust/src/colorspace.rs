@@ -7,6 +7,8 @@
 //!
 //! 4:2:0 subsampling: Cb and Cr planes are downsampled to (ceil(W/2)) × (ceil(H/2))
 //! using a simple 2×2 box average, matching JPEG's default chroma subsampling.
+use crate::block::Block;
+use crate::blockizer::Blockizer;
 use rayon::prelude::*;
 const PARALLEL_DECODE_PIXELS_THRESHOLD: usize = 262_144; // ~512x512
 const PARALLEL_ENCODE_PIXELS_THRESHOLD: usize = 262_144; // ~512x512
@@ -27,82 +29,107 @@ fn clamp_u8(v: i32) -> u8 {
     if v < 0 { 0 } else if v > 255 { 255 } else { v as u8 }
 }
 
-#[inline]
-fn interleave_rgb_planar(r: &[u8], g: &[u8], b: &[u8], out_row: &mut [u8]) {
-    debug_assert_eq!(r.len(), g.len());
-    debug_assert_eq!(r.len(), b.len());
-    let mut i = 0usize;
-    let mut o = 0usize;
-    while i + 3 < r.len() {
-        out_row[o] = r[i];
-        out_row[o + 1] = g[i];
-        out_row[o + 2] = b[i];
-        out_row[o + 3] = r[i + 1];
-        out_row[o + 4] = g[i + 1];
-        out_row[o + 5] = b[i + 1];
-        out_row[o + 6] = r[i + 2];
-        out_row[o + 7] = g[i + 2];
-        out_row[o + 8] = b[i + 2];
-        out_row[o + 9] = r[i + 3];
-        out_row[o + 10] = g[i + 3];
-        out_row[o + 11] = b[i + 3];
-        i += 4;
-        o += 12;
+/// Interleaved layouts the decoder writes directly.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum PixelFormat {
+    Rgb,
+    Rgba,
+    Bgr,
+    Bgra,
+    /// RGB plus a padding byte (255).
+    Rgbx,
+    /// BGR plus a padding byte (255).
+    Bgrx,
+}
+
+impl PixelFormat {
+    /// From the C API value (`BITGRAIN_PIXEL_*`).
+    pub fn from_code(code: u32) -> Option<Self> {
+        Some(match code {
+            0 => Self::Rgb,
+            1 => Self::Rgba,
+            2 => Self::Bgr,
+            3 => Self::Bgra,
+            4 => Self::Rgbx,
+            5 => Self::Bgrx,
+            _ => return None,
+        })
     }
-    while i < r.len() {
-        out_row[o] = r[i];
-        out_row[o + 1] = g[i];
-        out_row[o + 2] = b[i];
-        i += 1;
-        o += 3;
+
+    pub fn bytes_per_pixel(self) -> usize {
+        match self {
+            Self::Rgb | Self::Bgr => 3,
+            _ => 4,
+        }
+    }
+
+    /// The fourth byte carries alpha (255 for opaque sources) rather than padding.
+    pub fn has_alpha(self) -> bool {
+        matches!(self, Self::Rgba | Self::Bgra)
+    }
+
+    fn is_bgr(self) -> bool {
+        matches!(self, Self::Bgr | Self::Bgra | Self::Bgrx)
+    }
+}
+
+/// Store one pixel; RED is the byte offset of red (0 = RGB order, 2 = BGR order).
+#[inline(always)]
+fn put_pixel<const BPP: usize, const RED: usize>(out: &mut [u8], o: usize, r: u8, g: u8, b: u8, a: u8) {
+    out[o + RED] = r;
+    out[o + 1] = g;
+    out[o + 2 - RED] = b;
+    if BPP == 4 {
+        out[o + 3] = a;
     }
 }
 
 #[inline]
-fn interleave_rgba_planar(r: &[u8], g: &[u8], b: &[u8], a: &[u8], out_row: &mut [u8]) {
+fn interleave_planar_t<const BPP: usize, const RED: usize>(
+    r: &[u8],
+    g: &[u8],
+    b: &[u8],
+    a: Option<&[u8]>,
+    out_row: &mut [u8],
+) {
     debug_assert_eq!(r.len(), g.len());
     debug_assert_eq!(r.len(), b.len());
-    debug_assert_eq!(r.len(), a.len());
-    let mut i = 0usize;
-    let mut o = 0usize;
-    while i + 3 < r.len() {
-        out_row[o] = r[i];
-        out_row[o + 1] = g[i];
-        out_row[o + 2] = b[i];
-        out_row[o + 3] = a[i];
-        out_row[o + 4] = r[i + 1];
-        out_row[o + 5] = g[i + 1];
-        out_row[o + 6] = b[i + 1];
-        out_row[o + 7] = a[i + 1];
-        out_row[o + 8] = r[i + 2];
-        out_row[o + 9] = g[i + 2];
-        out_row[o + 10] = b[i + 2];
-        out_row[o + 11] = a[i + 2];
-        out_row[o + 12] = r[i + 3];
-        out_row[o + 13] = g[i + 3];
-        out_row[o + 14] = b[i + 3];
-        out_row[o + 15] = a[i + 3];
-        i += 4;
-        o += 16;
+    let out_row = &mut out_row[..r.len() * BPP];
+    match a {
+        Some(a) => {
+            for (i, px) in out_row.chunks_exact_mut(BPP).enumerate() {
+                put_pixel::<BPP, RED>(px, 0, r[i], g[i], b[i], a[i]);
+            }
+        }
+        None => {
+            for (i, px) in out_row.chunks_exact_mut(BPP).enumerate() {
+                put_pixel::<BPP, RED>(px, 0, r[i], g[i], b[i], 255);
+            }
+        }
     }
-    while i < r.len() {
-        out_row[o] = r[i];
-        out_row[o + 1] = g[i];
-        out_row[o + 2] = b[i];
-        out_row[o + 3] = a[i];
-        i += 1;
-        o += 4;
+}
+
+/// Interleave planar R/G/B (and A, else 255) into `fmt` pixels.
+#[inline]
+fn interleave_planar(fmt: PixelFormat, r: &[u8], g: &[u8], b: &[u8], a: Option<&[u8]>, out_row: &mut [u8]) {
+    match (fmt.bytes_per_pixel(), fmt.is_bgr()) {
+        (3, false) => interleave_planar_t::<3, 0>(r, g, b, a, out_row),
+        (3, true) => interleave_planar_t::<3, 2>(r, g, b, a, out_row),
+        (_, false) => interleave_planar_t::<4, 0>(r, g, b, a, out_row),
+        (_, true) => interleave_planar_t::<4, 2>(r, g, b, a, out_row),
     }
 }
 
 #[inline]
-fn ycbcr420_to_rgb_row_scalar(
+fn ycbcr420_row_scalar_t<const BPP: usize, const RED: usize>(
     y_row: &[u8],
     cb_row: &[u8],
     cr_row: &[u8],
+    a_row: Option<&[u8]>,
     w: usize,
     out_row: &mut [u8],
 ) {
+    let alpha = |px: usize| a_row.map_or(255, |a| a[px]);
     let mut px = 0usize;
     while px + 1 < w {
         let cbi = cb_row[px >> 1] as i32 - 128;
@@ -112,16 +139,11 @@ fn ycbcr420_to_rgb_row_scalar(
         let b_add = (454 * cbi) >> 8;
 
         let yi0 = y_row[px] as i32;
-        let o0 = px * 3;
-        out_row[o0] = clamp_u8(yi0 + r_add);
-        out_row[o0 + 1] = clamp_u8(yi0 - g_sub);
-        out_row[o0 + 2] = clamp_u8(yi0 + b_add);
-
+        put_pixel::<BPP, RED>(out_row, px * BPP,
+            clamp_u8(yi0 + r_add), clamp_u8(yi0 - g_sub), clamp_u8(yi0 + b_add), alpha(px));
         let yi1 = y_row[px + 1] as i32;
-        let o1 = o0 + 3;
-        out_row[o1] = clamp_u8(yi1 + r_add);
-        out_row[o1 + 1] = clamp_u8(yi1 - g_sub);
-        out_row[o1 + 2] = clamp_u8(yi1 + b_add);
+        put_pixel::<BPP, RED>(out_row, (px + 1) * BPP,
+            clamp_u8(yi1 + r_add), clamp_u8(yi1 - g_sub), clamp_u8(yi1 + b_add), alpha(px + 1));
 
         px += 2;
     }
@@ -129,207 +151,82 @@ fn ycbcr420_to_rgb_row_scalar(
         let cbi = cb_row[px >> 1] as i32 - 128;
         let cri = cr_row[px >> 1] as i32 - 128;
         let yi = y_row[px] as i32;
-        let i = px * 3;
-        out_row[i] = clamp_u8(yi + ((359 * cri) >> 8));
-        out_row[i + 1] = clamp_u8(yi - ((88 * cbi + 183 * cri) >> 8));
-        out_row[i + 2] = clamp_u8(yi + ((454 * cbi) >> 8));
+        put_pixel::<BPP, RED>(out_row, px * BPP,
+            clamp_u8(yi + ((359 * cri) >> 8)),
+            clamp_u8(yi - ((88 * cbi + 183 * cri) >> 8)),
+            clamp_u8(yi + ((454 * cbi) >> 8)),
+            alpha(px));
     }
 }
 
+/// Convert one row of Y/Cb/Cr (and A, else 255) to `fmt` pixels.
 #[inline]
-fn ycbcr420a_to_rgba_row_scalar(
+fn ycbcr420_row_scalar(
     y_row: &[u8],
     cb_row: &[u8],
     cr_row: &[u8],
-    a_row: &[u8],
+    a_row: Option<&[u8]>,
     w: usize,
+    fmt: PixelFormat,
     out_row: &mut [u8],
 ) {
-    let mut px = 0usize;
-    while px + 1 < w {
-        let cbi = cb_row[px >> 1] as i32 - 128;
-        let cri = cr_row[px >> 1] as i32 - 128;
-        let r_add = (359 * cri) >> 8;
-        let g_sub = (88 * cbi + 183 * cri) >> 8;
-        let b_add = (454 * cbi) >> 8;
-
-        let yi0 = y_row[px] as i32;
-        let o0 = px * 4;
-        out_row[o0] = clamp_u8(yi0 + r_add);
-        out_row[o0 + 1] = clamp_u8(yi0 - g_sub);
-        out_row[o0 + 2] = clamp_u8(yi0 + b_add);
-        out_row[o0 + 3] = a_row[px];
-
-        let yi1 = y_row[px + 1] as i32;
-        let o1 = o0 + 4;
-        out_row[o1] = clamp_u8(yi1 + r_add);
-        out_row[o1 + 1] = clamp_u8(yi1 - g_sub);
-        out_row[o1 + 2] = clamp_u8(yi1 + b_add);
-        out_row[o1 + 3] = a_row[px + 1];
-
-        px += 2;
-    }
-    if px < w {
-        let cbi = cb_row[px >> 1] as i32 - 128;
-        let cri = cr_row[px >> 1] as i32 - 128;
-        let yi = y_row[px] as i32;
-        let i = px * 4;
-        out_row[i] = clamp_u8(yi + ((359 * cri) >> 8));
-        out_row[i + 1] = clamp_u8(yi - ((88 * cbi + 183 * cri) >> 8));
-        out_row[i + 2] = clamp_u8(yi + ((454 * cbi) >> 8));
-        out_row[i + 3] = a_row[px];
+    match (fmt.bytes_per_pixel(), fmt.is_bgr()) {
+        (3, false) => ycbcr420_row_scalar_t::<3, 0>(y_row, cb_row, cr_row, a_row, w, out_row),
+        (3, true) => ycbcr420_row_scalar_t::<3, 2>(y_row, cb_row, cr_row, a_row, w, out_row),
+        (_, false) => ycbcr420_row_scalar_t::<4, 0>(y_row, cb_row, cr_row, a_row, w, out_row),
+        (_, true) => ycbcr420_row_scalar_t::<4, 2>(y_row, cb_row, cr_row, a_row, w, out_row),
     }
 }
 
+/// Interleave 16 pixels from byte vectors c0..c3 into 64 bytes (c0 c1 c2 c3 per pixel).
 #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
 #[target_feature(enable = "sse2")]
-unsafe fn ycbcr420_to_rgb_row_sse2(
-    y_row: &[u8],
-    cb_row: &[u8],
-    cr_row: &[u8],
-    w: usize,
-    out_row: &mut [u8],
-) {
-    let zero = _mm_setzero_si128();
-    let mut px = 0usize;
-    let mut r_add_arr = [0i16; 16];
-    let mut g_sub_arr = [0i16; 16];
-    let mut b_add_arr = [0i16; 16];
-    let mut rv = [0u8; 16];
-    let mut gv = [0u8; 16];
-    let mut bv = [0u8; 16];
-    while px + 16 <= w {
-        for pair in 0..8usize {
-            let cbi = cb_row[(px >> 1) + pair] as i32 - 128;
-            let cri = cr_row[(px >> 1) + pair] as i32 - 128;
-            let r_add = ((359 * cri) >> 8) as i16;
-            let g_sub = ((88 * cbi + 183 * cri) >> 8) as i16;
-            let b_add = ((454 * cbi) >> 8) as i16;
-            let i = pair * 2;
-            r_add_arr[i] = r_add;
-            r_add_arr[i + 1] = r_add;
-            g_sub_arr[i] = g_sub;
-            g_sub_arr[i + 1] = g_sub;
-            b_add_arr[i] = b_add;
-            b_add_arr[i + 1] = b_add;
-        }
-
-        let yv = _mm_loadu_si128(y_row.as_ptr().add(px) as *const __m128i);
-        let y_lo = _mm_unpacklo_epi8(yv, zero);
-        let y_hi = _mm_unpackhi_epi8(yv, zero);
-
-        let r_add_lo = _mm_loadu_si128(r_add_arr.as_ptr() as *const __m128i);
-        let r_add_hi = _mm_loadu_si128(r_add_arr.as_ptr().add(8) as *const __m128i);
-        let g_sub_lo = _mm_loadu_si128(g_sub_arr.as_ptr() as *const __m128i);
-        let g_sub_hi = _mm_loadu_si128(g_sub_arr.as_ptr().add(8) as *const __m128i);
-        let b_add_lo = _mm_loadu_si128(b_add_arr.as_ptr() as *const __m128i);
-        let b_add_hi = _mm_loadu_si128(b_add_arr.as_ptr().add(8) as *const __m128i);
-
-        let r_lo = _mm_add_epi16(y_lo, r_add_lo);
-        let r_hi = _mm_add_epi16(y_hi, r_add_hi);
-        let g_lo = _mm_sub_epi16(y_lo, g_sub_lo);
-        let g_hi = _mm_sub_epi16(y_hi, g_sub_hi);
-        let b_lo = _mm_add_epi16(y_lo, b_add_lo);
-        let b_hi = _mm_add_epi16(y_hi, b_add_hi);
-
-        let r8 = _mm_packus_epi16(r_lo, r_hi);
-        let g8 = _mm_packus_epi16(g_lo, g_hi);
-        let b8 = _mm_packus_epi16(b_lo, b_hi);
-
-        _mm_storeu_si128(rv.as_mut_ptr() as *mut __m128i, r8);
-        _mm_storeu_si128(gv.as_mut_ptr() as *mut __m128i, g8);
-        _mm_storeu_si128(bv.as_mut_ptr() as *mut __m128i, b8);
-        interleave_rgb_planar(&rv, &gv, &bv, &mut out_row[px * 3..(px + 16) * 3]);
-        px += 16;
-    }
-
-    if px < w {
-        ycbcr420_to_rgb_row_scalar(&y_row[px..], &cb_row[px >> 1..], &cr_row[px >> 1..], w - px, &mut out_row[px * 3..]);
-    }
+unsafe fn store_pixels4_sse2(c0: __m128i, c1: __m128i, c2: __m128i, c3: __m128i, dst: &mut [u8]) {
+    debug_assert!(dst.len() >= 64);
+    let lo01 = _mm_unpacklo_epi8(c0, c1);
+    let hi01 = _mm_unpackhi_epi8(c0, c1);
+    let lo23 = _mm_unpacklo_epi8(c2, c3);
+    let hi23 = _mm_unpackhi_epi8(c2, c3);
+    let p = dst.as_mut_ptr() as *mut __m128i;
+    _mm_storeu_si128(p, _mm_unpacklo_epi16(lo01, lo23));
+    _mm_storeu_si128(p.add(1), _mm_unpackhi_epi16(lo01, lo23));
+    _mm_storeu_si128(p.add(2), _mm_unpacklo_epi16(hi01, hi23));
+    _mm_storeu_si128(p.add(3), _mm_unpackhi_epi16(hi01, hi23));
 }
 
+/// Interleave 32 pixels from byte vectors c0..c3 into 128 bytes (c0 c1 c2 c3 per pixel).
+/// Unpacks work within 128-bit lanes, so the halves are recombined across lanes on store.
 #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
 #[target_feature(enable = "avx2")]
-unsafe fn ycbcr420_to_rgb_row_avx2(
-    y_row: &[u8],
-    cb_row: &[u8],
-    cr_row: &[u8],
-    w: usize,
-    out_row: &mut [u8],
-) {
-    let zero = _mm256_setzero_si256();
-    let mut px = 0usize;
-    let mut r_add_arr = [0i16; 32];
-    let mut g_sub_arr = [0i16; 32];
-    let mut b_add_arr = [0i16; 32];
-    let mut rv = [0u8; 32];
-    let mut gv = [0u8; 32];
-    let mut bv = [0u8; 32];
-    while px + 32 <= w {
-        for pair in 0..16usize {
-            let cbi = cb_row[(px >> 1) + pair] as i32 - 128;
-            let cri = cr_row[(px >> 1) + pair] as i32 - 128;
-            let r_add = ((359 * cri) >> 8) as i16;
-            let g_sub = ((88 * cbi + 183 * cri) >> 8) as i16;
-            let b_add = ((454 * cbi) >> 8) as i16;
-            let i = pair * 2;
-            r_add_arr[i] = r_add;
-            r_add_arr[i + 1] = r_add;
-            g_sub_arr[i] = g_sub;
-            g_sub_arr[i + 1] = g_sub;
-            b_add_arr[i] = b_add;
-            b_add_arr[i + 1] = b_add;
-        }
-
-        let yv = _mm256_loadu_si256(y_row.as_ptr().add(px) as *const __m256i);
-        let y_lo = _mm256_unpacklo_epi8(yv, zero);
-        let y_hi = _mm256_unpackhi_epi8(yv, zero);
-
-        let r_add_lo = _mm256_loadu_si256(r_add_arr.as_ptr() as *const __m256i);
-        let r_add_hi = _mm256_loadu_si256(r_add_arr.as_ptr().add(16) as *const __m256i);
-        let g_sub_lo = _mm256_loadu_si256(g_sub_arr.as_ptr() as *const __m256i);
-        let g_sub_hi = _mm256_loadu_si256(g_sub_arr.as_ptr().add(16) as *const __m256i);
-        let b_add_lo = _mm256_loadu_si256(b_add_arr.as_ptr() as *const __m256i);
-        let b_add_hi = _mm256_loadu_si256(b_add_arr.as_ptr().add(16) as *const __m256i);
-
-        let r_lo = _mm256_add_epi16(y_lo, r_add_lo);
-        let r_hi = _mm256_add_epi16(y_hi, r_add_hi);
-        let g_lo = _mm256_sub_epi16(y_lo, g_sub_lo);
-        let g_hi = _mm256_sub_epi16(y_hi, g_sub_hi);
-        let b_lo = _mm256_add_epi16(y_lo, b_add_lo);
-        let b_hi = _mm256_add_epi16(y_hi, b_add_hi);
-
-        let r8 = _mm256_packus_epi16(r_lo, r_hi);
-        let g8 = _mm256_packus_epi16(g_lo, g_hi);
-        let b8 = _mm256_packus_epi16(b_lo, b_hi);
-
-        _mm256_storeu_si256(rv.as_mut_ptr() as *mut __m256i, r8);
-        _mm256_storeu_si256(gv.as_mut_ptr() as *mut __m256i, g8);
-        _mm256_storeu_si256(bv.as_mut_ptr() as *mut __m256i, b8);
-        interleave_rgb_planar(&rv, &gv, &bv, &mut out_row[px * 3..(px + 32) * 3]);
-        px += 32;
-    }
-    if px < w {
-        ycbcr420_to_rgb_row_sse2(
-            &y_row[px..],
-            &cb_row[px >> 1..],
-            &cr_row[px >> 1..],
-            w - px,
-            &mut out_row[px * 3..],
-        );
-    }
+unsafe fn store_pixels4_avx2(c0: __m256i, c1: __m256i, c2: __m256i, c3: __m256i, dst: &mut [u8]) {
+    debug_assert!(dst.len() >= 128);
+    let lo01 = _mm256_unpacklo_epi8(c0, c1); // px 0..7  | 16..23
+    let hi01 = _mm256_unpackhi_epi8(c0, c1); // px 8..15 | 24..31
+    let lo23 = _mm256_unpacklo_epi8(c2, c3);
+    let hi23 = _mm256_unpackhi_epi8(c2, c3);
+    let p0 = _mm256_unpacklo_epi16(lo01, lo23); // px 0..3   | 16..19
+    let p1 = _mm256_unpackhi_epi16(lo01, lo23); // px 4..7   | 20..23
+    let p2 = _mm256_unpacklo_epi16(hi01, hi23); // px 8..11  | 24..27
+    let p3 = _mm256_unpackhi_epi16(hi01, hi23); // px 12..15 | 28..31
+    let p = dst.as_mut_ptr() as *mut __m256i;
+    _mm256_storeu_si256(p, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(p.add(1), _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(p.add(2), _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(p.add(3), _mm256_permute2x128_si256(p2, p3, 0x31));
 }
 
 #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
 #[target_feature(enable = "sse2")]
-unsafe fn ycbcr420a_to_rgba_row_sse2(
+unsafe fn ycbcr420_row_sse2(
     y_row: &[u8],
     cb_row: &[u8],
     cr_row: &[u8],
-    a_row: &[u8],
+    a_row: Option<&[u8]>,
     w: usize,
+    fmt: PixelFormat,
     out_row: &mut [u8],
 ) {
+    let bpp = fmt.bytes_per_pixel();
     let zero = _mm_setzero_si128();
     let mut px = 0usize;
     let mut r_add_arr = [0i16; 16];
@@ -338,7 +235,6 @@ unsafe fn ycbcr420a_to_rgba_row_sse2(
     let mut rv = [0u8; 16];
     let mut gv = [0u8; 16];
     let mut bv = [0u8; 16];
-    let mut av = [0u8; 16];
     while px + 16 <= w {
         for pair in 0..8usize {
             let cbi = cb_row[(px >> 1) + pair] as i32 - 128;
@@ -366,48 +262,52 @@ unsafe fn ycbcr420a_to_rgba_row_sse2(
         let b_add_lo = _mm_loadu_si128(b_add_arr.as_ptr() as *const __m128i);
         let b_add_hi = _mm_loadu_si128(b_add_arr.as_ptr().add(8) as *const __m128i);
 
-        let r_lo = _mm_add_epi16(y_lo, r_add_lo);
-        let r_hi = _mm_add_epi16(y_hi, r_add_hi);
-        let g_lo = _mm_sub_epi16(y_lo, g_sub_lo);
-        let g_hi = _mm_sub_epi16(y_hi, g_sub_hi);
-        let b_lo = _mm_add_epi16(y_lo, b_add_lo);
-        let b_hi = _mm_add_epi16(y_hi, b_add_hi);
-
-        let r8 = _mm_packus_epi16(r_lo, r_hi);
-        let g8 = _mm_packus_epi16(g_lo, g_hi);
-        let b8 = _mm_packus_epi16(b_lo, b_hi);
-        let a8 = _mm_loadu_si128(a_row.as_ptr().add(px) as *const __m128i);
-
-        _mm_storeu_si128(rv.as_mut_ptr() as *mut __m128i, r8);
-        _mm_storeu_si128(gv.as_mut_ptr() as *mut __m128i, g8);
-        _mm_storeu_si128(bv.as_mut_ptr() as *mut __m128i, b8);
-        _mm_storeu_si128(av.as_mut_ptr() as *mut __m128i, a8);
-        interleave_rgba_planar(&rv, &gv, &bv, &av, &mut out_row[px * 4..(px + 16) * 4]);
+        let r8 = _mm_packus_epi16(_mm_add_epi16(y_lo, r_add_lo), _mm_add_epi16(y_hi, r_add_hi));
+        let g8 = _mm_packus_epi16(_mm_sub_epi16(y_lo, g_sub_lo), _mm_sub_epi16(y_hi, g_sub_hi));
+        let b8 = _mm_packus_epi16(_mm_add_epi16(y_lo, b_add_lo), _mm_add_epi16(y_hi, b_add_hi));
+
+        let dst = &mut out_row[px * bpp..(px + 16) * bpp];
+        if bpp == 4 {
+            let a8 = match a_row {
+                Some(a) => _mm_loadu_si128(a.as_ptr().add(px) as *const __m128i),
+                None => _mm_set1_epi8(-1),
+            };
+            let (c0, c2) = if fmt.is_bgr() { (b8, r8) } else { (r8, b8) };
+            store_pixels4_sse2(c0, g8, c2, a8, dst);
+        } else {
+            _mm_storeu_si128(rv.as_mut_ptr() as *mut __m128i, r8);
+            _mm_storeu_si128(gv.as_mut_ptr() as *mut __m128i, g8);
+            _mm_storeu_si128(bv.as_mut_ptr() as *mut __m128i, b8);
+            interleave_planar(fmt, &rv, &gv, &bv, None, dst);
+        }
         px += 16;
     }
 
     if px < w {
-        ycbcr420a_to_rgba_row_scalar(
+        ycbcr420_row_scalar(
             &y_row[px..],
             &cb_row[px >> 1..],
             &cr_row[px >> 1..],
-            &a_row[px..],
+            a_row.map(|a| &a[px..]),
             w - px,
-            &mut out_row[px * 4..],
+            fmt,
+            &mut out_row[px * bpp..],
         );
     }
 }
 
 #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
 #[target_feature(enable = "avx2")]
-unsafe fn ycbcr420a_to_rgba_row_avx2(
+unsafe fn ycbcr420_row_avx2(
     y_row: &[u8],
     cb_row: &[u8],
     cr_row: &[u8],
-    a_row: &[u8],
+    a_row: Option<&[u8]>,
     w: usize,
+    fmt: PixelFormat,
     out_row: &mut [u8],
 ) {
+    let bpp = fmt.bytes_per_pixel();
     let zero = _mm256_setzero_si256();
     let mut px = 0usize;
     let mut r_add_arr = [0i16; 32];
@@ -416,7 +316,6 @@ unsafe fn ycbcr420a_to_rgba_row_avx2(
     let mut rv = [0u8; 32];
     let mut gv = [0u8; 32];
     let mut bv = [0u8; 32];
-    let mut av = [0u8; 32];
     while px + 32 <= w {
         for pair in 0..16usize {
             let cbi = cb_row[(px >> 1) + pair] as i32 - 128;
@@ -433,7 +332,9 @@ unsafe fn ycbcr420a_to_rgba_row_avx2(
             b_add_arr[i + 1] = b_add;
         }
 
-        let yv = _mm256_loadu_si256(y_row.as_ptr().add(px) as *const __m256i);
+        // Unpack/pack work per 128-bit lane: reorder the quadwords so y_lo holds
+        // pixels 0..15 and y_hi 16..31 (matching the chroma arrays), and undo it after packing.
+        let yv = _mm256_permute4x64_epi64(_mm256_loadu_si256(y_row.as_ptr().add(px) as *const __m256i), 0xD8);
         let y_lo = _mm256_unpacklo_epi8(yv, zero);
         let y_hi = _mm256_unpackhi_epi8(yv, zero);
 
@@ -444,33 +345,38 @@ unsafe fn ycbcr420a_to_rgba_row_avx2(
         let b_add_lo = _mm256_loadu_si256(b_add_arr.as_ptr() as *const __m256i);
         let b_add_hi = _mm256_loadu_si256(b_add_arr.as_ptr().add(16) as *const __m256i);
 
-        let r_lo = _mm256_add_epi16(y_lo, r_add_lo);
-        let r_hi = _mm256_add_epi16(y_hi, r_add_hi);
-        let g_lo = _mm256_sub_epi16(y_lo, g_sub_lo);
-        let g_hi = _mm256_sub_epi16(y_hi, g_sub_hi);
-        let b_lo = _mm256_add_epi16(y_lo, b_add_lo);
-        let b_hi = _mm256_add_epi16(y_hi, b_add_hi);
-
-        let r8 = _mm256_packus_epi16(r_lo, r_hi);
-        let g8 = _mm256_packus_epi16(g_lo, g_hi);
-        let b8 = _mm256_packus_epi16(b_lo, b_hi);
-        let a8 = _mm256_loadu_si256(a_row.as_ptr().add(px) as *const __m256i);
-
-        _mm256_storeu_si256(rv.as_mut_ptr() as *mut __m256i, r8);
-        _mm256_storeu_si256(gv.as_mut_ptr() as *mut __m256i, g8);
-        _mm256_storeu_si256(bv.as_mut_ptr() as *mut __m256i, b8);
-        _mm256_storeu_si256(av.as_mut_ptr() as *mut __m256i, a8);
-        interleave_rgba_planar(&rv, &gv, &bv, &av, &mut out_row[px * 4..(px + 32) * 4]);
+        let r8 = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_add_epi16(y_lo, r_add_lo), _mm256_add_epi16(y_hi, r_add_hi)), 0xD8);
+        let g8 = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_sub_epi16(y_lo, g_sub_lo), _mm256_sub_epi16(y_hi, g_sub_hi)), 0xD8);
+        let b8 = _mm256_permute4x64_epi64(
+            _mm256_packus_epi16(_mm256_add_epi16(y_lo, b_add_lo), _mm256_add_epi16(y_hi, b_add_hi)), 0xD8);
+
+        let dst = &mut out_row[px * bpp..(px + 32) * bpp];
+        if bpp == 4 {
+            let a8 = match a_row {
+                Some(a) => _mm256_loadu_si256(a.as_ptr().add(px) as *const __m256i),
+                None => _mm256_set1_epi8(-1),
+            };
+            let (c0, c2) = if fmt.is_bgr() { (b8, r8) } else { (r8, b8) };
+            store_pixels4_avx2(c0, g8, c2, a8, dst);
+        } else {
+            _mm256_storeu_si256(rv.as_mut_ptr() as *mut __m256i, r8);
+            _mm256_storeu_si256(gv.as_mut_ptr() as *mut __m256i, g8);
+            _mm256_storeu_si256(bv.as_mut_ptr() as *mut __m256i, b8);
+            interleave_planar(fmt, &rv, &gv, &bv, None, dst);
+        }
         px += 32;
     }
     if px < w {
-        ycbcr420a_to_rgba_row_sse2(
+        ycbcr420_row_sse2(
             &y_row[px..],
             &cb_row[px >> 1..],
             &cr_row[px >> 1..],
-            &a_row[px..],
+            a_row.map(|a| &a[px..]),
             w - px,
-            &mut out_row[px * 4..],
+            fmt,
+            &mut out_row[px * bpp..],
         );
     }
 }
@@ -537,57 +443,20 @@ unsafe fn ycbcr_to_rgb8_neon(y8: uint8x8_t, cb8: uint8x8_t, cr8: uint8x8_t) -> (
 #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
 #[inline]
 #[target_feature(enable = "neon")]
-unsafe fn ycbcr420_to_rgb_row_neon(
-    y_row: &[u8],
-    cb_row: &[u8],
-    cr_row: &[u8],
-    w: usize,
-    out_row: &mut [u8],
-) {
-    let mut px = 0usize;
-    let mut rv = [0u8; 16];
-    let mut gv = [0u8; 16];
-    let mut bv = [0u8; 16];
-    while px + 16 <= w {
-        let cb8 = vld1_u8(cb_row.as_ptr().add(px >> 1));
-        let cr8 = vld1_u8(cr_row.as_ptr().add(px >> 1));
-        let cbz = vzip_u8(cb8, cb8);
-        let crz = vzip_u8(cr8, cr8);
-
-        let y0 = vld1_u8(y_row.as_ptr().add(px));
-        let y1 = vld1_u8(y_row.as_ptr().add(px + 8));
-        let (r0, g0, b0) = ycbcr_to_rgb8_neon(y0, cbz.0, crz.0);
-        let (r1, g1, b1) = ycbcr_to_rgb8_neon(y1, cbz.1, crz.1);
-        vst1_u8(rv.as_mut_ptr(), r0);
-        vst1_u8(rv.as_mut_ptr().add(8), r1);
-        vst1_u8(gv.as_mut_ptr(), g0);
-        vst1_u8(gv.as_mut_ptr().add(8), g1);
-        vst1_u8(bv.as_mut_ptr(), b0);
-        vst1_u8(bv.as_mut_ptr().add(8), b1);
-        interleave_rgb_planar(&rv, &gv, &bv, &mut out_row[px * 3..(px + 16) * 3]);
-        px += 16;
-    }
-    if px < w {
-        ycbcr420_to_rgb_row_scalar(&y_row[px..], &cb_row[px >> 1..], &cr_row[px >> 1..], w - px, &mut out_row[px * 3..]);
-    }
-}
-
-#[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
-#[inline]
-#[target_feature(enable = "neon")]
-unsafe fn ycbcr420a_to_rgba_row_neon(
+unsafe fn ycbcr420_row_neon(
     y_row: &[u8],
     cb_row: &[u8],
     cr_row: &[u8],
-    a_row: &[u8],
+    a_row: Option<&[u8]>,
     w: usize,
+    fmt: PixelFormat,
     out_row: &mut [u8],
 ) {
+    let bpp = fmt.bytes_per_pixel();
     let mut px = 0usize;
     let mut rv = [0u8; 16];
     let mut gv = [0u8; 16];
     let mut bv = [0u8; 16];
-    let mut av = [0u8; 16];
     while px + 16 <= w {
         let cb8 = vld1_u8(cb_row.as_ptr().add(px >> 1));
         let cr8 = vld1_u8(cr_row.as_ptr().add(px >> 1));
@@ -598,50 +467,49 @@ unsafe fn ycbcr420a_to_rgba_row_neon(
         let y1 = vld1_u8(y_row.as_ptr().add(px + 8));
         let (r0, g0, b0) = ycbcr_to_rgb8_neon(y0, cbz.0, crz.0);
         let (r1, g1, b1) = ycbcr_to_rgb8_neon(y1, cbz.1, crz.1);
-        let a0 = vld1_u8(a_row.as_ptr().add(px));
-        let a1 = vld1_u8(a_row.as_ptr().add(px + 8));
-
         vst1_u8(rv.as_mut_ptr(), r0);
         vst1_u8(rv.as_mut_ptr().add(8), r1);
         vst1_u8(gv.as_mut_ptr(), g0);
         vst1_u8(gv.as_mut_ptr().add(8), g1);
         vst1_u8(bv.as_mut_ptr(), b0);
         vst1_u8(bv.as_mut_ptr().add(8), b1);
-        vst1_u8(av.as_mut_ptr(), a0);
-        vst1_u8(av.as_mut_ptr().add(8), a1);
-        interleave_rgba_planar(&rv, &gv, &bv, &av, &mut out_row[px * 4..(px + 16) * 4]);
+        interleave_planar(fmt, &rv, &gv, &bv, a_row.map(|a| &a[px..px + 16]), &mut out_row[px * bpp..(px + 16) * bpp]);
         px += 16;
     }
     if px < w {
-        ycbcr420a_to_rgba_row_scalar(
+        ycbcr420_row_scalar(
             &y_row[px..],
             &cb_row[px >> 1..],
             &cr_row[px >> 1..],
-            &a_row[px..],
+            a_row.map(|a| &a[px..]),
             w - px,
-            &mut out_row[px * 4..],
+            fmt,
+            &mut out_row[px * bpp..],
         );
     }
 }
 
+// Forward kernels read BPP-byte pixels with red at byte RED (0 = RGB, 2 = BGR order);
+// ALPHA kernels also copy byte 3 into the A row.
+
 #[inline]
-fn rgb_to_y_row_scalar(src_row: &[u8], y_row: &mut [u8], w: usize) {
+fn rgb_to_y_row_scalar<const BPP: usize, const RED: usize>(src_row: &[u8], y_row: &mut [u8], w: usize) {
     for px in 0..w {
-        let base = px * 3;
-        let r = src_row[base] as i32;
+        let base = px * BPP;
+        let r = src_row[base + RED] as i32;
         let g = src_row[base + 1] as i32;
-        let b = src_row[base + 2] as i32;
+        let b = src_row[base + 2 - RED] as i32;
         y_row[px] = ((77 * r + 150 * g + 29 * b + 128) >> 8) as u8;
     }
 }
 
 #[inline]
-fn rgba_to_ya_row_scalar(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w: usize) {
+fn rgba_to_ya_row_scalar<const RED: usize>(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w: usize) {
     for px in 0..w {
         let base = px * 4;
-        let r = src_row[base] as i32;
+        let r = src_row[base + RED] as i32;
         let g = src_row[base + 1] as i32;
-        let b = src_row[base + 2] as i32;
+        let b = src_row[base + 2 - RED] as i32;
         y_row[px] = ((77 * r + 150 * g + 29 * b + 128) >> 8) as u8;
         a_row[px] = src_row[base + 3];
     }
@@ -649,7 +517,7 @@ fn rgba_to_ya_row_scalar(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w:
 
 #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
 #[target_feature(enable = "sse2")]
-unsafe fn rgb_to_y_row_sse2(src_row: &[u8], y_row: &mut [u8], w: usize) {
+unsafe fn rgb_to_y_row_sse2<const BPP: usize, const RED: usize>(src_row: &[u8], y_row: &mut [u8], w: usize) {
     let zero = _mm_setzero_si128();
     let c77 = _mm_set1_epi16(77);
     let c150 = _mm_set1_epi16(150);
@@ -660,12 +528,12 @@ unsafe fn rgb_to_y_row_sse2(src_row: &[u8], y_row: &mut [u8], w: usize) {
     let mut gv = [0u8; 16];
     let mut bv = [0u8; 16];
     while px + 16 <= w {
-        let row = &src_row[px * 3..(px + 16) * 3];
+        let row = &src_row[px * BPP..(px + 16) * BPP];
         for i in 0..16 {
-            let j = i * 3;
-            rv[i] = row[j];
+            let j = i * BPP;
+            rv[i] = row[j + RED];
             gv[i] = row[j + 1];
-            bv[i] = row[j + 2];
+            bv[i] = row[j + 2 - RED];
         }
         let r8 = _mm_loadu_si128(rv.as_ptr() as *const __m128i);
         let g8 = _mm_loadu_si128(gv.as_ptr() as *const __m128i);
@@ -702,13 +570,13 @@ unsafe fn rgb_to_y_row_sse2(src_row: &[u8], y_row: &mut [u8], w: usize) {
         px += 16;
     }
     if px < w {
-        rgb_to_y_row_scalar(&src_row[px * 3..], &mut y_row[px..], w - px);
+        rgb_to_y_row_scalar::<BPP, RED>(&src_row[px * BPP..], &mut y_row[px..], w - px);
     }
 }
 
 #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
 #[target_feature(enable = "sse2")]
-unsafe fn rgba_to_ya_row_sse2(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w: usize) {
+unsafe fn rgba_to_ya_row_sse2<const RED: usize>(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w: usize) {
     let zero = _mm_setzero_si128();
     let c77 = _mm_set1_epi16(77);
     let c150 = _mm_set1_epi16(150);
@@ -723,9 +591,9 @@ unsafe fn rgba_to_ya_row_sse2(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8]
         let row = &src_row[px * 4..(px + 16) * 4];
         for i in 0..16 {
             let j = i * 4;
-            rv[i] = row[j];
+            rv[i] = row[j + RED];
             gv[i] = row[j + 1];
-            bv[i] = row[j + 2];
+            bv[i] = row[j + 2 - RED];
             av[i] = row[j + 3];
         }
         let r8 = _mm_loadu_si128(rv.as_ptr() as *const __m128i);
@@ -764,7 +632,7 @@ unsafe fn rgba_to_ya_row_sse2(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8]
         px += 16;
     }
     if px < w {
-        rgba_to_ya_row_scalar(&src_row[px * 4..], &mut y_row[px..], &mut a_row[px..], w - px);
+        rgba_to_ya_row_scalar::<RED>(&src_row[px * 4..], &mut y_row[px..], &mut a_row[px..], w - px);
     }
 }
 
@@ -782,18 +650,18 @@ unsafe fn rgb8_to_y8_neon(r8: uint8x8_t, g8: uint8x8_t, b8: uint8x8_t) -> uint8x
 #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
 #[inline]
 #[target_feature(enable = "neon")]
-unsafe fn rgb_to_y_row_neon(src_row: &[u8], y_row: &mut [u8], w: usize) {
+unsafe fn rgb_to_y_row_neon<const BPP: usize, const RED: usize>(src_row: &[u8], y_row: &mut [u8], w: usize) {
     let mut px = 0usize;
     let mut rv = [0u8; 16];
     let mut gv = [0u8; 16];
     let mut bv = [0u8; 16];
     while px + 16 <= w {
-        let row = &src_row[px * 3..(px + 16) * 3];
+        let row = &src_row[px * BPP..(px + 16) * BPP];
         for i in 0..16 {
-            let j = i * 3;
-            rv[i] = row[j];
+            let j = i * BPP;
+            rv[i] = row[j + RED];
             gv[i] = row[j + 1];
-            bv[i] = row[j + 2];
+            bv[i] = row[j + 2 - RED];
         }
         let r0 = vld1_u8(rv.as_ptr());
         let r1 = vld1_u8(rv.as_ptr().add(8));
@@ -808,14 +676,14 @@ unsafe fn rgb_to_y_row_neon(src_row: &[u8], y_row: &mut [u8], w: usize) {
         px += 16;
     }
     if px < w {
-        rgb_to_y_row_scalar(&src_row[px * 3..], &mut y_row[px..], w - px);
+        rgb_to_y_row_scalar::<BPP, RED>(&src_row[px * BPP..], &mut y_row[px..], w - px);
     }
 }
 
 #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
 #[inline]
 #[target_feature(enable = "neon")]
-unsafe fn rgba_to_ya_row_neon(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w: usize) {
+unsafe fn rgba_to_ya_row_neon<const RED: usize>(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8], w: usize) {
     let mut px = 0usize;
     let mut rv = [0u8; 16];
     let mut gv = [0u8; 16];
@@ -825,9 +693,9 @@ unsafe fn rgba_to_ya_row_neon(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8]
         let row = &src_row[px * 4..(px + 16) * 4];
         for i in 0..16 {
             let j = i * 4;
-            rv[i] = row[j];
+            rv[i] = row[j + RED];
             gv[i] = row[j + 1];
-            bv[i] = row[j + 2];
+            bv[i] = row[j + 2 - RED];
             av[i] = row[j + 3];
         }
         let r0 = vld1_u8(rv.as_ptr());
@@ -844,148 +712,284 @@ unsafe fn rgba_to_ya_row_neon(src_row: &[u8], y_row: &mut [u8], a_row: &mut [u8]
         px += 16;
     }
     if px < w {
-        rgba_to_ya_row_scalar(&src_row[px * 4..], &mut y_row[px..], &mut a_row[px..], w - px);
+        rgba_to_ya_row_scalar::<RED>(&src_row[px * 4..], &mut y_row[px..], &mut a_row[px..], w - px);
     }
 }
 
-/// Convert interleaved RGB (3 bytes/pixel) to separate Y, Cb, Cr planes.
-/// Y is full resolution (w×h). Cb and Cr are 4:2:0 subsampled: ((w+1)/2) × ((h+1)/2).
-/// Returns (Y, Cb, Cr).
-pub fn rgb_to_ycbcr420(image: &[u8], w: usize, h: usize) -> (Vec<u8>, Vec<u8>, Vec<u8>) {
-    let npix = w * h;
-    let cw = (w + 1) / 2;
-    let ch = (h + 1) / 2;
+/// Y (and, when ALPHA, A) for one source row, through the best available kernel.
+#[inline(always)]
+fn y_row_t<const BPP: usize, const RED: usize, const ALPHA: bool>(
+    src_row: &[u8],
+    y_row: &mut [u8],
+    a_row: &mut [u8],
+    w: usize,
+    use_sse2: bool,
+    use_neon: bool,
+) {
+    if use_sse2 {
+        #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+        unsafe {
+            if ALPHA { rgba_to_ya_row_sse2::<RED>(src_row, y_row, a_row, w) } else { rgb_to_y_row_sse2::<BPP, RED>(src_row, y_row, w) }
+        }
+        #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+        return;
+    }
+    if use_neon {
+        #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
+        unsafe {
+            if ALPHA { rgba_to_ya_row_neon::<RED>(src_row, y_row, a_row, w) } else { rgb_to_y_row_neon::<BPP, RED>(src_row, y_row, w) }
+        }
+        #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
+        return;
+    }
+    if ALPHA {
+        rgba_to_ya_row_scalar::<RED>(src_row, y_row, a_row, w);
+    } else {
+        rgb_to_y_row_scalar::<BPP, RED>(src_row, y_row, w);
+    }
+}
 
-    let mut y_plane  = vec![0u8; npix];
-    let mut cb_plane = vec![0u8; cw * ch];
-    let mut cr_plane = vec![0u8; cw * ch];
+// Chroma kernels. Per pixel, Cb = ((-43r - 85g + 128b + 128) >> 8) + 128 (arithmetic
+// shift); Cr likewise with (128, -107, -21). Adding 127·256 before the shift keeps the
+// sum in 0..=65280, so vector kernels work in u16 lanes with a logical shift and add
+// the 1 left over (127 + 1 = 128) per pixel into the rounding: a full 2×2 window
+// gives (Σ' + 4 + 2) >> 2.
 
-    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-    let use_sse2 = is_x86_feature_detected!("sse2");
-    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-    let use_sse2 = false;
-    #[cfg(target_arch = "arm")]
-    let use_neon = is_arm_feature_detected!("neon");
-    #[cfg(target_arch = "aarch64")]
-    let use_neon = true;
-    #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-    let use_neon = false;
+/// Biased Cb' = Cb - 1 of one pixel (see above), in 0..=255.
+#[inline(always)]
+fn cb_biased(r: i32, g: i32, b: i32) -> i32 {
+    (128 * b + 32640 - 43 * r - 85 * g) >> 8
+}
 
-    // Full-res Y in integer fixed-point (BT.601 full-range) with SIMD row kernels.
-    if npix >= PARALLEL_ENCODE_PIXELS_THRESHOLD {
-        y_plane
-            .par_chunks_mut(w)
-            .enumerate()
-            .for_each(|(py, y_row)| {
-                let src_row = &image[(py * w * 3)..((py + 1) * w * 3)];
-                if use_sse2 {
-                    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-                    unsafe { rgb_to_y_row_sse2(src_row, y_row, w) }
-                    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-                    rgb_to_y_row_scalar(src_row, y_row, w);
-                } else if use_neon {
-                    #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
-                    unsafe { rgb_to_y_row_neon(src_row, y_row, w) }
-                    #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-                    rgb_to_y_row_scalar(src_row, y_row, w);
-                } else {
-                    rgb_to_y_row_scalar(src_row, y_row, w);
-                }
-            });
-    } else {
-        y_plane
-            .chunks_mut(w)
-            .enumerate()
-            .for_each(|(py, y_row)| {
-                let src_row = &image[(py * w * 3)..((py + 1) * w * 3)];
-                if use_sse2 {
-                    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-                    unsafe { rgb_to_y_row_sse2(src_row, y_row, w) }
-                    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-                    rgb_to_y_row_scalar(src_row, y_row, w);
-                } else if use_neon {
-                    #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
-                    unsafe { rgb_to_y_row_neon(src_row, y_row, w) }
-                    #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-                    rgb_to_y_row_scalar(src_row, y_row, w);
-                } else {
-                    rgb_to_y_row_scalar(src_row, y_row, w);
-                }
-            });
-    }
+/// Biased Cr' = Cr - 1 of one pixel, in 0..=255.
+#[inline(always)]
+fn cr_biased(r: i32, g: i32, b: i32) -> i32 {
+    (128 * r + 32640 - 107 * g - 21 * b) >> 8
+}
 
-    // Subsampled Cb/Cr: 2x2 box average.
-    if npix >= PARALLEL_ENCODE_PIXELS_THRESHOLD {
-        cb_plane
-            .par_chunks_mut(cw)
-            .zip(cr_plane.par_chunks_mut(cw))
-            .enumerate()
-            .for_each(|(cy, (cb_row, cr_row))| {
-                for cx in 0..cw {
-                    let mut sum_cb = 0i32;
-                    let mut sum_cr = 0i32;
-                    let mut count = 0i32;
-                    for dy in 0..2usize {
-                        for dx in 0..2usize {
-                            let px = cx * 2 + dx;
-                            let py = cy * 2 + dy;
-                            if px < w && py < h {
-                                let base = (py * w + px) * 3;
-                                let r = image[base] as i32;
-                                let g = image[base + 1] as i32;
-                                let b = image[base + 2] as i32;
-                                sum_cb += ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
-                                sum_cr += ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
-                                count += 1;
-                            }
-                        }
-                    }
-                    cb_row[cx] = clamp_u8((sum_cb + (count >> 1)) / count);
-                    cr_row[cx] = clamp_u8((sum_cr + (count >> 1)) / count);
-                }
-            });
-    } else {
-        for cy in 0..ch {
-            for cx in 0..cw {
-                let mut sum_cb = 0i32;
-                let mut sum_cr = 0i32;
-                let mut count = 0i32;
-                for dy in 0..2usize {
-                    for dx in 0..2usize {
-                        let px = cx * 2 + dx;
-                        let py = cy * 2 + dy;
-                        if px < w && py < h {
-                            let base = (py * w + px) * 3;
-                            let r = image[base] as i32;
-                            let g = image[base + 1] as i32;
-                            let b = image[base + 2] as i32;
-                            sum_cb += ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
-                            sum_cr += ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
-                            count += 1;
-                        }
-                    }
-                }
-                cb_plane[cy * cw + cx] = clamp_u8((sum_cb + (count >> 1)) / count);
-                cr_plane[cy * cw + cx] = clamp_u8((sum_cr + (count >> 1)) / count);
+/// Chroma columns `from..to` of a full row pair: every 2×2 window lies inside the image.
+#[inline]
+fn cbcr_pairs_scalar<const BPP: usize, const RED: usize>(
+    row0: &[u8],
+    row1: &[u8],
+    cb_row: &mut [u8],
+    cr_row: &mut [u8],
+    from: usize,
+    to: usize,
+) {
+    for cx in from..to {
+        let (mut sum_cb, mut sum_cr) = (0i32, 0i32);
+        for row in [row0, row1] {
+            for base in [cx * 2 * BPP, (cx * 2 + 1) * BPP] {
+                let (r, g, b) = (row[base + RED] as i32, row[base + 1] as i32, row[base + 2 - RED] as i32);
+                sum_cb += cb_biased(r, g, b);
+                sum_cr += cr_biased(r, g, b);
             }
         }
+        cb_row[cx] = clamp_u8((sum_cb + 6) >> 2);
+        cr_row[cx] = clamp_u8((sum_cr + 6) >> 2);
     }
+}
 
-    (y_plane, cb_plane, cr_plane)
+/// (cp·p + 127·256 - cm·m - cn·n) >> 8 in u16 lanes; wrapping arithmetic is exact
+/// because every partial sum stays in 0..=65280.
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+#[inline]
+#[target_feature(enable = "sse2")]
+unsafe fn chroma_biased_sse2(p: __m128i, m: __m128i, n: __m128i, cp: i16, cm: i16, cn: i16) -> __m128i {
+    let acc = _mm_add_epi16(_mm_mullo_epi16(p, _mm_set1_epi16(cp)), _mm_set1_epi16(32640u16 as i16));
+    let acc = _mm_sub_epi16(acc, _mm_mullo_epi16(m, _mm_set1_epi16(cm)));
+    _mm_srli_epi16(_mm_sub_epi16(acc, _mm_mullo_epi16(n, _mm_set1_epi16(cn))), 8)
 }
 
-/// Convert interleaved RGBA (4 bytes/pixel) to Y, Cb, Cr, A planes.
-/// Y/Cb/Cr same as rgb_to_ycbcr420. A is full resolution.
-pub fn rgba_to_ycbcr420a(image: &[u8], w: usize, h: usize) -> (Vec<u8>, Vec<u8>, Vec<u8>, Vec<u8>) {
-    let npix = w * h;
-    let cw = (w + 1) / 2;
-    let ch = (h + 1) / 2;
+/// Biased Cb' and Cr' of 16 pixels as u16 lanes: [Cb 0–7, Cb 8–15, Cr 0–7, Cr 8–15].
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+#[inline]
+#[target_feature(enable = "sse2")]
+unsafe fn cbcr16_sse2<const BPP: usize, const RED: usize>(row: &[u8]) -> [__m128i; 4] {
+    let mut rv = [0u8; 16];
+    let mut gv = [0u8; 16];
+    let mut bv = [0u8; 16];
+    for i in 0..16 {
+        let j = i * BPP;
+        rv[i] = row[j + RED];
+        gv[i] = row[j + 1];
+        bv[i] = row[j + 2 - RED];
+    }
+    let zero = _mm_setzero_si128();
+    let r8 = _mm_loadu_si128(rv.as_ptr() as *const __m128i);
+    let g8 = _mm_loadu_si128(gv.as_ptr() as *const __m128i);
+    let b8 = _mm_loadu_si128(bv.as_ptr() as *const __m128i);
+    let (r_lo, r_hi) = (_mm_unpacklo_epi8(r8, zero), _mm_unpackhi_epi8(r8, zero));
+    let (g_lo, g_hi) = (_mm_unpacklo_epi8(g8, zero), _mm_unpackhi_epi8(g8, zero));
+    let (b_lo, b_hi) = (_mm_unpacklo_epi8(b8, zero), _mm_unpackhi_epi8(b8, zero));
+    [
+        chroma_biased_sse2(b_lo, r_lo, g_lo, 128, 43, 85),
+        chroma_biased_sse2(b_hi, r_hi, g_hi, 128, 43, 85),
+        chroma_biased_sse2(r_lo, g_lo, b_lo, 128, 107, 21),
+        chroma_biased_sse2(r_hi, g_hi, b_hi, 128, 107, 21),
+    ]
+}
 
-    let mut y_plane  = vec![0u8; npix];
-    let mut cb_plane = vec![0u8; cw * ch];
-    let mut cr_plane = vec![0u8; cw * ch];
-    let mut a_plane  = vec![0u8; npix];
+/// 8 chroma samples from biased values of 16 pixels in two rows: vertical sum,
+/// horizontal pairs (madd), then (Σ' + 6) >> 2, packed to u8 in the low half.
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+#[inline]
+#[target_feature(enable = "sse2")]
+unsafe fn average2x2_sse2(t_lo: __m128i, t_hi: __m128i, b_lo: __m128i, b_hi: __m128i) -> __m128i {
+    let ones = _mm_set1_epi16(1);
+    let lo = _mm_madd_epi16(_mm_add_epi16(t_lo, b_lo), ones);
+    let hi = _mm_madd_epi16(_mm_add_epi16(t_hi, b_hi), ones);
+    let avg = _mm_srli_epi16(_mm_add_epi16(_mm_packs_epi32(lo, hi), _mm_set1_epi16(6)), 2);
+    _mm_packus_epi16(avg, _mm_setzero_si128())
+}
 
+/// Full-window chroma columns `0..pairs` of a row pair, 8 per step, then the
+/// remainder in scalar.
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+#[target_feature(enable = "sse2")]
+unsafe fn cbcr_pairs_sse2<const BPP: usize, const RED: usize>(
+    row0: &[u8],
+    row1: &[u8],
+    cb_row: &mut [u8],
+    cr_row: &mut [u8],
+    pairs: usize,
+) {
+    let mut cx = 0usize;
+    while cx + 8 <= pairs {
+        let at = cx * 2 * BPP;
+        let [cb_t0, cb_t1, cr_t0, cr_t1] = cbcr16_sse2::<BPP, RED>(&row0[at..at + 16 * BPP]);
+        let [cb_b0, cb_b1, cr_b0, cr_b1] = cbcr16_sse2::<BPP, RED>(&row1[at..at + 16 * BPP]);
+        _mm_storel_epi64(cb_row.as_mut_ptr().add(cx) as *mut __m128i, average2x2_sse2(cb_t0, cb_t1, cb_b0, cb_b1));
+        _mm_storel_epi64(cr_row.as_mut_ptr().add(cx) as *mut __m128i, average2x2_sse2(cr_t0, cr_t1, cr_b0, cr_b1));
+        cx += 8;
+    }
+    cbcr_pairs_scalar::<BPP, RED>(row0, row1, cb_row, cr_row, cx, pairs);
+}
+
+/// Biased Cb' and Cr' of 8 pixels as u16 lanes.
+#[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
+#[inline]
+#[target_feature(enable = "neon")]
+unsafe fn cbcr8_neon(r8: uint8x8_t, g8: uint8x8_t, b8: uint8x8_t) -> (uint16x8_t, uint16x8_t) {
+    let bias = vdupq_n_u16(32640);
+    let mut cb = vaddq_u16(vmull_u8(b8, vdup_n_u8(128)), bias);
+    cb = vmlsl_u8(cb, r8, vdup_n_u8(43));
+    cb = vmlsl_u8(cb, g8, vdup_n_u8(85));
+    let mut cr = vaddq_u16(vmull_u8(r8, vdup_n_u8(128)), bias);
+    cr = vmlsl_u8(cr, g8, vdup_n_u8(107));
+    cr = vmlsl_u8(cr, b8, vdup_n_u8(21));
+    (vshrq_n_u16(cb, 8), vshrq_n_u16(cr, 8))
+}
+
+/// NEON `average2x2_sse2`: 8 chroma samples from two rows of 16 biased values.
+#[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
+#[inline]
+#[target_feature(enable = "neon")]
+unsafe fn average2x2_neon(t0: uint16x8_t, t1: uint16x8_t, b0: uint16x8_t, b1: uint16x8_t) -> uint8x8_t {
+    let (s0, s1) = (vaddq_u16(t0, b0), vaddq_u16(t1, b1));
+    let pairs = vcombine_u16(
+        vpadd_u16(vget_low_u16(s0), vget_high_u16(s0)),
+        vpadd_u16(vget_low_u16(s1), vget_high_u16(s1)),
+    );
+    vqmovn_u16(vshrq_n_u16(vaddq_u16(pairs, vdupq_n_u16(6)), 2))
+}
+
+/// NEON `cbcr_pairs_sse2`.
+#[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
+#[target_feature(enable = "neon")]
+unsafe fn cbcr_pairs_neon<const BPP: usize, const RED: usize>(
+    row0: &[u8],
+    row1: &[u8],
+    cb_row: &mut [u8],
+    cr_row: &mut [u8],
+    pairs: usize,
+) {
+    // Top row pixels 0–15, then bottom row pixels 0–15.
+    let mut rv = [0u8; 32];
+    let mut gv = [0u8; 32];
+    let mut bv = [0u8; 32];
+    let mut cx = 0usize;
+    while cx + 8 <= pairs {
+        let at = cx * 2 * BPP;
+        for (k, row) in [row0, row1].into_iter().enumerate() {
+            let row = &row[at..at + 16 * BPP];
+            for i in 0..16 {
+                let j = i * BPP;
+                rv[k * 16 + i] = row[j + RED];
+                gv[k * 16 + i] = row[j + 1];
+                bv[k * 16 + i] = row[j + 2 - RED];
+            }
+        }
+        let (cb_t0, cr_t0) = cbcr8_neon(vld1_u8(rv.as_ptr()), vld1_u8(gv.as_ptr()), vld1_u8(bv.as_ptr()));
+        let (cb_t1, cr_t1) = cbcr8_neon(vld1_u8(rv.as_ptr().add(8)), vld1_u8(gv.as_ptr().add(8)), vld1_u8(bv.as_ptr().add(8)));
+        let (cb_b0, cr_b0) = cbcr8_neon(vld1_u8(rv.as_ptr().add(16)), vld1_u8(gv.as_ptr().add(16)), vld1_u8(bv.as_ptr().add(16)));
+        let (cb_b1, cr_b1) = cbcr8_neon(vld1_u8(rv.as_ptr().add(24)), vld1_u8(gv.as_ptr().add(24)), vld1_u8(bv.as_ptr().add(24)));
+        vst1_u8(cb_row.as_mut_ptr().add(cx), average2x2_neon(cb_t0, cb_t1, cb_b0, cb_b1));
+        vst1_u8(cr_row.as_mut_ptr().add(cx), average2x2_neon(cr_t0, cr_t1, cr_b0, cr_b1));
+        cx += 8;
+    }
+    cbcr_pairs_scalar::<BPP, RED>(row0, row1, cb_row, cr_row, cx, pairs);
+}
+
+/// Chroma row `cy`: 2×2 box average of per-pixel Cb/Cr over source rows 2cy and 2cy+1.
+/// Full windows go through the row-pair kernels; only the last column (odd width) and
+/// the last row (odd height) take the partial-window path.
+#[inline(always)]
+fn cbcr_row_t<const BPP: usize, const RED: usize>(
+    image: &[u8],
+    stride: usize,
+    w: usize,
+    h: usize,
+    cy: usize,
+    cb_row: &mut [u8],
+    cr_row: &mut [u8],
+    use_sse2: bool,
+    use_neon: bool,
+) {
+    let py = cy * 2;
+    let mut edge_from = 0;
+    if py + 1 < h {
+        let row0 = &image[py * stride..py * stride + w * BPP];
+        let row1 = &image[(py + 1) * stride..(py + 1) * stride + w * BPP];
+        let pairs = w / 2;
+        edge_from = pairs;
+        if use_sse2 {
+            #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+            unsafe { cbcr_pairs_sse2::<BPP, RED>(row0, row1, cb_row, cr_row, pairs) }
+        } else if use_neon {
+            #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
+            unsafe { cbcr_pairs_neon::<BPP, RED>(row0, row1, cb_row, cr_row, pairs) }
+        } else {
+            cbcr_pairs_scalar::<BPP, RED>(row0, row1, cb_row, cr_row, 0, pairs);
+        }
+    }
+    for cx in edge_from..cb_row.len() {
+        let mut sum_cb = 0i32;
+        let mut sum_cr = 0i32;
+        let mut count = 0i32;
+        for dy in 0..2usize {
+            for dx in 0..2usize {
+                let px = cx * 2 + dx;
+                let py = cy * 2 + dy;
+                if px < w && py < h {
+                    let base = py * stride + px * BPP;
+                    let r = image[base + RED] as i32;
+                    let g = image[base + 1] as i32;
+                    let b = image[base + 2 - RED] as i32;
+                    sum_cb += ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+                    sum_cr += ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+                    count += 1;
+                }
+            }
+        }
+        cb_row[cx] = clamp_u8((sum_cb + (count >> 1)) / count);
+        cr_row[cx] = clamp_u8((sum_cr + (count >> 1)) / count);
+    }
+}
+
+/// (SSE2, NEON) availability for the Y row kernels.
+fn row_kernels() -> (bool, bool) {
     #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
     let use_sse2 = is_x86_feature_detected!("sse2");
     #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
@@ -996,115 +1000,193 @@ pub fn rgba_to_ycbcr420a(image: &[u8], w: usize, h: usize) -> (Vec<u8>, Vec<u8>,
     let use_neon = true;
     #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
     let use_neon = false;
+    (use_sse2, use_neon)
+}
 
-    if npix >= PARALLEL_ENCODE_PIXELS_THRESHOLD {
-        y_plane
-            .par_chunks_mut(w)
-            .zip(a_plane.par_chunks_mut(w))
-            .enumerate()
-            .for_each(|(py, (y_row, a_row))| {
-                let src_row = &image[(py * w * 4)..((py + 1) * w * 4)];
-                if use_sse2 {
-                    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-                    unsafe { rgba_to_ya_row_sse2(src_row, y_row, a_row, w) }
-                    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-                    rgba_to_ya_row_scalar(src_row, y_row, a_row, w);
-                } else if use_neon {
-                    #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
-                    unsafe { rgba_to_ya_row_neon(src_row, y_row, a_row, w) }
-                    #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-                    rgba_to_ya_row_scalar(src_row, y_row, a_row, w);
-                } else {
-                    rgba_to_ya_row_scalar(src_row, y_row, a_row, w);
-                }
-            });
-    } else {
-        y_plane
-            .chunks_mut(w)
-            .zip(a_plane.chunks_mut(w))
-            .enumerate()
-            .for_each(|(py, (y_row, a_row))| {
-                let src_row = &image[(py * w * 4)..((py + 1) * w * 4)];
-                if use_sse2 {
-                    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-                    unsafe { rgba_to_ya_row_sse2(src_row, y_row, a_row, w) }
-                    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-                    rgba_to_ya_row_scalar(src_row, y_row, a_row, w);
-                } else if use_neon {
-                    #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
-                    unsafe { rgba_to_ya_row_neon(src_row, y_row, a_row, w) }
-                    #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-                    rgba_to_ya_row_scalar(src_row, y_row, a_row, w);
-                } else {
-                    rgba_to_ya_row_scalar(src_row, y_row, a_row, w);
-                }
-            });
+fn pixels_to_ycbcr420_t<const BPP: usize, const RED: usize, const ALPHA: bool>(
+    image: &[u8],
+    w: usize,
+    h: usize,
+    stride: usize,
+) -> (Vec<u8>, Vec<u8>, Vec<u8>, Option<Vec<u8>>) {
+    let npix = w * h;
+    let cw = (w + 1) / 2;
+    let ch = (h + 1) / 2;
+
+    let mut y_plane  = vec![0u8; npix];
+    let mut cb_plane = vec![0u8; cw * ch];
+    let mut cr_plane = vec![0u8; cw * ch];
+    let mut a_plane  = vec![0u8; if ALPHA { npix } else { 0 }];
+    let (use_sse2, use_neon) = row_kernels();
+
+    // Full-res Y (and A) in integer fixed-point (BT.601 full-range) with SIMD row kernels.
+    let parallel = npix >= PARALLEL_ENCODE_PIXELS_THRESHOLD;
+    let src = |py: usize| &image[py * stride..py * stride + w * BPP];
+    let y_row = |py: usize, y_row: &mut [u8]| y_row_t::<BPP, RED, false>(src(py), y_row, &mut [], w, use_sse2, use_neon);
+    let ya_row = |(py, (y_row, a_row)): (usize, (&mut [u8], &mut [u8]))| {
+        y_row_t::<BPP, RED, true>(src(py), y_row, a_row, w, use_sse2, use_neon)
+    };
+    match (ALPHA, parallel) {
+        (false, true) => y_plane.par_chunks_mut(w).enumerate().for_each(|(py, r)| y_row(py, r)),
+        (false, false) => y_plane.chunks_mut(w).enumerate().for_each(|(py, r)| y_row(py, r)),
+        (true, true) => y_plane.par_chunks_mut(w).zip(a_plane.par_chunks_mut(w)).enumerate().for_each(ya_row),
+        (true, false) => y_plane.chunks_mut(w).zip(a_plane.chunks_mut(w)).enumerate().for_each(ya_row),
     }
 
-    if npix >= PARALLEL_ENCODE_PIXELS_THRESHOLD {
-        cb_plane
-            .par_chunks_mut(cw)
-            .zip(cr_plane.par_chunks_mut(cw))
-            .enumerate()
-            .for_each(|(cy, (cb_row, cr_row))| {
-                for cx in 0..cw {
-                    let mut sum_cb = 0i32;
-                    let mut sum_cr = 0i32;
-                    let mut count = 0i32;
-                    for dy in 0..2usize {
-                        for dx in 0..2usize {
-                            let px = cx * 2 + dx;
-                            let py = cy * 2 + dy;
-                            if px < w && py < h {
-                                let base = (py * w + px) * 4;
-                                let r = image[base] as i32;
-                                let g = image[base + 1] as i32;
-                                let b = image[base + 2] as i32;
-                                sum_cb += ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
-                                sum_cr += ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
-                                count += 1;
-                            }
-                        }
-                    }
-                    cb_row[cx] = clamp_u8((sum_cb + (count >> 1)) / count);
-                    cr_row[cx] = clamp_u8((sum_cr + (count >> 1)) / count);
-                }
-            });
+    // Subsampled Cb/Cr: 2x2 box average.
+    let cbcr_row = |(cy, (cb_row, cr_row)): (usize, (&mut [u8], &mut [u8]))| {
+        cbcr_row_t::<BPP, RED>(image, stride, w, h, cy, cb_row, cr_row, use_sse2, use_neon)
+    };
+    if parallel {
+        cb_plane.par_chunks_mut(cw).zip(cr_plane.par_chunks_mut(cw)).enumerate().for_each(cbcr_row);
     } else {
-        for cy in 0..ch {
-            for cx in 0..cw {
-                let mut sum_cb = 0i32;
-                let mut sum_cr = 0i32;
-                let mut count = 0i32;
-                for dy in 0..2usize {
-                    for dx in 0..2usize {
-                        let px = cx * 2 + dx;
-                        let py = cy * 2 + dy;
-                        if px < w && py < h {
-                            let base = (py * w + px) * 4;
-                            let r = image[base] as i32;
-                            let g = image[base + 1] as i32;
-                            let b = image[base + 2] as i32;
-                            sum_cb += ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
-                            sum_cr += ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
-                            count += 1;
-                        }
-                    }
-                }
-                cb_plane[cy * cw + cx] = clamp_u8((sum_cb + (count >> 1)) / count);
-                cr_plane[cy * cw + cx] = clamp_u8((sum_cr + (count >> 1)) / count);
-            }
+        cb_plane.chunks_mut(cw).zip(cr_plane.chunks_mut(cw)).enumerate().for_each(cbcr_row);
+    }
+
+    (y_plane, cb_plane, cr_plane, ALPHA.then_some(a_plane))
+}
+
+/// Convert interleaved `fmt` pixels, rows `stride` bytes apart, to Y (w×h), Cb and Cr
+/// (((w+1)/2) × ((h+1)/2)) and, for RGBA/BGRA, A (w×h). The padding byte of
+/// RGBX/BGRX is ignored.
+pub fn pixels_to_ycbcr420(
+    image: &[u8],
+    w: usize,
+    h: usize,
+    fmt: PixelFormat,
+    stride: usize,
+) -> (Vec<u8>, Vec<u8>, Vec<u8>, Option<Vec<u8>>) {
+    match fmt {
+        PixelFormat::Rgb => pixels_to_ycbcr420_t::<3, 0, false>(image, w, h, stride),
+        PixelFormat::Bgr => pixels_to_ycbcr420_t::<3, 2, false>(image, w, h, stride),
+        PixelFormat::Rgba => pixels_to_ycbcr420_t::<4, 0, true>(image, w, h, stride),
+        PixelFormat::Bgra => pixels_to_ycbcr420_t::<4, 2, true>(image, w, h, stride),
+        PixelFormat::Rgbx => pixels_to_ycbcr420_t::<4, 0, false>(image, w, h, stride),
+        PixelFormat::Bgrx => pixels_to_ycbcr420_t::<4, 2, false>(image, w, h, stride),
+    }
+}
+
+/// Level-shifted 8×8 blocks of Y, Cb, Cr and (RGBA/BGRA) A, each in block-row order:
+/// what `Blockizer` would cut from the `pixels_to_ycbcr420` planes.
+pub struct YcbcrBlocks {
+    pub y: Vec<Block>,
+    pub cb: Vec<Block>,
+    pub cr: Vec<Block>,
+    pub a: Option<Vec<Block>>,
+}
+
+/// One 16-row band's blocks: two luma block rows (Y, A) and one chroma block row.
+type BandBlocks<'a> = (&'a mut [Block], &'a mut [Block], &'a mut [Block], Option<&'a mut [Block]>);
+
+fn pixels_to_ycbcr420_blocks_t<const BPP: usize, const RED: usize, const ALPHA: bool>(
+    image: &[u8],
+    w: usize,
+    h: usize,
+    stride: usize,
+) -> YcbcrBlocks {
+    let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+    let (bw, cbw) = ((w + 7) / 8, (cw + 7) / 8);
+    let luma_blocks = bw * ((h + 7) / 8);
+    let chroma_blocks = cbw * ((ch + 7) / 8);
+    let mut y = vec![Block::new(); luma_blocks];
+    let mut cb = vec![Block::new(); chroma_blocks];
+    let mut cr = vec![Block::new(); chroma_blocks];
+    let mut a = vec![Block::new(); if ALPHA { luma_blocks } else { 0 }];
+    let (use_sse2, use_neon) = row_kernels();
+
+    // Each band converts its 16 rows with the plane kernels into band-sized scratch
+    // (cache resident) and blockizes it; no full-size u8 plane is written.
+    let band = |(b, (yb, cbb, crb, ab)): (usize, BandBlocks)| {
+        let rows = (h - b * 16).min(16);
+        let crows = (rows + 1) / 2;
+        let mut ys = vec![0u8; rows * w];
+        let mut as_ = vec![0u8; if ALPHA { rows * w } else { 0 }];
+        for (r, y_row) in ys.chunks_mut(w).enumerate() {
+            let py = b * 16 + r;
+            let src = &image[py * stride..py * stride + w * BPP];
+            let a_row = if ALPHA { &mut as_[r * w..(r + 1) * w] } else { &mut [][..] };
+            y_row_t::<BPP, RED, ALPHA>(src, y_row, a_row, w, use_sse2, use_neon);
+        }
+        let (mut cbs, mut crs) = (vec![0u8; crows * cw], vec![0u8; crows * cw]);
+        for (r, (cb_row, cr_row)) in cbs.chunks_mut(cw).zip(crs.chunks_mut(cw)).enumerate() {
+            cbcr_row_t::<BPP, RED>(image, stride, w, h, b * 8 + r, cb_row, cr_row, use_sse2, use_neon);
+        }
+        let luma = Blockizer::new(w, rows);
+        luma.fill_blocks_strided(&ys, w, yb);
+        if let Some(ab) = ab {
+            luma.fill_blocks_strided(&as_, w, ab);
         }
+        let chroma = Blockizer::new(cw, crows);
+        chroma.fill_blocks_strided(&cbs, cw, cbb);
+        chroma.fill_blocks_strided(&crs, cw, crb);
+    };
+    let a_bands = a.chunks_mut(2 * bw).map(Some).chain(std::iter::repeat_with(|| None));
+    let bands: Vec<BandBlocks> = y
+        .chunks_mut(2 * bw)
+        .zip(cb.chunks_mut(cbw))
+        .zip(cr.chunks_mut(cbw))
+        .zip(a_bands)
+        .map(|(((yb, cbb), crb), ab)| (yb, cbb, crb, ab))
+        .collect();
+    if w * h >= PARALLEL_ENCODE_PIXELS_THRESHOLD {
+        bands.into_par_iter().enumerate().for_each(band);
+    } else {
+        bands.into_iter().enumerate().for_each(band);
     }
 
-    (y_plane, cb_plane, cr_plane, a_plane)
+    YcbcrBlocks { y, cb, cr, a: ALPHA.then_some(a) }
 }
 
-/// Reconstruct interleaved RGB from Y (w×h), Cb and Cr ((cw)×(ch)) planes.
+/// Fused `pixels_to_ycbcr420` + blockization: interleaved `fmt` pixels, rows `stride`
+/// bytes apart, straight to level-shifted Y, Cb, Cr (and A) blocks, 16 rows at a time.
+pub fn pixels_to_ycbcr420_blocks(image: &[u8], w: usize, h: usize, fmt: PixelFormat, stride: usize) -> YcbcrBlocks {
+    match fmt {
+        PixelFormat::Rgb => pixels_to_ycbcr420_blocks_t::<3, 0, false>(image, w, h, stride),
+        PixelFormat::Bgr => pixels_to_ycbcr420_blocks_t::<3, 2, false>(image, w, h, stride),
+        PixelFormat::Rgba => pixels_to_ycbcr420_blocks_t::<4, 0, true>(image, w, h, stride),
+        PixelFormat::Bgra => pixels_to_ycbcr420_blocks_t::<4, 2, true>(image, w, h, stride),
+        PixelFormat::Rgbx => pixels_to_ycbcr420_blocks_t::<4, 0, false>(image, w, h, stride),
+        PixelFormat::Bgrx => pixels_to_ycbcr420_blocks_t::<4, 2, false>(image, w, h, stride),
+    }
+}
+
+/// Convert interleaved RGB (3 bytes/pixel) to separate Y, Cb, Cr planes.
+/// Y is full resolution (w×h). Cb and Cr are 4:2:0 subsampled: ((w+1)/2) × ((h+1)/2).
+/// Returns (Y, Cb, Cr).
+pub fn rgb_to_ycbcr420(image: &[u8], w: usize, h: usize) -> (Vec<u8>, Vec<u8>, Vec<u8>) {
+    let (y, cb, cr, _) = pixels_to_ycbcr420_t::<3, 0, false>(image, w, h, w * 3);
+    (y, cb, cr)
+}
+
+/// Convert interleaved RGBA (4 bytes/pixel) to Y, Cb, Cr, A planes.
+/// Y/Cb/Cr same as rgb_to_ycbcr420. A is full resolution.
+pub fn rgba_to_ycbcr420a(image: &[u8], w: usize, h: usize) -> (Vec<u8>, Vec<u8>, Vec<u8>, Vec<u8>) {
+    let (y, cb, cr, a) = pixels_to_ycbcr420_t::<4, 0, true>(image, w, h, w * 4);
+    (y, cb, cr, a.unwrap_or_default())
+}
+
+/// Reconstruct interleaved `fmt` pixels from Y (w×h), Cb and Cr ((cw)×(ch)) planes and
+/// an optional A plane (w×h; 255 when absent or ignored by `fmt`). Output rows start
+/// `stride` bytes apart; bytes past each row's pixels are left untouched.
 /// Cb/Cr are upsampled with nearest-neighbor (fast, matches JPEG baseline).
-pub fn ycbcr420_to_rgb(y: &[u8], cb: &[u8], cr: &[u8], w: usize, _h: usize, out: &mut [u8]) {
+pub fn ycbcr420_to_pixels(
+    y: &[u8],
+    cb: &[u8],
+    cr: &[u8],
+    a: Option<&[u8]>,
+    w: usize,
+    fmt: PixelFormat,
+    out: &mut [u8],
+    stride: usize,
+) {
+    if w == 0 || y.len() < w {
+        return;
+    }
     let cw = (w + 1) / 2;
     let h = y.len() / w;
+    let row_bytes = w * fmt.bytes_per_pixel();
+    let a = if fmt.has_alpha() { a } else { None };
+    let out = &mut out[..stride * (h - 1) + row_bytes];
     #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
     let use_avx512 = is_x86_feature_detected!("avx512f");
     #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
@@ -1124,114 +1206,118 @@ pub fn ycbcr420_to_rgb(y: &[u8], cb: &[u8], cr: &[u8], w: usize, _h: usize, out:
     #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
     let use_neon = false;
     let decode_row = |py: usize, out_row: &mut [u8]| {
+        let out_row = &mut out_row[..row_bytes];
         let y_row = py * w;
         let c_row = (py / 2) * cw;
         let y_slice = &y[y_row..y_row + w];
         let cb_slice = &cb[c_row..c_row + cw];
         let cr_slice = &cr[c_row..c_row + cw];
+        let a_slice = a.map(|a| &a[y_row..y_row + w]);
         if use_avx512 || use_avx2 {
             #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
             unsafe {
-                ycbcr420_to_rgb_row_avx2(y_slice, cb_slice, cr_slice, w, out_row);
+                ycbcr420_row_avx2(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
             }
             #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-            ycbcr420_to_rgb_row_scalar(y_slice, cb_slice, cr_slice, w, out_row);
+            ycbcr420_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
         } else if use_sse2 {
             #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
             unsafe {
-                ycbcr420_to_rgb_row_sse2(y_slice, cb_slice, cr_slice, w, out_row);
+                ycbcr420_row_sse2(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
             }
             #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-            ycbcr420_to_rgb_row_scalar(y_slice, cb_slice, cr_slice, w, out_row);
+            ycbcr420_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
         } else {
             if use_neon {
                 #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
                 unsafe {
-                    ycbcr420_to_rgb_row_neon(y_slice, cb_slice, cr_slice, w, out_row);
+                    ycbcr420_row_neon(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
                 }
                 #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-                ycbcr420_to_rgb_row_scalar(y_slice, cb_slice, cr_slice, w, out_row);
+                ycbcr420_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
             } else {
-                ycbcr420_to_rgb_row_scalar(y_slice, cb_slice, cr_slice, w, out_row);
+                ycbcr420_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, fmt, out_row);
             }
         }
     };
 
     if w * h >= PARALLEL_DECODE_PIXELS_THRESHOLD {
-        out.par_chunks_mut(w * 3)
+        out.par_chunks_mut(stride)
             .enumerate()
             .for_each(|(py, out_row)| decode_row(py, out_row));
     } else {
-        out.chunks_mut(w * 3)
+        out.chunks_mut(stride)
             .enumerate()
             .for_each(|(py, out_row)| decode_row(py, out_row));
     }
 }
 
+/// Like `ycbcr420_to_pixels`, with Cb and Cr at full resolution (w per row). Used for
+/// downscaled decodes, where the image is small.
+pub fn ycbcr444_to_pixels(
+    y: &[u8],
+    cb: &[u8],
+    cr: &[u8],
+    a: Option<&[u8]>,
+    w: usize,
+    fmt: PixelFormat,
+    out: &mut [u8],
+    stride: usize,
+) {
+    let bpp = fmt.bytes_per_pixel();
+    let a = if fmt.has_alpha() { a } else { None };
+    for (row, out_row) in out.chunks_mut(stride).enumerate().take(y.len() / w.max(1)) {
+        let o = row * w;
+        for (i, px) in out_row[..w * bpp].chunks_exact_mut(bpp).enumerate() {
+            let yi = y[o + i] as i32;
+            let cbi = cb[o + i] as i32 - 128;
+            let cri = cr[o + i] as i32 - 128;
+            let (r, g, b) = (
+                clamp_u8(yi + ((359 * cri) >> 8)),
+                clamp_u8(yi - ((88 * cbi + 183 * cri) >> 8)),
+                clamp_u8(yi + ((454 * cbi) >> 8)),
+            );
+            let (r, b) = if fmt.is_bgr() { (b, r) } else { (r, b) };
+            px[0] = r;
+            px[1] = g;
+            px[2] = b;
+            if bpp == 4 {
+                px[3] = a.map_or(255, |a| a[o + i]);
+            }
+        }
+    }
+}
+
+/// Reconstruct interleaved RGB from Y (w×h), Cb and Cr ((cw)×(ch)) planes.
+pub fn ycbcr420_to_rgb(y: &[u8], cb: &[u8], cr: &[u8], w: usize, _h: usize, out: &mut [u8]) {
+    ycbcr420_to_pixels(y, cb, cr, None, w, PixelFormat::Rgb, out, w * 3);
+}
+
 /// Reconstruct interleaved RGBA from Y, Cb, Cr, A planes.
 pub fn ycbcr420a_to_rgba(y: &[u8], cb: &[u8], cr: &[u8], a: &[u8], w: usize, _h: usize, out: &mut [u8]) {
-    let cw = (w + 1) / 2;
-    let h = y.len() / w;
-    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-    let use_avx512 = is_x86_feature_detected!("avx512f");
-    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-    let use_avx512 = false;
-    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-    let use_avx2 = is_x86_feature_detected!("avx2");
-    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-    let use_avx2 = false;
-    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-    let use_sse2 = is_x86_feature_detected!("sse2");
-    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-    let use_sse2 = false;
-    #[cfg(target_arch = "arm")]
-    let use_neon = is_arm_feature_detected!("neon");
-    #[cfg(target_arch = "aarch64")]
-    let use_neon = true;
-    #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-    let use_neon = false;
-    let decode_row = |py: usize, out_row: &mut [u8]| {
-        let y_row = py * w;
-        let c_row = (py / 2) * cw;
-        let y_slice = &y[y_row..y_row + w];
-        let cb_slice = &cb[c_row..c_row + cw];
-        let cr_slice = &cr[c_row..c_row + cw];
-        let a_slice = &a[y_row..y_row + w];
-        if use_avx512 || use_avx2 {
-            #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-            unsafe {
-                ycbcr420a_to_rgba_row_avx2(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
-            }
-            #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-            ycbcr420a_to_rgba_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
-        } else if use_sse2 {
-            #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
-            unsafe {
-                ycbcr420a_to_rgba_row_sse2(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
-            }
-            #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
-            ycbcr420a_to_rgba_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
-        } else {
-            if use_neon {
-                #[cfg(any(target_arch = "arm", target_arch = "aarch64"))]
-                unsafe {
-                    ycbcr420a_to_rgba_row_neon(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
-                }
-                #[cfg(not(any(target_arch = "arm", target_arch = "aarch64")))]
-                ycbcr420a_to_rgba_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
+    ycbcr420_to_pixels(y, cb, cr, Some(a), w, PixelFormat::Rgba, out, w * 4);
+}
+
+/// Rewrite tightly packed 1/3/4-channel pixels as `fmt` with rows `stride` bytes apart.
+/// Gray is replicated to R, G and B; missing alpha becomes 255.
+pub fn repack_pixels(src: &[u8], channels: usize, w: usize, h: usize, fmt: PixelFormat, out: &mut [u8], stride: usize) {
+    let bpp = fmt.bytes_per_pixel();
+    let alpha = fmt.has_alpha();
+    for (src_row, out_row) in src.chunks_exact(w * channels).take(h).zip(out.chunks_mut(stride)) {
+        for (s, d) in src_row.chunks_exact(channels).zip(out_row[..w * bpp].chunks_exact_mut(bpp)) {
+            let (r, g, b) = if channels >= 3 { (s[0], s[1], s[2]) } else { (s[0], s[0], s[0]) };
+            let a = if channels == 4 && alpha { s[3] } else { 255 };
+            if fmt.is_bgr() {
+                d[0] = b;
+                d[2] = r;
             } else {
-                ycbcr420a_to_rgba_row_scalar(y_slice, cb_slice, cr_slice, a_slice, w, out_row);
+                d[0] = r;
+                d[2] = b;
+            }
+            d[1] = g;
+            if bpp == 4 {
+                d[3] = a;
             }
         }
-    };
-
-    if w * h >= PARALLEL_DECODE_PIXELS_THRESHOLD {
-        out.par_chunks_mut(w * 4)
-            .enumerate()
-            .for_each(|(py, out_row)| decode_row(py, out_row));
-    } else {
-        out.chunks_mut(w * 4)
-            .enumerate()
-            .for_each(|(py, out_row)| decode_row(py, out_row));
     }
 }
@@ -0,0 +1,208 @@
+//! Chunked .bg container (version 20).
+//!
+//! Layout:
+//!   [0..12)   standard header: "BG" + 20 + width(u32 LE) + height(u32 LE) + quality(u8)
+//!   [12]      plane profile: the v4..v19 version byte whose plane coding is used
+//!   [13]      flags (reserved, 0)
+//!   [14..16)  chunk count (u16 LE)
+//!   [16..)    TOC: chunk count × 16-byte entries
+//!             tag[4] + offset(u32 LE, absolute) + length(u32 LE) + info(u32 LE)
+//!   ...       chunk payloads, in TOC order
+//!
+//! The TOC sits at a fixed position right after the header, so a reader that has
+//! only the first `toc_size()` bytes (a single range request) knows where every
+//! plane, table and trailer lives. Unknown tags are skipped.
+
+use crate::bitstream;
+
+pub const BG_VERSION_CHUNKED: u8 = 20;
+pub const CONTAINER_HEADER_SIZE: usize = 16;
+pub const TOC_ENTRY_SIZE: usize = 16;
+
+/// Entropy-coded plane payload (no length prefix). info = plane index (0=Y 1=Cb 2=Cr 3=A).
+pub const TAG_PLANE: [u8; 4] = *b"PLNE";
+/// ICC profile bytes.
+pub const TAG_ICC: [u8; 4] = *b"ICCP";
+/// Quantization table: 64 × u16 LE in natural (row-major) order. info = 0 luma, 1 chroma.
+/// When present the decoder uses it instead of deriving the table from profile + quality.
+pub const TAG_QUANT: [u8; 4] = *b"DQT ";
+pub const QUANT_TABLE_LUMA: u32 = 0;
+pub const QUANT_TABLE_CHROMA: u32 = 1;
+pub const QUANT_TABLE_SIZE: usize = 64 * 2;
+/// Most a v20 stream (no ICC) can exceed the v18/v19 stream of the same planes by:
+/// the longer header, one TOC entry per chunk (two `DQT ` plus up to four planes) and
+/// both tables. The dropped plane length prefixes only add slack. Mirrored by
+/// BITGRAIN_CHUNKED_BOUND_EXTRA in c/config.h.
+pub const CHUNKED_BOUND_EXTRA: usize = CONTAINER_HEADER_SIZE - 12 + 6 * TOC_ENTRY_SIZE + 2 * QUANT_TABLE_SIZE;
+/// Segment index (reserved, not yet written or read: restart-point offsets inside planes).
+pub const TAG_SEGMENT_INDEX: [u8; 4] = *b"SIDX";
+/// Embedded preview (reserved, not yet written or read: a smaller .bg stream).
+pub const TAG_PREVIEW: [u8; 4] = *b"PREV";
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct Chunk {
+    pub tag: [u8; 4],
+    pub offset: u32,
+    pub length: u32,
+    pub info: u32,
+}
+
+/// Parsed header + TOC. Chunk data is borrowed from the input buffer.
+pub struct Container<'a> {
+    pub width: u32,
+    pub height: u32,
+    pub quality: u8,
+    pub profile: u8,
+    pub chunks: Vec<Chunk>,
+    buf: &'a [u8],
+}
+
+/// Bytes needed to read the header and the whole TOC. Needs the first 16 bytes.
+pub fn toc_size(buf: &[u8]) -> Option<usize> {
+    if buf.len() < CONTAINER_HEADER_SIZE || buf[0] != b'B' || buf[1] != b'G' || buf[2] != BG_VERSION_CHUNKED {
+        return None;
+    }
+    let count = u16::from_le_bytes([buf[14], buf[15]]) as usize;
+    Some(CONTAINER_HEADER_SIZE + count * TOC_ENTRY_SIZE)
+}
+
+/// Parse the TOC only. Works on a prefix of the file (at least `toc_size()` bytes);
+/// chunk bounds are not checked against the buffer.
+pub fn read_toc(buf: &[u8]) -> Option<Vec<Chunk>> {
+    let need = toc_size(buf)?;
+    if buf.len() < need {
+        return None;
+    }
+    let rd = |p: usize| u32::from_le_bytes(buf[p..p + 4].try_into().unwrap());
+    let count = (need - CONTAINER_HEADER_SIZE) / TOC_ENTRY_SIZE;
+    let mut chunks = Vec::with_capacity(count);
+    for i in 0..count {
+        let e = CONTAINER_HEADER_SIZE + i * TOC_ENTRY_SIZE;
+        chunks.push(Chunk {
+            tag: buf[e..e + 4].try_into().unwrap(),
+            offset: rd(e + 4),
+            length: rd(e + 8),
+            info: rd(e + 12),
+        });
+    }
+    Some(chunks)
+}
+
+impl<'a> Container<'a> {
+    /// Parse a complete container. Every chunk must lie inside `buf`.
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        let chunks = read_toc(buf)?;
+        for c in &chunks {
+            let end = (c.offset as usize).checked_add(c.length as usize)?;
+            if end > buf.len() {
+                return None;
+            }
+        }
+        Some(Self {
+            width: u32::from_le_bytes(buf[3..7].try_into().unwrap()),
+            height: u32::from_le_bytes(buf[7..11].try_into().unwrap()),
+            quality: buf[11],
+            profile: buf[12],
+            chunks,
+            buf,
+        })
+    }
+
+    /// First chunk with this tag and info value.
+    pub fn find(&self, tag: [u8; 4], info: u32) -> Option<&'a [u8]> {
+        self.chunks
+            .iter()
+            .find(|c| c.tag == tag && c.info == info)
+            .map(|c| &self.buf[c.offset as usize..c.offset as usize + c.length as usize])
+    }
+}
+
+/// Serialize a quant table as a `DQT ` chunk payload.
+pub fn quant_table_bytes(table: &[i16; 64]) -> [u8; QUANT_TABLE_SIZE] {
+    let mut out = [0u8; QUANT_TABLE_SIZE];
+    for (i, &q) in table.iter().enumerate() {
+        out[i * 2..i * 2 + 2].copy_from_slice(&(q as u16).to_le_bytes());
+    }
+    out
+}
+
+/// Parse a `DQT ` chunk payload. Entries must be in 1..=32767.
+pub fn parse_quant_table(data: &[u8]) -> Option<[i16; 64]> {
+    if data.len() != QUANT_TABLE_SIZE {
+        return None;
+    }
+    let mut table = [0i16; 64];
+    for (i, q) in table.iter_mut().enumerate() {
+        let v = u16::from_le_bytes([data[i * 2], data[i * 2 + 1]]);
+        if v == 0 || v > i16::MAX as u16 {
+            return None;
+        }
+        *q = v as i16;
+    }
+    Some(table)
+}
+
+/// Collects chunks, then writes header + TOC + payloads in one pass.
+pub struct ContainerWriter<'a> {
+    width: u32,
+    height: u32,
+    quality: u8,
+    profile: u8,
+    chunks: Vec<([u8; 4], u32, &'a [u8])>,
+    payload_len: usize,
+}
+
+impl<'a> ContainerWriter<'a> {
+    pub fn new(width: u32, height: u32, quality: u8, profile: u8) -> Self {
+        Self { width, height, quality, profile, chunks: Vec::new(), payload_len: 0 }
+    }
+
+    /// Queue a chunk. Returns false (and adds nothing) when the TOC is full
+    /// (u16 count) or the chunk would end past the u32 offset range.
+    pub fn add_chunk(&mut self, tag: [u8; 4], info: u32, data: &'a [u8]) -> bool {
+        if self.chunks.len() >= u16::MAX as usize
+            || self.encoded_len() + TOC_ENTRY_SIZE + data.len() > u32::MAX as usize
+        {
+            return false;
+        }
+        self.chunks.push((tag, info, data));
+        self.payload_len += data.len();
+        true
+    }
+
+    /// Total bytes `write` will produce.
+    pub fn encoded_len(&self) -> usize {
+        CONTAINER_HEADER_SIZE + self.chunks.len() * TOC_ENTRY_SIZE + self.payload_len
+    }
+
+    pub fn write(&self, out: &mut [u8], pos: &mut i32) {
+        assert!(self.chunks.len() <= u16::MAX as usize, "container chunk count exceeds u16");
+        let base = *pos as usize;
+        let mut hdr = [0u8; CONTAINER_HEADER_SIZE];
+        hdr[0] = b'B';
+        hdr[1] = b'G';
+        hdr[2] = BG_VERSION_CHUNKED;
+        hdr[3..7].copy_from_slice(&self.width.to_le_bytes());
+        hdr[7..11].copy_from_slice(&self.height.to_le_bytes());
+        hdr[11] = self.quality;
+        hdr[12] = self.profile;
+        hdr[14..16].copy_from_slice(&(self.chunks.len() as u16).to_le_bytes());
+        bitstream::write_bytes(out, pos, &hdr);
+
+        // Offsets are absolute within the .bg stream, which starts at `base`.
+        let mut offset = CONTAINER_HEADER_SIZE + self.chunks.len() * TOC_ENTRY_SIZE;
+        for &(tag, info, data) in &self.chunks {
+            let mut e = [0u8; TOC_ENTRY_SIZE];
+            e[0..4].copy_from_slice(&tag);
+            e[4..8].copy_from_slice(&(offset as u32).to_le_bytes());
+            e[8..12].copy_from_slice(&(data.len() as u32).to_le_bytes());
+            e[12..16].copy_from_slice(&info.to_le_bytes());
+            bitstream::write_bytes(out, pos, &e);
+            offset += data.len();
+        }
+        for &(_, _, data) in &self.chunks {
+            bitstream::write_bytes(out, pos, data);
+        }
+        debug_assert_eq!(*pos as usize - base, self.encoded_len());
+    }
+}
@@ -4,6 +4,7 @@
 
 use crate::block::Block;
 use std::f64::consts::PI;
+use std::sync::OnceLock;
 
 /// Pure-Rust reference forward DCT. Used in tests and as a software fallback.
 /// Matches the separable DCT-II definition used by the C implementation.
@@ -81,3 +82,59 @@ pub fn idct(block: &mut Block) {
     { block.data = idct_reference(&block.data); }
 }
 
+
+/// Scaled IDCT weights for k = 1, 2, 4, `w[n * 8 + u]`: basis function u averaged over
+/// output cell n (8/k pixels wide).
+fn scaled_idct_weights(k: usize) -> &'static [f32] {
+    static WEIGHTS: OnceLock<[[f32; 32]; 3]> = OnceLock::new();
+    let all = WEIGHTS.get_or_init(|| {
+        let mut all = [[0f32; 32]; 3];
+        for (slot, k) in [1usize, 2, 4].into_iter().enumerate() {
+            let cell = 8 / k;
+            for n in 0..k {
+                for u in 0..8 {
+                    let cu = if u == 0 { 1.0 / 2f64.sqrt() } else { 1.0 };
+                    let sum: f64 = (n * cell..(n + 1) * cell)
+                        .map(|x| ((2 * x + 1) as f64 * u as f64 * PI / 16.0).cos())
+                        .sum();
+                    all[slot][n * 8 + u] = (0.5 * cu * sum / cell as f64) as f32;
+                }
+            }
+        }
+        all
+    });
+    match k {
+        1 => &all[0][..8],
+        2 => &all[1][..16],
+        _ => &all[2][..32],
+    }
+}
+
+/// Dequantize and inverse-transform an 8×8 block straight to k×k pixels (k = 1, 2 or 4),
+/// centered (-128..127), row-major in `out[..k * k]`. Each output pixel is the mean of
+/// its (8/k)² cell of the full IDCT, computed without producing the 64 pixels.
+pub fn idct_scaled(coef: &[i16; 64], quant: &[i16; 64], k: usize, out: &mut [i16]) {
+    let w = scaled_idct_weights(k);
+    // Rows: 8 coefficient rows → k cell averages each. All-zero rows are common.
+    let mut t = [0f32; 32];
+    for v in 0..8 {
+        let row = &coef[v * 8..v * 8 + 8];
+        if row.iter().all(|&c| c == 0) {
+            continue;
+        }
+        let mut f = [0f32; 8];
+        for u in 0..8 {
+            f[u] = (row[u] as i32 * quant[v * 8 + u] as i32).clamp(i16::MIN as i32, i16::MAX as i32) as f32;
+        }
+        for x in 0..k {
+            t[v * k + x] = (0..8).map(|u| w[x * 8 + u] * f[u]).sum();
+        }
+    }
+    // Columns.
+    for y in 0..k {
+        for x in 0..k {
+            let s: f32 = (0..8).map(|v| w[y * 8 + v] * t[v * k + x]).sum();
+            out[y * k + x] = s.round() as i16;
+        }
+    }
+}
@@ -19,13 +19,20 @@
 //!  v17: YCbCr 4:2:0 + A, very aggressive perceptual quant + chroma AC + DC delta → RGBA output
 //!  v18: YCbCr 4:2:0, ultra perceptual + AC sparsify + chroma AC + DC delta → RGB output
 //!  v19: YCbCr 4:2:0 + A, ultra perceptual + AC sparsify + chroma AC + DC delta → RGBA output
+//!  v20: chunked container (header + TOC); planes coded per a v4..v19 profile byte
+//!  v21: multi-frame sequence with inter-frame block skip → first frame (see sequence.rs)
+//!  v22: lossless, YCoCg-R + MED prediction + Rice coding in row strips (see lossless.rs)
 
 use crate::block::Block;
-use crate::colorspace;
+use crate::colorspace::{self, PixelFormat};
+use crate::container::{self, Container};
 use crate::dct;
 use crate::encoder;
 use crate::ffi::dequantize_block;
 use crate::huffman;
+use crate::lossless;
+use crate::resample;
+use crate::sequence;
 use crate::zigzag::ZIGZAG;
 use rayon::prelude::*;
 const BLOCK_TILE_SIZE: usize = 512;
@@ -33,6 +40,7 @@ const PARALLEL_DEQUANT_BLOCKS_THRESHOLD: usize = 384;
 const PARALLEL_DEQUANT_PIXELS_THRESHOLD: usize = 262_144;
 const PARALLEL_WRITE_BLOCKS_THRESHOLD: usize = 2048;
 const PARALLEL_WRITE_PIXELS_THRESHOLD: usize = 786_432;
+const PARALLEL_PLANES_BLOCKS_THRESHOLD: usize = 256;
 
 const HEADER_SIZE:     usize = 3 + 4 + 4 + 1;
 const HEADER_SIZE_OLD: usize = 3 + 4 + 4;
@@ -50,11 +58,16 @@ fn should_parallel_write(n_blocks: usize, w: usize, h: usize) -> bool {
         && w.saturating_mul(h) >= PARALLEL_WRITE_PIXELS_THRESHOLD
 }
 
+#[inline]
+fn should_parallel_planes(luma_blocks: usize) -> bool {
+    luma_blocks >= PARALLEL_PLANES_BLOCKS_THRESHOLD
+}
+
 // ---------------------------------------------------------------------------
 // RLE decode (v1/v2/v3)
 // ---------------------------------------------------------------------------
 
-fn decode_rle_one_block(buffer: &[u8], mut pos: usize) -> Option<(Block, usize)> {
+pub(crate) fn decode_rle_one_block(buffer: &[u8], mut pos: usize) -> Option<(Block, usize)> {
     let mut block = Block::new();
     if pos + 2 > buffer.len() { return None; }
     block.data[ZIGZAG[0]] = i16::from_le_bytes([buffer[pos], buffer[pos + 1]]);
@@ -87,10 +100,16 @@ fn decode_rle_to_blocks(buffer: &[u8], mut pos: usize, n: usize) -> Option<(Vec<
 
 #[inline]
 fn write_block_to_plane(block: &Block, plane: &mut [u8], w: usize, h: usize, bx: usize, by: usize) {
+    write_block_strided(block, plane, w, w, h, bx, by);
+}
+
+/// Write a reconstructed block to a plane whose rows are `stride` bytes apart.
+#[inline]
+fn write_block_strided(block: &Block, plane: &mut [u8], stride: usize, w: usize, h: usize, bx: usize, by: usize) {
     // Fast interior path: avoid bounds checks per pixel.
     if bx + 8 <= w && by + 8 <= h {
         for y in 0..8 {
-            let dst = (by + y) * w + bx;
+            let dst = (by + y) * stride + bx;
             let src = y * 8;
             for x in 0..8 {
                 plane[dst + x] = (block.data[src + x] + 128).clamp(0, 255) as u8;
@@ -104,7 +123,7 @@ fn write_block_to_plane(block: &Block, plane: &mut [u8], w: usize, h: usize, bx:
             let py = by + y;
             let px = bx + x;
             if py < h && px < w {
-                plane[py * w + px] = (block.data[y * 8 + x] + 128).clamp(0, 255) as u8;
+                plane[py * stride + px] = (block.data[y * 8 + x] + 128).clamp(0, 255) as u8;
             }
         }
     }
@@ -167,25 +186,58 @@ fn decode_plane_rle(
 // Huffman decode (v4/v5)
 // ---------------------------------------------------------------------------
 
-/// Decode one plane using Huffman, dequant+IDCT in parallel, write to flat plane buffer.
-fn decode_plane_huffman(
+/// Split the length-prefixed plane payloads of a v4..v19 stream starting at `pos`.
+/// Returns the payloads and the byte position after the last one.
+fn split_prefixed_planes(buffer: &[u8], mut pos: usize, n_planes: usize) -> Option<(Vec<&[u8]>, usize)> {
+    let mut planes = Vec::with_capacity(n_planes);
+    for _ in 0..n_planes {
+        if pos + 4 > buffer.len() { return None; }
+        let len = u32::from_le_bytes(buffer[pos..pos + 4].try_into().unwrap()) as usize;
+        let start = pos + 4;
+        let end = start.checked_add(len)?;
+        if end > buffer.len() { return None; }
+        planes.push(&buffer[start..end]);
+        pos = end;
+    }
+    Some((planes, pos))
+}
+
+/// v4..v19: decode Y/Cb/Cr[/A] length-prefixed planes straight into interleaved
+/// pixels. Returns the byte position after the last plane (ICC trailer).
+fn decode_huffman_planes(
+    scratch: &mut DecodeScratch,
     buffer: &[u8], pos: usize,
     w: usize, h: usize,
+    luma_q: &[i16; 64],
+    chroma_q: &[i16; 64],
+    p: &PlaneProfile,
+    out_pixels: &mut [u8],
+) -> Option<usize> {
+    let (planes, end) = split_prefixed_planes(buffer, pos, p.channels())?;
+    let fmt = if p.has_alpha { PixelFormat::Rgba } else { PixelFormat::Rgb };
+    decode_planes_banded(scratch, &planes, w, h, luma_q, chroma_q, p.use_chroma_ac, p.use_dc_delta, fmt, w * fmt.bytes_per_pixel(), out_pixels)?;
+    Some(end)
+}
+
+/// Decode one bare plane payload (v20 `PLNE` chunk) into a flat plane buffer.
+fn decode_plane_chunk(
+    payload: &[u8],
+    w: usize, h: usize,
     quant: &[i16; 64],
     is_chroma: bool,
     use_chroma_ac: bool,
     use_dc_delta: bool,
     plane: &mut [u8],
-) -> Option<usize> {
-    let bw = (w + 7) / 8;
-    let bh = (h + 7) / 8;
-    let n  = bw * bh;
-
-    let (mut blocks, new_pos) =
-        huffman::decode_plane_with_profile(buffer, pos, n, is_chroma, use_chroma_ac, use_dc_delta)?;
+) -> Option<()> {
+    let n = ((w + 7) / 8) * ((h + 7) / 8);
+    let blocks = huffman::decode_plane_payload(payload, n, is_chroma, use_chroma_ac, use_dc_delta)?;
+    reconstruct_plane(blocks, w, h, quant, plane);
+    Some(())
+}
 
-    // Parallel dequant + IDCT
-    if should_parallel_dequant(n, w, h) {
+/// Dequant + IDCT in place; parallel when the plane is large.
+fn dequant_idct_blocks(blocks: &mut [Block], quant: &[i16; 64], w: usize, h: usize) {
+    if should_parallel_dequant(blocks.len(), w, h) {
         blocks.par_chunks_mut(BLOCK_TILE_SIZE).for_each(|chunk| {
             for block in chunk.iter_mut() {
                 unsafe { dequantize_block(block.data.as_mut_ptr(), quant.as_ptr()); }
@@ -198,6 +250,30 @@ fn decode_plane_huffman(
             dct::idct(block);
         }
     }
+}
+
+/// Dequant + IDCT `blocks` and write each to block index `indices[i]` of the plane,
+/// leaving every other block untouched (inter-frame skip).
+pub(crate) fn reconstruct_blocks_at(
+    mut blocks: Vec<Block>,
+    indices: &[usize],
+    w: usize, h: usize,
+    quant: &[i16; 64],
+    plane: &mut [u8],
+) {
+    let bw = (w + 7) / 8;
+    dequant_idct_blocks(&mut blocks, quant, w, h);
+    for (block, &idx) in blocks.iter().zip(indices) {
+        write_block_to_plane(block, plane, w, h, (idx % bw) * 8, (idx / bw) * 8);
+    }
+}
+
+/// Dequant + IDCT decoded blocks (parallel when large), then write them to the flat plane.
+fn reconstruct_plane(mut blocks: Vec<Block>, w: usize, h: usize, quant: &[i16; 64], plane: &mut [u8]) {
+    let bw = (w + 7) / 8;
+    let n  = blocks.len();
+
+    dequant_idct_blocks(&mut blocks, quant, w, h);
 
     // Write to flat plane
     if should_parallel_write(n, w, h) {
@@ -246,589 +322,1024 @@ fn decode_plane_huffman(
             write_block_to_plane(block, plane, w, h, bx, by);
         }
     }
-    Some(new_pos)
 }
 
 // ---------------------------------------------------------------------------
-// ICC trailer
+// Band-pipelined decode (Y/Cb/Cr[/A] → interleaved pixels)
 // ---------------------------------------------------------------------------
+//
+// Works in bands of 16 output rows: two luma (and alpha) block rows, one chroma
+// block row. The planes are entropy-decoded in step, one band at a time, so only a
+// group of bands of coefficients is ever held; each band is then dequantized,
+// IDCT'd and color converted into its rows of the output while its plane samples
+// are still in cache. Reconstruction of one group runs across the Rayon pool
+// while the next group is entropy-decoded.
+
+const DECODE_BAND_ROWS: usize = 16;
+
+/// Coefficients of one band, per plane (Y, Cb, Cr, A), and the band's reconstructed samples.
+#[derive(Default)]
+struct BandBlocks {
+    planes: [Vec<Block>; 4],
+    samples: [Vec<u8>; 4],
+}
 
-fn parse_icc_trailer(buffer: &[u8], pos: usize) -> Option<(Vec<u8>, usize)> {
-    if pos + 8 > buffer.len() { return None; }
-    if buffer[pos] != b'B' || buffer[pos+1] != b'G' || buffer[pos+2] != b'x' { return None; }
-    let chunk_type = buffer[pos + 3];
-    let len = u32::from_le_bytes(buffer[pos+4..pos+8].try_into().unwrap()) as usize;
-    let data_pos = pos + 8;
-    if chunk_type != 1 || data_pos + len > buffer.len() { return None; }
-    Some((buffer[data_pos..data_pos+len].to_vec(), data_pos + len))
+/// Reusable decode buffers: per-band coefficients and samples plus the repack
+/// buffer of `decode_to_format`. They grow to the largest image seen and are kept
+/// across calls, so repeated decodes do not allocate.
+#[derive(Default)]
+pub struct DecodeScratch {
+    cur: Vec<BandBlocks>,
+    next: Vec<BandBlocks>,
+    packed: Vec<u8>,
 }
 
-// ---------------------------------------------------------------------------
-// Public decode entry point
-// ---------------------------------------------------------------------------
+/// First `n` bytes of `buf`, growing it if needed. Contents are stale; callers overwrite them.
+fn scratch_slice(buf: &mut Vec<u8>, n: usize) -> &mut [u8] {
+    if buf.len() < n {
+        buf.resize(n, 0);
+    }
+    &mut buf[..n]
+}
 
-pub fn decode(
-    buffer: &[u8],
-    out_pixels: &mut [u8],
-    out_width:  &mut u32,
-    out_height: &mut u32,
-    out_channels: &mut u32,
-    out_icc: Option<&mut Vec<u8>>,
-) -> bool {
-    if buffer.len() < HEADER_SIZE_OLD {
-        return false;
+/// Entropy-decode one plane's blocks for consecutive bands, `n` blocks into each of `outs`.
+fn entropy_decode_plane(data: &[u8], cursor: &mut huffman::PlaneCursor, n: usize, outs: &mut [&mut Vec<Block>]) -> Option<()> {
+    for out in outs.iter_mut() {
+        out.clear();
+        cursor.decode(data.get(cursor.consumed()..)?, true, n, out)?;
     }
-    if buffer[0] != b'B' || buffer[1] != b'G' {
-        return false;
+    Some(())
+}
+
+/// Entropy-decode the next `bands.len()` bands of every plane. Planes are independent
+/// bitstreams, so each runs on its own cursor, concurrently when the bands are large.
+fn entropy_decode_bands(
+    planes: &[&[u8]],
+    cursors: &mut [huffman::PlaneCursor],
+    blocks_per_band: &[usize],
+    bands: &mut [BandBlocks],
+) -> Option<()> {
+    let luma_blocks = bands.len() * blocks_per_band[0];
+    let mut outs: [Vec<&mut Vec<Block>>; 4] = Default::default();
+    for band in bands.iter_mut() {
+        for (o, blocks) in outs.iter_mut().zip(band.planes.iter_mut()) {
+            o.push(blocks);
+        }
     }
+    let [oy, ocb, ocr, oa] = &mut outs;
+    let [cy, ccb, ccr, ca @ ..] = cursors else { return None };
+    let mut alpha = || match ca.first_mut() {
+        Some(c) => entropy_decode_plane(planes[3], c, blocks_per_band[3], oa),
+        None => Some(()),
+    };
+    let mut luma = || entropy_decode_plane(planes[0], cy, blocks_per_band[0], oy);
+    let mut cb = || entropy_decode_plane(planes[1], ccb, blocks_per_band[1], ocb);
+    let mut cr = || entropy_decode_plane(planes[2], ccr, blocks_per_band[2], ocr);
 
-    let version = buffer[2];
-    if version == 0 || version > 19 {
-        return false;
+    if should_parallel_planes(luma_blocks) {
+        let ((y, a), (cb, cr)) = rayon::join(|| rayon::join(luma, alpha), || rayon::join(cb, cr));
+        y.and(a).and(cb).and(cr)
+    } else {
+        luma()?;
+        cb()?;
+        cr()?;
+        alpha()
     }
+}
 
-    let width  = u32::from_le_bytes(buffer[3..7].try_into().unwrap());
-    let height = u32::from_le_bytes(buffer[7..11].try_into().unwrap());
-    let (header_size, quality) = if buffer.len() >= HEADER_SIZE {
-        (HEADER_SIZE, buffer[11])
+/// Dequant + IDCT the blocks of one band plane and write them to `plane` (pw × ph).
+fn reconstruct_band_plane(blocks: &[Block], quant: &[i16; 64], pw: usize, ph: usize, plane: &mut [u8]) {
+    let pbw = (pw + 7) / 8;
+    for (idx, block) in blocks.iter().enumerate() {
+        let mut b = *block;
+        unsafe { dequantize_block(b.data.as_mut_ptr(), quant.as_ptr()); }
+        dct::idct(&mut b);
+        write_block_to_plane(&b, plane, pw, ph, (idx % pbw) * 8, (idx / pbw) * 8);
+    }
+}
+
+/// Reconstruct one band into `out` (its rows of the output, `stride` bytes apart).
+fn reconstruct_band(
+    band: &mut BandBlocks,
+    w: usize,
+    fmt: PixelFormat,
+    stride: usize,
+    luma_q: &[i16; 64],
+    chroma_q: &[i16; 64],
+    out: &mut [u8],
+) {
+    let rows = (out.len() + stride - w * fmt.bytes_per_pixel()) / stride;
+    let cw = (w + 1) / 2;
+    let crows = (rows + 1) / 2;
+    let has_alpha = !band.planes[3].is_empty();
+    let [ys, cbs, crs, as_] = &mut band.samples;
+    let y  = scratch_slice(ys,  w * rows);
+    let cb = scratch_slice(cbs, cw * crows);
+    let cr = scratch_slice(crs, cw * crows);
+    reconstruct_band_plane(&band.planes[0], luma_q,   w,  rows,  y);
+    reconstruct_band_plane(&band.planes[1], chroma_q, cw, crows, cb);
+    reconstruct_band_plane(&band.planes[2], chroma_q, cw, crows, cr);
+    let a = if has_alpha {
+        let a = scratch_slice(as_, w * rows);
+        reconstruct_band_plane(&band.planes[3], luma_q, w, rows, a);
+        Some(&a[..])
     } else {
-        (HEADER_SIZE_OLD, 50u8)
+        None
     };
-    let q = if quality == 0 { 50 } else { quality };
-
-    if width == 0 || height == 0 || width > 65536 || height > 65536 { return false; }
-    let w = width as usize;
-    let h = height as usize;
+    colorspace::ycbcr420_to_pixels(y, cb, cr, a, w, fmt, out, stride);
+}
 
-    // ---- v1: grayscale RLE ----
-    if version == 1 {
-        if out_pixels.len() < w * h { return false; }
-        *out_width = width; *out_height = height; *out_channels = 1;
-        let quant = encoder::quant_table_for_quality(q);
-        let pos = match decode_plane_rle(buffer, header_size, w, h, &quant, out_pixels, 1, 0) {
-            Some(p) => p, None => return false,
-        };
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+/// Entropy-decode 3 (Y/Cb/Cr) or 4 (+A) bare plane payloads band by band, handing each
+/// group of decoded bands, in order, to `reconstruct` while the next group is decoded.
+fn pipeline_bands<F>(
+    scratch: &mut DecodeScratch,
+    planes: &[&[u8]],
+    w: usize, h: usize,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+    mut reconstruct: F,
+) -> Option<()>
+where
+    F: FnMut(&mut [BandBlocks]) + Send,
+{
+    if !(3..=4).contains(&planes.len()) {
+        return None;
     }
-
-    // ---- v2: RGB planar RLE ----
-    if version == 2 {
-        if out_pixels.len() < w * h * 3 { return false; }
-        *out_width = width; *out_height = height; *out_channels = 3;
-        let quant = encoder::quant_table_for_quality(q);
-        let mut pos = header_size;
-        for c in 0..3 {
-            pos = match decode_plane_rle(buffer, pos, w, h, &quant, out_pixels, 3, c) {
-                Some(p) => p, None => return false,
-            };
-        }
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+    let bw = (w + 7) / 8;
+    let cbw = ((w + 1) / 2 + 7) / 8;
+    let luma_blocks = bw * ((h + 7) / 8);
+    let chroma_blocks = cbw * (((h + 1) / 2 + 7) / 8);
+    let mut cursors: Vec<huffman::PlaneCursor> = (0..planes.len())
+        .map(|i| {
+            let is_chroma = i == 1 || i == 2;
+            let n = if is_chroma { chroma_blocks } else { luma_blocks };
+            huffman::PlaneCursor::new(n, is_chroma, is_chroma && use_chroma_ac, use_dc_delta)
+        })
+        .collect();
+    let blocks_per_band = [2 * bw, cbw, cbw, 2 * bw];
+
+    let n_bands = (h + DECODE_BAND_ROWS - 1) / DECODE_BAND_ROWS;
+    let group = (rayon::current_num_threads() * 2).max(2);
+    let DecodeScratch { cur, next, .. } = scratch;
+    for bands in [&mut *cur, &mut *next] {
+        if bands.len() < group {
+            bands.resize_with(group, BandBlocks::default);
         }
-        return true;
     }
 
-    // ---- v3: RGBA planar RLE ----
-    if version == 3 {
-        if out_pixels.len() < w * h * 4 { return false; }
-        *out_width = width; *out_height = height; *out_channels = 4;
-        let quant = encoder::quant_table_for_quality(q);
-        let mut pos = header_size;
-        for c in 0..4 {
-            pos = match decode_plane_rle(buffer, pos, w, h, &quant, out_pixels, 4, c) {
-                Some(p) => p, None => return false,
-            };
-        }
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+    let mut cur_len = group.min(n_bands);
+    // A previous RGBA decode leaves alpha blocks behind.
+    for band in cur.iter_mut().chain(next.iter_mut()) {
+        band.planes[3].clear();
     }
+    entropy_decode_bands(planes, &mut cursors, &blocks_per_band, &mut cur[..cur_len])?;
+    let mut queued = cur_len;
+    while cur_len > 0 {
+        let next_len = group.min(n_bands - queued);
+        let bands = &mut cur[..cur_len];
+        let (_, ok) = rayon::join(
+            || reconstruct(bands),
+            || entropy_decode_bands(planes, &mut cursors, &blocks_per_band, &mut next[..next_len]),
+        );
+        ok?;
+        std::mem::swap(cur, next);
+        cur_len = next_len;
+        queued += next_len;
+    }
+    Some(())
+}
 
-    // ---- v4: YCbCr 4:2:0 + Huffman → RGB ----
-    if version == 4 {
-        if out_pixels.len() < w * h * 3 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
+/// Decode 3 (Y/Cb/Cr) or 4 (+A) bare plane payloads into `fmt` pixels, output rows
+/// `stride` bytes apart, band by band without materializing full planes. The alpha
+/// plane is skipped when `fmt` has no alpha.
+fn decode_planes_banded(
+    scratch: &mut DecodeScratch,
+    planes: &[&[u8]],
+    w: usize, h: usize,
+    luma_q: &[i16; 64],
+    chroma_q: &[i16; 64],
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+    fmt: PixelFormat,
+    stride: usize,
+    out_pixels: &mut [u8],
+) -> Option<()> {
+    let row_bytes = w * fmt.bytes_per_pixel();
+    if planes.len() < 3 || stride < row_bytes || out_pixels.len() < stride * (h - 1) + row_bytes {
+        return None;
+    }
+    let planes = if fmt.has_alpha() { planes } else { &planes[..3] };
+    let band_bytes = DECODE_BAND_ROWS * stride;
+    let mut rest = &mut out_pixels[..stride * (h - 1) + row_bytes];
+    pipeline_bands(scratch, planes, w, h, use_chroma_ac, use_dc_delta, |bands| {
+        let split = (bands.len() * band_bytes).min(rest.len());
+        let (chunk, tail) = std::mem::take(&mut rest).split_at_mut(split);
+        rest = tail;
+        chunk
+            .par_chunks_mut(band_bytes)
+            .zip(bands.par_iter_mut())
+            .for_each(|(out, band)| reconstruct_band(band, w, fmt, stride, luma_q, chroma_q, out));
+    })
+}
 
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  false, false, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  false, false, &mut cr_plane) { Some(p) => p, None => return false };
+// ---------------------------------------------------------------------------
+// Huffman profiles (v4..v19)
+// ---------------------------------------------------------------------------
 
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
+type QuantFn = fn(u8) -> [i16; 64];
+
+/// Everything that distinguishes one v4..v19 profile (also the v20 profile byte):
+/// quant tables derived from quality, entropy coding flags and the plane layout.
+pub(crate) struct PlaneProfile {
+    pub(crate) version: u8,
+    luma_quant: QuantFn,
+    chroma_quant: QuantFn,
+    pub(crate) use_chroma_ac: bool,
+    pub(crate) use_dc_delta: bool,
+    pub(crate) has_alpha: bool,
+}
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+impl PlaneProfile {
+    /// (luma, chroma) quant tables for quality `q`.
+    pub(crate) fn quant_tables(&self, q: u8) -> ([i16; 64], [i16; 64]) {
+        ((self.luma_quant)(q), (self.chroma_quant)(q))
     }
 
-    // ---- v5: YCbCr 4:2:0 + A + Huffman → RGBA ----
-    if version == 5 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 4;
+    /// Y/Cb/Cr, plus A for the odd versions.
+    pub(crate) fn channels(&self) -> usize {
+        if self.has_alpha { 4 } else { 3 }
+    }
+}
 
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality(q);
+const fn huffman_profile(
+    version: u8,
+    luma_quant: QuantFn,
+    chroma_quant: QuantFn,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+) -> PlaneProfile {
+    PlaneProfile { version, luma_quant, chroma_quant, use_chroma_ac, use_dc_delta, has_alpha: version % 2 == 1 }
+}
 
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
+/// One row per profile, indexed by `version - 4`. RGB/RGBA pairs share everything but alpha.
+static PLANE_PROFILES: [PlaneProfile; 16] = {
+    use encoder::*;
+    [
+        huffman_profile(4,  quant_table_for_quality, chroma_quant_table_for_quality, false, false),
+        huffman_profile(5,  quant_table_for_quality, chroma_quant_table_for_quality, false, false),
+        huffman_profile(6,  quant_table_for_quality, chroma_quant_table_for_quality, true, false),
+        huffman_profile(7,  quant_table_for_quality, chroma_quant_table_for_quality, true, false),
+        huffman_profile(8,  quant_table_for_quality_perceptual, chroma_quant_table_for_quality_perceptual, true, false),
+        huffman_profile(9,  quant_table_for_quality_perceptual, chroma_quant_table_for_quality_perceptual, true, false),
+        huffman_profile(10, quant_table_for_quality_perceptual, chroma_quant_table_for_quality_perceptual, true, true),
+        huffman_profile(11, quant_table_for_quality_perceptual, chroma_quant_table_for_quality_perceptual, true, true),
+        huffman_profile(12, quant_table_for_quality_perceptual_v2, chroma_quant_table_for_quality_perceptual_v2, true, true),
+        huffman_profile(13, quant_table_for_quality_perceptual_v2, chroma_quant_table_for_quality_perceptual_v2, true, true),
+        huffman_profile(14, quant_table_for_quality_perceptual_v3, chroma_quant_table_for_quality_perceptual_v3, true, true),
+        huffman_profile(15, quant_table_for_quality_perceptual_v3, chroma_quant_table_for_quality_perceptual_v3, true, true),
+        huffman_profile(16, quant_table_for_quality_perceptual_v4, chroma_quant_table_for_quality_perceptual_v4, true, true),
+        huffman_profile(17, quant_table_for_quality_perceptual_v4, chroma_quant_table_for_quality_perceptual_v4, true, true),
+        huffman_profile(18, quant_table_for_quality_perceptual_v4, chroma_quant_table_for_quality_perceptual_v4, true, true),
+        huffman_profile(19, quant_table_for_quality_perceptual_v4, chroma_quant_table_for_quality_perceptual_v4, true, true),
+    ]
+};
+
+pub(crate) fn plane_profile(profile: u8) -> Option<&'static PlaneProfile> {
+    let p = PLANE_PROFILES.get((profile as usize).checked_sub(4)?)?;
+    debug_assert_eq!(p.version, profile);
+    Some(p)
+}
 
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  false, false, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  false, false, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut a_plane)  { Some(p) => p, None => return false };
+/// (luma, chroma) quant tables a v4..v19 profile derives from quality.
+/// Only used when a v20 stream carries no `DQT ` chunks.
+pub(crate) fn profile_quant_tables(profile: u8, q: u8) -> ([i16; 64], [i16; 64]) {
+    let p = plane_profile(profile).unwrap_or(&PLANE_PROFILES[PLANE_PROFILES.len() - 1]);
+    p.quant_tables(q)
+}
 
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
+// ---------------------------------------------------------------------------
+// Chunked container (v20)
+// ---------------------------------------------------------------------------
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+/// Quant tables for a v20 stream: stored `DQT ` chunks as-is, else derived from the profile.
+/// None if only one of the luma/chroma tables is stored, or either fails to parse.
+pub(crate) fn container_quant_tables(c: &Container, q: u8) -> Option<([i16; 64], [i16; 64])> {
+    let luma = c.find(container::TAG_QUANT, container::QUANT_TABLE_LUMA);
+    let chroma = c.find(container::TAG_QUANT, container::QUANT_TABLE_CHROMA);
+    match (luma, chroma) {
+        (Some(l), Some(ch)) => Some((container::parse_quant_table(l)?, container::parse_quant_table(ch)?)),
+        (None, None) => Some(profile_quant_tables(c.profile, q)),
+        _ => None,
     }
+}
 
-    // ---- v6: YCbCr 4:2:0 + Huffman (chroma AC) → RGB ----
-    if version == 6 {
-        if out_pixels.len() < w * h * 3 {
-            return false;
+/// Decode bare plane payloads into interleaved pixels.
+/// 1 plane = grayscale, 3 = Y/Cb/Cr → RGB, 4 = Y/Cb/Cr/A → RGBA.
+pub(crate) fn decode_payload_planes(
+    scratch: &mut DecodeScratch,
+    planes: &[&[u8]],
+    w: usize, h: usize,
+    luma_q: &[i16; 64],
+    chroma_q: &[i16; 64],
+    p: &PlaneProfile,
+    out_pixels: &mut [u8],
+) -> bool {
+    if out_pixels.len() < w * h * planes.len() {
+        return false;
+    }
+    // Colorspace writers walk every row of `out`; callers may pass a larger buffer.
+    let out_pixels = &mut out_pixels[..w * h * planes.len()];
+    match planes.len() {
+        1 => decode_plane_chunk(planes[0], w, h, luma_q, false, false, p.use_dc_delta, &mut out_pixels[..w * h]).is_some(),
+        3 | 4 => {
+            let fmt = if planes.len() == 4 { PixelFormat::Rgba } else { PixelFormat::Rgb };
+            let stride = w * planes.len();
+            decode_planes_banded(scratch, planes, w, h, luma_q, chroma_q, p.use_chroma_ac, p.use_dc_delta, fmt, stride, out_pixels).is_some()
         }
-        *out_width = width; *out_height = height; *out_channels = 3;
+        _ => false,
+    }
+}
 
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality(q);
+// ---------------------------------------------------------------------------
+// Planar YCbCr output (no color conversion)
+// ---------------------------------------------------------------------------
 
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
+/// Block rows entropy-decoded per step when writing a plane straight to the caller.
+const PLANE_GROUP_BLOCK_ROWS: usize = 8;
+
+/// The Y/Cb/Cr[/A] plane payloads of a v4..v20 stream and what is needed to decode them.
+pub struct PlaneSet<'a> {
+    pub width: usize,
+    pub height: usize,
+    planes: Vec<&'a [u8]>,
+    luma_q: [i16; 64],
+    chroma_q: [i16; 64],
+    profile: &'static PlaneProfile,
+}
 
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cr_plane) { Some(p) => p, None => return false };
+impl PlaneSet<'_> {
+    pub fn has_alpha(&self) -> bool {
+        self.profile.has_alpha
+    }
+}
 
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
+/// Locate the planes of a Huffman (v4..v19) or chunked (v20) stream.
+/// Other versions carry no 4:2:0 planes and return None.
+pub fn parse_plane_set(buffer: &[u8]) -> Option<PlaneSet<'_>> {
+    if buffer.len() < HEADER_SIZE || buffer[0] != b'B' || buffer[1] != b'G' {
+        return None;
+    }
+    let version = buffer[2];
+    let (width, height, planes, luma_q, chroma_q, profile) = if version == container::BG_VERSION_CHUNKED {
+        let c = Container::parse(buffer)?;
+        let q = if c.quality == 0 { 50 } else { c.quality };
+        let profile = plane_profile(c.profile)?;
+        let (luma_q, chroma_q) = container_quant_tables(&c, q)?;
+        let planes = (0..profile.channels() as u32).map(|i| c.find(container::TAG_PLANE, i)).collect::<Option<Vec<_>>>()?;
+        (c.width, c.height, planes, luma_q, chroma_q, profile)
+    } else {
+        let profile = plane_profile(version)?;
+        let q = if buffer[11] == 0 { 50 } else { buffer[11] };
+        let (luma_q, chroma_q) = profile.quant_tables(q);
+        let (planes, _) = split_prefixed_planes(buffer, HEADER_SIZE, profile.channels())?;
+        let width = u32::from_le_bytes(buffer[3..7].try_into().unwrap());
+        let height = u32::from_le_bytes(buffer[7..11].try_into().unwrap());
+        (width, height, planes, luma_q, chroma_q, profile)
+    };
+    if width == 0 || height == 0 || width > 65536 || height > 65536 {
+        return None;
+    }
+    Some(PlaneSet { width: width as usize, height: height as usize, planes, luma_q, chroma_q, profile })
+}
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+/// Decode one plane payload into `dst`, rows `stride` bytes apart (the last row
+/// needs only `w` bytes). Entropy decode runs a few block rows ahead of reconstruction.
+fn decode_plane_strided(
+    payload: &[u8],
+    w: usize, h: usize,
+    quant: &[i16; 64],
+    is_chroma: bool,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+    dst: &mut [u8],
+    stride: usize,
+) -> Option<()> {
+    let bw = (w + 7) / 8;
+    let bh = (h + 7) / 8;
+    if stride < w || dst.len() < stride * (h - 1) + w {
+        return None;
+    }
+    let mut cursor = huffman::PlaneCursor::new(bw * bh, is_chroma, use_chroma_ac, use_dc_delta);
+    let mut blocks = Vec::with_capacity(bw * PLANE_GROUP_BLOCK_ROWS);
+    let group_bytes = PLANE_GROUP_BLOCK_ROWS * 8 * stride;
+    for (g, rows) in dst[..stride * (h - 1) + w].chunks_mut(group_bytes).enumerate() {
+        blocks.clear();
+        cursor.decode(payload.get(cursor.consumed()..)?, true, bw * PLANE_GROUP_BLOCK_ROWS, &mut blocks)?;
+        let by0 = g * PLANE_GROUP_BLOCK_ROWS;
+        rows.par_chunks_mut(8 * stride)
+            .zip(blocks.par_chunks_mut(bw))
+            .enumerate()
+            .for_each(|(i, (band, row_blocks))| {
+                let band_h = (h - (by0 + i) * 8).min(8);
+                for (bx, block) in row_blocks.iter_mut().enumerate() {
+                    unsafe { dequantize_block(block.data.as_mut_ptr(), quant.as_ptr()); }
+                    dct::idct(block);
+                    write_block_strided(block, band, stride, w, band_h, bx * 8, 0);
+                }
+            });
     }
+    Some(())
+}
 
-    // ---- v7: YCbCr 4:2:0 + A + Huffman (chroma AC) → RGBA ----
-    if version == 7 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
+/// Decode the planes of `set` without color conversion: Y and A at full size, Cb/Cr
+/// at ((w+1)/2)×((h+1)/2). Planes are independent, so they decode concurrently.
+/// A stream without alpha fills `a` with 255; `a = None` skips the alpha plane.
+pub fn decode_yuv(
+    set: &PlaneSet,
+    y: &mut [u8], y_stride: usize,
+    u: &mut [u8], u_stride: usize,
+    v: &mut [u8], v_stride: usize,
+    a: Option<(&mut [u8], usize)>,
+) -> bool {
+    let (w, h) = (set.width, set.height);
+    let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+    let p = &set.profile;
+    let alpha = || match a {
+        Some((a, a_stride)) if p.has_alpha => {
+            decode_plane_strided(set.planes[3], w, h, &set.luma_q, false, false, p.use_dc_delta, a, a_stride)
         }
-        *out_width = width; *out_height = height; *out_channels = 4;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut a_plane)  { Some(p) => p, None => return false };
+        Some((a, a_stride)) => {
+            if a_stride < w || a.len() < a_stride * (h - 1) + w {
+                return None;
+            }
+            a[..a_stride * (h - 1) + w].chunks_mut(a_stride).for_each(|row| row[..w].fill(255));
+            Some(())
+        }
+        None => Some(()),
+    };
+    let (luma, (chroma, alpha)) = rayon::join(
+        || decode_plane_strided(set.planes[0], w, h, &set.luma_q, false, false, p.use_dc_delta, y, y_stride),
+        || rayon::join(
+            || {
+                let (cb, cr) = rayon::join(
+                    || decode_plane_strided(set.planes[1], cw, ch, &set.chroma_q, true, p.use_chroma_ac, p.use_dc_delta, u, u_stride),
+                    || decode_plane_strided(set.planes[2], cw, ch, &set.chroma_q, true, p.use_chroma_ac, p.use_dc_delta, v, v_stride),
+                );
+                cb.and(cr)
+            },
+            alpha,
+        ),
+    );
+    luma.and(chroma).and(alpha).is_some()
+}
 
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
+// ---------------------------------------------------------------------------
+// Caller pixel format and row stride
+// ---------------------------------------------------------------------------
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+/// Decode into `fmt` pixels with output rows `stride` bytes apart (0 = tightly packed).
+/// v4..v20 streams are converted straight from YCbCr; other versions are decoded as
+/// usual and repacked. Buffers come from `scratch` and are kept for the next call.
+pub fn decode_to_format(
+    scratch: &mut DecodeScratch,
+    buffer: &[u8],
+    out_pixels: &mut [u8],
+    fmt: PixelFormat,
+    stride: usize,
+    out_width: &mut u32,
+    out_height: &mut u32,
+) -> bool {
+    let bpp = fmt.bytes_per_pixel();
+    if let Some(set) = parse_plane_set(buffer) {
+        let (w, h) = (set.width, set.height);
+        let stride = if stride == 0 { w * bpp } else { stride };
+        let p = &set.profile;
+        if decode_planes_banded(scratch, &set.planes, w, h, &set.luma_q, &set.chroma_q, p.use_chroma_ac, p.use_dc_delta, fmt, stride, out_pixels).is_none() {
+            return false;
         }
+        *out_width = w as u32;
+        *out_height = h as u32;
         return true;
     }
 
-    // ---- v8: YCbCr 4:2:0 + Huffman (perceptual quant + chroma AC) → RGB ----
-    if version == 8 {
-        if out_pixels.len() < w * h * 3 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cr_plane) { Some(p) => p, None => return false };
+    if buffer.len() < HEADER_SIZE_OLD {
+        return false;
+    }
+    let w = u32::from_le_bytes(buffer[3..7].try_into().unwrap()) as usize;
+    let h = u32::from_le_bytes(buffer[7..11].try_into().unwrap()) as usize;
+    if w == 0 || h == 0 || w > 65536 || h > 65536 {
+        return false;
+    }
+    let stride = if stride == 0 { w * bpp } else { stride };
+    if stride < w * bpp || out_pixels.len() < stride * (h - 1) + w * bpp {
+        return false;
+    }
+    let mut packed = std::mem::take(&mut scratch.packed);
+    let (mut pw, mut ph, mut ch) = (0u32, 0u32, 0u32);
+    let ok = decode_with(scratch, buffer, scratch_slice(&mut packed, w * h * 4), &mut pw, &mut ph, &mut ch, None)
+        && pw as usize == w && ph as usize == h;
+    if ok {
+        colorspace::repack_pixels(&packed, ch as usize, w, h, fmt, out_pixels, stride);
+    }
+    scratch.packed = packed;
+    if !ok {
+        return false;
+    }
+    *out_width = pw;
+    *out_height = ph;
+    true
+}
 
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
+// ---------------------------------------------------------------------------
+// Decode with resize
+// ---------------------------------------------------------------------------
+//
+// The band pipeline runs with a scaled IDCT (each 8×8 block straight to 1×1, 2×2 or
+// 4×4 pixels) at the smallest scale that still covers the target, so most of the
+// reduction costs nothing. Each reconstructed band is color converted and filtered
+// horizontally to the target width right away; the vertical pass runs once all
+// bands are in. Full-size planes and pixels never exist.
+
+/// Scaled IDCT sizes (output pixels per 8-pixel block side), smallest first.
+const IDCT_SCALES: [usize; 4] = [1, 2, 4, 8];
+
+/// A `len`-pixel dimension decoded at `k`/8.
+fn scaled_len(len: usize, k: usize) -> usize {
+    (len * k + 7) / 8
+}
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+/// Reconstruct the blocks of one band plane (`pbw` blocks per row) at `k` pixels per
+/// block side into `plane` (pw × ph).
+fn reconstruct_band_plane_scaled(
+    blocks: &[Block], quant: &[i16; 64], pbw: usize, k: usize, pw: usize, ph: usize, plane: &mut [u8],
+) {
+    if k == 8 {
+        reconstruct_band_plane(blocks, quant, pw, ph, plane);
+        return;
     }
-
-    // ---- v9: YCbCr 4:2:0 + A + Huffman (perceptual quant + chroma AC) → RGBA ----
-    if version == 9 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
+    let mut px = [0i16; 16];
+    for (idx, block) in blocks.iter().enumerate() {
+        dct::idct_scaled(&block.data, quant, k, &mut px);
+        let (bx, by) = ((idx % pbw) * k, (idx / pbw) * k);
+        for y in 0..k.min(ph.saturating_sub(by)) {
+            for x in 0..k.min(pw.saturating_sub(bx)) {
+                plane[(by + y) * pw + bx + x] = (px[y * k + x] + 128).clamp(0, 255) as u8;
+            }
         }
-        *out_width = width; *out_height = height; *out_channels = 4;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  false, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, false, &mut a_plane)  { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
+    }
+}
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+/// Reconstruct one band at scale `k`, color convert it and filter its rows to the
+/// target width into `rows` (one `kx.len() * bpp` float row per scaled image row).
+/// Below full size, chroma is reconstructed at 2k so every scaled pixel gets the
+/// chroma of exactly its own area (4:4:4 at the scaled size).
+fn reconstruct_band_resized(
+    band: &mut BandBlocks,
+    w: usize,
+    k: usize,
+    fmt: PixelFormat,
+    luma_q: &[i16; 64],
+    chroma_q: &[i16; 64],
+    kx: &resample::Kernel,
+    rows: &mut [f32],
+) {
+    let bpp = fmt.bytes_per_pixel();
+    let srows = rows.len() / (kx.len() * bpp);
+    let sw = scaled_len(w, k);
+    let (bw, cbw) = ((w + 7) / 8, ((w + 1) / 2 + 7) / 8);
+    let (kc, scw, scrows) = if k == 8 { (8, (sw + 1) / 2, (srows + 1) / 2) } else { (2 * k, sw, srows) };
+    let has_alpha = !band.planes[3].is_empty();
+    let [ys, cbs, crs, as_] = &mut band.samples;
+    let y  = scratch_slice(ys,  sw * srows);
+    let cb = scratch_slice(cbs, scw * scrows);
+    let cr = scratch_slice(crs, scw * scrows);
+    reconstruct_band_plane_scaled(&band.planes[0], luma_q,   bw,  k,  sw,  srows,  y);
+    reconstruct_band_plane_scaled(&band.planes[1], chroma_q, cbw, kc, scw, scrows, cb);
+    reconstruct_band_plane_scaled(&band.planes[2], chroma_q, cbw, kc, scw, scrows, cr);
+    let a = if has_alpha {
+        let a = scratch_slice(as_, sw * srows);
+        reconstruct_band_plane_scaled(&band.planes[3], luma_q, bw, k, sw, srows, a);
+        Some(&a[..])
+    } else {
+        None
+    };
+    let mut px = vec![0u8; sw * srows * bpp];
+    if k == 8 {
+        colorspace::ycbcr420_to_pixels(y, cb, cr, a, sw, fmt, &mut px, sw * bpp);
+    } else {
+        colorspace::ycbcr444_to_pixels(y, cb, cr, a, sw, fmt, &mut px, sw * bpp);
+    }
+    for (src, dst) in px.chunks_exact(sw * bpp).zip(rows.chunks_exact_mut(kx.len() * bpp)) {
+        resample::resample_row(kx, src, bpp, dst);
     }
+}
 
-    // ---- v10: YCbCr 4:2:0 + Huffman (perceptual quant + chroma AC + DC delta) → RGB ----
-    if version == 10 {
-        if out_pixels.len() < w * h * 3 {
+/// Decode resized to `tw` × `th`, tightly packed with the stream's channel count.
+/// v4..v20 streams combine a scaled IDCT with `filter`; other versions are decoded
+/// at full size and resampled.
+pub fn decode_resized(
+    buffer: &[u8],
+    tw: usize, th: usize,
+    filter: resample::Filter,
+    out_pixels: &mut [u8],
+    out_channels: &mut u32,
+) -> bool {
+    if tw == 0 || th == 0 || tw > 65536 || th > 65536 {
+        return false;
+    }
+    if let Some(set) = parse_plane_set(buffer) {
+        let (w, h) = (set.width, set.height);
+        let p = set.profile;
+        let ch = p.channels();
+        if out_pixels.len() < tw * th * ch {
             return false;
         }
-        *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
-
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+        let fmt = if p.has_alpha { PixelFormat::Rgba } else { PixelFormat::Rgb };
+        let k = IDCT_SCALES.into_iter().find(|&k| scaled_len(w, k) >= tw && scaled_len(h, k) >= th).unwrap_or(8);
+        let kx = resample::Kernel::new(scaled_len(w, k), tw, filter);
+        let ky = resample::Kernel::new(scaled_len(h, k), th, filter);
+        let row_len = tw * ch;
+        let mut rows = vec![0f32; scaled_len(h, k) * row_len];
+        let band_len = DECODE_BAND_ROWS * k / 8 * row_len;
+        let mut rest = &mut rows[..];
+        let (luma_q, chroma_q) = (&set.luma_q, &set.chroma_q);
+        let ok = pipeline_bands(&mut DecodeScratch::default(), &set.planes, w, h, p.use_chroma_ac, p.use_dc_delta, |bands| {
+            let split = (bands.len() * band_len).min(rest.len());
+            let (chunk, tail) = std::mem::take(&mut rest).split_at_mut(split);
+            rest = tail;
+            chunk
+                .par_chunks_mut(band_len)
+                .zip(bands.par_iter_mut())
+                .for_each(|(rows, band)| reconstruct_band_resized(band, w, k, fmt, luma_q, chroma_q, &kx, rows));
+        });
+        if ok.is_none() {
+            return false;
         }
+        resample::resample_columns(&ky, &rows, row_len, out_pixels);
+        *out_channels = ch as u32;
         return true;
     }
 
-    // ---- v11: YCbCr 4:2:0 + A + Huffman (perceptual quant + chroma AC + DC delta) → RGBA ----
-    if version == 11 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 4;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut a_plane)  { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
-
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+    if buffer.len() < HEADER_SIZE_OLD {
+        return false;
+    }
+    let w = u32::from_le_bytes(buffer[3..7].try_into().unwrap()) as usize;
+    let h = u32::from_le_bytes(buffer[7..11].try_into().unwrap()) as usize;
+    if w == 0 || h == 0 || w > 65536 || h > 65536 {
+        return false;
     }
+    let mut full = vec![0u8; w * h * 4];
+    let (mut fw, mut fh, mut ch) = (0u32, 0u32, 0u32);
+    if !decode(buffer, &mut full, &mut fw, &mut fh, &mut ch, None) || fw as usize != w || fh as usize != h {
+        return false;
+    }
+    let ch = ch as usize;
+    if out_pixels.len() < tw * th * ch {
+        return false;
+    }
+    resample::resize(&full, w, h, ch, tw, th, filter, out_pixels);
+    *out_channels = ch as u32;
+    true
+}
 
-    // ---- v12: YCbCr 4:2:0 + Huffman (strong perceptual quant + chroma AC + DC delta) → RGB ----
-    if version == 12 {
-        if out_pixels.len() < w * h * 3 {
+// ---------------------------------------------------------------------------
+// Region of interest
+// ---------------------------------------------------------------------------
+//
+// Entropy data is one sequential bitstream per plane, so every band down to the
+// region's last row is still parsed. Blocks outside the region's columns are
+// dropped as soon as their band is decoded; only the region's blocks are
+// dequantized, IDCT'd and color converted, and bands below it are never read.
+
+/// Decode the `rw` × `rh` region at (`x`, `y`) into `out`, tightly packed with the
+/// stream's channel count. `out_width`/`out_height` receive the full image size.
+/// v4..v20 streams skip the work outside the region; other versions are decoded
+/// whole and cropped.
+pub fn decode_region(
+    buffer: &[u8],
+    x: usize, y: usize,
+    rw: usize, rh: usize,
+    out_pixels: &mut [u8],
+    out_width: &mut u32,
+    out_height: &mut u32,
+    out_channels: &mut u32,
+) -> bool {
+    let inside = |w: usize, h: usize| {
+        rw > 0 && rh > 0 && x.checked_add(rw).map_or(false, |e| e <= w) && y.checked_add(rh).map_or(false, |e| e <= h)
+    };
+    if let Some(set) = parse_plane_set(buffer) {
+        let ch = set.profile.channels();
+        if !inside(set.width, set.height) || out_pixels.len() < rw * rh * ch {
             return false;
         }
-        *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v2(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v2(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
-
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+        if decode_region_planes(&set, x, y, rw, rh, out_pixels).is_none() {
+            return false;
         }
+        *out_width = set.width as u32;
+        *out_height = set.height as u32;
+        *out_channels = ch as u32;
         return true;
     }
 
-    // ---- v13: YCbCr 4:2:0 + A + Huffman (strong perceptual quant + chroma AC + DC delta) → RGBA ----
-    if version == 13 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 4;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v2(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v2(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut a_plane)  { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
+    if buffer.len() < HEADER_SIZE_OLD {
+        return false;
+    }
+    let w = u32::from_le_bytes(buffer[3..7].try_into().unwrap()) as usize;
+    let h = u32::from_le_bytes(buffer[7..11].try_into().unwrap()) as usize;
+    if w == 0 || h == 0 || w > 65536 || h > 65536 || !inside(w, h) {
+        return false;
+    }
+    let mut full = vec![0u8; w * h * 4];
+    let (mut fw, mut fh, mut ch) = (0u32, 0u32, 0u32);
+    if !decode(buffer, &mut full, &mut fw, &mut fh, &mut ch, None) || fw as usize != w || fh as usize != h {
+        return false;
+    }
+    let ch = ch as usize;
+    if out_pixels.len() < rw * rh * ch {
+        return false;
+    }
+    for (r, dst) in out_pixels[..rw * rh * ch].chunks_exact_mut(rw * ch).enumerate() {
+        dst.copy_from_slice(&full[((y + r) * w + x) * ch..][..rw * ch]);
+    }
+    *out_width = fw;
+    *out_height = fh;
+    *out_channels = ch as u32;
+    true
+}
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+fn decode_region_planes(set: &PlaneSet, x0: usize, y0: usize, rw: usize, rh: usize, out: &mut [u8]) -> Option<()> {
+    let (w, h) = (set.width, set.height);
+    let p = set.profile;
+    let fmt = if p.has_alpha { PixelFormat::Rgba } else { PixelFormat::Rgb };
+    let bpp = fmt.bytes_per_pixel();
+    let bw = (w + 7) / 8;
+    let cw = (w + 1) / 2;
+    let cbw = (cw + 7) / 8;
+
+    // Luma columns kept: [lx0, lx1), starting on a 16-pixel boundary so the matching
+    // chroma columns start on a block boundary too.
+    let lx0 = x0 / 16 * 16;
+    let lx1 = ((x0 + rw + 15) / 16 * 16).min(w);
+    let sw = lx1 - lx0;
+    let scw = (sw + 1) / 2;
+    let luma_cols = lx0 / 8..(lx1 + 7) / 8;
+    let chroma_cols = lx0 / 16..(lx0 / 2 + scw + 7) / 8;
+
+    let luma_blocks = bw * ((h + 7) / 8);
+    let chroma_blocks = cbw * (((h + 1) / 2 + 7) / 8);
+    let mut cursors: Vec<huffman::PlaneCursor> = (0..set.planes.len())
+        .map(|i| {
+            let is_chroma = i == 1 || i == 2;
+            let n = if is_chroma { chroma_blocks } else { luma_blocks };
+            huffman::PlaneCursor::new(n, is_chroma, is_chroma && p.use_chroma_ac, p.use_dc_delta)
+        })
+        .collect();
+    let blocks_per_band = [2 * bw, cbw, cbw, 2 * bw];
+
+    let first = y0 / DECODE_BAND_ROWS;
+    let last = (y0 + rh - 1) / DECODE_BAND_ROWS;
+    let mut bands: Vec<[Vec<Block>; 4]> = Vec::with_capacity(last - first + 1);
+    let mut decoded = Vec::with_capacity(2 * bw);
+    for b in 0..=last {
+        let mut kept: [Vec<Block>; 4] = Default::default();
+        for (i, cursor) in cursors.iter_mut().enumerate() {
+            decoded.clear();
+            cursor.decode(set.planes[i].get(cursor.consumed()..)?, true, blocks_per_band[i], &mut decoded)?;
+            if b >= first {
+                let (row_blocks, cols) = if i == 1 || i == 2 { (cbw, &chroma_cols) } else { (bw, &luma_cols) };
+                kept[i].extend(
+                    decoded.iter().enumerate().filter(|(k, _)| cols.contains(&(k % row_blocks))).map(|(_, b)| *b),
+                );
+            }
+        }
+        if b >= first {
+            bands.push(kept);
         }
-        return true;
     }
 
-    // ---- v14: YCbCr 4:2:0 + Huffman (aggressive perceptual quant + chroma AC + DC delta) → RGB ----
-    if version == 14 {
-        if out_pixels.len() < w * h * 3 {
-            return false;
+    // Each band owns its rows of the region in `out`.
+    let row_bytes = rw * bpp;
+    let mut rest = &mut out[..rh * row_bytes];
+    let mut jobs = Vec::with_capacity(bands.len());
+    for (k, band) in bands.into_iter().enumerate() {
+        let by = (first + k) * DECODE_BAND_ROWS;
+        let r0 = y0.max(by);
+        let r1 = (y0 + rh).min(by + DECODE_BAND_ROWS);
+        let (chunk, tail) = std::mem::take(&mut rest).split_at_mut((r1 - r0) * row_bytes);
+        rest = tail;
+        jobs.push((by, r0 - by, chunk, band));
+    }
+    let (luma_q, chroma_q) = (&set.luma_q, &set.chroma_q);
+    jobs.into_par_iter().for_each(|(by, skip, chunk, band)| {
+        let rows = (h - by).min(DECODE_BAND_ROWS);
+        let crows = (rows + 1) / 2;
+        let mut yp = vec![0u8; sw * rows];
+        let mut cb = vec![0u8; scw * crows];
+        let mut cr = vec![0u8; scw * crows];
+        reconstruct_band_plane(&band[0], luma_q,   sw,  rows,  &mut yp);
+        reconstruct_band_plane(&band[1], chroma_q, scw, crows, &mut cb);
+        reconstruct_band_plane(&band[2], chroma_q, scw, crows, &mut cr);
+        let mut a = Vec::new();
+        if p.has_alpha {
+            a.resize(sw * rows, 0);
+            reconstruct_band_plane(&band[3], luma_q, sw, rows, &mut a);
         }
-        *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v3(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v3(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
+        let a = if p.has_alpha { Some(&a[..]) } else { None };
+        let mut px = vec![0u8; sw * rows * bpp];
+        colorspace::ycbcr420_to_pixels(&yp, &cb, &cr, a, sw, fmt, &mut px, sw * bpp);
+        for (r, dst) in chunk.chunks_exact_mut(row_bytes).enumerate() {
+            dst.copy_from_slice(&px[((skip + r) * sw + x0 - lx0) * bpp..][..row_bytes]);
+        }
+    });
+    Some(())
+}
 
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
+fn decode_chunked(
+    scratch: &mut DecodeScratch,
+    buffer: &[u8],
+    out_pixels: &mut [u8],
+    out_width:  &mut u32,
+    out_height: &mut u32,
+    out_channels: &mut u32,
+    out_icc: Option<&mut Vec<u8>>,
+) -> bool {
+    let c = match Container::parse(buffer) { Some(c) => c, None => return false };
+    if c.width == 0 || c.height == 0 || c.width > 65536 || c.height > 65536 { return false; }
+    let q = if c.quality == 0 { 50 } else { c.quality };
+    let p = match plane_profile(c.profile) { Some(p) => p, None => return false };
+    let (luma_q, chroma_q) = match container_quant_tables(&c, q) { Some(t) => t, None => return false };
+
+    let w = c.width as usize;
+    let h = c.height as usize;
+    let channels = p.channels();
+    if out_pixels.len() < w * h * channels {
+        return false;
+    }
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+    let mut planes = Vec::with_capacity(channels);
+    for idx in 0..channels as u32 {
+        match c.find(container::TAG_PLANE, idx) {
+            Some(data) => planes.push(data),
+            None => return false,
         }
-        return true;
     }
+    if !decode_payload_planes(scratch, &planes, w, h, &luma_q, &chroma_q, &p, out_pixels) {
+        return false;
+    }
+    *out_width = c.width; *out_height = c.height; *out_channels = channels as u32;
 
-    // ---- v15: YCbCr 4:2:0 + A + Huffman (aggressive perceptual quant + chroma AC + DC delta) → RGBA ----
-    if version == 15 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 4;
+    if let Some(v) = out_icc {
+        if let Some(icc) = c.find(container::TAG_ICC, 0) { *v = icc.to_vec(); }
+    }
+    true
+}
 
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v3(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v3(q);
+// ---------------------------------------------------------------------------
+// ICC trailer
+// ---------------------------------------------------------------------------
 
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
+pub(crate) fn parse_icc_trailer(buffer: &[u8], pos: usize) -> Option<(Vec<u8>, usize)> {
+    if pos + 8 > buffer.len() { return None; }
+    if buffer[pos] != b'B' || buffer[pos+1] != b'G' || buffer[pos+2] != b'x' { return None; }
+    let chunk_type = buffer[pos + 3];
+    let len = u32::from_le_bytes(buffer[pos+4..pos+8].try_into().unwrap()) as usize;
+    let data_pos = pos + 8;
+    if chunk_type != 1 || data_pos + len > buffer.len() { return None; }
+    Some((buffer[data_pos..data_pos+len].to_vec(), data_pos + len))
+}
 
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut a_plane)  { Some(p) => p, None => return false };
+// ---------------------------------------------------------------------------
+// Public decode entry point
+// ---------------------------------------------------------------------------
 
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
+pub fn decode(
+    buffer: &[u8],
+    out_pixels: &mut [u8],
+    out_width:  &mut u32,
+    out_height: &mut u32,
+    out_channels: &mut u32,
+    out_icc: Option<&mut Vec<u8>>,
+) -> bool {
+    decode_with(&mut DecodeScratch::default(), buffer, out_pixels, out_width, out_height, out_channels, out_icc)
+}
 
-        if let Some(v) = out_icc {
-            if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
-        }
-        return true;
+/// `decode` with caller-owned scratch buffers, reused across calls.
+pub fn decode_with(
+    scratch: &mut DecodeScratch,
+    buffer: &[u8],
+    out_pixels: &mut [u8],
+    out_width:  &mut u32,
+    out_height: &mut u32,
+    out_channels: &mut u32,
+    out_icc: Option<&mut Vec<u8>>,
+) -> bool {
+    if buffer.len() < HEADER_SIZE_OLD {
+        return false;
+    }
+    if buffer[0] != b'B' || buffer[1] != b'G' {
+        return false;
     }
 
-    // ---- v16: YCbCr 4:2:0 + Huffman (very aggressive perceptual quant + chroma AC + DC delta) → RGB ----
-    if version == 16 {
-        if out_pixels.len() < w * h * 3 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v4(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v4(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
+    let version = buffer[2];
+    if version == 0 || version > lossless::BG_VERSION_LOSSLESS {
+        return false;
+    }
 
+    if version == container::BG_VERSION_CHUNKED {
+        return decode_chunked(scratch, buffer, out_pixels, out_width, out_height, out_channels, out_icc);
+    }
+    if version == sequence::BG_VERSION_SEQUENCE {
+        return sequence::decode_first_frame(buffer, out_pixels, out_width, out_height, out_channels);
+    }
+    if version == lossless::BG_VERSION_LOSSLESS {
+        let pos = match lossless::decode(buffer, out_pixels, out_width, out_height, out_channels) {
+            Some(p) => p,
+            None => return false,
+        };
         if let Some(v) = out_icc {
             if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
         }
         return true;
     }
 
-    // ---- v17: YCbCr 4:2:0 + A + Huffman (very aggressive perceptual quant + chroma AC + DC delta) → RGBA ----
-    if version == 17 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
-        }
-        *out_width = width; *out_height = height; *out_channels = 4;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v4(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v4(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
-
-        let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut a_plane)  { Some(p) => p, None => return false };
+    let width  = u32::from_le_bytes(buffer[3..7].try_into().unwrap());
+    let height = u32::from_le_bytes(buffer[7..11].try_into().unwrap());
+    let (header_size, quality) = if buffer.len() >= HEADER_SIZE {
+        (HEADER_SIZE, buffer[11])
+    } else {
+        (HEADER_SIZE_OLD, 50u8)
+    };
+    let q = if quality == 0 { 50 } else { quality };
 
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
+    if width == 0 || height == 0 || width > 65536 || height > 65536 { return false; }
+    let w = width as usize;
+    let h = height as usize;
 
+    // ---- v1: grayscale RLE ----
+    if version == 1 {
+        if out_pixels.len() < w * h { return false; }
+        *out_width = width; *out_height = height; *out_channels = 1;
+        let quant = encoder::quant_table_for_quality(q);
+        let pos = match decode_plane_rle(buffer, header_size, w, h, &quant, out_pixels, 1, 0) {
+            Some(p) => p, None => return false,
+        };
         if let Some(v) = out_icc {
             if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
         }
         return true;
     }
 
-    // ---- v18: YCbCr 4:2:0 + Huffman (ultra perceptual + AC sparsify + chroma AC + DC delta) → RGB ----
-    if version == 18 {
-        if out_pixels.len() < w * h * 3 {
-            return false;
-        }
+    // ---- v2: RGB planar RLE ----
+    if version == 2 {
+        if out_pixels.len() < w * h * 3 { return false; }
         *out_width = width; *out_height = height; *out_channels = 3;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v4(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v4(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-
+        let quant = encoder::quant_table_for_quality(q);
         let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420_to_rgb(&y_plane, &cb_plane, &cr_plane, w, h, out_pixels);
-
+        for c in 0..3 {
+            pos = match decode_plane_rle(buffer, pos, w, h, &quant, out_pixels, 3, c) {
+                Some(p) => p, None => return false,
+            };
+        }
         if let Some(v) = out_icc {
             if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
         }
         return true;
     }
 
-    // ---- v19: YCbCr 4:2:0 + A + Huffman (ultra perceptual + AC sparsify + chroma AC + DC delta) → RGBA ----
-    if version == 19 {
-        if out_pixels.len() < w * h * 4 {
-            return false;
-        }
+    // ---- v3: RGBA planar RLE ----
+    if version == 3 {
+        if out_pixels.len() < w * h * 4 { return false; }
         *out_width = width; *out_height = height; *out_channels = 4;
-
-        let cw = (w + 1) / 2;
-        let ch = (h + 1) / 2;
-        let luma_q   = encoder::quant_table_for_quality_perceptual_v4(q);
-        let chroma_q = encoder::chroma_quant_table_for_quality_perceptual_v4(q);
-
-        let mut y_plane  = vec![0u8; w * h];
-        let mut cb_plane = vec![0u8; cw * ch];
-        let mut cr_plane = vec![0u8; cw * ch];
-        let mut a_plane  = vec![0u8; w * h];
-
+        let quant = encoder::quant_table_for_quality(q);
         let mut pos = header_size;
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut y_plane)  { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cb_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, cw, ch, &chroma_q, true,  true,  true, &mut cr_plane) { Some(p) => p, None => return false };
-        pos = match decode_plane_huffman(buffer, pos, w,  h,  &luma_q,   false, false, true, &mut a_plane)  { Some(p) => p, None => return false };
-
-        colorspace::ycbcr420a_to_rgba(&y_plane, &cb_plane, &cr_plane, &a_plane, w, h, out_pixels);
-
+        for c in 0..4 {
+            pos = match decode_plane_rle(buffer, pos, w, h, &quant, out_pixels, 4, c) {
+                Some(p) => p, None => return false,
+            };
+        }
         if let Some(v) = out_icc {
             if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
         }
         return true;
     }
 
-    false
+    // ---- v4..v19: YCbCr 4:2:0 (+ A) + Huffman → RGB / RGBA ----
+    let p = match plane_profile(version) { Some(p) => p, None => return false };
+    let channels = p.channels();
+    if out_pixels.len() < w * h * channels {
+        return false;
+    }
+    *out_width = width; *out_height = height; *out_channels = channels as u32;
+
+    let (luma_q, chroma_q) = p.quant_tables(q);
+    let pos = match decode_huffman_planes(scratch, buffer, header_size, w, h, &luma_q, &chroma_q, p, out_pixels) {
+        Some(p) => p,
+        None => return false,
+    };
+    if let Some(v) = out_icc {
+        if let Some((icc, _)) = parse_icc_trailer(buffer, pos) { *v = icc; }
+    }
+    true
 }
 
 pub fn decode_grayscale(
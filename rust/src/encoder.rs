@@ -1,13 +1,15 @@
-use crate::bitstream;
+use crate::bitstream::{self, Sink};
 use crate::block::Block;
 use crate::blockizer::Blockizer;
-use crate::colorspace;
+use crate::colorspace::{self, PixelFormat, YcbcrBlocks};
+use crate::container;
 use crate::dct;
 use crate::entropy;
 use crate::ffi::quantize_block;
 use crate::huffman;
 use crate::zigzag::ZIGZAG;
 use rayon::prelude::*;
+use std::borrow::Cow;
 const BLOCK_TILE_SIZE: usize = 512;
 const PARALLEL_BLOCKS_THRESHOLD: usize = 384;
 const PARALLEL_PLANE_PIXELS_THRESHOLD: usize = 262_144;
@@ -20,10 +22,22 @@ fn should_parallel_blocks(n_blocks: usize, plane_w: usize, plane_h: usize) -> bo
 }
 
 #[inline]
-fn should_parallel_planes(width: usize, height: usize) -> bool {
+pub(crate) fn should_parallel_planes(width: usize, height: usize) -> bool {
     width.saturating_mul(height) >= PARALLEL_IMAGE_PIXELS_THRESHOLD
 }
 
+/// Apply `f` to every block of a `plane_w`×`plane_h` plane, in parallel tiles when large.
+pub(crate) fn for_each_block<F>(blocks: &mut [Block], plane_w: usize, plane_h: usize, f: F)
+where
+    F: Fn(&mut Block) + Sync + Send,
+{
+    if should_parallel_blocks(blocks.len(), plane_w, plane_h) {
+        blocks.par_chunks_mut(BLOCK_TILE_SIZE).for_each(|chunk| chunk.iter_mut().for_each(&f));
+    } else {
+        blocks.iter_mut().for_each(f);
+    }
+}
+
 /// .bg header: "BG" + version + width(u32 LE) + height(u32 LE) + quality(u8) = 12 bytes.
 ///
 /// Version byte:
@@ -53,6 +67,9 @@ const BG_MAGIC_RGB:     &[u8; 3] = b"BG\x02";
 const BG_MAGIC_RGBA:    &[u8; 3] = b"BG\x03";
 const BG_MAGIC_YUV420_V8:  &[u8; 3] = b"BG\x12";
 const BG_MAGIC_YUV420A_V8: &[u8; 3] = b"BG\x13";
+/// Plane profile of the current RGB/RGBA Huffman path, as stored by v20 and .bga.
+pub(crate) const BG_PROFILE_YUV420: u8 = BG_MAGIC_YUV420_V8[2];
+pub(crate) const BG_VERSION_GRAY: u8 = BG_MAGIC_GRAY[2];
 
 /// Standard JPEG luminance quantization table (quality ~50).
 pub fn default_quant_table() -> [i16; 64] {
@@ -326,19 +343,24 @@ pub fn quantize(block: &mut [i16; 64], table: &[i16; 64]) {
     unsafe { quantize_block(block.as_mut_ptr(), table.as_ptr()); }
 }
 
+/// The 12-byte stream header: magic, version, width, height, quality.
+pub(crate) fn header_bytes(version: u8, w: usize, h: usize, q: u8) -> [u8; BG_HEADER_SIZE] {
+    let mut hdr = [0u8; BG_HEADER_SIZE];
+    let mut pos = 0;
+    write_header(&mut hdr, &mut pos, &[b'B', b'G', version], w, h, q);
+    hdr
+}
+
 fn write_header(out: &mut [u8], pos: &mut i32, magic: &[u8; 3], w: usize, h: usize, q: u8) {
-    if (*pos as usize) + BG_HEADER_SIZE > out.len() { return; }
     bitstream::write_bytes(out, pos, magic);
     for b in (w as u32).to_le_bytes() { bitstream::write_byte(out, pos, b); }
     for b in (h as u32).to_le_bytes() { bitstream::write_byte(out, pos, b); }
     bitstream::write_byte(out, pos, if q == 0 { 50 } else { q });
 }
 
-fn write_icc_trailer(out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>) {
+pub(crate) fn write_icc_trailer(out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>) {
     let Some(data) = icc else { return };
     if data.is_empty() { return; }
-    let need = 3 + 1 + 4 + data.len();
-    if (*pos as usize) + need > out.len() { return; }
     bitstream::write_byte(out, pos, b'B');
     bitstream::write_byte(out, pos, b'G');
     bitstream::write_byte(out, pos, b'x');
@@ -351,6 +373,9 @@ fn write_icc_trailer(out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>) {
 // RLE path (legacy v1/v2/v3)
 // ---------------------------------------------------------------------------
 
+/// Largest RLE block: DC, 63 (run, level) triples, end of block.
+const RLE_BLOCK_MAX: usize = 2 + 63 * 3 + 3;
+
 fn encode_blocks_rle(
     blocks: &mut [Block],
     table: &[i16; 64],
@@ -359,39 +384,34 @@ fn encode_blocks_rle(
     plane_w: usize,
     plane_h: usize,
 ) {
-    if should_parallel_blocks(blocks.len(), plane_w, plane_h) {
-        blocks.par_chunks_mut(BLOCK_TILE_SIZE).for_each(|chunk| {
-            for block in chunk.iter_mut() {
-                dct::dct(block);
-                quantize(&mut block.data, table);
-            }
-        });
-    } else {
-        for block in blocks.iter_mut() {
-            dct::dct(block);
-            quantize(&mut block.data, table);
-        }
-    }
+    for_each_block(blocks, plane_w, plane_h, |block| {
+        dct::dct(block);
+        quantize(&mut block.data, table);
+    });
+    // Near the end of `out`, code into scratch so a short buffer still counts the size needed.
+    let mut scratch = [0u8; RLE_BLOCK_MAX];
     for block in blocks.iter() {
-        entropy::encode_block_to_buffer(block, out, pos);
+        if out.len().saturating_sub(*pos as usize) >= RLE_BLOCK_MAX {
+            entropy::encode_block_to_buffer(block, out, pos);
+        } else {
+            let mut p: i32 = 0;
+            entropy::encode_block_to_buffer(block, &mut scratch, &mut p);
+            bitstream::write_bytes(out, pos, &scratch[..p as usize]);
+        }
     }
 }
 
-fn encode_channel_rle(blocks: &mut [Block], table: &[i16; 64], plane_w: usize, plane_h: usize) -> Vec<u8> {
-    if should_parallel_blocks(blocks.len(), plane_w, plane_h) {
-        blocks.par_chunks_mut(BLOCK_TILE_SIZE).for_each(|chunk| {
-            for block in chunk.iter_mut() {
-                dct::dct(block);
-                quantize(&mut block.data, table);
-            }
-        });
-    } else {
-        for block in blocks.iter_mut() {
-            dct::dct(block);
-            quantize(&mut block.data, table);
-        }
-    }
-    let cap = blocks.len() * (2 + 63 * 3 + 3);
+pub(crate) fn encode_channel_rle(blocks: &mut [Block], table: &[i16; 64], plane_w: usize, plane_h: usize) -> Vec<u8> {
+    for_each_block(blocks, plane_w, plane_h, |block| {
+        dct::dct(block);
+        quantize(&mut block.data, table);
+    });
+    rle_payload(blocks)
+}
+
+/// RLE payload of already quantized blocks.
+pub(crate) fn rle_payload(blocks: &[Block]) -> Vec<u8> {
+    let cap = blocks.len() * RLE_BLOCK_MAX;
     let mut buf = vec![0u8; cap];
     let mut p: i32 = 0;
     for block in blocks.iter() {
@@ -416,164 +436,482 @@ pub fn encode_grayscale(
 // Huffman + YCbCr 4:2:0 path (v4/v5) — best compression
 // ---------------------------------------------------------------------------
 
-/// Encode blocks with Huffman into a Vec<u8>. Parallel DCT+quant, sequential Huffman.
-fn encode_channel_huffman(
+/// DCT + quant (+ AC sparsify) + JPEG coefficient clamp, in place. Parallel for large planes.
+pub(crate) fn quantize_blocks(
     blocks: &mut [Block],
     table: &[i16; 64],
     plane_w: usize,
     plane_h: usize,
-    is_chroma: bool,
-    use_chroma_ac: bool,
-    use_dc_delta: bool,
     sparsify_thresholds: Option<&[i16; 64]>,
-) -> Vec<u8> {
-    if should_parallel_blocks(blocks.len(), plane_w, plane_h) {
-        blocks.par_chunks_mut(BLOCK_TILE_SIZE).for_each(|chunk| {
-            for block in chunk.iter_mut() {
-                dct::dct(block);
-                quantize(&mut block.data, table);
-                if let Some(thr) = sparsify_thresholds {
-                    sparsify_ac_block(block, thr);
-                }
-                huffman::clamp_block_jpeg_coeffs(block);
+) {
+    for_each_block(blocks, plane_w, plane_h, |block| {
+        dct::dct(block);
+        quantize_coeffs(block, table, sparsify_thresholds);
+    });
+}
+
+/// Quant (+ AC sparsify) + JPEG coefficient clamp of one block already through the DCT.
+#[inline]
+pub(crate) fn quantize_coeffs(block: &mut Block, table: &[i16; 64], sparsify_thresholds: Option<&[i16; 64]>) {
+    quantize(&mut block.data, table);
+    if let Some(thr) = sparsify_thresholds {
+        sparsify_ac_block(block, thr);
+    }
+    huffman::clamp_block_jpeg_coeffs(block);
+}
+
+/// Write one plane to a sink as `[len: u32 LE][payload]` (v4+ sequential layout).
+pub(crate) fn write_plane_to<S: Sink>(sink: &mut S, payload: &[u8]) -> bool {
+    sink.write(&(payload.len() as u32).to_le_bytes()) && sink.write(payload)
+}
+
+/// Quant tables and sparsify thresholds of the current (v18/v19) profile,
+/// or caller-supplied tables (v20 with `DQT ` chunks).
+pub(crate) struct PlaneTables {
+    pub(crate) luma: [i16; 64],
+    pub(crate) chroma: [i16; 64],
+    luma_sparsify: [i16; 64],
+    chroma_sparsify: [i16; 64],
+}
+
+impl PlaneTables {
+    pub(crate) fn for_quality(quality: u8) -> Self {
+        Self {
+            luma: quant_table_for_quality_perceptual_v4(quality),
+            chroma: chroma_quant_table_for_quality_perceptual_v4(quality),
+            luma_sparsify: build_sparsify_thresholds(quality, false),
+            chroma_sparsify: build_sparsify_thresholds(quality, true),
+        }
+    }
+
+    /// Quant table and sparsify thresholds for luma/alpha or chroma planes.
+    pub(crate) fn plane(&self, chroma: bool) -> (&[i16; 64], &[i16; 64]) {
+        if chroma {
+            (&self.chroma, &self.chroma_sparsify)
+        } else {
+            (&self.luma, &self.luma_sparsify)
+        }
+    }
+
+    /// DCT + quantize luma/alpha blocks of a `w`×`h` plane with this profile.
+    pub(crate) fn quantize_luma(&self, blocks: &mut [Block], w: usize, h: usize) {
+        quantize_blocks(blocks, &self.luma, w, h, Some(&self.luma_sparsify));
+    }
+
+    /// DCT + quantize chroma blocks of a `cw`×`ch` plane with this profile.
+    pub(crate) fn quantize_chroma(&self, blocks: &mut [Block], cw: usize, ch: usize) {
+        quantize_blocks(blocks, &self.chroma, cw, ch, Some(&self.chroma_sparsify));
+    }
+
+    /// Custom tables; `quality` still drives the AC sparsify thresholds.
+    fn custom(luma: &[i16; 64], chroma: &[i16; 64], quality: u8) -> Self {
+        Self {
+            luma: *luma,
+            chroma: *chroma,
+            luma_sparsify: build_sparsify_thresholds(quality, false),
+            chroma_sparsify: build_sparsify_thresholds(quality, true),
+        }
+    }
+}
+
+/// Where a plane's blocks come from.
+#[derive(Clone, Copy)]
+enum Samples<'a> {
+    /// u8 samples `stride` bytes per row, blockized on demand.
+    Plane { samples: &'a [u8], stride: usize, w: usize, h: usize },
+    /// Blocks already DCT'd and quantized with this plane's tables.
+    Quantized(&'a [Block]),
+}
+
+/// One plane to entropy code, with the luma/alpha or chroma profile.
+#[derive(Clone, Copy)]
+struct PlaneSrc<'a> {
+    src: Samples<'a>,
+    chroma: bool,
+}
+
+impl<'a> PlaneSrc<'a> {
+    fn luma(samples: &'a [u8], stride: usize, w: usize, h: usize) -> Self {
+        Self { src: Samples::Plane { samples, stride, w, h }, chroma: false }
+    }
+
+    fn chroma(samples: &'a [u8], stride: usize, w: usize, h: usize) -> Self {
+        Self { src: Samples::Plane { samples, stride, w, h }, chroma: true }
+    }
+
+    fn quantized(blocks: &'a [Block], chroma: bool) -> Self {
+        Self { src: Samples::Quantized(blocks), chroma }
+    }
+
+    /// Blockize, DCT and quantize with this plane's tables (if not done already).
+    fn quantized_blocks(&self, t: &PlaneTables) -> Cow<'a, [Block]> {
+        let (samples, stride, w, h) = match self.src {
+            Samples::Plane { samples, stride, w, h } => (samples, stride, w, h),
+            Samples::Quantized(blocks) => return Cow::Borrowed(blocks),
+        };
+        let mut blocks = Blockizer::new(w, h).generate_blocks_strided(samples, stride);
+        if self.chroma {
+            t.quantize_chroma(&mut blocks, w, h);
+        } else {
+            t.quantize_luma(&mut blocks, w, h);
+        }
+        Cow::Owned(blocks)
+    }
+
+    /// Bare entropy payload in a new Vec.
+    fn payload(&self, t: &PlaneTables) -> Vec<u8> {
+        huffman::encode_plane_payload(&self.quantized_blocks(t), self.chroma, self.chroma, true)
+    }
+
+    /// Entropy payload written into `out`; returns its length (see `encode_plane_into`).
+    fn payload_into(&self, t: &PlaneTables, out: &mut [u8]) -> usize {
+        huffman::encode_plane_into(&self.quantized_blocks(t), self.chroma, self.chroma, true, out)
+    }
+
+    /// Worst-case payload size (`encode_bound`).
+    fn bound(&self, t: &PlaneTables) -> usize {
+        let n_blocks = match self.src {
+            Samples::Plane { w, h, .. } => ((w + 7) / 8) * ((h + 7) / 8),
+            Samples::Quantized(blocks) => blocks.len(),
+        };
+        huffman_plane_bound(if self.chroma { &t.chroma } else { &t.luma }, n_blocks, self.chroma)
+    }
+}
+
+/// Interleaved `fmt` pixels to quantized Y, Cb, Cr (and A) blocks: color conversion
+/// and blockization are fused per 16-row band, then each plane is DCT'd and quantized
+/// in place.
+fn quantized_ycbcr_blocks(
+    image: &[u8], width: usize, height: usize, fmt: PixelFormat, stride: usize, t: &PlaneTables,
+) -> YcbcrBlocks {
+    let mut b = colorspace::pixels_to_ycbcr420_blocks(image, width, height, fmt, stride);
+    let (cw, ch) = ((width + 1) / 2, (height + 1) / 2);
+    t.quantize_luma(&mut b.y, width, height);
+    t.quantize_chroma(&mut b.cb, cw, ch);
+    t.quantize_chroma(&mut b.cr, cw, ch);
+    if let Some(a) = b.a.as_mut() {
+        t.quantize_luma(a, width, height);
+    }
+    b
+}
+
+/// Y, Cb, Cr (and A) of `quantized_ycbcr_blocks` in stream order.
+fn ycbcr_plane_srcs(b: &YcbcrBlocks) -> Vec<PlaneSrc<'_>> {
+    let mut planes = vec![
+        PlaneSrc::quantized(&b.y, false),
+        PlaneSrc::quantized(&b.cb, true),
+        PlaneSrc::quantized(&b.cr, true),
+    ];
+    planes.extend(b.a.as_deref().map(|a| PlaneSrc::quantized(a, false)));
+    planes
+}
+
+pub(crate) fn encode_luma_plane(plane: &[u8], width: usize, height: usize, t: &PlaneTables) -> Vec<u8> {
+    PlaneSrc::luma(plane, width, width, height).payload(t)
+}
+
+/// Payloads in stream order, coded concurrently (nested `rayon::join`) for large images.
+fn plane_payloads(planes: &[PlaneSrc], t: &PlaneTables, parallel: bool) -> Vec<Vec<u8>> {
+    if !parallel || planes.len() < 2 {
+        return planes.iter().map(|p| p.payload(t)).collect();
+    }
+    let (l, r) = planes.split_at(planes.len() / 2);
+    let (mut a, b) = rayon::join(|| plane_payloads(l, t, true), || plane_payloads(r, t, true));
+    a.extend(b);
+    a
+}
+
+/// Code each `planes[i]` into `regions[i]`, concurrently; lengths go to `lens[i]`.
+fn code_regions(planes: &[PlaneSrc], regions: &mut [&mut [u8]], lens: &mut [usize], t: &PlaneTables) {
+    if planes.len() == 1 {
+        lens[0] = planes[0].payload_into(t, regions[0]);
+        return;
+    }
+    let mid = planes.len() / 2;
+    let (pl, pr) = planes.split_at(mid);
+    let (rl, rr) = regions.split_at_mut(mid);
+    let (ll, lr) = lens.split_at_mut(mid);
+    rayon::join(|| code_regions(pl, rl, ll, t), || code_regions(pr, rr, lr, t));
+}
+
+/// Write `planes` as `[len][payload]...` at `pos`, with the entropy coders writing
+/// straight into `out` (no per-plane Vec).
+///
+/// Sequentially, each plane is coded at its final offset and its length patched in
+/// front. In parallel (large images, and room for every plane's worst case) `out` is
+/// split into one worst-case region per plane; afterwards the lengths are patched
+/// and planes after the first are moved down over the slack.
+fn write_planes_direct(planes: &[PlaneSrc], t: &PlaneTables, parallel: bool, out: &mut [u8], pos: &mut i32) {
+    let start = *pos as usize;
+    if parallel && planes.len() > 1 {
+        let bounds: Vec<usize> = planes.iter().map(|p| p.bound(t)).collect();
+        let need: usize = bounds.iter().map(|b| 4 + b).sum();
+        if out.len().saturating_sub(start) >= need {
+            let mut lens = vec![0usize; planes.len()];
+            let mut regions: Vec<&mut [u8]> = Vec::with_capacity(planes.len());
+            let mut rest = &mut out[start..];
+            for &b in &bounds {
+                let (region, tail) = std::mem::take(&mut rest).split_at_mut(4 + b);
+                regions.push(&mut region[4..]);
+                rest = tail;
             }
-        });
-    } else {
-        for block in blocks.iter_mut() {
-            dct::dct(block);
-            quantize(&mut block.data, table);
-            if let Some(thr) = sparsify_thresholds {
-                sparsify_ac_block(block, thr);
+            code_regions(planes, &mut regions, &mut lens, t);
+            if lens.iter().zip(&bounds).all(|(len, b)| len <= b) {
+                let (mut src, mut dst) = (start, start);
+                for (&len, &b) in lens.iter().zip(&bounds) {
+                    if src != dst {
+                        out.copy_within(src + 4..src + 4 + len, dst + 4);
+                    }
+                    out[dst..dst + 4].copy_from_slice(&(len as u32).to_le_bytes());
+                    src += 4 + b;
+                    dst += 4 + len;
+                }
+                *pos = dst as i32;
+                return;
             }
-            huffman::clamp_block_jpeg_coeffs(block);
+            // A bound was exceeded (cannot happen for valid tables): recode in place.
         }
     }
-    huffman::encode_plane_with_profile(blocks, is_chroma, use_chroma_ac, use_dc_delta)
+    for plane in planes {
+        write_plane_blocks(&plane.quantized_blocks(t), plane.chroma, out, pos);
+    }
 }
 
-/// Encode RGB image using YCbCr 4:2:0 + Huffman (version 4).
+/// Entropy code quantized blocks as `[len][payload]` at `pos`, straight into `out`.
+pub(crate) fn write_plane_blocks(blocks: &[Block], chroma: bool, out: &mut [u8], pos: &mut i32) {
+    let mut len_at = *pos;
+    let region = out.get_mut(*pos as usize + 4..).unwrap_or_default();
+    let len = huffman::encode_plane_into(blocks, chroma, chroma, true, region);
+    bitstream::write_bytes(out, &mut len_at, &(len as u32).to_le_bytes());
+    *pos = len_at + len as i32;
+}
+
+/// RGB → Y, Cb, Cr entropy payloads (v18 profile). Planes are coded in parallel for large images.
+pub(crate) fn encode_ycbcr_planes(image: &[u8], width: usize, height: usize, t: &PlaneTables) -> [Vec<u8>; 3] {
+    let blocks = quantized_ycbcr_blocks(image, width, height, PixelFormat::Rgb, width * 3, t);
+    plane_payloads(&ycbcr_plane_srcs(&blocks), t, should_parallel_planes(width, height)).try_into().unwrap()
+}
+
+/// RGBA → Y, Cb, Cr, A entropy payloads (v19 profile).
+pub(crate) fn encode_ycbcra_planes(image: &[u8], width: usize, height: usize, t: &PlaneTables) -> [Vec<u8>; 4] {
+    let blocks = quantized_ycbcr_blocks(image, width, height, PixelFormat::Rgba, width * 4, t);
+    plane_payloads(&ycbcr_plane_srcs(&blocks), t, should_parallel_planes(width, height)).try_into().unwrap()
+}
+
+/// Encode RGB image using YCbCr 4:2:0 + Huffman (version 18).
 /// This is the recommended path for RGB images — best compression ratio.
 pub fn encode_rgb_ycbcr(
     image: &[u8], width: usize, height: usize, quality: u8,
     out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
 ) {
-    write_header(out, pos, BG_MAGIC_YUV420_V8, width, height, quality);
-
-    let (y, cb, cr) = colorspace::rgb_to_ycbcr420(image, width, height);
-    let cw = (width  + 1) / 2;
-    let ch = (height + 1) / 2;
-
-    let luma_table   = quant_table_for_quality_perceptual_v4(quality);
-    let chroma_table = chroma_quant_table_for_quality_perceptual_v4(quality);
-    let luma_sparsify = build_sparsify_thresholds(quality, false);
-    let chroma_sparsify = build_sparsify_thresholds(quality, true);
-
-    // Encode Y, Cb, Cr in parallel — each into its own buffer
-    let blockizer_full   = Blockizer::new(width, height);
-    let blockizer_chroma = Blockizer::new(cw, ch);
-
-    let (y_buf, cb_buf, cr_buf) = if should_parallel_planes(width, height) {
-        let (y_buf, (cb_buf, cr_buf)) = rayon::join(
-            || {
-                let mut blocks = blockizer_full.generate_blocks(&y);
-                encode_channel_huffman(&mut blocks, &luma_table, width, height, false, false, true, Some(&luma_sparsify))
-            },
-            || {
-                rayon::join(
-                    || {
-                        let mut blocks = blockizer_chroma.generate_blocks(&cb);
-                        encode_channel_huffman(&mut blocks, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify))
-                    },
-                    || {
-                        let mut blocks = blockizer_chroma.generate_blocks(&cr);
-                        encode_channel_huffman(&mut blocks, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify))
-                    },
-                )
-            },
-        );
-        (y_buf, cb_buf, cr_buf)
-    } else {
-        let mut yb = blockizer_full.generate_blocks(&y);
-        let y_buf = encode_channel_huffman(&mut yb, &luma_table, width, height, false, false, true, Some(&luma_sparsify));
-        let mut cbb = blockizer_chroma.generate_blocks(&cb);
-        let cb_buf = encode_channel_huffman(&mut cbb, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify));
-        let mut crb = blockizer_chroma.generate_blocks(&cr);
-        let cr_buf = encode_channel_huffman(&mut crb, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify));
-        (y_buf, cb_buf, cr_buf)
-    };
-
-    bitstream::write_bytes(out, pos, &y_buf);
-    bitstream::write_bytes(out, pos, &cb_buf);
-    bitstream::write_bytes(out, pos, &cr_buf);
-    write_icc_trailer(out, pos, icc);
+    encode_pixels(image, width, height, PixelFormat::Rgb, width * 3, quality, out, pos, icc);
 }
 
-/// Encode RGBA image using YCbCr 4:2:0 + Huffman + full-res alpha (version 5).
+/// Encode RGBA image using YCbCr 4:2:0 + Huffman + full-res alpha (version 19).
 pub fn encode_rgba_ycbcr(
     image: &[u8], width: usize, height: usize, quality: u8,
     out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
 ) {
-    write_header(out, pos, BG_MAGIC_YUV420A_V8, width, height, quality);
-
-    let (y, cb, cr, a) = colorspace::rgba_to_ycbcr420a(image, width, height);
-    let cw = (width  + 1) / 2;
-    let ch = (height + 1) / 2;
-
-    let luma_table   = quant_table_for_quality_perceptual_v4(quality);
-    let chroma_table = chroma_quant_table_for_quality_perceptual_v4(quality);
-    let luma_sparsify = build_sparsify_thresholds(quality, false);
-    let chroma_sparsify = build_sparsify_thresholds(quality, true);
-
-    let blockizer_full   = Blockizer::new(width, height);
-    let blockizer_chroma = Blockizer::new(cw, ch);
-
-    let (y_buf, cb_buf, cr_buf, a_buf) = if should_parallel_planes(width, height) {
-        let ((y_buf, a_buf), (cb_buf, cr_buf)) = rayon::join(
-            || {
-                rayon::join(
-                    || {
-                        let mut blocks = blockizer_full.generate_blocks(&y);
-                        encode_channel_huffman(&mut blocks, &luma_table, width, height, false, false, true, Some(&luma_sparsify))
-                    },
-                    || {
-                        let mut blocks = blockizer_full.generate_blocks(&a);
-                        encode_channel_huffman(&mut blocks, &luma_table, width, height, false, false, true, Some(&luma_sparsify))
-                    },
-                )
-            },
-            || {
-                rayon::join(
-                    || {
-                        let mut blocks = blockizer_chroma.generate_blocks(&cb);
-                        encode_channel_huffman(&mut blocks, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify))
-                    },
-                    || {
-                        let mut blocks = blockizer_chroma.generate_blocks(&cr);
-                        encode_channel_huffman(&mut blocks, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify))
-                    },
-                )
-            },
-        );
-        (y_buf, cb_buf, cr_buf, a_buf)
-    } else {
-        let mut yb = blockizer_full.generate_blocks(&y);
-        let y_buf = encode_channel_huffman(&mut yb, &luma_table, width, height, false, false, true, Some(&luma_sparsify));
-        let mut cbb = blockizer_chroma.generate_blocks(&cb);
-        let cb_buf = encode_channel_huffman(&mut cbb, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify));
-        let mut crb = blockizer_chroma.generate_blocks(&cr);
-        let cr_buf = encode_channel_huffman(&mut crb, &chroma_table, cw, ch, true, true, true, Some(&chroma_sparsify));
-        let mut ab = blockizer_full.generate_blocks(&a);
-        let a_buf = encode_channel_huffman(&mut ab, &luma_table, width, height, false, false, true, Some(&luma_sparsify));
-        (y_buf, cb_buf, cr_buf, a_buf)
-    };
+    encode_pixels(image, width, height, PixelFormat::Rgba, width * 4, quality, out, pos, icc);
+}
 
-    bitstream::write_bytes(out, pos, &y_buf);
-    bitstream::write_bytes(out, pos, &cb_buf);
-    bitstream::write_bytes(out, pos, &cr_buf);
-    bitstream::write_bytes(out, pos, &a_buf);
+/// Encode planar YUV 4:2:0 (Y and A `width`×`height`, Cb/Cr half size rounded up) as
+/// version 18, or 19 when `a` is given, without color conversion. Each plane is
+/// `(samples, row stride)`; the samples go straight to the blockizer.
+pub fn encode_yuv420(
+    y: (&[u8], usize), cb: (&[u8], usize), cr: (&[u8], usize), a: Option<(&[u8], usize)>,
+    width: usize, height: usize, quality: u8,
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let t = PlaneTables::for_quality(quality);
+    let (cw, ch) = ((width + 1) / 2, (height + 1) / 2);
+    let mut planes = vec![
+        PlaneSrc::luma(y.0, y.1, width, height),
+        PlaneSrc::chroma(cb.0, cb.1, cw, ch),
+        PlaneSrc::chroma(cr.0, cr.1, cw, ch),
+    ];
+    planes.extend(a.map(|(p, s)| PlaneSrc::luma(p, s, width, height)));
+    write_yuv420(&planes, &t, width, height, quality, out, pos, icc);
+}
+
+/// Encode interleaved `fmt` pixels with rows `stride` bytes apart: version 19 for
+/// RGBA/BGRA, version 18 otherwise (the X byte of RGBX/BGRX is ignored). Pixels go
+/// straight to quantized blocks (`quantized_ycbcr_blocks`): the row kernels read the
+/// layout in place and no full-size Y/Cb/Cr plane is made.
+pub fn encode_pixels(
+    image: &[u8], width: usize, height: usize, fmt: PixelFormat, stride: usize, quality: u8,
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let t = PlaneTables::for_quality(quality);
+    let blocks = quantized_ycbcr_blocks(image, width, height, fmt, stride, &t);
+    write_yuv420(&ycbcr_plane_srcs(&blocks), &t, width, height, quality, out, pos, icc);
+}
+
+/// Header, Y/Cb/Cr(/A) planes and ICC trailer of a v18 (three planes) or v19 stream.
+fn write_yuv420(
+    planes: &[PlaneSrc], t: &PlaneTables, width: usize, height: usize, quality: u8,
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let magic = if planes.len() == 4 { BG_MAGIC_YUV420A_V8 } else { BG_MAGIC_YUV420_V8 };
+    write_header(out, pos, magic, width, height, quality);
+    write_planes_direct(planes, t, should_parallel_planes(width, height), out, pos);
     write_icc_trailer(out, pos, icc);
 }
 
+/// Encode like `encode_grayscale` (channels 1), `encode_rgb_ycbcr` (3) or
+/// `encode_rgba_ycbcr` (4), handing the header and then each finished plane to `sink`
+/// instead of a preallocated buffer. Color conversion, DCT and quantization run up
+/// front; planes are then entropy coded one at a time and written as each completes,
+/// so at most one payload is held. False if the sink fails or `channels` is invalid.
+pub fn encode_to_sink<S: Sink>(
+    image: &[u8], width: usize, height: usize, channels: usize, quality: u8, sink: &mut S,
+) -> bool {
+    let (magic, fmt) = match channels {
+        1 => (BG_MAGIC_GRAY, PixelFormat::Rgb),
+        3 => (BG_MAGIC_YUV420_V8, PixelFormat::Rgb),
+        4 => (BG_MAGIC_YUV420A_V8, PixelFormat::Rgba),
+        _ => return false,
+    };
+    if !sink.write(&header_bytes(magic[2], width, height, quality)) {
+        return false;
+    }
+    if channels == 1 {
+        let mut blocks = Blockizer::new(width, height).generate_blocks(image);
+        return sink.write(&encode_channel_rle(&mut blocks, &quant_table_for_quality(quality), width, height));
+    }
+    let t = PlaneTables::for_quality(quality);
+    let blocks = quantized_ycbcr_blocks(image, width, height, fmt, width * channels, &t);
+    ycbcr_plane_srcs(&blocks).iter().all(|p| write_plane_to(sink, &p.payload(&t)))
+}
+
+// ---------------------------------------------------------------------------
+// Output size bound
+// ---------------------------------------------------------------------------
+
+/// Largest magnitude of each natural-order coefficient after the forward DCT of
+/// level-shifted samples (|x| <= 128) and quantization by `table`, rounding included.
+fn max_quantized_coeffs(table: &[i16; 64]) -> [i32; 64] {
+    let s = |u: usize| -> f64 {
+        (0..8).map(|x| ((2 * x + 1) as f64 * u as f64 * std::f64::consts::PI / 16.0).cos().abs()).sum()
+    };
+    let c = |u: usize| if u == 0 { std::f64::consts::FRAC_1_SQRT_2 } else { 1.0 };
+    let mut out = [0i32; 64];
+    for v in 0..8 {
+        for u in 0..8 {
+            let coeff = (128.0 * 0.25 * c(u) * c(v) * s(u) * s(v) + 1.0).ceil() as i32;
+            let q = table[v * 8 + u].max(1) as i32;
+            out[v * 8 + u] = (coeff + q / 2) / q;
+        }
+    }
+    out
+}
+
+/// Worst-case bytes of one Huffman plane of `n_blocks` blocks, stuffing included.
+fn huffman_plane_bound(table: &[i16; 64], n_blocks: usize, is_chroma: bool) -> usize {
+    let bits = huffman::max_block_bits(&max_quantized_coeffs(table), is_chroma, is_chroma, true);
+    // Every byte could be 0xFF and gain a stuffed 0x00.
+    2 * ((n_blocks * bits + 7) / 8)
+}
+
+/// Upper bound on the stream `encode_grayscale` (channels 1), `encode_rgb_ycbcr` (3) or
+/// `encode_rgba_ycbcr` (4) writes for this size and quality, without ICC trailer.
+/// Derived from the quant tables: the largest coefficient each position can hold and
+/// the longest code for it. None for other channel counts or a zero dimension.
+pub fn encode_bound(width: usize, height: usize, channels: usize, quality: u8) -> Option<usize> {
+    if width == 0 || height == 0 {
+        return None;
+    }
+    let luma_blocks = ((width + 7) / 8) * ((height + 7) / 8);
+    let chroma_blocks = (((width + 1) / 2 + 7) / 8) * (((height + 1) / 2 + 7) / 8);
+    let planes = match channels {
+        1 => {
+            // RLE: DC, one (run, level) triple per position that can be non-zero, end of block.
+            let max = max_quantized_coeffs(&quant_table_for_quality(quality));
+            let live = max[1..].iter().filter(|&&m| m > 0).count();
+            luma_blocks * (2 + 3 * live + 3)
+        }
+        3 | 4 => {
+            let t = PlaneTables::for_quality(quality);
+            let luma = huffman_plane_bound(&t.luma, luma_blocks, false);
+            let chroma = huffman_plane_bound(&t.chroma, chroma_blocks, true);
+            (channels - 2) * luma + 2 * chroma + 4 * channels
+        }
+        _ => return None,
+    };
+    Some(BG_HEADER_SIZE + planes)
+}
+
+// ---------------------------------------------------------------------------
+// Chunked container (v20) — same plane coding as v18/v19, TOC up front
+// ---------------------------------------------------------------------------
+
+/// Write planes + quant tables (+ ICC) as a v20 container. The tables are always
+/// stored so decoders never have to rebuild them from profile + quality.
+fn write_chunked(
+    planes: &[Vec<u8>], tables: &PlaneTables, profile: u8,
+    width: usize, height: usize, quality: u8,
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let q = if quality == 0 { 50 } else { quality };
+    let luma_dqt = container::quant_table_bytes(&tables.luma);
+    let chroma_dqt = container::quant_table_bytes(&tables.chroma);
+    let mut writer = container::ContainerWriter::new(width as u32, height as u32, q, profile);
+    let mut ok = writer.add_chunk(container::TAG_QUANT, container::QUANT_TABLE_LUMA, &luma_dqt);
+    ok &= writer.add_chunk(container::TAG_QUANT, container::QUANT_TABLE_CHROMA, &chroma_dqt);
+    for (idx, plane) in planes.iter().enumerate() {
+        ok &= writer.add_chunk(container::TAG_PLANE, idx as u32, plane);
+    }
+    if let Some(data) = icc.filter(|d| !d.is_empty()) {
+        ok &= writer.add_chunk(container::TAG_ICC, 0, data);
+    }
+    // At most seven chunks, and the i32 write position keeps offsets in u32 range.
+    debug_assert!(ok);
+    writer.write(out, pos);
+}
+
+/// Encode RGB into the chunked container (version 20, plane profile 18).
+pub fn encode_rgb_chunked(
+    image: &[u8], width: usize, height: usize, quality: u8,
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let tables = PlaneTables::for_quality(quality);
+    let planes = encode_ycbcr_planes(image, width, height, &tables);
+    write_chunked(&planes, &tables, BG_MAGIC_YUV420_V8[2], width, height, quality, out, pos, icc);
+}
+
+/// Encode RGBA into the chunked container (version 20, plane profile 19).
+pub fn encode_rgba_chunked(
+    image: &[u8], width: usize, height: usize, quality: u8,
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let tables = PlaneTables::for_quality(quality);
+    let planes = encode_ycbcra_planes(image, width, height, &tables);
+    write_chunked(&planes, &tables, BG_MAGIC_YUV420A_V8[2], width, height, quality, out, pos, icc);
+}
+
+/// Encode RGB with caller-supplied luma/chroma quant tables (natural order, entries ≥ 1).
+/// Output is a v20 container; the tables travel in `DQT ` chunks.
+pub fn encode_rgb_with_tables(
+    image: &[u8], width: usize, height: usize, quality: u8,
+    luma: &[i16; 64], chroma: &[i16; 64],
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let tables = PlaneTables::custom(luma, chroma, quality);
+    let planes = encode_ycbcr_planes(image, width, height, &tables);
+    write_chunked(&planes, &tables, BG_MAGIC_YUV420_V8[2], width, height, quality, out, pos, icc);
+}
+
+/// Encode RGBA with caller-supplied quant tables (alpha uses the luma table).
+pub fn encode_rgba_with_tables(
+    image: &[u8], width: usize, height: usize, quality: u8,
+    luma: &[i16; 64], chroma: &[i16; 64],
+    out: &mut [u8], pos: &mut i32, icc: Option<&[u8]>,
+) {
+    let tables = PlaneTables::custom(luma, chroma, quality);
+    let planes = encode_ycbcra_planes(image, width, height, &tables);
+    write_chunked(&planes, &tables, BG_MAGIC_YUV420A_V8[2], width, height, quality, out, pos, icc);
+}
+
 // ---------------------------------------------------------------------------
 // Legacy RGB/RGBA RLE paths (v2/v3) — kept for backward compat
 // ---------------------------------------------------------------------------
@@ -5,10 +5,12 @@ use std::slice;
 use std::sync::atomic::{AtomicUsize, Ordering};
 
 extern "C" {
+    #[cfg(not(test))]
     pub fn quantize_block(
         block: *mut i16,
         table: *const i16,
     );
+    #[cfg(not(test))]
     pub fn dequantize_block(
         block: *mut i16,
         table: *const i16,
@@ -17,12 +19,35 @@ extern "C" {
     pub fn bitgrain_idct_block(block: *mut i16);
 }
 
+// Test builds don't link the C objects: scalar equivalents of c/quant.c
+// (SIMD quantize rounds half-to-even; dequantize saturates).
+#[cfg(test)]
+pub unsafe fn quantize_block(block: *mut i16, table: *const i16) {
+    let b = slice::from_raw_parts_mut(block, 64);
+    let t = slice::from_raw_parts(table, 64);
+    for i in 0..64 {
+        let v = (b[i] as f32 / t[i] as f32).round_ties_even();
+        b[i] = v.clamp(i16::MIN as f32, i16::MAX as f32) as i16;
+    }
+}
+
+#[cfg(test)]
+pub unsafe fn dequantize_block(block: *mut i16, table: *const i16) {
+    let b = slice::from_raw_parts_mut(block, 64);
+    let t = slice::from_raw_parts(table, 64);
+    for i in 0..64 {
+        b[i] = (b[i] as i32 * t[i] as i32).clamp(i16::MIN as i32, i16::MAX as i32) as i16;
+    }
+}
+
 static RAYON_THREADS_CONFIGURED: AtomicUsize = AtomicUsize::new(0);
 
 const BITGRAIN_OK: i32 = 0;
 const BITGRAIN_ERR_INVALID_ARG: i32 = 1;
 const BITGRAIN_ERR_DECODE_FAILED: i32 = 2;
 const BITGRAIN_ERR_THREAD_INIT: i32 = 3;
+const BITGRAIN_ERR_NEED_DATA: i32 = 4;
+const BITGRAIN_ERR_SINK: i32 = 5;
 const BITGRAIN_ERR_PANIC: i32 = 100;
 
 thread_local! {
@@ -60,6 +85,16 @@ where
     }
 }
 
+/// Report the length of a finished encode. Encoders keep counting past the end of a
+/// short buffer, so `pos` is the size needed; it is returned in `out_len` either way.
+fn encoded(pos: i32, capacity: usize, out_len: *mut i32) -> i32 {
+    unsafe { *out_len = pos };
+    if pos as usize > capacity {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "output buffer too small (*out_len = size needed)");
+    }
+    0
+}
+
 #[no_mangle]
 pub extern "C" fn bitgrain_last_error_code() -> i32 {
     LAST_ERROR_CODE.with(|c| c.get())
@@ -131,8 +166,7 @@ pub extern "C" fn bitgrain_encode_grayscale(
             buffer_slice,
             &mut pos,
         );
-        unsafe { *out_len = pos };
-        0
+        encoded(pos, out_capacity as usize, out_len)
     })
 }
 
@@ -169,8 +203,7 @@ pub extern "C" fn bitgrain_encode_rgb(
             &mut pos,
             None,
         );
-        unsafe { *out_len = pos };
-        0
+        encoded(pos, out_capacity as usize, out_len)
     })
 }
 
@@ -207,8 +240,7 @@ pub extern "C" fn bitgrain_encode_rgba(
             &mut pos,
             None,
         );
-        unsafe { *out_len = pos };
-        0
+        encoded(pos, out_capacity as usize, out_len)
     })
 }
 
@@ -289,6 +321,323 @@ pub extern "C" fn bitgrain_decode_grayscale(
     })
 }
 
+/// Check a .bg stream's structure without decoding pixels. On failure the reason is
+/// the last error message and out_error_offset (may be NULL) gets the byte offset
+/// where parsing stopped.
+#[no_mangle]
+pub extern "C" fn bitgrain_validate(buffer: *const u8, size: i32, out_error_offset: *mut u32) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || size <= 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid validate arguments");
+    }
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        match crate::validate::validate(buf_slice) {
+            Ok(()) => 0,
+            Err(e) => {
+                if !out_error_offset.is_null() {
+                    unsafe { *out_error_offset = e.offset as u32; }
+                }
+                fail(BITGRAIN_ERR_DECODE_FAILED, e.reason)
+            }
+        }
+    })
+}
+
+/// Decode into a caller-chosen pixel format (BITGRAIN_PIXEL_*) with output rows `stride`
+/// bytes apart (0 = width * bytes per pixel). out_capacity must be >= stride*(h-1) + w*bpp.
+#[no_mangle]
+pub extern "C" fn bitgrain_decode_to_format(
+    buffer: *const u8,
+    size: i32,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    pixel_format: u32,
+    stride: u32,
+    out_width: *mut u32,
+    out_height: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_pixels.is_null() || out_width.is_null() || out_height.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_to_format arguments");
+    }
+    if size <= 0 || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_to_format buffer size/capacity");
+    }
+    let fmt = match crate::colorspace::PixelFormat::from_code(pixel_format) {
+        Some(f) => f,
+        None => return fail(BITGRAIN_ERR_INVALID_ARG, "unknown pixel format"),
+    };
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        let ok = crate::decoder::decode_to_format(
+            &mut crate::decoder::DecodeScratch::default(),
+            buf_slice,
+            out_slice,
+            fmt,
+            stride as usize,
+            unsafe { &mut *out_width },
+            unsafe { &mut *out_height },
+        );
+        if ok {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "decode_to_format failed (corrupt stream, stride or capacity too small)")
+        }
+    })
+}
+
+/// Decode resized to target_w x target_h with a BITGRAIN_FILTER_* resampling filter,
+/// tightly packed with the stream's channel count (out_capacity >= target_w*target_h*4
+/// always suffices).
+#[no_mangle]
+pub extern "C" fn bitgrain_decode_resized(
+    buffer: *const u8,
+    size: i32,
+    target_w: u32,
+    target_h: u32,
+    filter: u32,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    out_channels: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_pixels.is_null() || out_channels.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_resized arguments");
+    }
+    if size <= 0 || out_capacity == 0 || target_w == 0 || target_h == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_resized buffer size/capacity/target");
+    }
+    let filter = match crate::resample::Filter::from_code(filter) {
+        Some(f) => f,
+        None => return fail(BITGRAIN_ERR_INVALID_ARG, "unknown resampling filter"),
+    };
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        let ok = crate::decoder::decode_resized(
+            buf_slice,
+            target_w as usize,
+            target_h as usize,
+            filter,
+            out_slice,
+            unsafe { &mut *out_channels },
+        );
+        if ok {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "decode_resized failed (corrupt stream or capacity too small)")
+        }
+    })
+}
+
+/// Decode only the region_w x region_h rectangle at (x, y). out_pixels receives it
+/// tightly packed with the stream's channel count; out_width/out_height receive the
+/// full image size. out_capacity must be >= region_w*region_h*channels.
+#[no_mangle]
+pub extern "C" fn bitgrain_decode_region(
+    buffer: *const u8,
+    size: i32,
+    x: u32,
+    y: u32,
+    region_w: u32,
+    region_h: u32,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    out_width: *mut u32,
+    out_height: *mut u32,
+    out_channels: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_pixels.is_null() || out_width.is_null()
+        || out_height.is_null() || out_channels.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_region arguments");
+    }
+    if size <= 0 || out_capacity == 0 || region_w == 0 || region_h == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_region buffer size/capacity/region");
+    }
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        let ok = crate::decoder::decode_region(
+            buf_slice,
+            x as usize,
+            y as usize,
+            region_w as usize,
+            region_h as usize,
+            out_slice,
+            unsafe { &mut *out_width },
+            unsafe { &mut *out_height },
+            unsafe { &mut *out_channels },
+        );
+        if ok {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "decode_region failed (corrupt stream, region outside image or capacity too small)")
+        }
+    })
+}
+
+/// Decode a v4..v20 stream to planar Y, U (Cb), V (Cr) and optional A without color
+/// conversion. Rows of each plane are `*_stride` bytes apart. With y = NULL only the
+/// dimensions and channel count are returned (3 = YUV, 4 = YUV + alpha).
+#[no_mangle]
+pub extern "C" fn bitgrain_decode_yuv(
+    buffer: *const u8,
+    size: i32,
+    y: *mut u8,
+    y_stride: u32,
+    u: *mut u8,
+    u_stride: u32,
+    v: *mut u8,
+    v_stride: u32,
+    a: *mut u8,
+    a_stride: u32,
+    out_width: *mut u32,
+    out_height: *mut u32,
+    out_channels: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || size <= 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decode_yuv arguments");
+    }
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let set = match crate::decoder::parse_plane_set(buf_slice) {
+            Some(s) => s,
+            None => return fail(BITGRAIN_ERR_DECODE_FAILED, "decode_yuv: not a YCbCr 4:2:0 stream (v4-v20)"),
+        };
+        let (w, h) = (set.width, set.height);
+        unsafe {
+            if !out_width.is_null() { *out_width = w as u32; }
+            if !out_height.is_null() { *out_height = h as u32; }
+            if !out_channels.is_null() { *out_channels = if set.has_alpha() { 4 } else { 3 }; }
+        }
+        if y.is_null() {
+            return 0;
+        }
+        let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+        let (y_stride, u_stride, v_stride, a_stride) =
+            (y_stride as usize, u_stride as usize, v_stride as usize, a_stride as usize);
+        if u.is_null() || v.is_null() || y_stride < w || u_stride < cw || v_stride < cw
+            || (!a.is_null() && a_stride < w) {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "decode_yuv: missing plane or stride below plane width");
+        }
+        let y_slice = unsafe { slice::from_raw_parts_mut(y, y_stride * (h - 1) + w) };
+        let u_slice = unsafe { slice::from_raw_parts_mut(u, u_stride * (ch - 1) + cw) };
+        let v_slice = unsafe { slice::from_raw_parts_mut(v, v_stride * (ch - 1) + cw) };
+        let a_plane = if a.is_null() {
+            None
+        } else {
+            Some((unsafe { slice::from_raw_parts_mut(a, a_stride * (h - 1) + w) }, a_stride))
+        };
+        if crate::decoder::decode_yuv(&set, y_slice, y_stride, u_slice, u_stride, v_slice, v_stride, a_plane) {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "decode_yuv failed")
+        }
+    })
+}
+
+/// Encode interleaved BITGRAIN_PIXEL_* pixels with rows `stride` bytes apart
+/// (0 = width * bytes per pixel). RGBA/BGRA keep alpha (v19); RGBX/BGRX ignore the pad byte.
+/// quality: 1–100, 0 = default 85.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_from_format(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    pixel_format: u32,
+    stride: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    quality: u8,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 || width == 0 || height == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_from_format arguments");
+    }
+    let fmt = match crate::colorspace::PixelFormat::from_code(pixel_format) {
+        Some(f) => f,
+        None => return fail(BITGRAIN_ERR_INVALID_ARG, "unknown pixel format"),
+    };
+    let (w, h) = (width as usize, height as usize);
+    let row_len = w * fmt.bytes_per_pixel();
+    let stride = if stride == 0 { row_len } else { stride as usize };
+    if stride < row_len {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "stride smaller than a row");
+    }
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let image_slice = unsafe { slice::from_raw_parts(image, stride * (h - 1) + row_len) };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        crate::encoder::encode_pixels(image_slice, w, h, fmt, stride, q, buffer_slice, &mut pos, None);
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Encode planar YUV 4:2:0 without color conversion (v18, or v19 when `a` is
+/// non-NULL). Y and A are width×height, U and V half size rounded up; strides >= plane width.
+/// quality: 1–100, 0 = default 85.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_yuv420(
+    y: *const u8,
+    y_stride: u32,
+    u: *const u8,
+    u_stride: u32,
+    v: *const u8,
+    v_stride: u32,
+    a: *const u8,
+    a_stride: u32,
+    width: u32,
+    height: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    quality: u8,
+) -> i32 {
+    clear_last_error();
+    if y.is_null() || u.is_null() || v.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_yuv420 arguments");
+    }
+    let (w, h) = (width as usize, height as usize);
+    let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+    let (y_stride, u_stride, v_stride, a_stride) =
+        (y_stride as usize, u_stride as usize, v_stride as usize, a_stride as usize);
+    if w == 0 || h == 0 || y_stride < w || u_stride < cw || v_stride < cw || (!a.is_null() && a_stride < w) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "encode_yuv420: empty image or stride below plane width");
+    }
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let y_slice = unsafe { slice::from_raw_parts(y, y_stride * (h - 1) + w) };
+        let u_slice = unsafe { slice::from_raw_parts(u, u_stride * (ch - 1) + cw) };
+        let v_slice = unsafe { slice::from_raw_parts(v, v_stride * (ch - 1) + cw) };
+        let a_plane = if a.is_null() {
+            None
+        } else {
+            Some((unsafe { slice::from_raw_parts(a, a_stride * (h - 1) + w) }, a_stride))
+        };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        crate::encoder::encode_yuv420(
+            (y_slice, y_stride),
+            (u_slice, u_stride),
+            (v_slice, v_stride),
+            a_plane,
+            w,
+            h,
+            q,
+            buffer_slice,
+            &mut pos,
+            None,
+        );
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
 /// Encode RGB with optional ICC profile.
 #[no_mangle]
 pub extern "C" fn bitgrain_encode_rgb_icc(
@@ -328,8 +677,7 @@ pub extern "C" fn bitgrain_encode_rgb_icc(
             &mut pos,
             icc_opt,
         );
-        unsafe { *out_len = pos };
-        0
+        encoded(pos, out_capacity as usize, out_len)
     })
 }
 
@@ -372,8 +720,7 @@ pub extern "C" fn bitgrain_encode_rgba_icc(
             &mut pos,
             icc_opt,
         );
-        unsafe { *out_len = pos };
-        0
+        encoded(pos, out_capacity as usize, out_len)
     })
 }
 
@@ -441,3 +788,1330 @@ pub extern "C" fn bitgrain_free_icc(ptr: *mut u8, len: u32) {
     }
     let _ = unsafe { Vec::from_raw_parts(ptr, len as usize, len as usize) };
 }
+
+/// Encode RGB into the chunked container (v20) with optional ICC profile.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_rgb_chunked(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    quality: u8,
+    icc: *const u8,
+    icc_len: u32,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_rgb_chunked arguments");
+    }
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(3);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        let icc_opt = if !icc.is_null() && icc_len > 0 {
+            Some(unsafe { slice::from_raw_parts(icc, icc_len as usize) })
+        } else {
+            None
+        };
+        crate::encoder::encode_rgb_chunked(
+            image_slice,
+            width as usize,
+            height as usize,
+            q,
+            buffer_slice,
+            &mut pos,
+            icc_opt,
+        );
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Encode RGBA into the chunked container (v20) with optional ICC profile.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_rgba_chunked(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    quality: u8,
+    icc: *const u8,
+    icc_len: u32,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_rgba_chunked arguments");
+    }
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(4);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        let icc_opt = if !icc.is_null() && icc_len > 0 {
+            Some(unsafe { slice::from_raw_parts(icc, icc_len as usize) })
+        } else {
+            None
+        };
+        crate::encoder::encode_rgba_chunked(
+            image_slice,
+            width as usize,
+            height as usize,
+            q,
+            buffer_slice,
+            &mut pos,
+            icc_opt,
+        );
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Copy a caller quant table; None if any entry is outside 1..=32767.
+fn read_quant_table(table: *const u16) -> Option<[i16; 64]> {
+    let src = unsafe { slice::from_raw_parts(table, 64) };
+    let mut out = [0i16; 64];
+    for (dst, &v) in out.iter_mut().zip(src) {
+        if v == 0 || v > i16::MAX as u16 {
+            return None;
+        }
+        *dst = v as i16;
+    }
+    Some(out)
+}
+
+/// Encode RGB with custom luma/chroma quant tables (64 entries, natural order).
+/// Writes a v20 container carrying the tables.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_rgb_tables(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    quality: u8,
+    luma_table: *const u16,
+    chroma_table: *const u16,
+    icc: *const u8,
+    icc_len: u32,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0
+        || luma_table.is_null() || chroma_table.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_rgb_tables arguments");
+    }
+    let (luma, chroma) = match (read_quant_table(luma_table), read_quant_table(chroma_table)) {
+        (Some(l), Some(c)) => (l, c),
+        _ => return fail(BITGRAIN_ERR_INVALID_ARG, "quant table entries must be in 1..32767"),
+    };
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(3);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        let icc_opt = if !icc.is_null() && icc_len > 0 {
+            Some(unsafe { slice::from_raw_parts(icc, icc_len as usize) })
+        } else {
+            None
+        };
+        crate::encoder::encode_rgb_with_tables(
+            image_slice,
+            width as usize,
+            height as usize,
+            q,
+            &luma,
+            &chroma,
+            buffer_slice,
+            &mut pos,
+            icc_opt,
+        );
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Encode RGBA with custom quant tables (alpha uses the luma table).
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_rgba_tables(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    quality: u8,
+    luma_table: *const u16,
+    chroma_table: *const u16,
+    icc: *const u8,
+    icc_len: u32,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0
+        || luma_table.is_null() || chroma_table.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_rgba_tables arguments");
+    }
+    let (luma, chroma) = match (read_quant_table(luma_table), read_quant_table(chroma_table)) {
+        (Some(l), Some(c)) => (l, c),
+        _ => return fail(BITGRAIN_ERR_INVALID_ARG, "quant table entries must be in 1..32767"),
+    };
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(4);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        let icc_opt = if !icc.is_null() && icc_len > 0 {
+            Some(unsafe { slice::from_raw_parts(icc, icc_len as usize) })
+        } else {
+            None
+        };
+        crate::encoder::encode_rgba_with_tables(
+            image_slice,
+            width as usize,
+            height as usize,
+            q,
+            &luma,
+            &chroma,
+            buffer_slice,
+            &mut pos,
+            icc_opt,
+        );
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Encode gray / RGB / RGBA (channels 1, 3 or 4) losslessly (version 22).
+/// icc may be NULL. Fails with BITGRAIN_ERR_INVALID_ARG if out_capacity is too small.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_lossless(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    channels: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    icc: *const u8,
+    icc_len: u32,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0
+        || width == 0 || height == 0 || !matches!(channels, 1 | 3 | 4) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_lossless arguments");
+    }
+    ffi_guard(|| {
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(channels as usize);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let icc_opt = if !icc.is_null() && icc_len > 0 {
+            Some(unsafe { slice::from_raw_parts(icc, icc_len as usize) })
+        } else {
+            None
+        };
+        let mut pos: i32 = 0;
+        if !crate::lossless::encode(
+            image_slice,
+            width as usize,
+            height as usize,
+            channels,
+            buffer_slice,
+            &mut pos,
+            icc_opt,
+        ) {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "lossless output buffer too small or dimensions out of range");
+        }
+        unsafe { *out_len = pos };
+        0
+    })
+}
+
+/// One TOC entry of a v20 container (mirrors bitgrain_chunk_t).
+#[repr(C)]
+pub struct BitgrainChunk {
+    pub tag: [u8; 4],
+    pub offset: u32,
+    pub length: u32,
+    pub info: u32,
+}
+
+/// Bytes of a v20 stream needed to read its full TOC. Needs the first 16 bytes.
+#[no_mangle]
+pub extern "C" fn bitgrain_container_toc_size(
+    buffer: *const u8,
+    size: i32,
+    out_toc_size: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_toc_size.is_null() || size <= 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid container_toc_size arguments");
+    }
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        match crate::container::toc_size(buf_slice) {
+            Some(n) => {
+                unsafe { *out_toc_size = n as u32 };
+                0
+            }
+            None => fail(BITGRAIN_ERR_DECODE_FAILED, "not a chunked .bg stream or header truncated"),
+        }
+    })
+}
+
+/// Read the TOC of a v20 stream. `buffer` may be a prefix of the file
+/// (at least bitgrain_container_toc_size bytes). At most max_chunks entries are
+/// written; *out_count receives the total number of chunks.
+#[no_mangle]
+pub extern "C" fn bitgrain_container_toc(
+    buffer: *const u8,
+    size: i32,
+    out_chunks: *mut BitgrainChunk,
+    max_chunks: u32,
+    out_count: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_count.is_null() || size <= 0 || (out_chunks.is_null() && max_chunks > 0) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid container_toc arguments");
+    }
+    ffi_guard(|| {
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let chunks = match crate::container::read_toc(buf_slice) {
+            Some(c) => c,
+            None => return fail(BITGRAIN_ERR_DECODE_FAILED, "not a chunked .bg stream or TOC truncated"),
+        };
+        let n = chunks.len().min(max_chunks as usize);
+        if n > 0 {
+            let out = unsafe { slice::from_raw_parts_mut(out_chunks, n) };
+            for (dst, c) in out.iter_mut().zip(&chunks) {
+                *dst = BitgrainChunk { tag: c.tag, offset: c.offset, length: c.length, info: c.info };
+            }
+        }
+        unsafe { *out_count = chunks.len() as u32 };
+        0
+    })
+}
+
+// ---------------------------------------------------------------------------
+// Multi-image archive (.bga)
+// ---------------------------------------------------------------------------
+
+/// Opaque archive builder handle (bitgrain_archive_builder_t).
+pub struct BitgrainArchiveBuilder(crate::archive::ArchiveBuilder);
+
+/// Archive index entry (mirrors bitgrain_archive_entry_t).
+#[repr(C)]
+pub struct BitgrainArchiveEntry {
+    pub id: u64,
+    pub offset: u64,
+    pub length: u32,
+    pub width: u32,
+    pub height: u32,
+    pub channels: u32,
+}
+
+impl From<crate::archive::ArchiveEntry> for BitgrainArchiveEntry {
+    fn from(e: crate::archive::ArchiveEntry) -> Self {
+        Self { id: e.id, offset: e.offset, length: e.length, width: e.width, height: e.height, channels: e.channels }
+    }
+}
+
+/// Create an archive builder. quality: 1–100, 0 = default 85. Returns NULL on failure.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_builder_new(quality: u8) -> *mut BitgrainArchiveBuilder {
+    clear_last_error();
+    match catch_unwind(|| Box::new(BitgrainArchiveBuilder(crate::archive::ArchiveBuilder::new(quality)))) {
+        Ok(b) => Box::into_raw(b),
+        Err(_) => {
+            set_last_error(BITGRAIN_ERR_PANIC, "panic in codec internals");
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Encode one image (channels 1, 3 or 4) into the builder under `id`.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_builder_add(
+    builder: *mut BitgrainArchiveBuilder,
+    id: u64,
+    image: *const u8,
+    width: u32,
+    height: u32,
+    channels: u32,
+) -> i32 {
+    clear_last_error();
+    if builder.is_null() || image.is_null() || width == 0 || height == 0
+        || !matches!(channels, 1 | 3 | 4) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_builder_add arguments");
+    }
+    ffi_guard(|| {
+        let b = unsafe { &mut *builder };
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(channels as usize);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        if b.0.add(id, image_slice, width as usize, height as usize, channels) {
+            0
+        } else {
+            fail(BITGRAIN_ERR_INVALID_ARG, "archive image dimensions out of range")
+        }
+    })
+}
+
+/// Bytes bitgrain_archive_builder_finish will write.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_builder_size(
+    builder: *const BitgrainArchiveBuilder,
+    out_size: *mut u64,
+) -> i32 {
+    clear_last_error();
+    if builder.is_null() || out_size.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_builder_size arguments");
+    }
+    unsafe { *out_size = (*builder).0.encoded_len() as u64 };
+    0
+}
+
+/// Write the archive (entries sorted by id). Fails on duplicate ids or short buffer.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_builder_finish(
+    builder: *mut BitgrainArchiveBuilder,
+    out_buffer: *mut u8,
+    out_capacity: u64,
+    out_len: *mut u64,
+) -> i32 {
+    clear_last_error();
+    if builder.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_builder_finish arguments");
+    }
+    ffi_guard(|| {
+        let b = unsafe { &mut *builder };
+        if (out_capacity as usize) < b.0.encoded_len() {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "archive output buffer too small");
+        }
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        match b.0.write(buffer_slice) {
+            Some(n) => {
+                unsafe { *out_len = n as u64 };
+                0
+            }
+            None => fail(BITGRAIN_ERR_INVALID_ARG, "duplicate archive ids"),
+        }
+    })
+}
+
+/// Free a builder from bitgrain_archive_builder_new. NULL is a no-op.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_builder_free(builder: *mut BitgrainArchiveBuilder) {
+    if builder.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(builder) };
+}
+
+#[inline]
+fn archive_slice<'a>(buffer: *const u8, size: u64) -> Option<crate::archive::Archive<'a>> {
+    let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+    crate::archive::Archive::parse(buf_slice)
+}
+
+/// Number of images in an archive.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_count(buffer: *const u8, size: u64, out_count: *mut u32) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_count.is_null() || size == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_count arguments");
+    }
+    ffi_guard(|| match archive_slice(buffer, size) {
+        Some(a) => {
+            unsafe { *out_count = a.len() as u32 };
+            0
+        }
+        None => fail(BITGRAIN_ERR_DECODE_FAILED, "not a .bga archive or index truncated"),
+    })
+}
+
+/// Find `id` in the archive index (binary search, no decode).
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_lookup(
+    buffer: *const u8,
+    size: u64,
+    id: u64,
+    out_entry: *mut BitgrainArchiveEntry,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_entry.is_null() || size == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_lookup arguments");
+    }
+    ffi_guard(|| {
+        let a = match archive_slice(buffer, size) {
+            Some(a) => a,
+            None => return fail(BITGRAIN_ERR_DECODE_FAILED, "not a .bga archive or index truncated"),
+        };
+        match a.lookup(id) {
+            Some(e) => {
+                unsafe { *out_entry = e.into() };
+                0
+            }
+            None => fail(BITGRAIN_ERR_INVALID_ARG, "archive id not found"),
+        }
+    })
+}
+
+/// Decode one image by id. out_entry may be NULL.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_decode(
+    buffer: *const u8,
+    size: u64,
+    id: u64,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    out_entry: *mut BitgrainArchiveEntry,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || out_pixels.is_null() || size == 0 || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_decode arguments");
+    }
+    ffi_guard(|| {
+        let a = match archive_slice(buffer, size) {
+            Some(a) => a,
+            None => return fail(BITGRAIN_ERR_DECODE_FAILED, "not a .bga archive or index truncated"),
+        };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        match a.decode(id, out_slice) {
+            Some(e) => {
+                if !out_entry.is_null() {
+                    unsafe { *out_entry = e.into() };
+                }
+                0
+            }
+            None => fail(BITGRAIN_ERR_DECODE_FAILED, "archive_decode failed (missing id, corrupt entry or small buffer)"),
+        }
+    })
+}
+
+/// Decode `n` images in parallel. outs[i] receives ids[i] (out_capacity bytes each);
+/// results[i] is 0 on success or a BITGRAIN_ERR_* code. Returns -1 if any entry failed.
+#[no_mangle]
+pub extern "C" fn bitgrain_archive_decode_batch(
+    buffer: *const u8,
+    size: u64,
+    ids: *const u64,
+    n: u32,
+    outs: *const *mut u8,
+    out_capacity: u32,
+    results: *mut i32,
+) -> i32 {
+    clear_last_error();
+    if buffer.is_null() || ids.is_null() || outs.is_null() || results.is_null() || size == 0 || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid archive_decode_batch arguments");
+    }
+    ffi_guard(|| {
+        let a = match archive_slice(buffer, size) {
+            Some(a) => a,
+            None => return fail(BITGRAIN_ERR_DECODE_FAILED, "not a .bga archive or index truncated"),
+        };
+        let ids = unsafe { slice::from_raw_parts(ids, n as usize) };
+        let outs = unsafe { slice::from_raw_parts(outs, n as usize) };
+        let results = unsafe { slice::from_raw_parts_mut(results, n as usize) };
+        if outs.iter().any(|p| p.is_null()) {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "NULL output in archive_decode_batch");
+        }
+        let mut jobs: Vec<(u64, &mut [u8])> = ids
+            .iter()
+            .zip(outs)
+            .map(|(&id, &p)| (id, unsafe { slice::from_raw_parts_mut(p, out_capacity as usize) }))
+            .collect();
+        let decoded = a.decode_batch(&mut jobs);
+        let mut failed = false;
+        for (r, d) in results.iter_mut().zip(&decoded) {
+            *r = if d.is_some() { BITGRAIN_OK } else { BITGRAIN_ERR_DECODE_FAILED };
+            failed |= d.is_none();
+        }
+        if failed {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "one or more archive entries failed to decode")
+        } else {
+            0
+        }
+    })
+}
+
+// ---------------------------------------------------------------------------
+// Multi-frame sequences (v21)
+// ---------------------------------------------------------------------------
+
+/// Opaque sequence encoder handle (bitgrain_sequence_encoder_t).
+pub struct BitgrainSequenceEncoder(crate::sequence::SequenceEncoder);
+
+/// Opaque sequence decoder handle (bitgrain_sequence_decoder_t). Borrows the
+/// caller's buffer, which must outlive the handle.
+pub struct BitgrainSequenceDecoder(crate::sequence::SequenceDecoder<'static>);
+
+/// Create a sequence encoder. keyframe_interval: keyframe every N frames, 0 = first only.
+/// Returns NULL on invalid arguments or failure.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_encoder_new(
+    width: u32,
+    height: u32,
+    channels: u32,
+    quality: u8,
+    keyframe_interval: u32,
+) -> *mut BitgrainSequenceEncoder {
+    clear_last_error();
+    let made = catch_unwind(|| {
+        crate::sequence::SequenceEncoder::new(width as usize, height as usize, channels, quality, keyframe_interval)
+    });
+    match made {
+        Ok(Some(e)) => Box::into_raw(Box::new(BitgrainSequenceEncoder(e))),
+        Ok(None) => {
+            set_last_error(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_encoder_new arguments");
+            std::ptr::null_mut()
+        }
+        Err(_) => {
+            set_last_error(BITGRAIN_ERR_PANIC, "panic in codec internals");
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Encode one frame (width*height*channels bytes, interleaved).
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_encoder_push(
+    encoder: *mut BitgrainSequenceEncoder,
+    image: *const u8,
+) -> i32 {
+    clear_last_error();
+    if encoder.is_null() || image.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_encoder_push arguments");
+    }
+    ffi_guard(|| {
+        let e = unsafe { &mut *encoder };
+        let image_slice = unsafe { slice::from_raw_parts(image, e.0.frame_len()) };
+        if e.0.push_frame(image_slice) {
+            0
+        } else {
+            fail(BITGRAIN_ERR_INVALID_ARG, "too many frames in sequence")
+        }
+    })
+}
+
+/// Bytes bitgrain_sequence_encoder_finish will write.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_encoder_size(
+    encoder: *const BitgrainSequenceEncoder,
+    out_size: *mut u64,
+) -> i32 {
+    clear_last_error();
+    if encoder.is_null() || out_size.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_encoder_size arguments");
+    }
+    unsafe { *out_size = (*encoder).0.encoded_len() as u64 };
+    0
+}
+
+/// Write the sequence (header, frame index, frames). The encoder stays usable.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_encoder_finish(
+    encoder: *const BitgrainSequenceEncoder,
+    out_buffer: *mut u8,
+    out_capacity: u64,
+    out_len: *mut u64,
+) -> i32 {
+    clear_last_error();
+    if encoder.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_encoder_finish arguments");
+    }
+    ffi_guard(|| {
+        let e = unsafe { &*encoder };
+        let need = e.0.encoded_len();
+        if need > i32::MAX as usize {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "sequence exceeds 2 GiB");
+        }
+        if (out_capacity as usize) < need {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "sequence output buffer too small");
+        }
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, need) };
+        let mut pos: i32 = 0;
+        e.0.write(buffer_slice, &mut pos);
+        unsafe { *out_len = pos as u64 };
+        0
+    })
+}
+
+/// Free an encoder from bitgrain_sequence_encoder_new. NULL is a no-op.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_encoder_free(encoder: *mut BitgrainSequenceEncoder) {
+    if encoder.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(encoder) };
+}
+
+/// Open a v21 sequence for frame-by-frame decoding. `buffer` must stay valid
+/// until bitgrain_sequence_decoder_free. Returns NULL on failure.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_decoder_new(buffer: *const u8, size: u64) -> *mut BitgrainSequenceDecoder {
+    clear_last_error();
+    if buffer.is_null() || size == 0 {
+        set_last_error(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_decoder_new arguments");
+        return std::ptr::null_mut();
+    }
+    let made = catch_unwind(|| {
+        let buf_slice: &'static [u8] = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        crate::sequence::SequenceDecoder::new(buf_slice)
+    });
+    match made {
+        Ok(Some(d)) => Box::into_raw(Box::new(BitgrainSequenceDecoder(d))),
+        Ok(None) => {
+            set_last_error(BITGRAIN_ERR_DECODE_FAILED, "not a v21 sequence or index truncated");
+            std::ptr::null_mut()
+        }
+        Err(_) => {
+            set_last_error(BITGRAIN_ERR_PANIC, "panic in codec internals");
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Sequence dimensions, channel count (1, 3 or 4) and frame count. Any output may be NULL.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_decoder_info(
+    decoder: *const BitgrainSequenceDecoder,
+    out_width: *mut u32,
+    out_height: *mut u32,
+    out_channels: *mut u32,
+    out_frames: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if decoder.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_decoder_info arguments");
+    }
+    let s = unsafe { (*decoder).0.sequence() };
+    unsafe {
+        if !out_width.is_null() { *out_width = s.width; }
+        if !out_height.is_null() { *out_height = s.height; }
+        if !out_channels.is_null() { *out_channels = s.channels; }
+        if !out_frames.is_null() { *out_frames = s.frame_count as u32; }
+    }
+    0
+}
+
+/// Decode the next frame. out_frame (may be NULL) receives its index.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_decoder_next(
+    decoder: *mut BitgrainSequenceDecoder,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    out_frame: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if decoder.is_null() || out_pixels.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_decoder_next arguments");
+    }
+    ffi_guard(|| {
+        let d = unsafe { &mut *decoder };
+        let index = d.0.position();
+        if index >= d.0.sequence().frame_count {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "end of sequence");
+        }
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        if !d.0.decode_next(out_slice) {
+            return fail(BITGRAIN_ERR_DECODE_FAILED, "sequence frame decode failed (corrupt frame or small buffer)");
+        }
+        if !out_frame.is_null() {
+            unsafe { *out_frame = index as u32 };
+        }
+        0
+    })
+}
+
+/// Make `frame` the next frame returned by bitgrain_sequence_decoder_next.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_decoder_seek(decoder: *mut BitgrainSequenceDecoder, frame: u32) -> i32 {
+    clear_last_error();
+    if decoder.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid sequence_decoder_seek arguments");
+    }
+    ffi_guard(|| {
+        let d = unsafe { &mut *decoder };
+        if d.0.seek(frame as usize) {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "sequence seek failed (frame out of range or corrupt)")
+        }
+    })
+}
+
+/// Free a decoder from bitgrain_sequence_decoder_new. NULL is a no-op.
+#[no_mangle]
+pub extern "C" fn bitgrain_sequence_decoder_free(decoder: *mut BitgrainSequenceDecoder) {
+    if decoder.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(decoder) };
+}
+
+// ---------------------------------------------------------------------------
+// Streaming decoder
+// ---------------------------------------------------------------------------
+
+/// Opaque decoder handle (bitgrain_decoder_t): streaming state plus scratch buffers
+/// reused by one-shot decodes.
+pub struct BitgrainDecoder {
+    stream: crate::stream::StreamDecoder,
+    scratch: crate::decoder::DecodeScratch,
+}
+
+/// Create a decoder. Returns NULL on failure.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_new() -> *mut BitgrainDecoder {
+    clear_last_error();
+    let new = || {
+        Box::new(BitgrainDecoder {
+            stream: crate::stream::StreamDecoder::new(),
+            scratch: crate::decoder::DecodeScratch::default(),
+        })
+    };
+    match catch_unwind(new) {
+        Ok(d) => Box::into_raw(d),
+        Err(_) => {
+            set_last_error(BITGRAIN_ERR_PANIC, "panic in codec internals");
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Append `size` bytes of the .bg stream and decode as far as they allow.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_feed(decoder: *mut BitgrainDecoder, data: *const u8, size: u64) -> i32 {
+    clear_last_error();
+    if decoder.is_null() || (data.is_null() && size > 0) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_feed arguments");
+    }
+    ffi_guard(|| {
+        let d = unsafe { &mut *decoder };
+        let data_slice = if size == 0 { &[][..] } else { unsafe { slice::from_raw_parts(data, size as usize) } };
+        if d.stream.feed(data_slice) {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "corrupt or non-streamable .bg stream")
+        }
+    })
+}
+
+/// Image size and channel count. Fails with BITGRAIN_ERR_NEED_DATA until the header has arrived.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_info(
+    decoder: *const BitgrainDecoder,
+    out_width: *mut u32,
+    out_height: *mut u32,
+    out_channels: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if decoder.is_null() || out_width.is_null() || out_height.is_null() || out_channels.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_info arguments");
+    }
+    match unsafe { (*decoder).stream.info() } {
+        Some((w, h, ch)) => {
+            unsafe {
+                *out_width = w;
+                *out_height = h;
+                *out_channels = ch;
+            }
+            0
+        }
+        None => fail(BITGRAIN_ERR_NEED_DATA, "header not received yet"),
+    }
+}
+
+/// Copy up to max_rows finished rows (width*channels bytes each, top to bottom)
+/// into out_pixels. *out_rows may be 0 when no new band is ready.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_read_rows(
+    decoder: *mut BitgrainDecoder,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    max_rows: u32,
+    out_rows: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if decoder.is_null() || out_pixels.is_null() || out_rows.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_read_rows arguments");
+    }
+    ffi_guard(|| {
+        let d = unsafe { &mut *decoder };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        match d.stream.read_rows(out_slice, max_rows as usize) {
+            Some(n) => {
+                unsafe { *out_rows = n as u32 };
+                0
+            }
+            None => fail(BITGRAIN_ERR_DECODE_FAILED, "corrupt .bg stream"),
+        }
+    })
+}
+
+/// bitgrain_decode on a complete stream, reusing the decoder's scratch buffers: they
+/// grow to the largest image seen and repeated calls do not allocate. Independent of
+/// the feed/read_rows state.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_decode(
+    decoder: *mut BitgrainDecoder,
+    buffer: *const u8,
+    size: i32,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    out_width: *mut u32,
+    out_height: *mut u32,
+    out_channels: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if decoder.is_null() || buffer.is_null() || out_pixels.is_null() || out_width.is_null()
+        || out_height.is_null() || out_channels.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_decode arguments");
+    }
+    if size <= 0 || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_decode buffer size/capacity");
+    }
+    ffi_guard(|| {
+        let d = unsafe { &mut *decoder };
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        let ok = crate::decoder::decode_with(
+            &mut d.scratch,
+            buf_slice,
+            out_slice,
+            unsafe { &mut *out_width },
+            unsafe { &mut *out_height },
+            unsafe { &mut *out_channels },
+            None,
+        );
+        if ok {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "decode failed")
+        }
+    })
+}
+
+/// bitgrain_decode_to_format reusing the decoder's scratch buffers.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_decode_to_format(
+    decoder: *mut BitgrainDecoder,
+    buffer: *const u8,
+    size: i32,
+    out_pixels: *mut u8,
+    out_capacity: u32,
+    pixel_format: u32,
+    stride: u32,
+    out_width: *mut u32,
+    out_height: *mut u32,
+) -> i32 {
+    clear_last_error();
+    if decoder.is_null() || buffer.is_null() || out_pixels.is_null() || out_width.is_null() || out_height.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_decode_to_format arguments");
+    }
+    if size <= 0 || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid decoder_decode_to_format buffer size/capacity");
+    }
+    let fmt = match crate::colorspace::PixelFormat::from_code(pixel_format) {
+        Some(f) => f,
+        None => return fail(BITGRAIN_ERR_INVALID_ARG, "unknown pixel format"),
+    };
+    ffi_guard(|| {
+        let d = unsafe { &mut *decoder };
+        let buf_slice = unsafe { slice::from_raw_parts(buffer, size as usize) };
+        let out_slice = unsafe { slice::from_raw_parts_mut(out_pixels, out_capacity as usize) };
+        let ok = crate::decoder::decode_to_format(
+            &mut d.scratch,
+            buf_slice,
+            out_slice,
+            fmt,
+            stride as usize,
+            unsafe { &mut *out_width },
+            unsafe { &mut *out_height },
+        );
+        if ok {
+            0
+        } else {
+            fail(BITGRAIN_ERR_DECODE_FAILED, "decode_to_format failed (corrupt stream, stride or capacity too small)")
+        }
+    })
+}
+
+/// Free a decoder from bitgrain_decoder_new. NULL is a no-op.
+#[no_mangle]
+pub extern "C" fn bitgrain_decoder_free(decoder: *mut BitgrainDecoder) {
+    if decoder.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(decoder) };
+}
+
+/// Caller output for the streaming encoder (`bitgrain_sink_t`).
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct BitgrainSink {
+    pub write: Option<extern "C" fn(user: *mut std::ffi::c_void, data: *const u8, len: u64) -> i32>,
+    pub write_at: Option<extern "C" fn(user: *mut std::ffi::c_void, offset: u64, data: *const u8, len: u64) -> i32>,
+    pub user: *mut std::ffi::c_void,
+}
+
+impl crate::bitstream::Sink for BitgrainSink {
+    fn write(&mut self, data: &[u8]) -> bool {
+        let write = self.write.expect("checked in bitgrain_encoder_new");
+        write(self.user, data.as_ptr(), data.len() as u64) == 0
+    }
+
+    fn can_write_at(&self) -> bool {
+        self.write_at.is_some()
+    }
+
+    fn write_at(&mut self, offset: u64, data: &[u8]) -> bool {
+        match self.write_at {
+            Some(write_at) => write_at(self.user, offset, data.as_ptr(), data.len() as u64) == 0,
+            None => false,
+        }
+    }
+}
+
+/// Opaque handle for bitgrain_encoder_*; None once finished.
+pub struct BitgrainEncoder(Option<crate::stream_encoder::StreamEncoder<BitgrainSink>>);
+
+/// Start a row-streaming encode to `sink` (copied). channels: 1, 3 or 4;
+/// quality: 1–100, 0 = default 85. The header is written immediately.
+/// Returns NULL on failure.
+#[no_mangle]
+pub extern "C" fn bitgrain_encoder_new(
+    width: u32,
+    height: u32,
+    channels: u32,
+    quality: u8,
+    sink: *const BitgrainSink,
+) -> *mut BitgrainEncoder {
+    clear_last_error();
+    if sink.is_null() || unsafe { (*sink).write.is_none() } {
+        set_last_error(BITGRAIN_ERR_INVALID_ARG, "invalid encoder_new arguments");
+        return std::ptr::null_mut();
+    }
+    let sink = unsafe { *sink };
+    let q = if quality == 0 { 85 } else { quality };
+    let made = catch_unwind(|| {
+        crate::stream_encoder::StreamEncoder::new(sink, width as usize, height as usize, channels as usize, q)
+    });
+    match made {
+        Ok(Some(e)) if !e.failed() => Box::into_raw(Box::new(BitgrainEncoder(Some(e)))),
+        Ok(Some(_)) => {
+            set_last_error(BITGRAIN_ERR_SINK, "sink write failed");
+            std::ptr::null_mut()
+        }
+        Ok(None) => {
+            set_last_error(BITGRAIN_ERR_INVALID_ARG, "invalid encoder_new arguments");
+            std::ptr::null_mut()
+        }
+        Err(_) => {
+            set_last_error(BITGRAIN_ERR_PANIC, "panic in codec internals");
+            std::ptr::null_mut()
+        }
+    }
+}
+
+/// Push `n_rows` rows of width*channels bytes, `stride` bytes apart (0 = packed).
+/// Every completed 16-row band is coded and its luma bytes handed to the sink.
+#[no_mangle]
+pub extern "C" fn bitgrain_encoder_push_rows(
+    encoder: *mut BitgrainEncoder,
+    rows: *const u8,
+    n_rows: u32,
+    stride: u32,
+) -> i32 {
+    clear_last_error();
+    if encoder.is_null() || (rows.is_null() && n_rows > 0) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encoder_push_rows arguments");
+    }
+    ffi_guard(|| {
+        let Some(e) = (unsafe { &mut *encoder }).0.as_mut() else {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "encoder already finished");
+        };
+        if n_rows == 0 {
+            return 0;
+        }
+        let row_len = e.row_len();
+        let stride = if stride == 0 { row_len } else { stride as usize };
+        if stride < row_len {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "stride smaller than a row");
+        }
+        if n_rows as usize > e.rows_remaining() {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "more rows than the image height");
+        }
+        let len = (n_rows as usize - 1) * stride + row_len;
+        let rows_slice = unsafe { slice::from_raw_parts(rows, len) };
+        if e.push_rows(rows_slice, n_rows as usize, stride) {
+            0
+        } else {
+            fail(BITGRAIN_ERR_SINK, "sink write failed")
+        }
+    })
+}
+
+/// After the last row: write the remaining planes and patch the luma length.
+/// The encoder is spent afterwards (free it with bitgrain_encoder_free).
+#[no_mangle]
+pub extern "C" fn bitgrain_encoder_finish(encoder: *mut BitgrainEncoder) -> i32 {
+    clear_last_error();
+    if encoder.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encoder_finish arguments");
+    }
+    ffi_guard(|| {
+        let e = unsafe { &mut *encoder };
+        match e.0.as_ref().map(|s| s.rows_remaining()) {
+            None => return fail(BITGRAIN_ERR_INVALID_ARG, "encoder already finished"),
+            Some(n) if n > 0 => return fail(BITGRAIN_ERR_INVALID_ARG, "rows missing before encoder_finish"),
+            Some(_) => {}
+        }
+        match e.0.take().and_then(|s| s.finish()) {
+            Some(_) => 0,
+            None => fail(BITGRAIN_ERR_SINK, "sink write failed"),
+        }
+    })
+}
+
+/// Free an encoder from bitgrain_encoder_new (finished or not). NULL is a no-op.
+#[no_mangle]
+pub extern "C" fn bitgrain_encoder_free(encoder: *mut BitgrainEncoder) {
+    if encoder.is_null() {
+        return;
+    }
+    let _ = unsafe { Box::from_raw(encoder) };
+}
+
+/// Worst-case size of `bitgrain_encode_grayscale` (channels 1), `bitgrain_encode_rgb` (3)
+/// or `bitgrain_encode_rgba` (4) output at this size and quality (0 = default 85),
+/// without ICC trailer. A buffer this large never fails for lack of space.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_bound(
+    width: u32,
+    height: u32,
+    channels: u32,
+    quality: u8,
+    out_bound: *mut u64,
+) -> i32 {
+    clear_last_error();
+    if out_bound.is_null() {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_bound arguments");
+    }
+    let q = if quality == 0 { 85 } else { quality };
+    match crate::encoder::encode_bound(width as usize, height as usize, channels as usize, q) {
+        Some(bound) => {
+            unsafe { *out_bound = bound as u64 };
+            0
+        }
+        None => fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_bound arguments"),
+    }
+}
+
+/// Worst-case size of `bitgrain_encode_lossless` output (channels 1, 3 or 4) at this
+/// size, without ICC trailer.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_lossless_bound(
+    width: u32,
+    height: u32,
+    channels: u32,
+    out_bound: *mut u64,
+) -> i32 {
+    clear_last_error();
+    if out_bound.is_null() || width == 0 || height == 0 || !matches!(channels, 1 | 3 | 4) {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_lossless_bound arguments");
+    }
+    let bound = crate::lossless::max_encoded_len(width as usize, height as usize, channels);
+    unsafe { *out_bound = bound as u64 };
+    0
+}
+
+/// One-shot encode (channels 1, 3 or 4, packed) written to `sink` (copied) as each
+/// plane is finished; no output buffer to size. `write_at` is not used.
+/// quality: 1–100, 0 = default 85.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_to_sink(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    channels: u32,
+    quality: u8,
+    sink: *const BitgrainSink,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || sink.is_null() || unsafe { (*sink).write.is_none() }
+        || width == 0 || height == 0 || !matches!(channels, 1 | 3 | 4)
+    {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_to_sink arguments");
+    }
+    let mut sink = unsafe { *sink };
+    ffi_guard(|| {
+        let q = if quality == 0 { 85 } else { quality };
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(channels as usize);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        if !crate::encoder::encode_to_sink(image_slice, width as usize, height as usize, channels as usize, q, &mut sink) {
+            return fail(BITGRAIN_ERR_SINK, "sink write failed");
+        }
+        0
+    })
+}
+
+/// Encode packed pixels (channels 1, 3 or 4) at the highest quality whose stream
+/// fits in `max_bytes` (and `out_capacity`). Color conversion and DCT run once; the
+/// quality search only re-quantizes and re-sizes. The quality used goes to
+/// `out_quality` when non-NULL. Fails if even quality 1 does not fit.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_target_size(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    channels: u32,
+    max_bytes: u32,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    out_quality: *mut u8,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_target_size arguments");
+    }
+    ffi_guard(|| {
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(channels as usize);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let Some(dct) = crate::rate::DctImage::new(image_slice, width as usize, height as usize, channels as usize) else {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_target_size arguments");
+        };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        let budget = max_bytes.min(out_capacity) as usize;
+        let Some(q) = dct.encode_max_size(budget, buffer_slice, &mut pos) else {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "size budget below the quality 1 stream");
+        };
+        if !out_quality.is_null() {
+            unsafe { *out_quality = q };
+        }
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Encode packed pixels (channels 1, 3 or 4) at the lowest quality whose luma PSNR or
+/// SSIM (`metric`: BITGRAIN_METRIC_*) reaches `target`, or at 100 when none does.
+/// The chosen quality and its measured value go to `out_quality` / `out_value`.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_target_quality(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    channels: u32,
+    metric: u32,
+    target: f64,
+    out_buffer: *mut u8,
+    out_capacity: u32,
+    out_len: *mut i32,
+    out_quality: *mut u8,
+    out_value: *mut f64,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || out_buffer.is_null() || out_len.is_null() || out_capacity == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_target_quality arguments");
+    }
+    let Some(target) = crate::rate::QualityTarget::from_code(metric, target) else {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "unknown metric or target out of range");
+    };
+    ffi_guard(|| {
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(channels as usize);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let Some(dct) = crate::rate::DctImage::new(image_slice, width as usize, height as usize, channels as usize) else {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_target_quality arguments");
+        };
+        let buffer_slice = unsafe { slice::from_raw_parts_mut(out_buffer, out_capacity as usize) };
+        let mut pos: i32 = 0;
+        let (q, value) = dct.encode_target_quality(target, buffer_slice, &mut pos);
+        if !out_quality.is_null() {
+            unsafe { *out_quality = q };
+        }
+        if !out_value.is_null() {
+            unsafe { *out_value = value };
+        }
+        encoded(pos, out_capacity as usize, out_len)
+    })
+}
+
+/// Encode packed pixels (channels 1, 3 or 4) at `n` qualities (0 = default 85) from
+/// one color conversion + DCT pass; quantization and Huffman for each quality run
+/// concurrently. outs[i] (out_capacities[i] bytes, must not overlap) receives
+/// qualities[i]; out_lens[i] its length, or the size needed when the buffer is short.
+/// Returns -1 if any buffer was too small.
+#[no_mangle]
+pub extern "C" fn bitgrain_encode_multi(
+    image: *const u8,
+    width: u32,
+    height: u32,
+    channels: u32,
+    qualities: *const u8,
+    n: u32,
+    outs: *const *mut u8,
+    out_capacities: *const u32,
+    out_lens: *mut i32,
+) -> i32 {
+    clear_last_error();
+    if image.is_null() || qualities.is_null() || outs.is_null() || out_capacities.is_null() || out_lens.is_null() || n == 0 {
+        return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_multi arguments");
+    }
+    ffi_guard(|| {
+        let size = (width as usize)
+            .saturating_mul(height as usize)
+            .saturating_mul(channels as usize);
+        let image_slice = unsafe { slice::from_raw_parts(image, size) };
+        let qualities = unsafe { slice::from_raw_parts(qualities, n as usize) };
+        let outs = unsafe { slice::from_raw_parts(outs, n as usize) };
+        let capacities = unsafe { slice::from_raw_parts(out_capacities, n as usize) };
+        let out_lens = unsafe { slice::from_raw_parts_mut(out_lens, n as usize) };
+        if outs.iter().any(|p| p.is_null()) {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "NULL output in encode_multi");
+        }
+        let Some(dct) = crate::rate::DctImage::new(image_slice, width as usize, height as usize, channels as usize) else {
+            return fail(BITGRAIN_ERR_INVALID_ARG, "invalid encode_multi arguments");
+        };
+        let mut jobs: Vec<(u8, &mut [u8])> = qualities
+            .iter()
+            .zip(outs.iter().zip(capacities))
+            .map(|(&q, (&p, &cap))| {
+                (if q == 0 { 85 } else { q }, unsafe { slice::from_raw_parts_mut(p, cap as usize) })
+            })
+            .collect();
+        let lens = dct.encode_each(&mut jobs);
+        let mut short = false;
+        for ((l, &len), &cap) in out_lens.iter_mut().zip(&lens).zip(capacities) {
+            *l = len as i32;
+            short |= len > cap as usize;
+        }
+        if short {
+            fail(BITGRAIN_ERR_INVALID_ARG, "output buffer too small (out_lens[i] = size needed)")
+        } else {
+            0
+        }
+    })
+}
@@ -273,22 +273,85 @@ pub(crate) fn clamp_block_jpeg_coeffs(block: &mut Block) {
 // Bit writer — continuous across blocks, flush once per plane
 // ---------------------------------------------------------------------------
 
-pub struct BitWriter {
-    pub buf:     Vec<u8>,
+/// Where a `BitWriter` puts finished bytes.
+pub trait ByteOut {
+    fn put(&mut self, byte: u8);
+}
+
+impl ByteOut for Vec<u8> {
+    #[inline]
+    fn put(&mut self, byte: u8) {
+        self.push(byte);
+    }
+}
+
+/// A region of the final output buffer. Bytes past its end are counted but not
+/// written, so `len` is the size the payload needs either way.
+pub struct SliceOut<'a> {
+    buf: &'a mut [u8],
+    pub len: usize,
+}
+
+impl<'a> SliceOut<'a> {
+    pub fn new(buf: &'a mut [u8]) -> Self {
+        Self { buf, len: 0 }
+    }
+}
+
+impl ByteOut for SliceOut<'_> {
+    #[inline]
+    fn put(&mut self, byte: u8) {
+        if let Some(b) = self.buf.get_mut(self.len) {
+            *b = byte;
+        }
+        self.len += 1;
+    }
+}
+
+/// Destination of entropy-coded bits.
+pub trait BitOut {
+    fn write_bits(&mut self, code: u16, n: u8);
+}
+
+impl<O: ByteOut> BitOut for BitWriter<O> {
+    #[inline]
+    fn write_bits(&mut self, code: u16, n: u8) {
+        BitWriter::write_bits(self, code, n);
+    }
+}
+
+/// Counts bits instead of writing them (size estimates).
+pub struct BitCount(pub usize);
+
+impl BitOut for BitCount {
+    #[inline]
+    fn write_bits(&mut self, _code: u16, n: u8) {
+        self.0 += n as usize;
+    }
+}
+
+pub struct BitWriter<O: ByteOut = Vec<u8>> {
+    pub buf:     O,
     bit_buf:     u64,
     bits_in:     u8,
 }
 
 impl BitWriter {
     pub fn new() -> Self {
-        Self { buf: Vec::with_capacity(4096), bit_buf: 0, bits_in: 0 }
+        Self::to(Vec::with_capacity(4096))
+    }
+}
+
+impl<O: ByteOut> BitWriter<O> {
+    pub fn to(buf: O) -> Self {
+        Self { buf, bit_buf: 0, bits_in: 0 }
     }
 
     #[inline]
     fn push_entropy_byte(&mut self, byte: u8) {
-        self.buf.push(byte);
+        self.buf.put(byte);
         if byte == 0xFF {
-            self.buf.push(0x00);
+            self.buf.put(0x00);
         }
     }
 
@@ -510,74 +573,186 @@ pub fn encode_plane_with_profile(
     use_chroma_ac: bool,
     use_dc_delta: bool,
 ) -> Vec<u8> {
-    let dc_table = if is_chroma { CHROMA_DC_TABLE } else { LUMA_DC_TABLE };
-    let ac_table = if use_chroma_ac { jpeg_chroma_ac_table() } else { jpeg_ac_table() };
-    let eob = ac_table[0x00];
-    let zrl = ac_table[0xF0];
-    let mut w = BitWriter::new();
-    let mut prev_dc: i16 = 0;
+    // Prepend 4-byte length so decoder can skip exactly to next plane
+    let data = encode_plane_payload(blocks, is_chroma, use_chroma_ac, use_dc_delta);
+    let len = data.len() as u32;
+    let mut out = Vec::with_capacity(4 + data.len());
+    out.extend_from_slice(&len.to_le_bytes());
+    out.extend_from_slice(&data);
+    out
+}
 
-    for block in blocks {
-        // DC
-        let dc_val = block.data[ZIGZAG[0]];
-        let dc_emit = if use_dc_delta {
-            let d = dc_val.wrapping_sub(prev_dc);
-            prev_dc = dc_val;
-            d
-        } else {
-            dc_val
-        };
-        let dc_cat = category(dc_emit);
-        let (dc_len, dc_code) = dc_table[dc_cat as usize];
-        w.write_bits(dc_code, dc_len);
-        if dc_cat > 0 { w.write_bits(magnitude_bits(dc_emit, dc_cat), dc_cat); }
+/// Encode all blocks of a plane into a bare entropy payload (no length prefix).
+/// Used by containers that record plane lengths elsewhere (v20 TOC).
+pub fn encode_plane_payload(
+    blocks: &[Block],
+    is_chroma: bool,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+) -> Vec<u8> {
+    let mut coder = PlaneCoder::new(is_chroma, use_chroma_ac, use_dc_delta);
+    coder.encode(blocks);
+    coder.finish()
+}
 
-        // AC (JPEG-style optimization): stop at last non-zero and emit EOB only when needed.
-        let mut last_nz = 63usize;
-        while last_nz > 0 && block.data[ZIGZAG[last_nz]] == 0 {
-            last_nz -= 1;
-        }
-        if last_nz == 0 {
-            w.write_bits(eob.1, eob.0);
-            continue;
+/// Code a plane like `encode_plane_payload`, straight into `out`. Returns the payload
+/// length; if it exceeds `out.len()` only the bytes that fit were written.
+pub fn encode_plane_into(
+    blocks: &[Block],
+    is_chroma: bool,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+    out: &mut [u8],
+) -> usize {
+    let mut coder = PlaneCoder::with(BitWriter::to(SliceOut::new(out)), is_chroma, use_chroma_ac, use_dc_delta);
+    coder.encode(blocks);
+    coder.w.flush();
+    coder.w.buf.len
+}
+
+/// Resumable plane entropy coder: blocks can be fed in several calls (one band at a
+/// time) and finished bytes taken out in between. The concatenated output equals
+/// `encode_plane_payload` over all blocks.
+pub struct PlaneCoder<W: BitOut = BitWriter> {
+    w: W,
+    prev_dc: i16,
+    dc_table: &'static [(u8, u16)],
+    ac_table: &'static AcTable,
+    use_dc_delta: bool,
+}
+
+impl PlaneCoder {
+    pub fn new(is_chroma: bool, use_chroma_ac: bool, use_dc_delta: bool) -> Self {
+        Self::with(BitWriter::new(), is_chroma, use_chroma_ac, use_dc_delta)
+    }
+
+    /// Whole bytes coded so far and not yet taken. Clear them with `consume`.
+    pub fn pending(&self) -> &[u8] {
+        &self.w.buf
+    }
+
+    pub fn consume(&mut self) {
+        self.w.buf.clear();
+    }
+
+    /// Pad the last byte and return the bytes not yet taken.
+    pub fn finish(mut self) -> Vec<u8> {
+        self.w.flush();
+        self.w.buf
+    }
+}
+
+impl PlaneCoder<BitCount> {
+    /// A coder that only counts bits (no byte stuffing, no final padding).
+    pub fn counter(is_chroma: bool, use_chroma_ac: bool, use_dc_delta: bool) -> Self {
+        Self::with(BitCount(0), is_chroma, use_chroma_ac, use_dc_delta)
+    }
+
+    pub fn bits(&self) -> usize {
+        self.w.0
+    }
+}
+
+impl<W: BitOut> PlaneCoder<W> {
+    fn with(w: W, is_chroma: bool, use_chroma_ac: bool, use_dc_delta: bool) -> Self {
+        Self {
+            w,
+            prev_dc: 0,
+            dc_table: if is_chroma { CHROMA_DC_TABLE } else { LUMA_DC_TABLE },
+            ac_table: if use_chroma_ac { jpeg_chroma_ac_table() } else { jpeg_ac_table() },
+            use_dc_delta,
         }
+    }
 
-        let mut zero_run: u8 = 0;
-        for i in 1..=last_nz {
-            let val = block.data[ZIGZAG[i]];
-            if val == 0 {
-                zero_run += 1;
-                continue;
+    /// Append the next blocks of the plane, in raster order.
+    pub fn encode(&mut self, blocks: &[Block]) {
+        let (dc_table, ac_table) = (self.dc_table, self.ac_table);
+        let eob = ac_table[0x00];
+        let zrl = ac_table[0xF0];
+        let w = &mut self.w;
+
+        for block in blocks {
+            // DC
+            let dc_val = block.data[ZIGZAG[0]];
+            let dc_emit = if self.use_dc_delta {
+                let d = dc_val.wrapping_sub(self.prev_dc);
+                self.prev_dc = dc_val;
+                d
+            } else {
+                dc_val
+            };
+            let dc_cat = category(dc_emit);
+            let (dc_len, dc_code) = dc_table[dc_cat as usize];
+            w.write_bits(dc_code, dc_len);
+            if dc_cat > 0 { w.write_bits(magnitude_bits(dc_emit, dc_cat), dc_cat); }
+
+            // AC (JPEG-style optimization): stop at last non-zero and emit EOB only when needed.
+            let mut last_nz = 63usize;
+            while last_nz > 0 && block.data[ZIGZAG[last_nz]] == 0 {
+                last_nz -= 1;
             }
-            while zero_run >= 16 {
-                w.write_bits(zrl.1, zrl.0);
-                zero_run -= 16;
+            if last_nz == 0 {
+                w.write_bits(eob.1, eob.0);
+                continue;
             }
-            let cat = category(val);
-            let sym = (zero_run << 4) | cat;
-            let (al, ac) = ac_table[sym as usize];
-            debug_assert!(al > 0, "missing AC Huffman for RS {sym:#04x} (run={zero_run} cat={cat})");
-            if al == 0 {
-                // Defensive fallback for unexpected table/profile mismatch.
-                let (el, ec) = ac_table[0x00];
-                w.write_bits(ec, el);
-                break;
+
+            let mut zero_run: u8 = 0;
+            for i in 1..=last_nz {
+                let val = block.data[ZIGZAG[i]];
+                if val == 0 {
+                    zero_run += 1;
+                    continue;
+                }
+                while zero_run >= 16 {
+                    w.write_bits(zrl.1, zrl.0);
+                    zero_run -= 16;
+                }
+                let cat = category(val);
+                let sym = (zero_run << 4) | cat;
+                let (al, ac) = ac_table[sym as usize];
+                debug_assert!(al > 0, "missing AC Huffman for RS {sym:#04x} (run={zero_run} cat={cat})");
+                if al == 0 {
+                    // Defensive fallback for unexpected table/profile mismatch.
+                    let (el, ec) = ac_table[0x00];
+                    w.write_bits(ec, el);
+                    break;
+                }
+                w.write_bits(ac, al);
+                w.write_bits(magnitude_bits(val, cat), cat);
+                zero_run = 0;
             }
-            w.write_bits(ac, al);
-            w.write_bits(magnitude_bits(val, cat), cat);
-            zero_run = 0;
+            w.write_bits(eob.1, eob.0);
         }
-        w.write_bits(eob.1, eob.0);
     }
-    w.flush();
+}
 
-    // Prepend 4-byte length so decoder can skip exactly to next plane
-    let data = w.buf;
-    let len = data.len() as u32;
-    let mut out = Vec::with_capacity(4 + data.len());
-    out.extend_from_slice(&len.to_le_bytes());
-    out.extend_from_slice(&data);
-    out
+/// Upper bound on the entropy-coded bits of one block whose natural-order
+/// coefficient `i` never exceeds `max_abs[i]` in magnitude. Maximizes over which
+/// positions are non-zero (runs, ZRLs and code lengths follow from that) and over
+/// every category up to each position's limit. Byte stuffing is not included.
+pub(crate) fn max_block_bits(max_abs: &[i32; 64], is_chroma: bool, use_chroma_ac: bool, use_dc_delta: bool) -> usize {
+    let dc_table = if is_chroma { CHROMA_DC_TABLE } else { LUMA_DC_TABLE };
+    let ac_table = if use_chroma_ac { jpeg_chroma_ac_table() } else { jpeg_ac_table() };
+    let cat_of = |v: i32| category(v.min(i16::MAX as i32) as i16) as usize;
+    let dc_max = max_abs[ZIGZAG[0]].min(DC_LIMIT as i32);
+    let dc_cat = cat_of(if use_dc_delta { (2 * dc_max).min(DC_LIMIT as i32) } else { dc_max });
+    let dc_bits = (0..=dc_cat).map(|c| dc_table[c].0 as usize + c).max().unwrap_or(0);
+
+    // most[i]: most bits up to and including a non-zero coefficient at zigzag i (0 = DC).
+    let zrl = ac_table[0xF0].0 as usize;
+    let mut most = [None::<usize>; 64];
+    most[0] = Some(dc_bits);
+    for i in 1..64 {
+        let cat = cat_of(max_abs[ZIGZAG[i]].min(1023));
+        most[i] = (0..i)
+            .filter_map(|j| {
+                let run = i - j - 1;
+                let code = (1..=cat).map(|c| ac_table[((run % 16) << 4) | c].0 as usize + c).max()?;
+                Some(most[j]? + (run / 16) * zrl + code)
+            })
+            .max();
+    }
+    most.iter().flatten().max().copied().unwrap_or(0) + ac_table[0x00].0 as usize
 }
 
 /// Decode a plane of `n_blocks` blocks from `buf[start..]`.
@@ -613,83 +788,271 @@ pub fn decode_plane_with_profile(
         return None;
     }
 
-    let dc_tree = if is_chroma { chroma_dc_tree() } else { luma_dc_tree() };
-    let ac_tree = ac_tree(use_chroma_ac);
-    let data = &buf[data_start..data_end];
-
-    let mut reader = BitReader::new(data, 0);
-    let blocks = decode_plane_blocks(&mut reader, n_blocks, dc_tree, ac_tree, use_dc_delta)?;
+    let blocks = decode_plane_payload(&buf[data_start..data_end], n_blocks, is_chroma, use_chroma_ac, use_dc_delta)?;
 
     // Return data_end as the next byte position (exact plane boundary)
     Some((blocks, data_end))
 }
 
-fn decode_plane_blocks(
+/// Decode `n_blocks` blocks from a bare entropy payload (no length prefix).
+pub fn decode_plane_payload(
+    data: &[u8],
+    n_blocks: usize,
+    is_chroma: bool,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+) -> Option<Vec<Block>> {
+    let dc_tree = if is_chroma { chroma_dc_tree() } else { luma_dc_tree() };
+    let ac_tree = ac_tree(use_chroma_ac);
+    let mut reader = BitReader::new(data, 0);
+    if use_dc_delta {
+        decode_plane_blocks::<true>(&mut reader, n_blocks, dc_tree, ac_tree)
+    } else {
+        decode_plane_blocks::<false>(&mut reader, n_blocks, dc_tree, ac_tree)
+    }
+}
+
+fn decode_plane_blocks<const DC_DELTA: bool>(
     reader: &mut BitReader,
     n_blocks: usize,
     dc_tree: &DecodeTree,
     ac_tree: &DecodeTree,
-    use_dc_delta: bool,
 ) -> Option<Vec<Block>> {
     let mut blocks = Vec::with_capacity(n_blocks);
     let mut prev_dc: i16 = 0;
     for _bi in 0..n_blocks {
-        let mut block = Block::new();
+        blocks.push(decode_block::<DC_DELTA>(reader, dc_tree, ac_tree, &mut prev_dc)?);
+    }
 
-        // DC
-        let dc_cat = match decode_sym(reader, dc_tree) {
-            Some(c) => c,
-            None => return None,
-        };
-        let dc_diff = if dc_cat == 0 {
-            0i16
-        } else {
-            let bits = match reader.read_bits(dc_cat) {
-                Some(b) => b,
-                None => return None,
-            };
-            magnitude_decode(bits, dc_cat)
+    Some(blocks)
+}
+
+/// Decode one block. The profile's flags are resolved before the block loop: the
+/// DC/AC trees arrive as references and DC prediction is a const parameter, so
+/// each profile gets a loop without per-block flag branches.
+#[inline]
+fn decode_block<const DC_DELTA: bool>(
+    reader: &mut BitReader,
+    dc_tree: &DecodeTree,
+    ac_tree: &DecodeTree,
+    prev_dc: &mut i16,
+) -> Option<Block> {
+    let mut block = Block::new();
+
+    // DC
+    let dc_cat = decode_sym(reader, dc_tree)?;
+    let dc_diff = if dc_cat == 0 {
+        0i16
+    } else {
+        magnitude_decode(reader.read_bits(dc_cat)?, dc_cat)
+    };
+    let dc_val = if DC_DELTA {
+        let v = prev_dc.wrapping_add(dc_diff);
+        *prev_dc = v;
+        v
+    } else {
+        dc_diff
+    };
+    block.data[ZIGZAG[0]] = dc_val;
+
+    // AC
+    let mut ac_idx = 1usize;
+    loop {
+        let sym = decode_sym(reader, ac_tree)?;
+        if sym == 0x00 { break; } // EOB
+        if sym == 0xF0 {
+            // ZRL: exactly 16 consecutive zeros.
+            if ac_idx + 16 > 64 { return None; }
+            ac_idx += 16;
+            continue;
+        }
+        let run = (sym >> 4) as usize;
+        let cat = sym & 0x0F;
+        // Need room for run zeros plus one non-zero coefficient.
+        if ac_idx + run >= 64 { return None; }
+        ac_idx += run;
+        let bits = reader.read_bits(cat)?;
+        block.data[ZIGZAG[ac_idx]] = magnitude_decode(bits, cat);
+        ac_idx += 1;
+        if ac_idx > 64 { return None; }
+    }
+
+    Some(block)
+}
+
+// ---------------------------------------------------------------------------
+// Resumable plane decode (streaming input)
+// ---------------------------------------------------------------------------
+
+/// Decodes a plane payload that arrives in pieces. A block whose bits have not all
+/// arrived is rolled back and retried on the next call, so the decoded blocks are
+/// exactly those of a one-shot decode; corruption is reported once the payload is complete.
+pub(crate) struct PlaneCursor {
+    pos: usize,
+    bit_buf: u64,
+    bits_in: u8,
+    prev_dc: i16,
+    done: usize,
+    n_blocks: usize,
+    is_chroma: bool,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+}
+
+impl PlaneCursor {
+    pub(crate) fn new(n_blocks: usize, is_chroma: bool, use_chroma_ac: bool, use_dc_delta: bool) -> Self {
+        Self { pos: 0, bit_buf: 0, bits_in: 0, prev_dc: 0, done: 0, n_blocks, is_chroma, use_chroma_ac, use_dc_delta }
+    }
+
+    /// Payload bytes fully consumed (everything before this may be discarded).
+    pub(crate) fn consumed(&self) -> usize {
+        self.pos
+    }
+
+    /// Decode up to `max_blocks` more blocks into `out`. `data` is the payload from
+    /// `consumed()` on, as far as it has arrived; `complete` says it reaches the
+    /// payload end. Returns None on corrupt data.
+    pub(crate) fn decode(&mut self, data: &[u8], complete: bool, max_blocks: usize, out: &mut Vec<Block>) -> Option<()> {
+        // A trailing 0xFF may be the first half of a stuffed pair: wait for the next byte.
+        let data = match data.last() {
+            Some(0xFF) if !complete => &data[..data.len() - 1],
+            _ => data,
         };
-        let dc_val = if use_dc_delta {
-            let v = prev_dc.wrapping_add(dc_diff);
-            prev_dc = v;
-            v
+        if self.use_dc_delta {
+            self.decode_blocks::<true>(data, complete, max_blocks, out)
         } else {
-            dc_diff
-        };
-        block.data[ZIGZAG[0]] = dc_val;
+            self.decode_blocks::<false>(data, complete, max_blocks, out)
+        }
+    }
 
-        // AC
-        let mut ac_idx = 1usize;
-        loop {
-            let sym = match decode_sym(reader, ac_tree) {
-                Some(s) => s,
+    fn decode_blocks<const DC_DELTA: bool>(&mut self, data: &[u8], complete: bool, max_blocks: usize, out: &mut Vec<Block>) -> Option<()> {
+        let dc_tree = if self.is_chroma { chroma_dc_tree() } else { luma_dc_tree() };
+        let ac_tree = ac_tree(self.use_chroma_ac);
+        let mut reader = BitReader { buf: data, pos: 0, bit_buf: self.bit_buf, bits_in: self.bits_in };
+        let target = self.done.saturating_add(max_blocks).min(self.n_blocks);
+        while self.done < target {
+            let (pos, bit_buf, bits_in, prev_dc) = (reader.pos, reader.bit_buf, reader.bits_in, self.prev_dc);
+            match decode_block::<DC_DELTA>(&mut reader, dc_tree, ac_tree, &mut self.prev_dc) {
+                Some(block) => {
+                    out.push(block);
+                    self.done += 1;
+                }
+                None if !complete => {
+                    reader.pos = pos;
+                    reader.bit_buf = bit_buf;
+                    reader.bits_in = bits_in;
+                    self.prev_dc = prev_dc;
+                    break;
+                }
                 None => return None,
-            };
-            if sym == 0x00 { break; } // EOB
-            if sym == 0xF0 {
-                // ZRL: exactly 16 consecutive zeros.
-                if ac_idx + 16 > 64 { return None; }
-                ac_idx += 16;
-                continue;
             }
-            let run = (sym >> 4) as usize;
-            let cat = sym & 0x0F;
-            // Need room for run zeros plus one non-zero coefficient.
-            if ac_idx + run >= 64 { return None; }
-            ac_idx += run;
-            let bits = match reader.read_bits(cat) {
-                Some(b) => b,
-                None => return None,
-            };
-            block.data[ZIGZAG[ac_idx]] = magnitude_decode(bits, cat);
-            ac_idx += 1;
-            if ac_idx > 64 { return None; }
         }
+        self.pos += reader.pos;
+        self.bit_buf = reader.bit_buf;
+        self.bits_in = reader.bits_in;
+        Some(())
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Structural validation (symbols only, no coefficients stored)
+// ---------------------------------------------------------------------------
 
-        blocks.push(block);
+/// Largest DC magnitude the encoder emits (category 11).
+const DC_LIMIT: i16 = 2047;
+
+/// Byte offset of the bit following `bits_in` buffered bits when the reader stands
+/// at `pos` (stuffed 0x00 bytes counted).
+fn bit_byte_offset(buf: &[u8], mut pos: usize, bits_in: u8) -> usize {
+    for _ in 0..(bits_in as usize + 7) / 8 {
+        pos -= 1;
+        if pos > 0 && buf[pos] == 0x00 && buf[pos - 1] == 0xFF {
+            pos -= 1;
+        }
     }
+    pos
+}
 
-    Some(blocks)
+/// Walk every symbol of a bare plane payload without building blocks: exactly
+/// `n_blocks` blocks, no AC run past coefficient 63, DC within category 11 and
+/// nothing but flush padding after the last block. On error returns the byte
+/// offset in `data` of the offending symbol and the reason.
+pub(crate) fn validate_plane_payload(
+    data: &[u8],
+    n_blocks: usize,
+    is_chroma: bool,
+    use_chroma_ac: bool,
+    use_dc_delta: bool,
+) -> Result<(), (usize, &'static str)> {
+    let dc_tree = if is_chroma { chroma_dc_tree() } else { luma_dc_tree() };
+    let ac_tree = ac_tree(use_chroma_ac);
+    let mut reader = BitReader::new(data, 0);
+    if use_dc_delta {
+        validate_blocks::<true>(&mut reader, n_blocks, dc_tree, ac_tree)
+    } else {
+        validate_blocks::<false>(&mut reader, n_blocks, dc_tree, ac_tree)
+    }
 }
 
+fn validate_blocks<const DC_DELTA: bool>(
+    reader: &mut BitReader,
+    n_blocks: usize,
+    dc_tree: &DecodeTree,
+    ac_tree: &DecodeTree,
+) -> Result<(), (usize, &'static str)> {
+    let mut prev_dc: i16 = 0;
+    // Reader state before the symbol being decoded, for error offsets.
+    let mut mark = (0usize, 0u8);
+    let result = (|| {
+        for _ in 0..n_blocks {
+            mark = (reader.pos, reader.bits_in);
+            let dc_cat = decode_sym(reader, dc_tree).ok_or("invalid DC Huffman code")?;
+            let dc_diff = if dc_cat == 0 {
+                0
+            } else {
+                magnitude_decode(reader.read_bits(dc_cat).ok_or("truncated DC magnitude")?, dc_cat)
+            };
+            let dc = if DC_DELTA { prev_dc.wrapping_add(dc_diff) } else { dc_diff };
+            if dc.unsigned_abs() > DC_LIMIT as u16 {
+                return Err("DC coefficient out of range");
+            }
+            prev_dc = dc;
+
+            let mut ac_idx = 1usize;
+            loop {
+                mark = (reader.pos, reader.bits_in);
+                let sym = decode_sym(reader, ac_tree).ok_or("invalid AC Huffman code")?;
+                if sym == 0x00 {
+                    break;
+                }
+                let run = (sym >> 4) as usize;
+                let cat = sym & 0x0F;
+                let len = if sym == 0xF0 { 16 } else { run + 1 };
+                if ac_idx + len > 64 {
+                    return Err("AC run past end of block");
+                }
+                if sym != 0xF0 {
+                    if cat == 0 || cat > 10 {
+                        return Err("AC coefficient out of range");
+                    }
+                    reader.read_bits(cat).ok_or("truncated AC magnitude")?;
+                }
+                ac_idx += len;
+            }
+        }
+        Ok(())
+    })();
+    if let Err(reason) = result {
+        // Codes cut off by the payload end are truncation, not corruption.
+        let reason = if reader.pos == reader.buf.len() && reader.bits_in < 16 { "truncated plane" } else { reason };
+        return Err((bit_byte_offset(reader.buf, mark.0, mark.1), reason));
+    }
+
+    // Only the final byte's 1-bit padding may follow the last block.
+    reader.refill();
+    if reader.pos < reader.buf.len() || reader.bits_in >= 8 {
+        let at = bit_byte_offset(reader.buf, reader.pos, reader.bits_in);
+        return Err((at, "unused bytes at end of plane"));
+    }
+    Ok(())
+}
@@ -1,7 +1,9 @@
+pub mod archive;
 pub mod block;
 pub mod blockizer;
 pub mod bitstream;
 pub mod colorspace;
+pub mod container;
 pub mod dct;
 pub mod decoder;
 pub mod encoder;
@@ -9,6 +11,13 @@ pub mod entropy;
 pub mod ffi;
 pub mod huffman;
 mod jpeg_luma_ac_ht;
+pub mod lossless;
+pub mod rate;
+pub mod resample;
+pub mod sequence;
+pub mod stream;
+pub mod stream_encoder;
+pub mod validate;
 pub mod zigzag;
 
 #[cfg(test)]
@@ -0,0 +1,483 @@
+//! Lossless mode (version 22): reversible color transform + MED prediction +
+//! adaptive Golomb-Rice residual coding.
+//!
+//! Layout:
+//!   [0..12)   standard header: "BG" + 22 + width(u32 LE) + height(u32 LE) + quality (100)
+//!   [12]      channels (1, 3 or 4)
+//!   [13]      color transform (0 = none, 1 = YCoCg-R on RGB; alpha is never transformed)
+//!   [14..16)  strip height in rows (u16 LE)
+//!   [16..)    strip index: ceil(height / strip height) × u32 LE payload length
+//!   ...       strip payloads, in order; optional "BGx" ICC trailer
+//!
+//! Strip payload: mode byte, then
+//!   0 = coded:  one MSB-first bitstream (0xFF stuffed, 1-padded, as in huffman.rs)
+//!               holding the strip's planes one after another (gray | Y Co Cg | Y Co Cg A)
+//!   1 = stored: the strip's interleaved pixels as-is (used when coding does not help)
+//!
+//! Each sample is predicted with the LOCO-I median edge detector from its left,
+//! top and top-left neighbours; the zigzagged residual is Rice coded with k taken
+//! from the running mean of one of eight activity contexts per plane. Where the
+//! neighbourhood is flat (zero activity) the coder switches to run mode and codes
+//! the number of samples equal to the left neighbour instead (as in JPEG-LS); the
+//! sample after a run that stops inside the row is always coded normally. Prediction
+//! and coder state restart at every strip, so strips encode and decode in parallel
+//! and the output does not depend on the thread count.
+
+use crate::bitstream;
+use crate::huffman::{BitReader, BitWriter};
+use crate::validate::{self, Invalid};
+use rayon::prelude::*;
+
+pub const BG_VERSION_LOSSLESS: u8 = 22;
+pub const LOSSLESS_HEADER_SIZE: usize = 16;
+pub const LOSSLESS_STRIP_ROWS: usize = 64;
+pub const TRANSFORM_NONE: u8 = 0;
+pub const TRANSFORM_YCOCG_R: u8 = 1;
+
+const STRIP_CODED: u8 = 0;
+const STRIP_STORED: u8 = 1;
+const CONTEXTS: usize = 8;
+/// Unary prefixes of this many zeros escape to a raw 16-bit value.
+const RICE_LIMIT: u32 = 16;
+const MAX_K: u32 = 14;
+const CTX_RESET: u32 = 64;
+/// Longest run coded in one symbol (fits the 16-bit escape).
+const MAX_RUN: usize = u16::MAX as usize;
+
+#[inline]
+fn strip_count(height: usize) -> usize {
+    (height + LOSSLESS_STRIP_ROWS - 1) / LOSSLESS_STRIP_ROWS
+}
+
+/// Largest stream `encode` can produce without ICC (every strip stored).
+pub fn max_encoded_len(width: usize, height: usize, channels: u32) -> usize {
+    let strips = strip_count(height);
+    LOSSLESS_HEADER_SIZE + strips * 5 + width * height * channels as usize
+}
+
+// ---------------------------------------------------------------------------
+// Prediction + Rice coder
+// ---------------------------------------------------------------------------
+
+/// Adaptive Rice parameter state for one context.
+#[derive(Clone, Copy)]
+struct RiceContext {
+    sum: u32,
+    count: u32,
+}
+
+impl RiceContext {
+    const INIT: Self = Self { sum: 8, count: 1 };
+
+    #[inline]
+    fn k(&self) -> u32 {
+        let mut k = 0;
+        while (self.count << k) < self.sum && k < MAX_K {
+            k += 1;
+        }
+        k
+    }
+
+    #[inline]
+    fn update(&mut self, u: u32) {
+        self.sum += u;
+        self.count += 1;
+        if self.count >= CTX_RESET {
+            self.sum >>= 1;
+            self.count >>= 1;
+        }
+    }
+}
+
+/// Median edge detector (LOCO-I / JPEG-LS).
+#[inline]
+fn med(a: i32, b: i32, c: i32) -> i32 {
+    let (lo, hi) = if a < b { (a, b) } else { (b, a) };
+    if c >= hi {
+        lo
+    } else if c <= lo {
+        hi
+    } else {
+        a + b - c
+    }
+}
+
+/// Neighbours (a = left, b = top, c = top-left, d = top-right) with the usual
+/// edge replication; the first row of a strip only sees its left neighbour.
+#[inline]
+fn neighbours(plane: &[i16], w: usize, row: usize, x: usize) -> (i32, i32, i32, i32) {
+    let i = row * w + x;
+    if row == 0 {
+        let a = if x > 0 { plane[i - 1] as i32 } else { 0 };
+        return (a, a, a, a);
+    }
+    let b = plane[i - w] as i32;
+    let a = if x > 0 { plane[i - 1] as i32 } else { b };
+    let c = if x > 0 { plane[i - w - 1] as i32 } else { b };
+    let d = if x + 1 < w { plane[i - w + 1] as i32 } else { b };
+    (a, b, c, d)
+}
+
+#[inline]
+fn context_index(a: i32, b: i32, c: i32, d: i32) -> usize {
+    let activity = ((d - b).abs() + (b - c).abs() + (c - a).abs()) as u32;
+    ((32 - activity.leading_zeros()) as usize).min(CONTEXTS - 1)
+}
+
+#[inline]
+fn zigzag(e: i32) -> u32 {
+    ((e << 1) ^ (e >> 31)) as u32
+}
+
+#[inline]
+fn unzigzag(u: u32) -> i32 {
+    ((u >> 1) as i32) ^ -((u & 1) as i32)
+}
+
+#[inline]
+fn write_rice(bw: &mut BitWriter, u: u32, k: u32) {
+    let q = u >> k;
+    if q < RICE_LIMIT {
+        bw.write_bits(1, (q + 1) as u8);
+        bw.write_bits((u & ((1 << k) - 1)) as u16, k as u8);
+    } else {
+        bw.write_bits(0, RICE_LIMIT as u8);
+        bw.write_bits(u as u16, 16);
+    }
+}
+
+fn encode_plane(plane: &[i16], w: usize, rows: usize, bw: &mut BitWriter) {
+    let mut ctx = [RiceContext::INIT; CONTEXTS];
+    let mut run_ctx = RiceContext::INIT;
+    for row in 0..rows {
+        let line = &plane[row * w..(row + 1) * w];
+        let mut x = 0;
+        let mut after_run = false;
+        while x < w {
+            let (a, b, c, d) = neighbours(plane, w, row, x);
+            let ci = context_index(a, b, c, d);
+            if ci == 0 && !after_run {
+                let run = line[x..].iter().take(MAX_RUN).take_while(|&&v| v as i32 == a).count();
+                write_rice(bw, run as u32, run_ctx.k());
+                run_ctx.update(run as u32);
+                x += run;
+                after_run = true;
+                continue;
+            }
+            after_run = false;
+            let cx = &mut ctx[ci];
+            let u = zigzag(line[x] as i32 - med(a, b, c));
+            write_rice(bw, u, cx.k());
+            cx.update(u);
+            x += 1;
+        }
+    }
+}
+
+#[inline]
+fn read_rice(br: &mut BitReader, k: u32) -> Option<u32> {
+    // Fast path: the whole unary prefix fits in one 16-bit peek.
+    let q = match br.peek_bits(RICE_LIMIT as u8) {
+        Some(v) => {
+            let q = v.leading_zeros();
+            br.drop_bits(if q < RICE_LIMIT { q as u8 + 1 } else { RICE_LIMIT as u8 });
+            q
+        }
+        None => {
+            let mut q = 0;
+            while br.read_one_bit()? == 0 {
+                q += 1;
+                if q == RICE_LIMIT {
+                    break;
+                }
+            }
+            q
+        }
+    };
+    if q == RICE_LIMIT {
+        return br.read_bits(16).map(|v| v as u32);
+    }
+    let low = br.read_bits(k as u8)? as u32;
+    Some((q << k) | low)
+}
+
+fn decode_plane(br: &mut BitReader, plane: &mut [i16], w: usize, rows: usize) -> Option<()> {
+    let mut ctx = [RiceContext::INIT; CONTEXTS];
+    let mut run_ctx = RiceContext::INIT;
+    for row in 0..rows {
+        let mut x = 0;
+        let mut after_run = false;
+        while x < w {
+            let (a, b, c, d) = neighbours(plane, w, row, x);
+            let ci = context_index(a, b, c, d);
+            if ci == 0 && !after_run {
+                let run = read_rice(br, run_ctx.k())? as usize;
+                if run > w - x || run > MAX_RUN {
+                    return None;
+                }
+                run_ctx.update(run as u32);
+                plane[row * w + x..row * w + x + run].fill(a as i16);
+                x += run;
+                after_run = true;
+                continue;
+            }
+            after_run = false;
+            let cx = &mut ctx[ci];
+            let u = read_rice(br, cx.k())?;
+            cx.update(u);
+            plane[row * w + x] = (med(a, b, c) + unzigzag(u)) as i16;
+            x += 1;
+        }
+    }
+    Some(())
+}
+
+// ---------------------------------------------------------------------------
+// Color transform
+// ---------------------------------------------------------------------------
+
+/// Split interleaved pixels into planes; RGB goes through YCoCg-R.
+fn forward_planes(pixels: &[u8], channels: usize) -> Vec<Vec<i16>> {
+    let n = pixels.len() / channels;
+    if channels == 1 {
+        return vec![pixels.iter().map(|&v| v as i16).collect()];
+    }
+    let mut planes = vec![vec![0i16; n]; channels];
+    let (y, rest) = planes.split_at_mut(1);
+    let (co, rest) = rest.split_at_mut(1);
+    let (cg, alpha) = rest.split_at_mut(1);
+    for (i, px) in pixels.chunks_exact(channels).enumerate() {
+        let (r, g, b) = (px[0] as i16, px[1] as i16, px[2] as i16);
+        let o = r - b;
+        let t = b + (o >> 1);
+        let gg = g - t;
+        y[0][i] = t + (gg >> 1);
+        co[0][i] = o;
+        cg[0][i] = gg;
+        if let Some(a) = alpha.first_mut() {
+            a[i] = px[3] as i16;
+        }
+    }
+    planes
+}
+
+/// Inverse of `forward_planes`. Values of a corrupt stream wrap instead of failing.
+fn inverse_planes(planes: &[Vec<i16>], channels: usize, out: &mut [u8]) {
+    if channels == 1 {
+        for (o, &v) in out.iter_mut().zip(&planes[0]) {
+            *o = v as u8;
+        }
+        return;
+    }
+    for (i, px) in out.chunks_exact_mut(channels).enumerate() {
+        let (y, o, gg) = (planes[0][i], planes[1][i], planes[2][i]);
+        let t = y.wrapping_sub(gg >> 1);
+        let g = gg.wrapping_add(t);
+        let b = t.wrapping_sub(o >> 1);
+        let r = b.wrapping_add(o);
+        px[0] = r as u8;
+        px[1] = g as u8;
+        px[2] = b as u8;
+        if channels == 4 {
+            px[3] = planes[3][i] as u8;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Strips
+// ---------------------------------------------------------------------------
+
+fn encode_strip(pixels: &[u8], w: usize, channels: usize) -> Vec<u8> {
+    let rows = pixels.len() / (w * channels);
+    let planes = forward_planes(pixels, channels);
+    let mut bw = BitWriter::new();
+    for plane in &planes {
+        encode_plane(plane, w, rows, &mut bw);
+    }
+    bw.flush();
+    if bw.buf.len() >= pixels.len() {
+        let mut stored = Vec::with_capacity(pixels.len() + 1);
+        stored.push(STRIP_STORED);
+        stored.extend_from_slice(pixels);
+        return stored;
+    }
+    let mut coded = Vec::with_capacity(bw.buf.len() + 1);
+    coded.push(STRIP_CODED);
+    coded.extend_from_slice(&bw.buf);
+    coded
+}
+
+pub(crate) fn decode_strip(data: &[u8], w: usize, channels: usize, out: &mut [u8]) -> bool {
+    let rows = out.len() / (w * channels);
+    match data.first() {
+        Some(&STRIP_STORED) if data.len() == out.len() + 1 => {
+            out.copy_from_slice(&data[1..]);
+            true
+        }
+        Some(&STRIP_CODED) => {
+            let mut br = BitReader::new(data, 1);
+            let mut planes = vec![vec![0i16; w * rows]; channels];
+            for plane in planes.iter_mut() {
+                if decode_plane(&mut br, plane, w, rows).is_none() {
+                    return false;
+                }
+            }
+            inverse_planes(&planes, channels, out);
+            true
+        }
+        _ => false,
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Stream
+// ---------------------------------------------------------------------------
+
+/// Encode interleaved gray / RGB / RGBA losslessly. Returns false (nothing
+/// useful written) if `out` is smaller than the stream.
+pub fn encode(
+    image: &[u8],
+    width: usize,
+    height: usize,
+    channels: u32,
+    out: &mut [u8],
+    pos: &mut i32,
+    icc: Option<&[u8]>,
+) -> bool {
+    let ch = channels as usize;
+    if width == 0 || height == 0 || width > 65536 || height > 65536 || !matches!(ch, 1 | 3 | 4) {
+        return false;
+    }
+    if image.len() < width * height * ch {
+        return false;
+    }
+    let strips: Vec<Vec<u8>> = image[..width * height * ch]
+        .par_chunks(LOSSLESS_STRIP_ROWS * width * ch)
+        .map(|s| encode_strip(s, width, ch))
+        .collect();
+
+    let icc_len = icc.map_or(0, |d| if d.is_empty() { 0 } else { 8 + d.len() });
+    let total = LOSSLESS_HEADER_SIZE + strips.len() * 4 + strips.iter().map(|s| s.len()).sum::<usize>();
+    if (*pos as usize).saturating_add(total + icc_len) > out.len() || total + icc_len > i32::MAX as usize {
+        return false;
+    }
+
+    let mut hdr = [0u8; LOSSLESS_HEADER_SIZE];
+    hdr[0] = b'B';
+    hdr[1] = b'G';
+    hdr[2] = BG_VERSION_LOSSLESS;
+    hdr[3..7].copy_from_slice(&(width as u32).to_le_bytes());
+    hdr[7..11].copy_from_slice(&(height as u32).to_le_bytes());
+    hdr[11] = 100;
+    hdr[12] = channels as u8;
+    hdr[13] = if ch == 1 { TRANSFORM_NONE } else { TRANSFORM_YCOCG_R };
+    hdr[14..16].copy_from_slice(&(LOSSLESS_STRIP_ROWS as u16).to_le_bytes());
+    bitstream::write_bytes(out, pos, &hdr);
+    for s in &strips {
+        bitstream::write_bytes(out, pos, &(s.len() as u32).to_le_bytes());
+    }
+    for s in &strips {
+        bitstream::write_bytes(out, pos, s);
+    }
+    crate::encoder::write_icc_trailer(out, pos, icc);
+    true
+}
+
+/// Decode a v22 stream. Returns the offset just past the strips (where an ICC
+/// trailer may follow).
+pub fn decode(
+    buffer: &[u8],
+    out_pixels: &mut [u8],
+    out_width: &mut u32,
+    out_height: &mut u32,
+    out_channels: &mut u32,
+) -> Option<usize> {
+    if buffer.len() < LOSSLESS_HEADER_SIZE || buffer[0] != b'B' || buffer[1] != b'G'
+        || buffer[2] != BG_VERSION_LOSSLESS {
+        return None;
+    }
+    let width = u32::from_le_bytes(buffer[3..7].try_into().unwrap());
+    let height = u32::from_le_bytes(buffer[7..11].try_into().unwrap());
+    let channels = buffer[12] as u32;
+    let strip_rows = u16::from_le_bytes([buffer[14], buffer[15]]) as usize;
+    let transform_ok = match channels {
+        1 => buffer[13] == TRANSFORM_NONE,
+        3 | 4 => buffer[13] == TRANSFORM_YCOCG_R,
+        _ => false,
+    };
+    if width == 0 || height == 0 || width > 65536 || height > 65536 || !transform_ok || strip_rows == 0 {
+        return None;
+    }
+    let (w, h, ch) = (width as usize, height as usize, channels as usize);
+    let n_strips = (h + strip_rows - 1) / strip_rows;
+    if out_pixels.len() < w * h * ch || buffer.len() < LOSSLESS_HEADER_SIZE + n_strips * 4 {
+        return None;
+    }
+
+    let mut strips: Vec<&[u8]> = Vec::with_capacity(n_strips);
+    let mut pos = LOSSLESS_HEADER_SIZE + n_strips * 4;
+    for i in 0..n_strips {
+        let p = LOSSLESS_HEADER_SIZE + i * 4;
+        let len = u32::from_le_bytes(buffer[p..p + 4].try_into().unwrap()) as usize;
+        let end = pos.checked_add(len).filter(|&e| e <= buffer.len())?;
+        strips.push(&buffer[pos..end]);
+        pos = end;
+    }
+
+    let ok = out_pixels[..w * h * ch]
+        .par_chunks_mut(strip_rows * w * ch)
+        .zip(strips.par_iter())
+        .all(|(out, data)| decode_strip(data, w, ch, out));
+    if !ok {
+        return None;
+    }
+    *out_width = width;
+    *out_height = height;
+    *out_channels = channels;
+    Some(pos)
+}
+
+/// Structural check for `validate::validate`: header, strip table and every strip.
+/// The Rice parameters adapt to reconstructed samples, so coded strips are decoded
+/// into strip-sized scratch memory. Returns the end of the last strip.
+pub(crate) fn validate(buffer: &[u8]) -> Result<usize, Invalid> {
+    let (w, h) = validate::header_dimensions(buffer, LOSSLESS_HEADER_SIZE)?;
+    let ch = buffer[12] as usize;
+    let transform_ok = match ch {
+        1 => buffer[13] == TRANSFORM_NONE,
+        3 | 4 => buffer[13] == TRANSFORM_YCOCG_R,
+        _ => return Err(Invalid::at(12, "bad channel count")),
+    };
+    if !transform_ok {
+        return Err(Invalid::at(13, "bad color transform"));
+    }
+    let strip_rows = u16::from_le_bytes([buffer[14], buffer[15]]) as usize;
+    if strip_rows == 0 {
+        return Err(Invalid::at(14, "bad strip height"));
+    }
+    let n_strips = (h + strip_rows - 1) / strip_rows;
+    if buffer.len() < LOSSLESS_HEADER_SIZE + n_strips * 4 {
+        return Err(Invalid::at(buffer.len(), "truncated strip table"));
+    }
+
+    let mut strips = Vec::with_capacity(n_strips);
+    let mut pos = LOSSLESS_HEADER_SIZE + n_strips * 4;
+    for i in 0..n_strips {
+        let p = LOSSLESS_HEADER_SIZE + i * 4;
+        let len = u32::from_le_bytes(buffer[p..p + 4].try_into().unwrap()) as usize;
+        let end = pos.checked_add(len).filter(|&e| e <= buffer.len());
+        let end = end.ok_or(Invalid::at(p, "strip past end of stream"))?;
+        strips.push((pos, &buffer[pos..end], strip_rows.min(h - i * strip_rows)));
+        pos = end;
+    }
+    let results: Vec<Result<(), Invalid>> = strips
+        .par_iter()
+        .map(|&(base, data, rows)| {
+            let mut scratch = vec![0u8; rows * w * ch];
+            if decode_strip(data, w, ch, &mut scratch) { Ok(()) } else { Err(Invalid::at(base, "corrupt strip")) }
+        })
+        .collect();
+    results.into_iter().collect::<Result<(), Invalid>>()?;
+    Ok(pos)
+}
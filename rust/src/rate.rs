@@ -0,0 +1,458 @@
+//! Rate control: encodes at several qualities from one transform pass.
+//!
+//! Color conversion, blockization and the forward DCT run once. The unquantized
+//! coefficients are kept in a `DctImage`; each quality then only re-runs
+//! quantization and entropy coding. That serves quality ladders (`encode_each`) and
+//! byte budgets (`encode_max_size`, whose candidates are sized by counting code bits
+//! rather than writing them) and quality targets (`encode_target_quality`, whose
+//! candidates are scored on luma in the coefficient domain). Output is identical to
+//! the one-shot encoders at the same quality (v1 grayscale, v18 RGB, v19 RGBA).
+
+use crate::bitstream;
+use crate::block::Block;
+use crate::blockizer::Blockizer;
+use crate::colorspace;
+use crate::dct;
+use crate::ffi::dequantize_block;
+use crate::encoder::{self, PlaneTables};
+use crate::huffman::{self, PlaneCoder};
+use rayon::prelude::*;
+
+/// Block rows (luma) the coarse quality search samples.
+const SAMPLE_BLOCK_ROWS: usize = 24;
+
+/// One plane's DCT coefficients.
+struct DctPlane {
+    blocks: Vec<Block>,
+    w: usize,
+    h: usize,
+    chroma: bool,
+}
+
+impl DctPlane {
+    fn new(samples: &[u8], w: usize, h: usize, chroma: bool) -> Self {
+        let mut blocks = Blockizer::new(w, h).generate_blocks(samples);
+        encoder::for_each_block(&mut blocks, w, h, dct::dct);
+        Self { blocks, w, h, chroma }
+    }
+}
+
+/// Quantization of one plane at one quality, as the one-shot encoders do it.
+struct Quantizer {
+    table: [i16; 64],
+    /// v18/v19 planes: AC sparsify thresholds (and the JPEG coefficient clamp).
+    sparsify: Option<[i16; 64]>,
+}
+
+impl Quantizer {
+    #[inline]
+    fn apply(&self, block: &mut Block) {
+        match &self.sparsify {
+            Some(thr) => encoder::quantize_coeffs(block, &self.table, Some(thr)),
+            None => encoder::quantize(&mut block.data, &self.table),
+        }
+    }
+}
+
+/// Luma quality goal for `encode_target_quality`.
+#[derive(Clone, Copy, Debug, PartialEq)]
+pub enum QualityTarget {
+    /// PSNR in dB.
+    Psnr(f64),
+    /// Mean SSIM over the 8×8 block grid (uniform window per block).
+    Ssim(f64),
+}
+
+/// SSIM stabilizers for 8-bit samples: (0.01·255)², (0.03·255)².
+const SSIM_C1: f64 = 6.5025;
+const SSIM_C2: f64 = 58.5225;
+
+/// Luma distortion accumulated block by block.
+#[derive(Default)]
+struct Distortion {
+    sq_err: u64,
+    samples: u64,
+    ssim_sum: f64,
+    blocks: usize,
+}
+
+impl Distortion {
+    /// Add one block of `n` samples from its means, variances, covariance and
+    /// squared error.
+    fn add(&mut self, n: usize, (mx, my): (f64, f64), (vx, vy, cxy): (f64, f64, f64), sq_err: u64) {
+        self.ssim_sum += ((2.0 * mx * my + SSIM_C1) * (2.0 * cxy + SSIM_C2))
+            / ((mx * mx + my * my + SSIM_C1) * (vx + vy + SSIM_C2));
+        self.blocks += 1;
+        self.sq_err += sq_err;
+        self.samples += n as u64;
+    }
+
+    /// Sum per-row partials in row order (the f64 SSIM sum stays deterministic).
+    fn total(rows: Vec<Distortion>) -> Distortion {
+        rows.into_iter().fold(Distortion::default(), |mut acc, d| {
+            acc.sq_err += d.sq_err;
+            acc.samples += d.samples;
+            acc.ssim_sum += d.ssim_sum;
+            acc.blocks += d.blocks;
+            acc
+        })
+    }
+
+    fn value(&self, target: QualityTarget) -> f64 {
+        match target {
+            QualityTarget::Psnr(_) => {
+                let mse = self.sq_err as f64 / self.samples.max(1) as f64;
+                if mse <= 0.0 { 99.0 } else { 10.0 * (255.0 * 255.0 / mse).log10() }
+            }
+            QualityTarget::Ssim(_) => self.ssim_sum / self.blocks.max(1) as f64,
+        }
+    }
+}
+
+impl QualityTarget {
+    /// BITGRAIN_METRIC_* code (0 = PSNR in dB, 1 = SSIM in 0..1) and its target value.
+    pub fn from_code(metric: u32, value: f64) -> Option<Self> {
+        match metric {
+            0 if value.is_finite() && value > 0.0 => Some(QualityTarget::Psnr(value)),
+            1 if value > 0.0 && value <= 1.0 => Some(QualityTarget::Ssim(value)),
+            _ => None,
+        }
+    }
+
+    fn met_by(self, value: f64) -> bool {
+        match self {
+            QualityTarget::Psnr(t) | QualityTarget::Ssim(t) => value >= t,
+        }
+    }
+}
+
+/// A packed image after color conversion and DCT, ready to quantize at any quality.
+pub struct DctImage {
+    width: usize,
+    height: usize,
+    channels: usize,
+    planes: Vec<DctPlane>,
+    /// Source luma (the gray plane for channels 1), for verifying quality targets.
+    luma: Vec<u8>,
+}
+
+impl DctImage {
+    /// channels: 1, 3 or 4 (packed, no row padding). None for other channel counts
+    /// or a zero or oversized dimension.
+    pub fn new(image: &[u8], width: usize, height: usize, channels: usize) -> Option<Self> {
+        if width == 0 || height == 0 || width > 65536 || height > 65536 || image.len() < width * height * channels {
+            return None;
+        }
+        let (cw, ch) = ((width + 1) / 2, (height + 1) / 2);
+        let (planes, luma) = match channels {
+            1 => (vec![DctPlane::new(image, width, height, false)], image[..width * height].to_vec()),
+            3 => {
+                let (y, cb, cr) = colorspace::rgb_to_ycbcr420(image, width, height);
+                let planes = vec![
+                    DctPlane::new(&y, width, height, false),
+                    DctPlane::new(&cb, cw, ch, true),
+                    DctPlane::new(&cr, cw, ch, true),
+                ];
+                (planes, y)
+            }
+            4 => {
+                let (y, cb, cr, a) = colorspace::rgba_to_ycbcr420a(image, width, height);
+                let planes = vec![
+                    DctPlane::new(&y, width, height, false),
+                    DctPlane::new(&cb, cw, ch, true),
+                    DctPlane::new(&cr, cw, ch, true),
+                    DctPlane::new(&a, width, height, false),
+                ];
+                (planes, y)
+            }
+            _ => return None,
+        };
+        Some(Self { width, height, channels, planes, luma })
+    }
+
+    /// How `quality` quantizes one plane: v1 table for grayscale, v18/v19 profile otherwise.
+    fn quantizer(&self, quality: u8, chroma: bool) -> Quantizer {
+        if self.channels == 1 {
+            return Quantizer { table: encoder::quant_table_for_quality(quality), sparsify: None };
+        }
+        let t = PlaneTables::for_quality(quality);
+        let (table, sparsify) = t.plane(chroma);
+        Quantizer { table: *table, sparsify: Some(*sparsify) }
+    }
+
+    /// Quantize every plane at `quality` into `out`, reusing its allocations.
+    fn quantize_into(&self, quality: u8, out: &mut Vec<Vec<Block>>) {
+        out.resize_with(self.planes.len(), Vec::new);
+        for (plane, q) in self.planes.iter().zip(out.iter_mut()) {
+            let quant = self.quantizer(quality, plane.chroma);
+            q.clear();
+            q.extend_from_slice(&plane.blocks);
+            encoder::for_each_block(q, plane.w, plane.h, |b| quant.apply(b));
+        }
+    }
+
+    /// Exact stream length of `quantized` planes (no ICC trailer).
+    fn stream_len(&self, quantized: &[Vec<Block>]) -> usize {
+        let planes: usize = if self.channels == 1 {
+            encoder::rle_payload(&quantized[0]).len()
+        } else {
+            self.planes
+                .iter()
+                .zip(quantized)
+                .map(|(p, q)| 4 + huffman::encode_plane_into(q, p.chroma, p.chroma, true, &mut []))
+                .sum()
+        };
+        encoder::BG_HEADER_SIZE + planes
+    }
+
+    fn write(&self, quality: u8, quantized: &[Vec<Block>], out: &mut [u8], pos: &mut i32) {
+        let version = match self.channels {
+            1 => encoder::BG_VERSION_GRAY,
+            3 => encoder::BG_PROFILE_YUV420,
+            _ => encoder::BG_PROFILE_YUV420 + 1,
+        };
+        bitstream::write_bytes(out, pos, &encoder::header_bytes(version, self.width, self.height, quality));
+        if self.channels == 1 {
+            bitstream::write_bytes(out, pos, &encoder::rle_payload(&quantized[0]));
+            return;
+        }
+        for (plane, q) in self.planes.iter().zip(quantized) {
+            encoder::write_plane_blocks(q, plane.chroma, out, pos);
+        }
+    }
+
+    /// Stream length at `quality` (1–100).
+    pub fn encoded_len(&self, quality: u8) -> usize {
+        let mut quantized = Vec::new();
+        self.quantize_into(quality, &mut quantized);
+        self.stream_len(&quantized)
+    }
+
+    /// Encode at `quality` (1–100), as the one-shot encoder would.
+    pub fn encode(&self, quality: u8, out: &mut [u8], pos: &mut i32) {
+        let mut quantized = Vec::new();
+        self.quantize_into(quality, &mut quantized);
+        self.write(quality, &quantized, out, pos);
+    }
+
+    /// Encode each `(quality, buffer)` of `outs`, concurrently on the worker pool.
+    /// Returns the stream lengths; a length above its buffer's size is the size needed.
+    pub fn encode_each(&self, outs: &mut [(u8, &mut [u8])]) -> Vec<usize> {
+        outs.par_iter_mut()
+            .map(|(quality, buf)| {
+                let mut pos = 0;
+                self.encode(*quality, buf, &mut pos);
+                pos as usize
+            })
+            .collect()
+    }
+
+    /// Stream length at `quality` from code lengths alone, over every `row_step`-th
+    /// block row and scaled up: each block is quantized on the stack and its bits
+    /// counted, so no quantized planes are built. Byte stuffing is left out, so with
+    /// `row_step` 1 this never exceeds the real length. Grayscale (RLE) is exact.
+    fn estimated_len(&self, quality: u8, row_step: usize) -> usize {
+        if self.channels == 1 {
+            return self.encoded_len(quality);
+        }
+        let planes: usize = self
+            .planes
+            .iter()
+            .map(|plane| {
+                let quant = self.quantizer(quality, plane.chroma);
+                let bw = (plane.w + 7) / 8;
+                let rows = plane.blocks.len() / bw;
+                let mut counter = PlaneCoder::counter(plane.chroma, plane.chroma, true);
+                for row in plane.blocks.chunks(bw).step_by(row_step) {
+                    for block in row {
+                        let mut b = *block;
+                        quant.apply(&mut b);
+                        counter.encode(std::slice::from_ref(&b));
+                    }
+                }
+                let sampled = (rows + row_step - 1) / row_step;
+                4 + (counter.bits() * rows / sampled + 7) / 8
+            })
+            .sum();
+        encoder::BG_HEADER_SIZE + planes
+    }
+
+    /// Encode at the highest quality whose stream is at most `max_bytes` (size grows
+    /// with quality). A binary search over 1–100 on estimates from a sample of block
+    /// rows picks a candidate, full estimates walk it up while the next quality fits,
+    /// and the real stream is written, stepping down while it does not fit. Returns
+    /// the quality used, or None (`pos` unchanged) when even quality 1 is larger.
+    pub fn encode_max_size(&self, max_bytes: usize, out: &mut [u8], pos: &mut i32) -> Option<u8> {
+        let luma_rows = (self.height + 7) / 8;
+        let row_step = (luma_rows / SAMPLE_BLOCK_ROWS).max(1);
+        let (mut lo, mut hi, mut q) = (1u8, 100u8, 1u8);
+        while lo <= hi {
+            let mid = lo + (hi - lo) / 2;
+            if self.estimated_len(mid, row_step) <= max_bytes {
+                q = mid;
+                lo = mid + 1;
+            } else if mid == 1 {
+                break;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        if row_step > 1 {
+            while q < 100 && self.estimated_len(q + 1, 1) <= max_bytes {
+                q += 1;
+            }
+        }
+        let start = *pos;
+        let mut quantized = Vec::new();
+        loop {
+            self.quantize_into(q, &mut quantized);
+            *pos = start;
+            self.write(q, &quantized, out, pos);
+            if (*pos - start) as usize <= max_bytes {
+                return Some(q);
+            }
+            if q == 1 {
+                *pos = start;
+                return None;
+            }
+            q -= 1;
+        }
+    }
+
+    /// Luma `target` metric at `quality` from the coefficients alone, over every
+    /// `row_step`-th block row: by Parseval (orthonormal DCT) a block's squared error
+    /// and its AC energies and cross term are sums over original and dequantized
+    /// coefficients, and its mean is DC / 8. Ignores IDCT rounding and clipping.
+    fn estimated_quality(&self, quality: u8, target: QualityTarget, row_step: usize) -> f64 {
+        let quant = self.quantizer(quality, false);
+        let plane = &self.planes[0];
+        let rows: Vec<Distortion> = plane
+            .blocks
+            .par_chunks((plane.w + 7) / 8)
+            .step_by(row_step)
+            .map(|row| {
+                let mut d = Distortion::default();
+                for block in row {
+                    let mut q = *block;
+                    quant.apply(&mut q);
+                    // Coefficients of 8-bit blocks are within ±2048 and dequantized ones
+                    // within a quant step of them, so 64 squares fit i32.
+                    let dq = |i: usize| q.data[i] as i32 * quant.table[i] as i32;
+                    let (x0, y0) = (block.data[0] as i32, dq(0));
+                    let (mut err, mut sxx, mut syy, mut sxy) = ((x0 - y0) * (x0 - y0), 0i32, 0i32, 0i32);
+                    for i in 1..64 {
+                        let (x, y) = (block.data[i] as i32, dq(i));
+                        err += (x - y) * (x - y);
+                        sxx += x * x;
+                        syy += y * y;
+                        sxy += x * y;
+                    }
+                    let means = (x0 as f64 / 8.0 + 128.0, y0 as f64 / 8.0 + 128.0);
+                    d.add(64, means, (sxx as f64 / 64.0, syy as f64 / 64.0, sxy as f64 / 64.0), err as u64);
+                }
+                d
+            })
+            .collect();
+        Distortion::total(rows).value(target)
+    }
+
+    /// Luma `target` metric of the decoded image: quantized luma blocks are
+    /// dequantized and inverse transformed as the decoder does, and compared with the
+    /// source luma over the pixels inside the image.
+    fn measured_quality(&self, quality: u8, quantized_luma: &[Block], target: QualityTarget) -> f64 {
+        let quant = self.quantizer(quality, false);
+        let (w, h) = (self.width, self.height);
+        let rows: Vec<Distortion> = quantized_luma
+            .par_chunks((w + 7) / 8)
+            .enumerate()
+            .map(|(brow, row)| {
+                let mut d = Distortion::default();
+                let by = brow * 8;
+                let bh = (h - by).min(8);
+                for (bcol, block) in row.iter().enumerate() {
+                    let mut r = *block;
+                    unsafe { dequantize_block(r.data.as_mut_ptr(), quant.table.as_ptr()) };
+                    dct::idct(&mut r);
+                    let bx = bcol * 8;
+                    let bw = (w - bx).min(8);
+                    let (mut sx, mut sy, mut sxx, mut syy, mut sxy, mut err) = (0u32, 0u32, 0u32, 0u32, 0u32, 0u32);
+                    for y in 0..bh {
+                        let src = &self.luma[(by + y) * w + bx..][..bw];
+                        for (x, &o) in src.iter().enumerate() {
+                            let o = o as u32;
+                            let p = (r.data[y * 8 + x] + 128).clamp(0, 255) as u32;
+                            sx += o;
+                            sy += p;
+                            sxx += o * o;
+                            syy += p * p;
+                            sxy += o * p;
+                            err += o.abs_diff(p).pow(2);
+                        }
+                    }
+                    let n = (bw * bh) as f64;
+                    let (mx, my) = (sx as f64 / n, sy as f64 / n);
+                    let var = (sxx as f64 / n - mx * mx, syy as f64 / n - my * my, sxy as f64 / n - mx * my);
+                    d.add(bw * bh, (mx, my), var, err as u64);
+                }
+                d
+            })
+            .collect();
+        Distortion::total(rows).value(target)
+    }
+
+    /// Encode at the lowest quality whose luma PSNR or SSIM reaches `target` (quality
+    /// 100 when none does). A binary search over 1–100 runs on coefficient-domain
+    /// estimates from sampled block rows and is settled with full-plane estimates.
+    /// The chosen quality is decoded and measured (stepping up if it falls short);
+    /// one quality lower is only decoded when the estimate, corrected by that
+    /// measurement, predicts it passes. Returns the quality used and its measured value.
+    pub fn encode_target_quality(&self, target: QualityTarget, out: &mut [u8], pos: &mut i32) -> (u8, f64) {
+        let row_step = ((self.height + 7) / 8 / SAMPLE_BLOCK_ROWS).max(1);
+        let (mut lo, mut hi, mut q) = (1u8, 100u8, 100u8);
+        while lo <= hi {
+            let mid = lo + (hi - lo) / 2;
+            if target.met_by(self.estimated_quality(mid, target, row_step)) {
+                q = mid;
+                hi = mid - 1;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        let mut full = [None; 101];
+        let mut estimate = |q: u8| *full[q as usize].get_or_insert_with(|| self.estimated_quality(q, target, 1));
+        if row_step > 1 {
+            while q < 100 && !target.met_by(estimate(q)) {
+                q += 1;
+            }
+            while q > 1 && target.met_by(estimate(q - 1)) {
+                q -= 1;
+            }
+        }
+        let mut quantized = Vec::new();
+        self.quantize_into(q, &mut quantized);
+        let mut value = self.measured_quality(q, &quantized[0], target);
+        while q < 100 && !target.met_by(value) {
+            q += 1;
+            self.quantize_into(q, &mut quantized);
+            value = self.measured_quality(q, &quantized[0], target);
+        }
+        if target.met_by(value) {
+            // Clipping makes the decoded result slightly better than estimated:
+            // calibrate on the measured candidate and try one quality lower while
+            // the corrected estimate says it passes.
+            let bias = value - estimate(q);
+            let mut lower = Vec::new();
+            while q > 1 && target.met_by(estimate(q - 1) + bias) {
+                self.quantize_into(q - 1, &mut lower);
+                let v = self.measured_quality(q - 1, &lower[0], target);
+                if !target.met_by(v) {
+                    break;
+                }
+                (q, value) = (q - 1, v);
+                std::mem::swap(&mut quantized, &mut lower);
+            }
+        }
+        self.write(q, &quantized, out, pos);
+        (q, value)
+    }
+}
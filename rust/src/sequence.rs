@@ -0,0 +1,493 @@
+//! Multi-frame sequences (version 21) with inter-frame block skip.
+//!
+//! Layout:
+//!   [0..12)    standard header: "BG" + 21 + width(u32 LE) + height(u32 LE) + quality(u8)
+//!   [12]       plane profile (v4..v19 version byte; entropy coding of every plane)
+//!   [13]       channels (1, 3 or 4)
+//!   [14..16)   keyframe interval (u16 LE, informational; 0 = only the first frame)
+//!   [16..20)   frame count (u32 LE)
+//!   [20..148)  luma quant table   (64 × u16 LE, natural order)
+//!   [148..276) chroma quant table (64 × u16 LE, natural order)
+//!   [276..)    frame index: count × 16 bytes
+//!              offset(u64 LE, absolute) + length(u32 LE) + type(u8) + reserved[3]
+//!   ...        frames
+//!
+//! Frame: type byte (0 = key, 1 = delta), then per plane (Y | Y Cb Cr | Y Cb Cr A):
+//!   delta only: skip bitmap, one bit per 8×8 block in raster order, LSB first;
+//!               1 = unchanged (keep the previous frame's reconstruction)
+//!   LEB128 payload length + Huffman payload of the coded blocks only.
+//!
+//! A block is skipped only when its quantized coefficients equal the ones the
+//! decoder already holds, so skipping never causes drift. Blocks whose source
+//! pixels are unchanged skip DCT/quant entirely.
+
+use crate::bitstream::{self, push_varint, read_varint};
+use crate::block::Block;
+use crate::blockizer::Blockizer;
+use crate::colorspace;
+use crate::container;
+use crate::decoder::{self, PlaneProfile};
+use crate::encoder::{self, PlaneTables};
+use crate::huffman;
+use crate::validate::{self, Invalid};
+use rayon::prelude::*;
+
+pub const BG_VERSION_SEQUENCE: u8 = 21;
+pub const SEQ_HEADER_SIZE: usize = 20 + 2 * container::QUANT_TABLE_SIZE;
+pub const SEQ_INDEX_ENTRY_SIZE: usize = 16;
+pub const FRAME_KEY: u8 = 0;
+pub const FRAME_DELTA: u8 = 1;
+
+/// (width, height, is_chroma) of each plane for the given channel count.
+fn plane_layout(width: usize, height: usize, channels: u32) -> Vec<(usize, usize, bool)> {
+    let (cw, ch) = ((width + 1) / 2, (height + 1) / 2);
+    match channels {
+        1 => vec![(width, height, false)],
+        3 => vec![(width, height, false), (cw, ch, true), (cw, ch, true)],
+        _ => vec![(width, height, false), (cw, ch, true), (cw, ch, true), (width, height, false)],
+    }
+}
+
+#[inline]
+fn block_count(w: usize, h: usize) -> usize {
+    ((w + 7) / 8) * ((h + 7) / 8)
+}
+
+// ---------------------------------------------------------------------------
+// Encoder
+// ---------------------------------------------------------------------------
+
+/// Per-plane encoder state: last source blocks and the coefficients the decoder holds.
+struct PlaneState {
+    w: usize,
+    h: usize,
+    is_chroma: bool,
+    prev_src: Vec<Block>,
+    prev_coded: Vec<Block>,
+}
+
+/// Encodes frames one at a time; `write` emits the header, frame index and frames.
+pub struct SequenceEncoder {
+    width: usize,
+    height: usize,
+    channels: u32,
+    quality: u8,
+    keyframe_interval: u32,
+    tables: PlaneTables,
+    planes: Vec<PlaneState>,
+    frames: Vec<(u8, Vec<u8>)>,
+    since_key: u32,
+}
+
+impl SequenceEncoder {
+    /// `keyframe_interval`: a keyframe every N frames; 0 = only the first frame.
+    pub fn new(width: usize, height: usize, channels: u32, quality: u8, keyframe_interval: u32) -> Option<Self> {
+        if width == 0 || height == 0 || width > 65536 || height > 65536 || !matches!(channels, 1 | 3 | 4) {
+            return None;
+        }
+        let q = if quality == 0 { 85 } else { quality };
+        let planes = plane_layout(width, height, channels)
+            .into_iter()
+            .map(|(w, h, is_chroma)| PlaneState { w, h, is_chroma, prev_src: Vec::new(), prev_coded: Vec::new() })
+            .collect();
+        Some(Self {
+            width,
+            height,
+            channels,
+            quality: q,
+            keyframe_interval,
+            tables: PlaneTables::for_quality(q),
+            planes,
+            frames: Vec::new(),
+            since_key: 0,
+        })
+    }
+
+    pub fn frame_count(&self) -> usize {
+        self.frames.len()
+    }
+
+    /// Bytes of one input frame.
+    pub fn frame_len(&self) -> usize {
+        self.width * self.height * self.channels as usize
+    }
+
+    /// Encode one interleaved frame (width × height × channels bytes).
+    pub fn push_frame(&mut self, image: &[u8]) -> bool {
+        let (w, h) = (self.width, self.height);
+        if image.len() < w * h * self.channels as usize || self.frames.len() >= u32::MAX as usize {
+            return false;
+        }
+        let key = self.frames.is_empty()
+            || (self.keyframe_interval > 0 && self.since_key >= self.keyframe_interval);
+        let raw: Vec<Vec<u8>> = match self.channels {
+            1 => vec![image[..w * h].to_vec()],
+            3 => {
+                let (y, cb, cr) = colorspace::rgb_to_ycbcr420(image, w, h);
+                vec![y, cb, cr]
+            }
+            _ => {
+                let (y, cb, cr, a) = colorspace::rgba_to_ycbcr420a(image, w, h);
+                vec![y, cb, cr, a]
+            }
+        };
+
+        let mut data = vec![if key { FRAME_KEY } else { FRAME_DELTA }];
+        for (state, plane) in self.planes.iter_mut().zip(&raw) {
+            encode_plane_frame(state, plane, key, &self.tables, &mut data);
+        }
+        self.frames.push((data[0], data));
+        self.since_key = if key { 1 } else { self.since_key + 1 };
+        true
+    }
+
+    /// Total bytes `write` will produce.
+    pub fn encoded_len(&self) -> usize {
+        SEQ_HEADER_SIZE
+            + self.frames.len() * SEQ_INDEX_ENTRY_SIZE
+            + self.frames.iter().map(|f| f.1.len()).sum::<usize>()
+    }
+
+    pub fn write(&self, out: &mut [u8], pos: &mut i32) {
+        let base = *pos as usize;
+        let mut hdr = [0u8; SEQ_HEADER_SIZE];
+        hdr[0] = b'B';
+        hdr[1] = b'G';
+        hdr[2] = BG_VERSION_SEQUENCE;
+        hdr[3..7].copy_from_slice(&(self.width as u32).to_le_bytes());
+        hdr[7..11].copy_from_slice(&(self.height as u32).to_le_bytes());
+        hdr[11] = self.quality;
+        hdr[12] = encoder::BG_PROFILE_YUV420 + (self.channels == 4) as u8;
+        hdr[13] = self.channels as u8;
+        hdr[14..16].copy_from_slice(&(self.keyframe_interval.min(u16::MAX as u32) as u16).to_le_bytes());
+        hdr[16..20].copy_from_slice(&(self.frames.len() as u32).to_le_bytes());
+        let qt = 20 + container::QUANT_TABLE_SIZE;
+        hdr[20..qt].copy_from_slice(&container::quant_table_bytes(&self.tables.luma));
+        hdr[qt..SEQ_HEADER_SIZE].copy_from_slice(&container::quant_table_bytes(&self.tables.chroma));
+        bitstream::write_bytes(out, pos, &hdr);
+
+        let mut offset = (SEQ_HEADER_SIZE + self.frames.len() * SEQ_INDEX_ENTRY_SIZE) as u64;
+        for (kind, data) in &self.frames {
+            let mut e = [0u8; SEQ_INDEX_ENTRY_SIZE];
+            e[0..8].copy_from_slice(&offset.to_le_bytes());
+            e[8..12].copy_from_slice(&(data.len() as u32).to_le_bytes());
+            e[12] = *kind;
+            bitstream::write_bytes(out, pos, &e);
+            offset += data.len() as u64;
+        }
+        for (_, data) in &self.frames {
+            bitstream::write_bytes(out, pos, data);
+        }
+        debug_assert_eq!(*pos as usize - base, self.encoded_len());
+    }
+}
+
+/// Code one plane of a frame: skip bitmap (delta frames) + payload of the changed blocks.
+fn encode_plane_frame(state: &mut PlaneState, plane: &[u8], key: bool, tables: &PlaneTables, out: &mut Vec<u8>) {
+    let src = Blockizer::new(state.w, state.h).generate_blocks(plane);
+    let n = src.len();
+
+    // Only blocks whose source pixels moved need DCT + quant.
+    let candidates: Vec<usize> = if key {
+        (0..n).collect()
+    } else {
+        (0..n).filter(|&i| src[i].data != state.prev_src[i].data).collect()
+    };
+    let mut coded: Vec<Block> = candidates.iter().map(|&i| src[i]).collect();
+    if state.is_chroma {
+        tables.quantize_chroma(&mut coded, state.w, state.h);
+    } else {
+        tables.quantize_luma(&mut coded, state.w, state.h);
+    }
+
+    let mut changed = Vec::with_capacity(coded.len());
+    if key {
+        state.prev_coded = coded.clone();
+        changed = coded;
+    } else {
+        let mut bitmap = vec![0xFFu8; (n + 7) / 8];
+        if n % 8 != 0 {
+            *bitmap.last_mut().unwrap() = (1u8 << (n % 8)) - 1;
+        }
+        for (block, &i) in coded.iter().zip(&candidates) {
+            if block.data != state.prev_coded[i].data {
+                bitmap[i / 8] &= !(1u8 << (i % 8));
+                state.prev_coded[i] = *block;
+                changed.push(*block);
+            }
+        }
+        out.extend_from_slice(&bitmap);
+    }
+    state.prev_src = src;
+
+    let payload = huffman::encode_plane_payload(&changed, state.is_chroma, state.is_chroma, true);
+    push_varint(out, payload.len());
+    out.extend_from_slice(&payload);
+}
+
+// ---------------------------------------------------------------------------
+// Decoder
+// ---------------------------------------------------------------------------
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct FrameEntry {
+    pub offset: u64,
+    pub length: u32,
+    pub kind: u8,
+}
+
+/// Parsed sequence header; frames are borrowed from the input buffer.
+pub struct Sequence<'a> {
+    buf: &'a [u8],
+    pub width: u32,
+    pub height: u32,
+    pub channels: u32,
+    pub frame_count: usize,
+    profile: &'static PlaneProfile,
+    luma_q: [i16; 64],
+    chroma_q: [i16; 64],
+}
+
+impl<'a> Sequence<'a> {
+    pub fn parse(buf: &'a [u8]) -> Option<Self> {
+        if buf.len() < SEQ_HEADER_SIZE || buf[0] != b'B' || buf[1] != b'G' || buf[2] != BG_VERSION_SEQUENCE {
+            return None;
+        }
+        let width = u32::from_le_bytes(buf[3..7].try_into().unwrap());
+        let height = u32::from_le_bytes(buf[7..11].try_into().unwrap());
+        let channels = buf[13] as u32;
+        if width == 0 || height == 0 || width > 65536 || height > 65536 || !matches!(channels, 1 | 3 | 4) {
+            return None;
+        }
+        let profile = decoder::plane_profile(buf[12])?;
+        let frame_count = u32::from_le_bytes(buf[16..20].try_into().unwrap()) as usize;
+        let qt = 20 + container::QUANT_TABLE_SIZE;
+        let luma_q = container::parse_quant_table(&buf[20..qt])?;
+        let chroma_q = container::parse_quant_table(&buf[qt..SEQ_HEADER_SIZE])?;
+        if buf.len() < SEQ_HEADER_SIZE + frame_count * SEQ_INDEX_ENTRY_SIZE {
+            return None;
+        }
+        Some(Self { buf, width, height, channels, frame_count, profile, luma_q, chroma_q })
+    }
+
+    pub fn frame(&self, i: usize) -> FrameEntry {
+        let p = SEQ_HEADER_SIZE + i * SEQ_INDEX_ENTRY_SIZE;
+        let e = &self.buf[p..p + SEQ_INDEX_ENTRY_SIZE];
+        FrameEntry {
+            offset: u64::from_le_bytes(e[0..8].try_into().unwrap()),
+            length: u32::from_le_bytes(e[8..12].try_into().unwrap()),
+            kind: e[12],
+        }
+    }
+
+    /// Bytes of one decoded frame.
+    pub fn frame_len(&self) -> usize {
+        self.width as usize * self.height as usize * self.channels as usize
+    }
+}
+
+/// Sequential frame decoder. Keeps the previous reconstruction so delta frames
+/// only entropy-decode and IDCT their changed blocks.
+pub struct SequenceDecoder<'a> {
+    seq: Sequence<'a>,
+    planes: Vec<Vec<u8>>,
+    layout: Vec<(usize, usize, bool)>,
+    next: usize,
+    has_reference: bool,
+}
+
+impl<'a> SequenceDecoder<'a> {
+    pub fn new(buf: &'a [u8]) -> Option<Self> {
+        let seq = Sequence::parse(buf)?;
+        let layout = plane_layout(seq.width as usize, seq.height as usize, seq.channels);
+        let planes = layout.iter().map(|&(w, h, _)| vec![0u8; w * h]).collect();
+        Some(Self { seq, planes, layout, next: 0, has_reference: false })
+    }
+
+    pub fn sequence(&self) -> &Sequence<'a> {
+        &self.seq
+    }
+
+    /// Index of the frame `decode_next` will return.
+    pub fn position(&self) -> usize {
+        self.next
+    }
+
+    /// Decode the next frame into `out` (at least `frame_len()` bytes).
+    pub fn decode_next(&mut self, out: &mut [u8]) -> bool {
+        let (w, h) = (self.seq.width as usize, self.seq.height as usize);
+        if self.next >= self.seq.frame_count || out.len() < self.seq.frame_len() {
+            return false;
+        }
+        if !self.decode_frame_planes(self.next) {
+            self.has_reference = false;
+            return false;
+        }
+        self.next += 1;
+        let out = &mut out[..self.seq.frame_len()];
+        match self.planes.len() {
+            1 => out.copy_from_slice(&self.planes[0]),
+            3 => colorspace::ycbcr420_to_rgb(&self.planes[0], &self.planes[1], &self.planes[2], w, h, out),
+            _ => colorspace::ycbcr420a_to_rgba(
+                &self.planes[0], &self.planes[1], &self.planes[2], &self.planes[3], w, h, out,
+            ),
+        }
+        true
+    }
+
+    /// Position on `frame`: rewinds to the nearest keyframe at or before it and
+    /// replays the planes (no color conversion) up to it.
+    pub fn seek(&mut self, frame: usize) -> bool {
+        if frame >= self.seq.frame_count {
+            return false;
+        }
+        let key = match (0..=frame).rev().find(|&i| self.seq.frame(i).kind == FRAME_KEY) {
+            Some(k) => k,
+            None => return false,
+        };
+        let start = if self.has_reference && self.next <= frame && self.next > key { self.next } else { key };
+        for i in start..frame {
+            if !self.decode_frame_planes(i) {
+                self.has_reference = false;
+                return false;
+            }
+        }
+        self.next = frame;
+        true
+    }
+
+    fn decode_frame_planes(&mut self, idx: usize) -> bool {
+        let f = self.seq.frame(idx);
+        let start = f.offset as usize;
+        let data = match start.checked_add(f.length as usize) {
+            Some(end) if end <= self.seq.buf.len() && f.length > 0 => &self.seq.buf[start..end],
+            _ => return false,
+        };
+        let key = match data[0] {
+            FRAME_KEY => true,
+            FRAME_DELTA if self.has_reference => false,
+            _ => return false,
+        };
+        let p = &self.seq.profile;
+        let mut pos = 1usize;
+        for (plane, &(w, h, is_chroma)) in self.planes.iter_mut().zip(&self.layout) {
+            let n = block_count(w, h);
+            let indices: Vec<usize> = if key {
+                (0..n).collect()
+            } else {
+                let bitmap = match data.get(pos..pos + (n + 7) / 8) { Some(b) => b, None => return false };
+                pos += bitmap.len();
+                (0..n).filter(|&i| bitmap[i / 8] & (1 << (i % 8)) == 0).collect()
+            };
+            let len = match read_varint(data, &mut pos) { Some(v) => v, None => return false };
+            let payload = match data.get(pos..pos + len) { Some(d) => d, None => return false };
+            pos += len;
+            if indices.is_empty() {
+                continue;
+            }
+            let quant = if is_chroma { &self.seq.chroma_q } else { &self.seq.luma_q };
+            let blocks = match huffman::decode_plane_payload(
+                payload, indices.len(), is_chroma, is_chroma && p.use_chroma_ac, p.use_dc_delta,
+            ) {
+                Some(b) => b,
+                None => return false,
+            };
+            decoder::reconstruct_blocks_at(blocks, &indices, w, h, quant, plane);
+        }
+        self.has_reference = true;
+        true
+    }
+}
+
+/// Decode the first frame of a sequence (what `decoder::decode` returns for v21).
+pub fn decode_first_frame(
+    buffer: &[u8],
+    out_pixels: &mut [u8],
+    out_width: &mut u32,
+    out_height: &mut u32,
+    out_channels: &mut u32,
+) -> bool {
+    let mut dec = match SequenceDecoder::new(buffer) { Some(d) => d, None => return false };
+    if !dec.decode_next(out_pixels) {
+        return false;
+    }
+    let s = dec.sequence();
+    *out_width = s.width; *out_height = s.height; *out_channels = s.channels;
+    true
+}
+
+/// Structural check for `validate::validate`: header, frame index, and per frame the
+/// type byte, skip bitmaps, payload lengths and every Huffman symbol. The first
+/// frame must be a keyframe and the frames must end the stream.
+pub(crate) fn validate(buffer: &[u8]) -> Result<(), Invalid> {
+    let (w, h) = validate::header_dimensions(buffer, SEQ_HEADER_SIZE)?;
+    if !matches!(buffer[13], 1 | 3 | 4) {
+        return Err(Invalid::at(13, "bad channel count"));
+    }
+    if decoder::plane_profile(buffer[12]).is_none() {
+        return Err(Invalid::at(12, "unknown plane profile"));
+    }
+    for at in [20, 20 + container::QUANT_TABLE_SIZE] {
+        if container::parse_quant_table(&buffer[at..at + container::QUANT_TABLE_SIZE]).is_none() {
+            return Err(Invalid::at(at, "bad quant table"));
+        }
+    }
+    let seq = Sequence::parse(buffer).ok_or(Invalid::at(buffer.len(), "truncated frame index"))?;
+    let layout = plane_layout(w, h, seq.channels);
+    let p = seq.profile;
+    let mut end = SEQ_HEADER_SIZE + seq.frame_count * SEQ_INDEX_ENTRY_SIZE;
+    for i in 0..seq.frame_count {
+        let entry = SEQ_HEADER_SIZE + i * SEQ_INDEX_ENTRY_SIZE;
+        let f = seq.frame(i);
+        let start = f.offset as usize;
+        let data = start.checked_add(f.length as usize).filter(|&e| e <= buffer.len() && f.length > 0);
+        let frame_end = data.ok_or(Invalid::at(entry, "frame past end of stream"))?;
+        let data = &buffer[start..frame_end];
+        end = end.max(frame_end);
+        let key = match data[0] {
+            FRAME_KEY => true,
+            FRAME_DELTA if i > 0 => false,
+            FRAME_DELTA => return Err(Invalid::at(start, "first frame is not a keyframe")),
+            _ => return Err(Invalid::at(start, "bad frame type")),
+        };
+        if data[0] != f.kind {
+            return Err(Invalid::at(entry + 12, "frame type does not match index"));
+        }
+        let mut pos = 1usize;
+        let mut planes = Vec::with_capacity(layout.len());
+        for &(pw, ph, _) in &layout {
+            let n = block_count(pw, ph);
+            let coded = if key {
+                n
+            } else {
+                let bitmap = data.get(pos..pos + (n + 7) / 8).ok_or(Invalid::at(start + pos, "truncated skip bitmap"))?;
+                pos += bitmap.len();
+                (0..n).filter(|&b| bitmap[b / 8] & (1 << (b % 8)) == 0).count()
+            };
+            let len_at = pos;
+            let len = read_varint(data, &mut pos).ok_or(Invalid::at(start + len_at, "truncated payload length"))?;
+            let payload = data.get(pos..).and_then(|d| d.get(..len)).ok_or(Invalid::at(start + len_at, "payload past end of frame"))?;
+            planes.push((start + pos, payload, coded));
+            pos += len;
+        }
+        if pos != data.len() {
+            return Err(Invalid::at(start + pos, "unused bytes at end of frame"));
+        }
+        let results: Vec<Result<(), Invalid>> = planes
+            .par_iter()
+            .zip(&layout)
+            .map(|(&(base, payload, coded), &(_, _, is_chroma))| {
+                if coded == 0 {
+                    return Ok(());
+                }
+                huffman::validate_plane_payload(payload, coded, is_chroma, is_chroma && p.use_chroma_ac, p.use_dc_delta)
+                    .map_err(|(at, reason)| Invalid::at(base + at, reason))
+            })
+            .collect();
+        results.into_iter().collect::<Result<(), Invalid>>()?;
+    }
+    if end != buffer.len() {
+        return Err(Invalid::at(end, "trailing bytes after stream"));
+    }
+    Ok(())
+}
@@ -0,0 +1,554 @@
+//! Streaming decoder: feed bytes as they arrive, pull finished rows.
+//!
+//! Supports the legacy RLE versions (v1–v3), the Huffman versions (v4–v19), the
+//! chunked container (v20) and lossless streams (v22). Rows come out in bands of
+//! 16 (two luma block rows, one chroma block row): once every plane's bytes for a
+//! band have arrived, just those blocks are entropy-decoded, reconstructed and
+//! color converted, and the input behind them is discarded.
+//!
+//! Planes are stored one after another, so the first band is ready while the last
+//! plane (Cr, B, or A) is still arriving. Until then the earlier planes are held
+//! as compressed input plus a cursor position; decoded pixels never exceed one
+//! band per plane. Legacy RLE planes carry no length, so they are scanned as they
+//! arrive to find where the next one starts. Lossless streams hand out one strip
+//! at a time, decoded on demand from the strip's bytes.
+
+use crate::block::Block;
+use crate::colorspace;
+use crate::container;
+use crate::decoder;
+use crate::encoder;
+use crate::huffman::PlaneCursor;
+use crate::lossless;
+use std::collections::VecDeque;
+
+pub const STREAM_BAND_ROWS: usize = 16;
+
+/// Part of the stream still to be read, in stream order.
+enum Segment {
+    /// v4–v19: u32 LE length prefix of plane i.
+    PlaneLen(usize),
+    /// v1–v3: RLE blocks of plane i still to scan from `offset` on, after the
+    /// given number of blocks (length not known up front).
+    Rle(usize, usize),
+    /// v20 `DQT ` chunk (info value).
+    Quant(u32),
+    /// v22 strip length table.
+    StripIndex,
+}
+
+struct Pending {
+    seg: Segment,
+    offset: usize,
+    len: usize,
+}
+
+struct StreamPlane {
+    w: usize,
+    h: usize,
+    is_chroma: bool,
+    /// v1–v3: blocks are RLE coded and `cursor` is unused.
+    rle: bool,
+    cursor: PlaneCursor,
+    /// Stream offset of the payload, and just past it, once known.
+    start: Option<usize>,
+    stop: Option<usize>,
+    /// RLE planes: stream offset of the next block to decode.
+    rle_pos: usize,
+    /// Blocks not yet entropy-decoded.
+    left: usize,
+    /// Decoded blocks of the band being assembled.
+    blocks: Vec<Block>,
+    /// Pixels of the last band, at this plane's resolution.
+    pixels: Vec<u8>,
+}
+
+impl StreamPlane {
+    fn new(w: usize, h: usize, is_chroma: bool, rle: bool, cursor: PlaneCursor) -> Self {
+        let left = ((w + 7) / 8) * ((h + 7) / 8);
+        Self { w, h, is_chroma, rle, cursor, start: None, stop: None, rle_pos: 0, left, blocks: Vec::new(), pixels: Vec::new() }
+    }
+
+    fn n_blocks(&self) -> usize {
+        ((self.w + 7) / 8) * ((self.h + 7) / 8)
+    }
+
+    /// Plane rows in band `k` (chroma planes are half height).
+    fn band_rows(&self, k: usize) -> usize {
+        let rows = if self.is_chroma { STREAM_BAND_ROWS / 2 } else { STREAM_BAND_ROWS };
+        rows.min(self.h - k * rows)
+    }
+
+    /// Stream offset of the first byte still needed.
+    fn next_byte(&self, start: usize) -> usize {
+        if self.rle { self.rle_pos } else { start + self.cursor.consumed() }
+    }
+
+    /// Reconstruct the decoded blocks of band `k` into `pixels`.
+    fn reconstruct(&mut self, k: usize, quant: &[i16; 64]) {
+        let rows = self.band_rows(k);
+        self.pixels.resize(self.w * rows, 0);
+        let blocks = std::mem::take(&mut self.blocks);
+        let indices: Vec<usize> = (0..blocks.len()).collect();
+        decoder::reconstruct_blocks_at(blocks, &indices, self.w, rows, quant, &mut self.pixels);
+    }
+}
+
+#[derive(Default)]
+pub struct StreamDecoder {
+    input: Vec<u8>,
+    /// Stream offset of `input[0]`.
+    base: usize,
+    version: u8,
+    width: usize,
+    height: usize,
+    channels: usize,
+    failed: bool,
+    queue: VecDeque<Pending>,
+
+    tables: Option<([i16; 64], [i16; 64])>,
+    dqt: [Option<[i16; 64]>; 2],
+    planes: Vec<StreamPlane>,
+
+    strips: Vec<(usize, usize)>,
+    strip_rows: usize,
+
+    band: Vec<u8>,
+    band_pos: usize,
+    rows_banded: usize,
+    rows_read: usize,
+}
+
+impl StreamDecoder {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// (width, height, channels) once the header has arrived.
+    pub fn info(&self) -> Option<(u32, u32, u32)> {
+        if self.width == 0 {
+            return None;
+        }
+        Some((self.width as u32, self.height as u32, self.channels as u32))
+    }
+
+    /// Rows handed out so far.
+    pub fn rows_read(&self) -> usize {
+        self.rows_read
+    }
+
+    /// All rows have been read.
+    pub fn is_finished(&self) -> bool {
+        self.width != 0 && self.rows_read == self.height
+    }
+
+    /// Append input and parse as far as it allows. Returns false once the header or
+    /// layout is known to be invalid or unsupported; the decoder then stays failed.
+    /// Corrupt plane data is reported by `read_rows`, when its band is decoded.
+    pub fn feed(&mut self, data: &[u8]) -> bool {
+        if self.failed {
+            return false;
+        }
+        let end = self.end();
+        if self.width != 0
+            && self.queue.is_empty()
+            && self.strips.is_empty()
+            && self.planes.iter().all(|p| p.stop.is_some_and(|s| s <= end))
+        {
+            // Everything needed has arrived; trailing data (ICC) is ignored.
+            self.base += data.len();
+            return true;
+        }
+        self.input.extend_from_slice(data);
+        if self.process().is_none() {
+            self.failed = true;
+            self.input = Vec::new();
+            return false;
+        }
+        true
+    }
+
+    /// Bytes held for decoding: undecoded input, decoded blocks and band buffers.
+    #[cfg(test)]
+    pub(crate) fn held_bytes(&self) -> usize {
+        let block = std::mem::size_of::<Block>();
+        let planes: usize = self.planes.iter().map(|p| p.blocks.capacity() * block + p.pixels.capacity()).sum();
+        self.input.capacity() + planes + self.band.capacity()
+    }
+
+    /// Copy up to `max_rows` finished rows (width × channels bytes each) into `out`.
+    /// Returns the number of rows written, or None if the stream is corrupt.
+    pub fn read_rows(&mut self, out: &mut [u8], max_rows: usize) -> Option<usize> {
+        if self.failed {
+            return None;
+        }
+        if self.width == 0 {
+            return Some(0);
+        }
+        let stride = self.width * self.channels;
+        let max_rows = max_rows.min(out.len() / stride);
+        let mut rows = 0;
+        while rows < max_rows {
+            let left = (self.band.len() - self.band_pos) / stride;
+            if left == 0 {
+                match self.next_band() {
+                    Some(true) => continue,
+                    Some(false) => break,
+                    None => {
+                        self.failed = true;
+                        return None;
+                    }
+                }
+            }
+            let n = left.min(max_rows - rows);
+            out[rows * stride..(rows + n) * stride]
+                .copy_from_slice(&self.band[self.band_pos..self.band_pos + n * stride]);
+            self.band_pos += n * stride;
+            rows += n;
+        }
+        self.rows_read += rows;
+        Some(rows)
+    }
+
+    // -----------------------------------------------------------------------
+    // Input side
+    // -----------------------------------------------------------------------
+
+    fn end(&self) -> usize {
+        self.base + self.input.len()
+    }
+
+    fn bytes(&self, offset: usize, len: usize) -> &[u8] {
+        &self.input[offset - self.base..offset - self.base + len]
+    }
+
+    fn process(&mut self) -> Option<()> {
+        if self.width == 0 && !self.parse_header()? {
+            return Some(());
+        }
+        while let Some(p) = self.queue.front() {
+            let (offset, len) = (p.offset, p.len);
+            if let Segment::Rle(i, scanned) = p.seg {
+                let (scanned, next) = self.scan_rle_plane(i, offset, scanned);
+                let front = self.queue.front_mut().unwrap();
+                front.seg = Segment::Rle(i, scanned);
+                front.offset = next;
+                if scanned < self.planes[i].n_blocks() {
+                    break;
+                }
+                self.queue.pop_front();
+                self.planes[i].stop = Some(next);
+                if let Some(plane) = self.planes.get_mut(i + 1) {
+                    plane.start = Some(next);
+                    plane.rle_pos = next;
+                    self.queue.push_back(Pending { seg: Segment::Rle(i + 1, 0), offset: next, len: 0 });
+                }
+                continue;
+            }
+            if self.end() < offset + len {
+                break;
+            }
+            let seg = self.queue.pop_front().unwrap().seg;
+            match seg {
+                Segment::Rle(..) => {}
+                Segment::PlaneLen(i) => {
+                    let n = u32::from_le_bytes(self.bytes(offset, 4).try_into().unwrap()) as usize;
+                    self.planes[i].start = Some(offset + 4);
+                    self.planes[i].stop = Some(offset + 4 + n);
+                    if i + 1 < self.planes.len() {
+                        self.queue.push_back(Pending { seg: Segment::PlaneLen(i + 1), offset: offset + 4 + n, len: 4 });
+                    }
+                }
+                Segment::Quant(info) => {
+                    self.dqt[info as usize] = Some(container::parse_quant_table(self.bytes(offset, len))?);
+                }
+                Segment::StripIndex => {
+                    let mut pos = offset + len;
+                    for i in 0..len / 4 {
+                        let n = u32::from_le_bytes(self.bytes(offset + i * 4, 4).try_into().unwrap()) as usize;
+                        self.strips.push((pos, n));
+                        pos += n;
+                    }
+                }
+            }
+        }
+        self.discard_consumed();
+        Some(())
+    }
+
+    /// Drop input that no pending segment, plane or strip still needs.
+    fn discard_consumed(&mut self) {
+        let mut keep = self.queue.front().map_or(usize::MAX, |p| p.offset);
+        for p in &self.planes {
+            if let (Some(start), true) = (p.start, p.left > 0) {
+                keep = keep.min(p.next_byte(start));
+            }
+        }
+        if let Some(&(offset, _)) = self.strips.get(self.rows_banded / self.strip_rows.max(1)) {
+            keep = keep.min(offset);
+        }
+        let n = keep.min(self.end()).saturating_sub(self.base);
+        if n > 0 {
+            self.input.drain(..n);
+            self.base += n;
+        }
+    }
+
+    /// Returns Ok(false) while more data is needed, None on invalid input.
+    fn parse_header(&mut self) -> Option<bool> {
+        let buf = &self.input;
+        if buf.first().is_some_and(|&b| b != b'B') || buf.get(1).is_some_and(|&b| b != b'G') {
+            return None;
+        }
+        if buf.len() < 3 {
+            return Some(false);
+        }
+        let version = buf[2];
+        let need = match version {
+            1..=19 => 12,
+            container::BG_VERSION_CHUNKED => match container::toc_size(buf) {
+                Some(n) => n,
+                None if buf.len() < container::CONTAINER_HEADER_SIZE => return Some(false),
+                None => return None,
+            },
+            lossless::BG_VERSION_LOSSLESS => lossless::LOSSLESS_HEADER_SIZE,
+            _ => return None,
+        };
+        if buf.len() < need {
+            return Some(false);
+        }
+        let width = u32::from_le_bytes(buf[3..7].try_into().unwrap()) as usize;
+        let height = u32::from_le_bytes(buf[7..11].try_into().unwrap()) as usize;
+        if width == 0 || height == 0 || width > 65536 || height > 65536 {
+            return None;
+        }
+        let quality = if buf[11] == 0 { 50 } else { buf[11] };
+
+        match version {
+            1..=3 => {
+                let channels = [1, 3, 4][version as usize - 1];
+                let n = ((width + 7) / 8) * ((height + 7) / 8);
+                self.channels = channels;
+                self.planes = (0..channels)
+                    .map(|_| StreamPlane::new(width, height, false, true, PlaneCursor::new(n, false, false, false)))
+                    .collect();
+                self.planes[0].start = Some(12);
+                self.planes[0].rle_pos = 12;
+                let table = encoder::quant_table_for_quality(quality);
+                self.tables = Some((table, table));
+                self.queue.push_back(Pending { seg: Segment::Rle(0, 0), offset: 12, len: 0 });
+            }
+            4..=19 => {
+                self.start_planes(version, width, height)?;
+                self.tables = Some(decoder::profile_quant_tables(version, quality));
+                self.queue.push_back(Pending { seg: Segment::PlaneLen(0), offset: 12, len: 4 });
+            }
+            container::BG_VERSION_CHUNKED => {
+                let profile = buf[12];
+                let mut chunks = container::read_toc(buf)?;
+                self.start_planes(profile, width, height)?;
+                chunks.sort_by_key(|c| c.offset);
+                let mut seen = [false; 4];
+                let mut pos = need;
+                let mut has_dqt = false;
+                for c in &chunks {
+                    let (offset, len) = (c.offset as usize, c.length as usize);
+                    if offset < pos {
+                        return None;
+                    }
+                    match c.tag {
+                        container::TAG_PLANE => {
+                            let i = c.info as usize;
+                            if i >= self.planes.len() || seen[i] {
+                                return None;
+                            }
+                            seen[i] = true;
+                            self.planes[i].start = Some(offset);
+                            self.planes[i].stop = Some(offset + len);
+                        }
+                        container::TAG_QUANT if c.info <= container::QUANT_TABLE_CHROMA => {
+                            // Tables must precede the planes to decode while streaming.
+                            if seen.iter().any(|&s| s) {
+                                return None;
+                            }
+                            has_dqt = true;
+                            self.queue.push_back(Pending { seg: Segment::Quant(c.info), offset, len });
+                        }
+                        _ => {}
+                    }
+                    pos = offset + len;
+                }
+                if seen.iter().take(self.planes.len()).any(|&s| !s) {
+                    return None;
+                }
+                if !has_dqt {
+                    self.tables = Some(decoder::profile_quant_tables(profile, quality));
+                }
+            }
+            _ => {
+                let channels = buf[12] as usize;
+                let strip_rows = u16::from_le_bytes([buf[14], buf[15]]) as usize;
+                let transform_ok = match channels {
+                    1 => buf[13] == lossless::TRANSFORM_NONE,
+                    3 | 4 => buf[13] == lossless::TRANSFORM_YCOCG_R,
+                    _ => false,
+                };
+                if !transform_ok || strip_rows == 0 {
+                    return None;
+                }
+                let n_strips = (height + strip_rows - 1) / strip_rows;
+                self.channels = channels;
+                self.strip_rows = strip_rows;
+                self.queue.push_back(Pending { seg: Segment::StripIndex, offset: need, len: n_strips * 4 });
+            }
+        }
+        self.version = version;
+        self.width = width;
+        self.height = height;
+        Some(true)
+    }
+
+    fn start_planes(&mut self, profile: u8, w: usize, h: usize) -> Option<()> {
+        let p = decoder::plane_profile(profile)?;
+        let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+        let mut layout = vec![(w, h, false), (cw, ch, true), (cw, ch, true)];
+        if p.has_alpha {
+            layout.push((w, h, false));
+        }
+        self.channels = layout.len();
+        self.planes = layout
+            .into_iter()
+            .map(|(pw, ph, is_chroma)| {
+                let n = ((pw + 7) / 8) * ((ph + 7) / 8);
+                let cursor = PlaneCursor::new(n, is_chroma, is_chroma && p.use_chroma_ac, p.use_dc_delta);
+                StreamPlane::new(pw, ph, is_chroma, false, cursor)
+            })
+            .collect();
+        Some(())
+    }
+
+    /// Count the RLE blocks of plane `i` that have fully arrived, from stream offset
+    /// `offset` on, `scanned` blocks in. Returns (blocks scanned, offset of the next).
+    fn scan_rle_plane(&self, i: usize, offset: usize, mut scanned: usize) -> (usize, usize) {
+        let data = &self.input[offset - self.base..];
+        let total = self.planes[i].n_blocks();
+        let mut pos = 0;
+        while scanned < total {
+            // A block cut off by the end of the input is retried on the next feed.
+            let Some((_, next)) = decoder::decode_rle_one_block(data, pos) else { break };
+            scanned += 1;
+            pos = next;
+        }
+        (scanned, offset + pos)
+    }
+
+    /// Entropy-decode plane `i` through band `k`. Some(false) while its bytes have
+    /// not all arrived, None on corrupt data.
+    fn decode_band(&mut self, i: usize, k: usize) -> Option<bool> {
+        let (base, end) = (self.base, self.end());
+        let plane = &mut self.planes[i];
+        let Some(start) = plane.start else { return Some(false) };
+        let need = ((plane.band_rows(k) + 7) / 8) * ((plane.w + 7) / 8);
+        if plane.rle {
+            while plane.blocks.len() < need {
+                let Some((block, next)) = decoder::decode_rle_one_block(&self.input[plane.rle_pos - base..], 0) else {
+                    return Some(false);
+                };
+                plane.blocks.push(block);
+                plane.rle_pos += next;
+                plane.left -= 1;
+            }
+            return Some(true);
+        }
+        if plane.blocks.len() < need {
+            let stop = plane.stop.unwrap_or(start);
+            let from = start + plane.cursor.consumed();
+            let avail = end.min(stop);
+            if avail < from {
+                return Some(false);
+            }
+            let complete = avail == stop;
+            let before = plane.blocks.len();
+            plane.cursor.decode(&self.input[from - base..avail - base], complete, need - before, &mut plane.blocks)?;
+            plane.left -= plane.blocks.len() - before;
+            if plane.blocks.len() < need {
+                // Payload ended before the last block.
+                return if complete { None } else { Some(false) };
+            }
+        }
+        Some(true)
+    }
+
+    // -----------------------------------------------------------------------
+    // Output side
+    // -----------------------------------------------------------------------
+
+    /// Fill `band` with the next rows. Some(false) if they are not ready yet.
+    fn next_band(&mut self) -> Option<bool> {
+        if self.rows_banded >= self.height {
+            return Some(false);
+        }
+        let (w, r0) = (self.width, self.rows_banded);
+        if self.version == lossless::BG_VERSION_LOSSLESS {
+            let Some(&(offset, len)) = self.strips.get(r0 / self.strip_rows) else { return Some(false) };
+            if self.end() < offset + len {
+                return Some(false);
+            }
+            let r1 = (r0 + self.strip_rows).min(self.height);
+            self.band.resize((r1 - r0) * w * self.channels, 0);
+            let data = &self.input[offset - self.base..offset + len - self.base];
+            if !lossless::decode_strip(data, w, self.channels, &mut self.band) {
+                return None;
+            }
+            self.band_pos = 0;
+            self.rows_banded = r1;
+            self.discard_consumed();
+            return Some(true);
+        }
+
+        let r1 = (r0 + STREAM_BAND_ROWS).min(self.height);
+        let k = r0 / STREAM_BAND_ROWS;
+        if self.tables.is_none() {
+            self.tables = match self.dqt {
+                [Some(l), Some(c)] => Some((l, c)),
+                _ if !self.queue.is_empty() => return Some(false),
+                _ => return None,
+            };
+        }
+        for i in 0..self.planes.len() {
+            if !self.decode_band(i, k)? {
+                return Some(false);
+            }
+        }
+        let (luma_q, chroma_q) = self.tables.unwrap();
+        for plane in &mut self.planes {
+            plane.reconstruct(k, if plane.is_chroma { &chroma_q } else { &luma_q });
+        }
+        self.discard_consumed();
+        self.band.resize((r1 - r0) * w * self.channels, 0);
+        if self.version <= 3 {
+            // RLE planes are full resolution, one per channel: interleave.
+            let ch = self.channels;
+            for (c, plane) in self.planes.iter().enumerate() {
+                for (d, &v) in self.band[c..].iter_mut().step_by(ch).zip(&plane.pixels) {
+                    *d = v;
+                }
+            }
+            self.band_pos = 0;
+            self.rows_banded = r1;
+            return Some(true);
+        }
+        let y = &self.planes[0].pixels;
+        let cb = &self.planes[1].pixels;
+        let cr = &self.planes[2].pixels;
+        if self.channels == 4 {
+            let a = &self.planes[3].pixels;
+            colorspace::ycbcr420a_to_rgba(y, cb, cr, a, w, r1 - r0, &mut self.band);
+        } else {
+            colorspace::ycbcr420_to_rgb(y, cb, cr, w, r1 - r0, &mut self.band);
+        }
+        self.band_pos = 0;
+        self.rows_banded = r1;
+        Some(true)
+    }
+}
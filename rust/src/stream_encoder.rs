@@ -0,0 +1,207 @@
+//! Strip-streaming encoder: push rows as they arrive, write the stream to a sink.
+//!
+//! Produces the same bytes as the one-shot encoders (v1 for grayscale, v18 RGB,
+//! v19 RGBA). Rows are collected into 16-row bands (two luma block rows, one chroma
+//! block row); each full band is color converted, blockized, quantized and appended
+//! to a resumable entropy coder per plane, so working memory is a few bands wide.
+//!
+//! Planes are stored one after another behind a u32 length, so only the first one
+//! can go out as it is coded: luma bytes are written as soon as they are final and
+//! its length is patched in at `finish`. Cb, Cr (and A) are held compressed until
+//! then. Sinks that cannot rewrite hold the luma payload too.
+
+use crate::bitstream::Sink;
+use crate::block::Block;
+use crate::blockizer::Blockizer;
+use crate::colorspace;
+use crate::encoder::{self, PlaneTables};
+use crate::huffman::PlaneCoder;
+
+pub const ENCODE_BAND_ROWS: usize = 16;
+
+enum Planes {
+    /// v1: one RLE plane, written band by band.
+    Gray { table: [i16; 64] },
+    /// v18/v19: Y, Cb, Cr and optional A entropy coders.
+    Color {
+        tables: PlaneTables,
+        y: PlaneCoder,
+        cb: PlaneCoder,
+        cr: PlaneCoder,
+        a: Option<PlaneCoder>,
+        /// Y bytes go to the sink as they are coded (length patched at finish).
+        stream_luma: bool,
+        luma_sent: usize,
+    },
+}
+
+pub struct StreamEncoder<S: Sink> {
+    sink: S,
+    width: usize,
+    height: usize,
+    channels: usize,
+    planes: Planes,
+    /// Interleaved rows of the band being filled.
+    band: Vec<u8>,
+    band_rows: usize,
+    rows_in: usize,
+    failed: bool,
+}
+
+impl<S: Sink> StreamEncoder<S> {
+    /// channels: 1 (v1), 3 (v18) or 4 (v19). Writes the header (and, when the sink
+    /// can rewrite, a placeholder luma length) right away.
+    pub fn new(sink: S, width: usize, height: usize, channels: usize, quality: u8) -> Option<Self> {
+        if width == 0 || height == 0 || width > 65536 || height > 65536 {
+            return None;
+        }
+        let version = match channels {
+            1 => encoder::BG_VERSION_GRAY,
+            3 => encoder::BG_PROFILE_YUV420,
+            4 => encoder::BG_PROFILE_YUV420 + 1,
+            _ => return None,
+        };
+        let planes = if channels == 1 {
+            Planes::Gray { table: encoder::quant_table_for_quality(quality) }
+        } else {
+            Planes::Color {
+                tables: PlaneTables::for_quality(quality),
+                y: PlaneCoder::new(false, false, true),
+                cb: PlaneCoder::new(true, true, true),
+                cr: PlaneCoder::new(true, true, true),
+                a: (channels == 4).then(|| PlaneCoder::new(false, false, true)),
+                stream_luma: sink.can_write_at(),
+                luma_sent: 0,
+            }
+        };
+        let mut enc = Self {
+            sink,
+            width,
+            height,
+            channels,
+            planes,
+            band: vec![0u8; ENCODE_BAND_ROWS * width * channels],
+            band_rows: 0,
+            rows_in: 0,
+            failed: false,
+        };
+        let hdr = encoder::header_bytes(version, width, height, quality);
+        enc.failed = !enc.sink.write(&hdr);
+        if let Planes::Color { stream_luma: true, .. } = enc.planes {
+            enc.failed |= !enc.sink.write(&[0u8; 4]);
+        }
+        Some(enc)
+    }
+
+    /// Bytes in one input row.
+    pub fn row_len(&self) -> usize {
+        self.width * self.channels
+    }
+
+    /// Rows still expected before `finish`.
+    pub fn rows_remaining(&self) -> usize {
+        self.height - self.rows_in
+    }
+
+    /// Whether a sink write has failed; the encode cannot complete.
+    pub fn failed(&self) -> bool {
+        self.failed
+    }
+
+    /// Append `n_rows` rows of `row_len()` bytes, `stride` bytes apart. Full bands are
+    /// coded immediately. False if the sink failed (now or earlier) or the rows
+    /// run past the image height.
+    pub fn push_rows(&mut self, rows: &[u8], n_rows: usize, stride: usize) -> bool {
+        if self.failed || n_rows > self.rows_remaining() {
+            return false;
+        }
+        let row_len = self.row_len();
+        for r in 0..n_rows {
+            let src = &rows[r * stride..r * stride + row_len];
+            self.band[self.band_rows * row_len..(self.band_rows + 1) * row_len].copy_from_slice(src);
+            self.band_rows += 1;
+            self.rows_in += 1;
+            if self.band_rows == ENCODE_BAND_ROWS || self.rows_in == self.height {
+                if !self.code_band() {
+                    self.failed = true;
+                    return false;
+                }
+            }
+        }
+        true
+    }
+
+    /// Code the rows collected in `band` (16, or fewer for the last band).
+    fn code_band(&mut self) -> bool {
+        let (w, rows) = (self.width, self.band_rows);
+        let band = &self.band[..rows * w * self.channels];
+        self.band_rows = 0;
+        match &mut self.planes {
+            Planes::Gray { table } => {
+                let mut blocks = Blockizer::new(w, rows).generate_blocks(band);
+                let payload = encoder::encode_channel_rle(&mut blocks, table, w, rows);
+                self.sink.write(&payload)
+            }
+            Planes::Color { tables, y, cb, cr, a, stream_luma, luma_sent } => {
+                let (cw, ch) = ((w + 1) / 2, (rows + 1) / 2);
+                let (yp, cbp, crp, ap) = if self.channels == 4 {
+                    let (yp, cbp, crp, ap) = colorspace::rgba_to_ycbcr420a(band, w, rows);
+                    (yp, cbp, crp, Some(ap))
+                } else {
+                    let (yp, cbp, crp) = colorspace::rgb_to_ycbcr420(band, w, rows);
+                    (yp, cbp, crp, None)
+                };
+                let luma = |plane: &[u8], coder: &mut PlaneCoder| {
+                    let mut blocks: Vec<Block> = Blockizer::new(w, rows).generate_blocks(plane);
+                    tables.quantize_luma(&mut blocks, w, rows);
+                    coder.encode(&blocks);
+                };
+                luma(&yp, y);
+                if let (Some(ap), Some(a)) = (ap.as_deref(), a.as_mut()) {
+                    luma(ap, a);
+                }
+                for (plane, coder) in [(&cbp, cb), (&crp, cr)] {
+                    let mut blocks = Blockizer::new(cw, ch).generate_blocks(plane);
+                    tables.quantize_chroma(&mut blocks, cw, ch);
+                    coder.encode(&blocks);
+                }
+                if *stream_luma {
+                    if !self.sink.write(y.pending()) {
+                        return false;
+                    }
+                    *luma_sent += y.pending().len();
+                    y.consume();
+                }
+                true
+            }
+        }
+    }
+
+    /// Flush the planes after the last row has been pushed and return the sink.
+    /// None if rows are missing or the sink failed.
+    pub fn finish(mut self) -> Option<S> {
+        if self.failed || self.rows_remaining() > 0 {
+            return None;
+        }
+        let sink = &mut self.sink;
+        let ok = match self.planes {
+            Planes::Gray { .. } => true,
+            Planes::Color { y, cb, cr, a, stream_luma, luma_sent, .. } => {
+                let mut ok = true;
+                if stream_luma {
+                    // Everything but the last partial byte has been written already.
+                    let tail = y.finish();
+                    let len = (luma_sent + tail.len()) as u32;
+                    ok &= sink.write(&tail) && sink.write_at(encoder::BG_HEADER_SIZE as u64, &len.to_le_bytes());
+                } else {
+                    ok &= encoder::write_plane_to(sink, &y.finish());
+                }
+                for coder in [Some(cb), Some(cr), a].into_iter().flatten() {
+                    ok = ok && encoder::write_plane_to(sink, &coder.finish());
+                }
+                ok
+            }
+        };
+        ok.then_some(self.sink)
+    }
+}
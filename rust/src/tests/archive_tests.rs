@@ -0,0 +1,82 @@
+use crate::archive::{Archive, ArchiveBuilder};
+use crate::decoder;
+use crate::encoder;
+
+fn gradient(w: usize, h: usize, ch: usize, seed: usize) -> Vec<u8> {
+    (0..w * h * ch).map(|i| ((i / ch % w) * 3 + (i / ch / w) * 5 + (i % ch) * 40 + seed) as u8).collect()
+}
+
+fn build(images: &[(u64, usize, usize, u32)]) -> Vec<u8> {
+    let mut b = ArchiveBuilder::new(80);
+    for &(id, w, h, ch) in images {
+        assert!(b.add(id, &gradient(w, h, ch as usize, id as usize), w, h, ch));
+    }
+    let mut out = vec![0u8; b.encoded_len()];
+    assert_eq!(b.write(&mut out), Some(out.len()));
+    out
+}
+
+#[test]
+fn archive_lookup_is_sorted_by_id() {
+    let buf = build(&[(42, 9, 7, 3), (7, 16, 16, 4), (1000, 5, 3, 1), (8, 1, 1, 3)]);
+    let a = Archive::parse(&buf).expect("parse");
+    assert_eq!(a.len(), 4);
+    let ids: Vec<u64> = (0..a.len()).map(|i| a.entry(i).id).collect();
+    assert_eq!(ids, vec![7, 8, 42, 1000]);
+
+    let e = a.lookup(42).expect("lookup");
+    assert_eq!((e.width, e.height, e.channels), (9, 7, 3));
+    assert!(a.lookup(9).is_none());
+    assert!(a.lookup(0).is_none());
+    assert!(a.lookup(u64::MAX).is_none());
+}
+
+#[test]
+fn archive_decode_matches_single_image_stream() {
+    let (w, h) = (23, 19);
+    let img = gradient(w, h, 4, 7);
+    let buf = build(&[(7, w, h, 4), (3, 8, 8, 3)]);
+    let a = Archive::parse(&buf).expect("parse");
+    let mut px = vec![0u8; w * h * 4];
+    let e = a.decode(7, &mut px).expect("decode");
+    assert_eq!(e.pixel_len(), px.len());
+
+    // Same tables and plane coding as a v20 stream at the same quality.
+    let mut bg = vec![0u8; w * h * 8 + 1024];
+    let mut pos = 0;
+    encoder::encode_rgba_chunked(&img, w, h, 80, &mut bg, &mut pos, None);
+    let mut ref_px = vec![0u8; w * h * 4];
+    let (mut ow, mut oh, mut oc) = (0, 0, 0);
+    assert!(decoder::decode(&bg[..pos as usize], &mut ref_px, &mut ow, &mut oh, &mut oc, None));
+    assert_eq!(px, ref_px);
+}
+
+#[test]
+fn archive_batch_decode_reports_missing_ids() {
+    let buf = build(&[(1, 8, 8, 3), (2, 12, 4, 1)]);
+    let a = Archive::parse(&buf).expect("parse");
+    let mut o1 = vec![0u8; 8 * 8 * 3];
+    let mut o2 = vec![0u8; 12 * 4];
+    let mut o3 = vec![0u8; 64];
+    let mut jobs: Vec<(u64, &mut [u8])> = vec![(2, &mut o2), (5, &mut o3), (1, &mut o1)];
+    let res = a.decode_batch(&mut jobs);
+    assert_eq!(res[0].map(|e| e.id), Some(2));
+    assert!(res[1].is_none());
+    assert_eq!(res[2].map(|e| e.id), Some(1));
+}
+
+#[test]
+fn archive_rejects_duplicate_ids_and_truncation() {
+    let mut b = ArchiveBuilder::new(80);
+    assert!(b.add(5, &gradient(4, 4, 3, 0), 4, 4, 3));
+    assert!(b.add(5, &gradient(4, 4, 3, 1), 4, 4, 3));
+    let mut out = vec![0u8; b.encoded_len()];
+    assert!(b.write(&mut out).is_none());
+
+    let buf = build(&[(1, 8, 8, 3)]);
+    assert!(Archive::parse(&buf[..buf.len() - 1]).is_some());
+    let a = Archive::parse(&buf[..buf.len() - 1]).unwrap();
+    let mut px = vec![0u8; 8 * 8 * 3];
+    assert!(a.decode(1, &mut px).is_none());
+    assert!(Archive::parse(&buf[..100]).is_none());
+}
@@ -0,0 +1,135 @@
+use crate::block::Block;
+use crate::blockizer::Blockizer;
+use crate::colorspace::{self, PixelFormat};
+
+const FORMATS: [PixelFormat; 6] = [
+    PixelFormat::Rgb,
+    PixelFormat::Rgba,
+    PixelFormat::Bgr,
+    PixelFormat::Bgra,
+    PixelFormat::Rgbx,
+    PixelFormat::Bgrx,
+];
+
+fn ramp(n: usize, mul: usize, add: usize) -> Vec<u8> {
+    (0..n).map(|i| (i * mul + add) as u8).collect()
+}
+
+/// Per-pixel BT.601 reference (same integer math as the decoder).
+fn expected(y: u8, cb: u8, cr: u8, a: u8, fmt: PixelFormat) -> Vec<u8> {
+    let clamp = |v: i32| v.clamp(0, 255) as u8;
+    let (yi, cbi, cri) = (y as i32, cb as i32 - 128, cr as i32 - 128);
+    let r = clamp(yi + ((359 * cri) >> 8));
+    let g = clamp(yi - ((88 * cbi + 183 * cri) >> 8));
+    let b = clamp(yi + ((454 * cbi) >> 8));
+    let a = if fmt.has_alpha() { a } else { 255 };
+    match fmt {
+        PixelFormat::Rgb => vec![r, g, b],
+        PixelFormat::Bgr => vec![b, g, r],
+        PixelFormat::Rgba | PixelFormat::Rgbx => vec![r, g, b, a],
+        PixelFormat::Bgra | PixelFormat::Bgrx => vec![b, g, r, a],
+    }
+}
+
+#[test]
+fn ycbcr_writers_match_reference_for_every_format() {
+    // Widths cover the scalar tail, one SSE2 step and several AVX2 steps.
+    for w in [1usize, 2, 7, 16, 17, 31, 32, 33, 64, 97] {
+        let h = 3;
+        let cw = (w + 1) / 2;
+        let y = ramp(w * h, 37, 5);
+        let cb = ramp(cw * 2, 71, 9);
+        let cr = ramp(cw * 2, 193, 200);
+        let a = ramp(w * h, 11, 3);
+        for fmt in FORMATS {
+            let bpp = fmt.bytes_per_pixel();
+            let stride = w * bpp + 5;
+            for alpha in [None, Some(&a[..])] {
+                let mut out = vec![0xAAu8; stride * h];
+                colorspace::ycbcr420_to_pixels(&y, &cb, &cr, alpha, w, fmt, &mut out, stride);
+                for py in 0..h {
+                    for px in 0..w {
+                        let c = (py / 2) * cw + px / 2;
+                        let av = alpha.map_or(255, |a| a[py * w + px]);
+                        let want = expected(y[py * w + px], cb[c], cr[c], av, fmt);
+                        let o = py * stride + px * bpp;
+                        assert_eq!(&out[o..o + bpp], &want[..], "w={w} {fmt:?} alpha={} ({px},{py})", alpha.is_some());
+                    }
+                    assert!(out[py * stride + w * bpp..(py + 1) * stride].iter().all(|&b| b == 0xAA));
+                }
+            }
+        }
+    }
+}
+
+#[test]
+fn fused_blocks_match_blockized_planes() {
+    // Partial bands and blocks at every edge; 700x400 takes the parallel band path.
+    for (w, h) in [(1usize, 1usize), (9, 17), (33, 16), (37, 41), (700, 400)] {
+        let (cw, ch) = ((w + 1) / 2, (h + 1) / 2);
+        for fmt in FORMATS {
+            let stride = w * fmt.bytes_per_pixel() + 3;
+            let image = ramp(stride * h, 29, 7);
+            let (y, cb, cr, a) = colorspace::pixels_to_ycbcr420(&image, w, h, fmt, stride);
+            let fused = colorspace::pixels_to_ycbcr420_blocks(&image, w, h, fmt, stride);
+            let same = |got: &[Block], plane: &[u8], pw: usize, ph: usize| {
+                let want = Blockizer::new(pw, ph).generate_blocks(plane);
+                got.len() == want.len() && got.iter().zip(&want).all(|(g, w)| g.data == w.data)
+            };
+            assert!(same(&fused.y, &y, w, h), "{w}x{h} {fmt:?} Y");
+            assert!(same(&fused.cb, &cb, cw, ch), "{w}x{h} {fmt:?} Cb");
+            assert!(same(&fused.cr, &cr, cw, ch), "{w}x{h} {fmt:?} Cr");
+            assert_eq!(fused.a.is_some(), a.is_some());
+            if let (Some(fa), Some(a)) = (&fused.a, &a) {
+                assert!(same(fa, a, w, h), "{w}x{h} {fmt:?} A");
+            }
+        }
+    }
+}
+
+#[test]
+fn chroma_kernels_match_scalar_box_average() {
+    let mut seed = 0x2545_f491u32;
+    let mut next = || {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        seed
+    };
+    // Widths around the 16-pixel step and odd edges; extreme colors hit the u16 bounds.
+    for w in [1usize, 2, 3, 15, 16, 17, 18, 31, 32, 33, 34, 50, 101] {
+        for h in [1usize, 2, 3, 6] {
+            for fmt in FORMATS {
+                let bpp = fmt.bytes_per_pixel();
+                let stride = w * bpp + 1;
+                let image: Vec<u8> = (0..stride * h)
+                    .map(|i| match next() % 5 {
+                        0 => 0,
+                        1 => 255,
+                        _ => (next() >> 8) as u8 ^ i as u8,
+                    })
+                    .collect();
+                let (_, cb, cr, _) = colorspace::pixels_to_ycbcr420(&image, w, h, fmt, stride);
+                let red = if matches!(fmt, PixelFormat::Bgr | PixelFormat::Bgra | PixelFormat::Bgrx) { 2 } else { 0 };
+                let cw = (w + 1) / 2;
+                for cy in 0..(h + 1) / 2 {
+                    for cx in 0..cw {
+                        let (mut scb, mut scr, mut n) = (0i32, 0i32, 0i32);
+                        for (px, py) in [(0, 0), (1, 0), (0, 1), (1, 1)].map(|(dx, dy)| (cx * 2 + dx, cy * 2 + dy)) {
+                            if px < w && py < h {
+                                let p = &image[py * stride + px * bpp..];
+                                let (r, g, b) = (p[red] as i32, p[1] as i32, p[2 - red] as i32);
+                                scb += ((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128;
+                                scr += ((128 * r - 107 * g - 21 * b + 128) >> 8) + 128;
+                                n += 1;
+                            }
+                        }
+                        let want = |s: i32| ((s + n / 2) / n).clamp(0, 255) as u8;
+                        assert_eq!(cb[cy * cw + cx], want(scb), "{w}x{h} {fmt:?} Cb ({cx},{cy})");
+                        assert_eq!(cr[cy * cw + cx], want(scr), "{w}x{h} {fmt:?} Cr ({cx},{cy})");
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+use crate::container::{
+    parse_quant_table, quant_table_bytes, read_toc, toc_size, Container, ContainerWriter, TAG_ICC, TAG_PLANE,
+};
+
+fn build(chunks: &[([u8; 4], u32, &[u8])]) -> Vec<u8> {
+    let mut w = ContainerWriter::new(33, 17, 80, 18);
+    for &(tag, info, data) in chunks {
+        assert!(w.add_chunk(tag, info, data));
+    }
+    let mut out = vec![0u8; w.encoded_len()];
+    let mut pos = 0i32;
+    w.write(&mut out, &mut pos);
+    assert_eq!(pos as usize, out.len());
+    out
+}
+
+#[test]
+fn container_roundtrip_header_and_chunks() {
+    let y = [1u8, 2, 3, 4, 5];
+    let cb = [6u8; 3];
+    let icc = [9u8; 7];
+    let buf = build(&[(TAG_PLANE, 0, &y), (TAG_PLANE, 1, &cb), (TAG_ICC, 0, &icc)]);
+
+    let c = Container::parse(&buf).expect("parse failed");
+    assert_eq!((c.width, c.height, c.quality, c.profile), (33, 17, 80, 18));
+    assert_eq!(c.chunks.len(), 3);
+    assert_eq!(c.find(TAG_PLANE, 0), Some(&y[..]));
+    assert_eq!(c.find(TAG_PLANE, 1), Some(&cb[..]));
+    assert_eq!(c.find(TAG_ICC, 0), Some(&icc[..]));
+    assert_eq!(c.find(TAG_PLANE, 2), None);
+}
+
+#[test]
+fn container_toc_readable_from_prefix() {
+    let y = [7u8; 100];
+    let buf = build(&[(*b"XTRA", 5, &[0u8; 4]), (TAG_PLANE, 0, &y)]);
+
+    let need = toc_size(&buf[..16]).expect("toc size");
+    assert_eq!(need, 16 + 2 * 16);
+    assert!(read_toc(&buf[..need - 1]).is_none());
+    let toc = read_toc(&buf[..need]).expect("toc from prefix");
+    // Unknown tags are listed but do not get in the way of lookups.
+    assert_eq!(&toc[0].tag, b"XTRA");
+    let plane = toc[1];
+    assert_eq!(&buf[plane.offset as usize..(plane.offset + plane.length) as usize], &y[..]);
+}
+
+#[test]
+fn container_rejects_out_of_bounds_chunk() {
+    let buf = build(&[(TAG_PLANE, 0, &[1u8; 8])]);
+    assert!(Container::parse(&buf[..buf.len() - 1]).is_none());
+}
+
+#[test]
+fn quant_table_chunk_roundtrip() {
+    let mut table = [0i16; 64];
+    for (i, q) in table.iter_mut().enumerate() {
+        *q = 1 + (i as i16) * 37;
+    }
+    let bytes = quant_table_bytes(&table);
+    assert_eq!(parse_quant_table(&bytes), Some(table));
+
+    let mut zero = bytes;
+    zero[10] = 0;
+    zero[11] = 0;
+    assert!(parse_quant_table(&zero).is_none());
+    assert!(parse_quant_table(&bytes[..126]).is_none());
+}
+
+#[test]
+fn container_writer_refuses_chunk_past_u16_count() {
+    let mut w = ContainerWriter::new(1, 1, 80, 18);
+    for i in 0..u16::MAX as u32 {
+        assert!(w.add_chunk(*b"XTRA", i, &[]));
+    }
+    assert!(!w.add_chunk(TAG_PLANE, 0, &[1]));
+
+    let mut out = vec![0u8; w.encoded_len()];
+    let mut pos = 0i32;
+    w.write(&mut out, &mut pos);
+    let chunks = read_toc(&out).expect("toc");
+    assert_eq!(chunks.len(), u16::MAX as usize);
+    assert!(chunks.iter().all(|c| c.tag == *b"XTRA"));
+}
@@ -1,5 +1,5 @@
 use crate::block::Block;
-use crate::dct::{dct, dct_reference, idct, idct_reference};
+use crate::dct::{dct, dct_reference, idct, idct_reference, idct_scaled};
 
 fn block_from(s: &[i16; 64]) -> Block {
     Block { data: *s }
@@ -77,3 +77,35 @@ fn reference_roundtrip() {
         assert!(diff <= 1, "reference roundtrip diff at {i}: {} vs {}", idct_out[i], input[i]);
     }
 }
+
+#[test]
+fn scaled_idct_averages_full_idct() {
+    // The k×k output is the mean of each (8/k)² cell of the block.
+    let mut px = [0i16; 64];
+    for y in 0..8 {
+        for x in 0..8 {
+            px[y * 8 + x] = (x as i16 * 9 - y as i16 * 5 + ((x * y) as i16 % 7)) - 20;
+        }
+    }
+    let coef = dct_reference(&block_from(&px));
+    let ones = [1i16; 64];
+    for k in [1usize, 2, 4] {
+        let mut out = [0i16; 16];
+        idct_scaled(&coef, &ones, k, &mut out);
+        let cell = 8 / k;
+        for cy in 0..k {
+            for cx in 0..k {
+                let sum: i32 = (0..cell * cell)
+                    .map(|i| px[(cy * cell + i / cell) * 8 + cx * cell + i % cell] as i32)
+                    .sum();
+                let mean = sum as f32 / (cell * cell) as f32;
+                let got = out[cy * k + cx] as f32;
+                assert!((got - mean).abs() <= 1.0, "k={k} ({cx},{cy}) got {got} mean {mean}");
+            }
+        }
+    }
+    // Scale 1/8 is the DC term alone.
+    let mut out = [0i16; 1];
+    idct_scaled(&coef, &ones, 1, &mut out);
+    assert_eq!(out[0], (coef[0] as f32 / 8.0).round() as i16);
+}
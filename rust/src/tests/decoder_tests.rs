@@ -0,0 +1,315 @@
+use crate::block::Block;
+use crate::colorspace;
+use crate::dct;
+use crate::decoder;
+use crate::encoder;
+use crate::ffi::dequantize_block;
+use crate::huffman;
+use super::{image, one_shot};
+
+/// Plane-at-a-time reference: decode each whole plane of a v4..v19 stream, with the
+/// historical per-version tables and flags spelled out independently of the decoder.
+fn reference_planes(buf: &[u8], w: usize, h: usize, ch: usize) -> Vec<Vec<u8>> {
+    let (version, q) = (buf[2], buf[11]);
+    let (luma_q, chroma_q) = match version {
+        4..=7 => (encoder::quant_table_for_quality(q), encoder::chroma_quant_table_for_quality(q)),
+        8..=11 => (encoder::quant_table_for_quality_perceptual(q), encoder::chroma_quant_table_for_quality_perceptual(q)),
+        12..=13 => (encoder::quant_table_for_quality_perceptual_v2(q), encoder::chroma_quant_table_for_quality_perceptual_v2(q)),
+        14..=15 => (encoder::quant_table_for_quality_perceptual_v3(q), encoder::chroma_quant_table_for_quality_perceptual_v3(q)),
+        _ => (encoder::quant_table_for_quality_perceptual_v4(q), encoder::chroma_quant_table_for_quality_perceptual_v4(q)),
+    };
+    let (chroma_ac, dc_delta) = (version >= 6, version >= 10);
+    let (cw, chh) = ((w + 1) / 2, (h + 1) / 2);
+    let mut pos = 12;
+    let mut planes = Vec::new();
+    for i in 0..ch {
+        let is_chroma = i == 1 || i == 2;
+        let (pw, ph) = if is_chroma { (cw, chh) } else { (w, h) };
+        let (pbw, pbh) = ((pw + 7) / 8, (ph + 7) / 8);
+        let (blocks, next) =
+            huffman::decode_plane_with_profile(buf, pos, pbw * pbh, is_chroma, is_chroma && chroma_ac, dc_delta).unwrap();
+        pos = next;
+        let mut plane = vec![0u8; pw * ph];
+        for (idx, block) in blocks.iter().enumerate() {
+            let mut b: Block = *block;
+            let quant = if is_chroma { &chroma_q } else { &luma_q };
+            unsafe { dequantize_block(b.data.as_mut_ptr(), quant.as_ptr()); }
+            dct::idct(&mut b);
+            for y in 0..8 {
+                for x in 0..8 {
+                    let (px, py) = ((idx % pbw) * 8 + x, (idx / pbw) * 8 + y);
+                    if px < pw && py < ph {
+                        plane[py * pw + px] = (b.data[y * 8 + x] + 128).clamp(0, 255) as u8;
+                    }
+                }
+            }
+        }
+        planes.push(plane);
+    }
+    planes
+}
+
+/// Reference planes, color converted.
+fn reference_decode(buf: &[u8], w: usize, h: usize, ch: usize) -> Vec<u8> {
+    let planes = reference_planes(buf, w, h, ch);
+    let mut out = vec![0u8; w * h * ch];
+    if ch == 4 {
+        colorspace::ycbcr420a_to_rgba(&planes[0], &planes[1], &planes[2], &planes[3], w, h, &mut out);
+    } else {
+        colorspace::ycbcr420_to_rgb(&planes[0], &planes[1], &planes[2], w, h, &mut out);
+    }
+    out
+}
+
+#[test]
+fn banded_decode_matches_plane_decode() {
+    // 520 wide: enough luma blocks per band group to entropy-decode the planes concurrently.
+    for &(w, h) in &[(1, 1), (9, 15), (17, 16), (31, 17), (40, 33), (16, 48), (70, 161), (520, 40)] {
+        for ch in [3usize, 4] {
+            let buf = one_shot(&image(w, h, ch, 40), w, h, ch, 85);
+
+            let mut out = vec![0u8; w * h * ch];
+            let (mut ow, mut oh, mut oc) = (0, 0, 0);
+            assert!(decoder::decode(&buf, &mut out, &mut ow, &mut oh, &mut oc, None));
+            assert!(out == reference_decode(&buf, w, h, ch), "{w}x{h}x{ch}");
+
+            // Cutting into the last plane must fail, not emit a partial image.
+            let cut = &buf[..buf.len() - 1];
+            assert!(!decoder::decode(cut, &mut out, &mut ow, &mut oh, &mut oc, None), "{w}x{h}x{ch} cut");
+        }
+    }
+}
+
+#[test]
+fn every_huffman_profile_decodes_with_its_tables_and_flags() {
+    let (w, h) = (45, 27);
+    let (cw, chh) = ((w + 1) / 2, (h + 1) / 2);
+    let mut seed = 0x9e37_79b9u32;
+    let mut blocks = |n: usize| -> Vec<Block> {
+        (0..n)
+            .map(|_| {
+                let mut b = Block::new();
+                for (k, v) in b.data.iter_mut().enumerate() {
+                    seed ^= seed << 13;
+                    seed ^= seed >> 17;
+                    seed ^= seed << 5;
+                    let range = if k == 0 { 61 } else if k < 10 { 7 } else { 1 };
+                    *v = (seed % range) as i16 - (range / 2) as i16;
+                }
+                b
+            })
+            .collect()
+    };
+    for version in 4u8..=19 {
+        let ch = if version % 2 == 1 { 4 } else { 3 };
+        let mut buf = vec![b'B', b'G', version];
+        buf.extend_from_slice(&(w as u32).to_le_bytes());
+        buf.extend_from_slice(&(h as u32).to_le_bytes());
+        buf.push(70);
+        for i in 0..ch {
+            let is_chroma = i == 1 || i == 2;
+            let (pw, ph) = if is_chroma { (cw, chh) } else { (w, h) };
+            let plane = blocks(((pw + 7) / 8) * ((ph + 7) / 8));
+            buf.extend(huffman::encode_plane_with_profile(&plane, is_chroma, is_chroma && version >= 6, version >= 10));
+        }
+        let mut out = vec![0u8; w * h * ch];
+        let (mut ow, mut oh, mut oc) = (0, 0, 0);
+        assert!(decoder::decode(&buf, &mut out, &mut ow, &mut oh, &mut oc, None), "v{version}");
+        assert_eq!(oc as usize, ch, "v{version}");
+        assert!(out == reference_decode(&buf, w, h, ch), "v{version}");
+    }
+}
+
+#[test]
+fn yuv_decode_returns_strided_planes() {
+    for &(w, h) in &[(1, 1), (17, 16), (31, 33), (70, 161)] {
+        for ch in [3usize, 4] {
+            let buf = one_shot(&image(w, h, ch, 40), w, h, ch, 85);
+            let reference = reference_planes(&buf, w, h, ch);
+            let set = decoder::parse_plane_set(&buf).unwrap();
+            assert_eq!((set.width, set.height, set.has_alpha()), (w, h, ch == 4));
+
+            let (cw, chh) = ((w + 1) / 2, (h + 1) / 2);
+            let (ys, cs) = (w + 5, cw + 3);
+            let mut y = vec![7u8; ys * h];
+            let mut u = vec![7u8; cs * chh];
+            let mut v = vec![7u8; cs * chh];
+            let mut a = vec![7u8; ys * h];
+            assert!(decoder::decode_yuv(&set, &mut y, ys, &mut u, cs, &mut v, cs, Some((&mut a, ys))));
+
+            let unstride = |p: &[u8], stride: usize, pw: usize, ph: usize| -> Vec<u8> {
+                (0..ph).flat_map(|r| p[r * stride..r * stride + pw].to_vec()).collect()
+            };
+            assert!(unstride(&y, ys, w, h) == reference[0], "{w}x{h}x{ch} y");
+            assert!(unstride(&u, cs, cw, chh) == reference[1], "{w}x{h}x{ch} u");
+            assert!(unstride(&v, cs, cw, chh) == reference[2], "{w}x{h}x{ch} v");
+            let a_ref = if ch == 4 { reference[3].clone() } else { vec![255u8; w * h] };
+            assert!(unstride(&a, ys, w, h) == a_ref, "{w}x{h}x{ch} a");
+            // Stride padding is left alone.
+            assert!((0..h).all(|r| y[r * ys + w..r * ys + ys].iter().all(|&b| b == 7)));
+        }
+    }
+}
+
+#[test]
+fn format_decode_writes_requested_layout_and_stride() {
+    use crate::colorspace::PixelFormat;
+    use crate::lossless;
+    let (w, h) = (37, 21);
+    for ch in [3usize, 4] {
+        let img = image(w, h, ch, 40);
+        let mut lossless_buf = vec![0u8; w * h * ch * 2 + 1024];
+        let mut len = 0;
+        assert!(lossless::encode(&img, w, h, ch as u32, &mut lossless_buf, &mut len, None));
+        lossless_buf.truncate(len as usize);
+        for buf in [one_shot(&img, w, h, ch, 85), lossless_buf] {
+            let mut packed = vec![0u8; w * h * ch];
+            let (mut ow, mut oh, mut oc) = (0, 0, 0);
+            assert!(decoder::decode(&buf, &mut packed, &mut ow, &mut oh, &mut oc, None));
+            for fmt in [PixelFormat::Rgb, PixelFormat::Bgra, PixelFormat::Bgrx, PixelFormat::Rgba] {
+                let bpp = fmt.bytes_per_pixel();
+                let stride = w * bpp + 12;
+                let mut out = vec![0x55u8; stride * h];
+                assert!(decoder::decode_to_format(&mut decoder::DecodeScratch::default(), &buf, &mut out, fmt, stride, &mut ow, &mut oh));
+                assert_eq!((ow, oh), (w as u32, h as u32));
+                for i in 0..w * h {
+                    let s = &packed[i * ch..i * ch + ch];
+                    let d = &out[(i / w) * stride + (i % w) * bpp..][..bpp];
+                    let a = if ch == 4 && fmt.has_alpha() { s[3] } else { 255 };
+                    let want: Vec<u8> = match fmt {
+                        PixelFormat::Rgb => vec![s[0], s[1], s[2]],
+                        PixelFormat::Rgba => vec![s[0], s[1], s[2], a],
+                        _ => vec![s[2], s[1], s[0], a],
+                    };
+                    assert_eq!(d, &want[..], "{ch} {fmt:?} px {i}");
+                }
+                assert!((0..h).all(|r| out[r * stride + w * bpp..(r + 1) * stride].iter().all(|&b| b == 0x55)));
+                // One byte short of the last row must be rejected.
+                let need = stride * (h - 1) + w * bpp;
+                assert!(!decoder::decode_to_format(&mut decoder::DecodeScratch::default(), &buf, &mut out[..need - 1], fmt, stride, &mut ow, &mut oh));
+            }
+        }
+    }
+}
+
+#[test]
+fn reused_scratch_matches_fresh_decode() {
+    // Large RGBA, then smaller RGB (stale alpha blocks and oversized buffers), a
+    // failing decode, then RGBA again: every result must match a fresh decode.
+    let mut scratch = decoder::DecodeScratch::default();
+    for &(w, h, ch) in &[(70, 161, 4), (17, 16, 3), (40, 33, 3), (31, 17, 4)] {
+        let buf = one_shot(&image(w, h, ch, 40), w, h, ch, 85);
+        let mut out = vec![0u8; w * h * ch];
+        let (mut ow, mut oh, mut oc) = (0, 0, 0);
+        assert!(decoder::decode_with(&mut scratch, &buf, &mut out, &mut ow, &mut oh, &mut oc, None));
+        assert_eq!((ow, oh, oc), (w as u32, h as u32, ch as u32));
+        assert!(out == reference_decode(&buf, w, h, ch), "{w}x{h}x{ch}");
+        assert!(!decoder::decode_with(&mut scratch, &buf[..buf.len() - 1], &mut out, &mut ow, &mut oh, &mut oc, None));
+    }
+}
+
+#[test]
+fn region_decode_matches_crop_of_full_decode() {
+    use crate::lossless;
+    let (w, h) = (83, 70);
+    for ch in [3usize, 4] {
+        let img = image(w, h, ch, 40);
+        let mut lossless_buf = vec![0u8; w * h * ch * 2 + 1024];
+        let mut len = 0;
+        assert!(lossless::encode(&img, w, h, ch as u32, &mut lossless_buf, &mut len, None));
+        lossless_buf.truncate(len as usize);
+        for buf in [one_shot(&img, w, h, ch, 85), lossless_buf] {
+            let mut full = vec![0u8; w * h * ch];
+            let (mut ow, mut oh, mut oc) = (0, 0, 0);
+            assert!(decoder::decode(&buf, &mut full, &mut ow, &mut oh, &mut oc, None));
+            for &(x, y, rw, rh) in &[(0, 0, w, h), (0, 0, 1, 1), (17, 9, 30, 21), (33, 31, 1, 2), (15, 16, 2, 17), (82, 69, 1, 1), (40, 0, 43, 70)] {
+                let mut out = vec![0u8; rw * rh * ch];
+                assert!(decoder::decode_region(&buf, x, y, rw, rh, &mut out, &mut ow, &mut oh, &mut oc));
+                assert_eq!((ow, oh, oc), (w as u32, h as u32, ch as u32));
+                for r in 0..rh {
+                    let want = &full[((y + r) * w + x) * ch..][..rw * ch];
+                    assert!(&out[r * rw * ch..][..rw * ch] == want, "{ch} v{} ({x},{y} {rw}x{rh}) row {r}", buf[2]);
+                }
+            }
+            let mut out = vec![0u8; 4 * 4 * ch];
+            assert!(!decoder::decode_region(&buf, w - 3, 0, 4, 4, &mut out, &mut ow, &mut oh, &mut oc));
+            assert!(!decoder::decode_region(&buf, 0, 0, 0, 4, &mut out, &mut ow, &mut oh, &mut oc));
+            assert!(!decoder::decode_region(&buf, 0, 0, 5, 4, &mut out, &mut ow, &mut oh, &mut oc));
+        }
+    }
+}
+
+#[test]
+fn resized_decode_tracks_full_decode_plus_resize() {
+    use crate::lossless;
+    use crate::resample::{self, Filter};
+    let (w, h) = (203, 118);
+    for ch in [3usize, 4] {
+        // Smooth content that stays clear of clamping.
+        let img: Vec<u8> = (0..w * h * ch)
+            .map(|i| {
+                let (x, y, c) = (i / ch % w, i / ch / w, i % ch);
+                (128.0 + 45.0 * ((x as f32 * 0.05 + c as f32).sin() + (y as f32 * 0.04).cos())) as u8
+            })
+            .collect();
+        let buf = one_shot(&img, w, h, ch, 85);
+        let mut full = vec![0u8; w * h * ch];
+        let (mut ow, mut oh, mut oc) = (0, 0, 0);
+        assert!(decoder::decode(&buf, &mut full, &mut ow, &mut oh, &mut oc, None));
+        let mut och = 0;
+
+        // At exactly 1/8, 1/4 and 1/2 size each pixel is the mean of its cell.
+        for k in [1usize, 2, 4] {
+            let (tw, th) = ((w * k + 7) / 8, (h * k + 7) / 8);
+            let mut out = vec![0u8; tw * th * ch];
+            assert!(decoder::decode_resized(&buf, tw, th, Filter::Box, &mut out, &mut och));
+            assert_eq!(och as usize, ch);
+            let cell = 8 / k;
+            let (mut err, mut n) = (0.0f64, 0);
+            for y in 0..h / cell {
+                for x in 0..w / cell {
+                    for c in 0..ch {
+                        let sum: u32 = (0..cell * cell)
+                            .map(|i| full[((y * cell + i / cell) * w + x * cell + i % cell) * ch + c] as u32)
+                            .sum();
+                        err += (out[(y * tw + x) * ch + c] as f64 - sum as f64 / (cell * cell) as f64).abs();
+                        n += 1;
+                    }
+                }
+            }
+            assert!(err / (n as f64) < 1.0, "{ch} k={k}: mean abs diff {}", err / n as f64);
+        }
+
+        for &(tw, th) in &[(20, 12), (50, 29), (100, 55), (150, 100), (300, 150)] {
+            for filter in [Filter::Box, Filter::Triangle, Filter::Lanczos3] {
+                let mut out = vec![0u8; tw * th * ch];
+                assert!(decoder::decode_resized(&buf, tw, th, filter, &mut out, &mut och));
+                let mut want = vec![0u8; tw * th * ch];
+                resample::resize(&full, w, h, ch, tw, th, filter, &mut want);
+                if tw * 2 > w {
+                    // Full-size IDCT: the same as resizing the full decode.
+                    assert!(out == want, "{ch} {tw}x{th} {filter:?}");
+                } else {
+                    // Two-stage (cell means, then the filter) vs one-stage resize.
+                    let err: u64 = out.iter().zip(&want).map(|(&a, &b)| (a as i32 - b as i32).unsigned_abs() as u64).sum();
+                    let mean = err as f64 / out.len() as f64;
+                    assert!(mean < 5.0, "{ch} {tw}x{th} {filter:?}: mean abs diff {mean}");
+                }
+            }
+        }
+        // Other versions resample the full decode exactly.
+        let mut ll = vec![0u8; w * h * ch * 2 + 1024];
+        let mut len = 0;
+        assert!(lossless::encode(&img, w, h, ch as u32, &mut ll, &mut len, None));
+        let (tw, th) = (61, 40);
+        let mut out = vec![0u8; tw * th * ch];
+        let mut och = 0;
+        assert!(decoder::decode_resized(&ll[..len as usize], tw, th, Filter::Triangle, &mut out, &mut och));
+        let mut want = vec![0u8; tw * th * ch];
+        resample::resize(&img, w, h, ch, tw, th, Filter::Triangle, &mut want);
+        assert!(out == want);
+        assert!(!decoder::decode_resized(&buf, 0, th, Filter::Box, &mut out, &mut och));
+        assert!(!decoder::decode_resized(&buf, tw, th, Filter::Box, &mut out[..tw * th * ch - 1], &mut och));
+    }
+}
+
@@ -0,0 +1,156 @@
+use crate::colorspace::{self, PixelFormat};
+use crate::container;
+use crate::encoder;
+use super::{encode_capped, image, one_shot};
+
+fn finish(mut buf: Vec<u8>, pos: i32) -> Vec<u8> {
+    buf.truncate(pos as usize);
+    buf
+}
+
+/// Copy a packed plane into rows `stride` bytes apart, padding filled with junk.
+fn strided(p: &[u8], pw: usize, ph: usize, stride: usize) -> Vec<u8> {
+    let mut out = vec![0xA5u8; stride * ph];
+    for r in 0..ph {
+        out[r * stride..r * stride + pw].copy_from_slice(&p[r * pw..(r + 1) * pw]);
+    }
+    out
+}
+
+#[test]
+fn yuv420_encode_matches_rgb_encode_of_same_planes() {
+    for &(w, h) in &[(1, 1), (17, 16), (31, 33), (70, 161)] {
+        for ch in [3usize, 4] {
+            let img = image(w, h, ch, 40);
+            let expect = one_shot(&img, w, h, ch, 80);
+            let (y, cb, cr, a) = if ch == 4 {
+                let (y, cb, cr, a) = colorspace::rgba_to_ycbcr420a(&img, w, h);
+                (y, cb, cr, Some(a))
+            } else {
+                let (y, cb, cr) = colorspace::rgb_to_ycbcr420(&img, w, h);
+                (y, cb, cr, None)
+            };
+
+            let (cw, chh) = ((w + 1) / 2, (h + 1) / 2);
+            let (ys, cs) = (w + 5, cw + 3);
+            let (yp, cbp, crp) = (strided(&y, w, h, ys), strided(&cb, cw, chh, cs), strided(&cr, cw, chh, cs));
+            let ap = a.map(|a| strided(&a, w, h, ys));
+            let (mut buf, mut pos) = (vec![0u8; w * h * ch * 2 + 4096], 0);
+            encoder::encode_yuv420(
+                (&yp, ys), (&cbp, cs), (&crp, cs), ap.as_deref().map(|a| (a, ys)),
+                w, h, 80, &mut buf, &mut pos, None,
+            );
+            assert!(finish(buf, pos) == expect, "{w}x{h}x{ch}");
+        }
+    }
+}
+
+/// `img` (RGB or RGBA) rewritten in `fmt` with `pad` junk bytes after every row.
+fn to_format(img: &[u8], w: usize, h: usize, fmt: PixelFormat, pad: usize) -> Vec<u8> {
+    let (ch, bpp) = (img.len() / (w * h), fmt.bytes_per_pixel());
+    let stride = w * bpp + pad;
+    let mut out = vec![0x5Au8; stride * h];
+    for i in 0..w * h {
+        let (p, o) = (&img[i * ch..], (i / w) * stride + (i % w) * bpp);
+        let (r, b) = if matches!(fmt, PixelFormat::Bgr | PixelFormat::Bgra | PixelFormat::Bgrx) { (2, 0) } else { (0, 2) };
+        out[o + r] = p[0];
+        out[o + 1] = p[1];
+        out[o + b] = p[2];
+        if bpp == 4 {
+            out[o + 3] = if fmt.has_alpha() { p[3] } else { (i * 13) as u8 };
+        }
+    }
+    out
+}
+
+#[test]
+fn format_encode_matches_packed_encode() {
+    for &(w, h) in &[(1, 1), (17, 16), (40, 9), (70, 33)] {
+        for fmt in [PixelFormat::Rgb, PixelFormat::Bgr, PixelFormat::Rgba, PixelFormat::Bgra, PixelFormat::Rgbx, PixelFormat::Bgrx] {
+            let ch = if fmt.has_alpha() { 4 } else { 3 };
+            let img = image(w, h, ch, 40);
+            let expect = one_shot(&img, w, h, ch, 80);
+
+            let pad = 7;
+            let src = to_format(&img, w, h, fmt, pad);
+            let (mut buf, mut pos) = (vec![0u8; w * h * ch * 2 + 4096], 0);
+            encoder::encode_pixels(&src, w, h, fmt, w * fmt.bytes_per_pixel() + pad, 80, &mut buf, &mut pos, None);
+            assert!(finish(buf, pos) == expect, "{w}x{h} {fmt:?}");
+        }
+    }
+}
+
+#[test]
+fn bound_covers_worst_case_input() {
+    for &(w, h) in &[(1, 1), (9, 7), (64, 48), (129, 65)] {
+        for ch in [1usize, 3, 4] {
+            for q in [1u8, 50, 85, 100] {
+                let bound = encoder::encode_bound(w, h, ch, q).unwrap();
+                for img in [image(w, h, ch, 256), image(w, h, ch, 40)] {
+                    let (_, pos) = encode_capped(&img, w, h, ch, q, bound);
+                    assert!(pos as usize <= bound, "{w}x{h}x{ch} q{q}: {pos} > {bound}");
+                    if ch == 1 {
+                        continue;
+                    }
+                    let chunked_bound = bound + container::CHUNKED_BOUND_EXTRA;
+                    let (mut buf, mut pos) = (vec![0u8; chunked_bound], 0);
+                    if ch == 4 {
+                        encoder::encode_rgba_chunked(&img, w, h, q, &mut buf, &mut pos, None);
+                    } else {
+                        encoder::encode_rgb_chunked(&img, w, h, q, &mut buf, &mut pos, None);
+                    }
+                    assert!(pos as usize <= chunked_bound, "chunked {w}x{h}x{ch} q{q}: {pos} > {chunked_bound}");
+                }
+            }
+        }
+    }
+    assert_eq!(encoder::encode_bound(16, 16, 2, 85), None);
+    assert_eq!(encoder::encode_bound(0, 16, 3, 85), None);
+    assert_eq!(container::CHUNKED_BOUND_EXTRA, 356, "keep BITGRAIN_CHUNKED_BOUND_EXTRA in c/config.h in sync");
+}
+
+#[test]
+fn short_buffer_reports_needed_size() {
+    let (w, h) = (40, 24);
+    for ch in [1usize, 3, 4] {
+        let img = image(w, h, ch, 256);
+        let (full, len) = encode_capped(&img, w, h, ch, 90, encoder::encode_bound(w, h, ch, 90).unwrap());
+        for cap in [0, 11, 12, 20, len as usize / 2, len as usize - 1] {
+            let (_, pos) = encode_capped(&img, w, h, ch, 90, cap);
+            assert_eq!(pos, len, "ch {ch} cap {cap}");
+        }
+        let (buf, pos) = encode_capped(&img, w, h, ch, 90, len as usize);
+        assert_eq!(finish(buf, pos), finish(full, len));
+    }
+}
+
+#[test]
+fn sink_encode_matches_buffer_encode() {
+    let (w, h) = (45, 30);
+    for ch in [1usize, 3, 4] {
+        let img = image(w, h, ch, 40);
+        let (buf, pos) = encode_capped(&img, w, h, ch, 80, 1 << 16);
+        let mut sink = Vec::new();
+        assert!(encoder::encode_to_sink(&img, w, h, ch, 80, &mut sink));
+        assert_eq!(sink, finish(buf, pos), "ch {ch}");
+    }
+    assert!(!encoder::encode_to_sink(&[0u8; 8], 2, 2, 2, 80, &mut Vec::new()));
+}
+
+#[test]
+fn in_place_planes_match_payload_path() {
+    // 640x480 takes the parallel region path when the buffer holds every plane's
+    // bound, the sequential one when it only holds the stream itself.
+    for &(w, h) in &[(640usize, 480usize), (50, 20)] {
+        for ch in [3usize, 4] {
+            let img = image(w, h, ch, 40);
+            let mut reference = Vec::new();
+            assert!(encoder::encode_to_sink(&img, w, h, ch, 85, &mut reference));
+            let bound = encoder::encode_bound(w, h, ch, 85).unwrap();
+            for cap in [bound, reference.len()] {
+                let (buf, pos) = encode_capped(&img, w, h, ch, 85, cap);
+                assert!(finish(buf, pos) == reference, "{w}x{h}x{ch} cap {cap}");
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+use crate::decoder;
+use crate::lossless::{self, LOSSLESS_STRIP_ROWS};
+
+fn encode(img: &[u8], w: usize, h: usize, ch: u32) -> Vec<u8> {
+    let mut out = vec![0u8; lossless::max_encoded_len(w, h, ch)];
+    let mut pos = 0;
+    assert!(lossless::encode(img, w, h, ch, &mut out, &mut pos, None));
+    out.truncate(pos as usize);
+    out
+}
+
+/// Smooth gradient with a hard edge and some deterministic noise.
+fn test_image(w: usize, h: usize, ch: usize) -> Vec<u8> {
+    let mut seed = 0x2545_f491u32;
+    let mut img = vec![0u8; w * h * ch];
+    for y in 0..h {
+        for x in 0..w {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            let noise = (seed % 5) as usize;
+            for c in 0..ch {
+                let v = if x > w / 2 { 200 + c * 20 } else { x * 2 + y + c * 40 + noise };
+                img[(y * w + x) * ch + c] = v as u8;
+            }
+        }
+    }
+    img
+}
+
+#[test]
+fn lossless_roundtrip_is_exact() {
+    let (w, h) = (37, LOSSLESS_STRIP_ROWS * 2 + 5);
+    for ch in [1u32, 3, 4] {
+        let img = test_image(w, h, ch as usize);
+        let buf = encode(&img, w, h, ch);
+        assert!(buf.len() < img.len(), "ch={ch}: {} >= {}", buf.len(), img.len());
+        let mut out = vec![0u8; img.len()];
+        let (mut ow, mut oh, mut oc) = (0, 0, 0);
+        assert!(decoder::decode(&buf, &mut out, &mut ow, &mut oh, &mut oc, None));
+        assert_eq!((ow, oh, oc), (w as u32, h as u32, ch));
+        assert_eq!(out, img, "ch={ch}");
+    }
+}
+
+#[test]
+fn lossless_extreme_values_and_stored_strips() {
+    // Full-range noise defeats prediction: strips fall back to stored and must
+    // still round-trip, and YCoCg-R must be exact at the corners of the cube.
+    let (w, h) = (16, 9);
+    let mut seed = 7u32;
+    let mut img: Vec<u8> = (0..w * h * 3)
+        .map(|_| {
+            seed = seed.wrapping_mul(1_103_515_245).wrapping_add(12_345);
+            (seed >> 16) as u8
+        })
+        .collect();
+    img[..6].copy_from_slice(&[255, 0, 255, 0, 255, 0]);
+    let buf = encode(&img, w, h, 3);
+    assert!(buf.len() <= lossless::max_encoded_len(w, h, 3));
+    let mut out = vec![0u8; img.len()];
+    let (mut ow, mut oh, mut oc) = (0, 0, 0);
+    assert!(decoder::decode(&buf, &mut out, &mut ow, &mut oh, &mut oc, None));
+    assert_eq!(out, img);
+}
+
+#[test]
+fn lossless_rejects_truncated_stream() {
+    let (w, h) = (24, 24);
+    let img = test_image(w, h, 3);
+    let buf = encode(&img, w, h, 3);
+    let mut out = vec![0u8; img.len()];
+    let (mut ow, mut oh, mut oc) = (0, 0, 0);
+    assert!(!decoder::decode(&buf[..buf.len() - 1], &mut out, &mut ow, &mut oh, &mut oc, None));
+    let mut small = vec![0u8; img.len() - 1];
+    assert!(!decoder::decode(&buf, &mut small, &mut ow, &mut oh, &mut oc, None));
+}
+
+#[test]
+fn lossless_flat_regions_use_run_mode() {
+    let (w, h) = (300, 200);
+    let mut img = vec![40u8; w * h * 3];
+    for y in 50..120 {
+        for x in 80..210 {
+            img[(y * w + x) * 3..(y * w + x) * 3 + 3].copy_from_slice(&[220, 30, 90]);
+        }
+    }
+    let buf = encode(&img, w, h, 3);
+    assert!(buf.len() * 100 < img.len(), "{} bytes", buf.len());
+    let mut out = vec![0u8; img.len()];
+    let (mut ow, mut oh, mut oc) = (0, 0, 0);
+    assert!(decoder::decode(&buf, &mut out, &mut ow, &mut oh, &mut oc, None));
+    assert_eq!(out, img);
+}
@@ -1,2 +1,49 @@
+mod archive_tests;
+mod colorspace_tests;
+mod container_tests;
 mod dct_tests;
+mod decoder_tests;
+mod encoder_tests;
 mod huffman_tests;
+mod lossless_tests;
+mod rate_tests;
+mod resample_tests;
+mod sequence_tests;
+mod stream_encoder_tests;
+mod stream_tests;
+mod validate_tests;
+
+use crate::encoder;
+
+/// Seeded test image: a per-channel gradient plus xorshift noise in 0..amp
+/// (256 gives full-range noise).
+fn image(w: usize, h: usize, ch: usize, amp: u32) -> Vec<u8> {
+    let mut seed = 0x2545_f491u32;
+    (0..w * h * ch)
+        .map(|i| {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            ((i / ch % w) * 3 + (i / ch / w) * 2 + (i % ch) * 50 + (seed % amp) as usize) as u8
+        })
+        .collect()
+}
+
+/// Packed encode (1 = v1 RLE, 3/4 = YCbCr Huffman) into a `cap`-byte buffer.
+/// Returns the buffer and the end position, which may pass `cap` on overflow.
+fn encode_capped(img: &[u8], w: usize, h: usize, ch: usize, q: u8, cap: usize) -> (Vec<u8>, i32) {
+    let (mut buf, mut pos) = (vec![0u8; cap], 0);
+    match ch {
+        1 => encoder::encode_grayscale(img, w, h, q, &mut buf, &mut pos),
+        3 => encoder::encode_rgb_ycbcr(img, w, h, q, &mut buf, &mut pos, None),
+        _ => encoder::encode_rgba_ycbcr(img, w, h, q, &mut buf, &mut pos, None),
+    }
+    (buf, pos)
+}
+
+/// The complete one-shot stream for `img` at quality `q`.
+fn one_shot(img: &[u8], w: usize, h: usize, ch: usize, q: u8) -> Vec<u8> {
+    let (mut buf, pos) = encode_capped(img, w, h, ch, q, encoder::encode_bound(w, h, ch, q).unwrap());
+    buf.truncate(pos as usize);
+    buf
+}
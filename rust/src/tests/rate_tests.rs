@@ -0,0 +1,99 @@
+use crate::decoder;
+use crate::encoder;
+use crate::rate::{DctImage, QualityTarget};
+use super::{image, one_shot};
+
+#[test]
+fn cached_coefficients_encode_like_one_shot() {
+    let (w, h) = (53, 38);
+    for ch in [1usize, 3, 4] {
+        let img = image(w, h, ch, 48);
+        let dct = DctImage::new(&img, w, h, ch).unwrap();
+        for q in [1u8, 40, 85, 100] {
+            let expect = one_shot(&img, w, h, ch, q);
+            assert_eq!(dct.encoded_len(q), expect.len(), "ch {ch} q {q}");
+            let (mut buf, mut pos) = (vec![0u8; expect.len()], 0);
+            dct.encode(q, &mut buf, &mut pos);
+            assert!(pos as usize == expect.len() && buf == expect, "ch {ch} q {q}");
+        }
+    }
+    assert!(DctImage::new(&[0u8; 16], 4, 4, 2).is_none());
+}
+
+#[test]
+fn max_size_picks_highest_fitting_quality() {
+    // 40x420 has enough block rows for the sampled coarse search.
+    for (w, h, ch) in [(96, 64, 1usize), (96, 64, 3), (96, 64, 4), (40, 420, 3)] {
+        let img = image(w, h, ch, 48);
+        let dct = DctImage::new(&img, w, h, ch).unwrap();
+        let budget = one_shot(&img, w, h, ch, 70).len() + 10;
+        let mut buf = vec![0u8; budget];
+        let mut pos = 0;
+        let q = dct.encode_max_size(budget, &mut buf, &mut pos).unwrap();
+        assert!(q >= 70, "ch {ch}: q {q}");
+        assert!(pos as usize <= budget);
+        assert_eq!(&buf[..pos as usize], &one_shot(&img, w, h, ch, q)[..]);
+        if q < 100 {
+            assert!(one_shot(&img, w, h, ch, q + 1).len() > budget, "ch {ch}: q {} also fits", q + 1);
+        }
+        let floor = dct.encoded_len(1);
+        let mut pos = 0;
+        assert_eq!(dct.encode_max_size(floor - 1, &mut buf, &mut pos), None);
+        assert_eq!(pos, 0);
+    }
+}
+
+#[test]
+fn quality_ladder_matches_separate_encodes() {
+    let (w, h) = (61, 45);
+    for ch in [1usize, 3, 4] {
+        let img = image(w, h, ch, 48);
+        let dct = DctImage::new(&img, w, h, ch).unwrap();
+        let qualities = [30u8, 60, 85, 95];
+        let mut bufs: Vec<Vec<u8>> = qualities.iter().map(|_| vec![0u8; 1 << 16]).collect();
+        let mut outs: Vec<(u8, &mut [u8])> = qualities.iter().copied().zip(bufs.iter_mut().map(|b| &mut b[..])).collect();
+        let lens = dct.encode_each(&mut outs);
+        for ((&q, buf), len) in qualities.iter().zip(&bufs).zip(lens) {
+            assert_eq!(&buf[..len], &one_shot(&img, w, h, ch, q)[..], "ch {ch} q {q}");
+        }
+        // Short buffers report the size needed.
+        let mut small = [0u8; 20];
+        let lens = dct.encode_each(&mut [(85, &mut small[..])]);
+        assert_eq!(lens[0], one_shot(&img, w, h, ch, 85).len());
+    }
+}
+
+/// PSNR of a decoded grayscale stream against `img`.
+fn gray_psnr(img: &[u8], w: usize, h: usize, stream: &[u8]) -> f64 {
+    let mut out = vec![0u8; w * h];
+    let (mut ow, mut oh, mut och) = (0, 0, 0);
+    assert!(decoder::decode(stream, &mut out, &mut ow, &mut oh, &mut och, None));
+    let mse = img.iter().zip(&out).map(|(&a, &b)| (a as f64 - b as f64).powi(2)).sum::<f64>() / (w * h) as f64;
+    10.0 * (255.0 * 255.0 / mse).log10()
+}
+
+#[test]
+fn target_quality_picks_lowest_reaching_quality() {
+    let (w, h) = (72, 56);
+    for ch in [1usize, 3, 4] {
+        let img = image(w, h, ch, 48);
+        let dct = DctImage::new(&img, w, h, ch).unwrap();
+        for target in [QualityTarget::Psnr(30.0), QualityTarget::Psnr(38.0), QualityTarget::Ssim(0.9)] {
+            let mut buf = vec![0u8; encoder::encode_bound(w, h, ch, 100).unwrap()];
+            let mut pos = 0;
+            let (q, value) = dct.encode_target_quality(target, &mut buf, &mut pos);
+            let stream = one_shot(&img, w, h, ch, q);
+            assert_eq!(&buf[..pos as usize], &stream[..], "ch {ch} {target:?}");
+            let (QualityTarget::Psnr(t) | QualityTarget::Ssim(t)) = target;
+            assert!(value >= t || q == 100, "ch {ch} {target:?}: q {q} gives {value}");
+            if let (1, QualityTarget::Psnr(t)) = (ch, target) {
+                // Grayscale decodes exactly what was measured; one step lower misses.
+                assert!((gray_psnr(&img, w, h, &stream) - value).abs() < 1e-9);
+                assert!(q == 1 || gray_psnr(&img, w, h, &one_shot(&img, w, h, 1, q - 1)) < t, "q {q} not lowest");
+            }
+        }
+    }
+    assert_eq!(QualityTarget::from_code(1, 1.5), None);
+    assert_eq!(QualityTarget::from_code(2, 0.5), None);
+    assert_eq!(QualityTarget::from_code(0, 40.0), Some(QualityTarget::Psnr(40.0)));
+}
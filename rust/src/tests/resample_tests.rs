@@ -0,0 +1,34 @@
+use crate::resample::{resize, Filter};
+
+#[test]
+fn same_size_resize_is_identity() {
+    let (w, h, ch) = (13, 7, 3);
+    let src: Vec<u8> = (0..w * h * ch).map(|i| (i * 37 % 251) as u8).collect();
+    for filter in [Filter::Box, Filter::Triangle, Filter::Lanczos3] {
+        let mut out = vec![0u8; w * h * ch];
+        resize(&src, w, h, ch, w, h, filter, &mut out);
+        assert!(out == src, "{filter:?}");
+    }
+}
+
+#[test]
+fn resize_preserves_flat_color_and_box_averages() {
+    let (w, h) = (40, 30);
+    let flat: Vec<u8> = [10u8, 200, 77, 255].iter().cycle().take(w * h * 4).copied().collect();
+    for filter in [Filter::Box, Filter::Triangle, Filter::Lanczos3] {
+        for &(tw, th) in &[(7, 5), (40, 1), (91, 33)] {
+            let mut out = vec![0u8; tw * th * 4];
+            resize(&flat, w, h, 4, tw, th, filter, &mut out);
+            assert!(out.chunks_exact(4).all(|p| p == [10, 200, 77, 255]), "{filter:?} {tw}x{th}");
+        }
+    }
+    // Halving with a box filter averages 2×2 cells.
+    let gray: Vec<u8> = (0..w * h).map(|i| ((i % w) * 6 + (i / w) * 2) as u8).collect();
+    let mut out = vec![0u8; (w / 2) * (h / 2)];
+    resize(&gray, w, h, 1, w / 2, h / 2, Filter::Box, &mut out);
+    for (i, &v) in out.iter().enumerate() {
+        let (x, y) = (i % (w / 2) * 2, i / (w / 2) * 2);
+        let sum: u32 = [0, 1, w, w + 1].iter().map(|&d| gray[y * w + x + d] as u32).sum();
+        assert_eq!(v as u32, (sum + 2) / 4, "px {i}");
+    }
+}
@@ -0,0 +1,86 @@
+use crate::decoder;
+use crate::sequence::{SequenceDecoder, SequenceEncoder, FRAME_DELTA};
+
+fn frames(w: usize, h: usize, ch: usize, n: usize) -> Vec<Vec<u8>> {
+    let base: Vec<u8> = (0..w * h * ch).map(|i| ((i / ch % w) * 5 + (i / ch / w) * 3 + (i % ch) * 50) as u8).collect();
+    (0..n)
+        .map(|f| {
+            let mut img = base.clone();
+            // A small object moving across an otherwise static scene.
+            for y in 2..h.min(8) {
+                for x in (f * 3)..(f * 3 + 6) {
+                    for c in 0..ch {
+                        img[(y * w + x % w) * ch + c] = 250;
+                    }
+                }
+            }
+            img
+        })
+        .collect()
+}
+
+fn encode(fr: &[Vec<u8>], w: usize, h: usize, ch: u32, keyint: u32) -> Vec<u8> {
+    let mut enc = SequenceEncoder::new(w, h, ch, 80, keyint).expect("encoder");
+    for f in fr {
+        assert!(enc.push_frame(f));
+    }
+    let mut out = vec![0u8; enc.encoded_len()];
+    let mut pos = 0;
+    enc.write(&mut out, &mut pos);
+    assert_eq!(pos as usize, out.len());
+    out
+}
+
+fn decode_all(buf: &[u8]) -> Vec<Vec<u8>> {
+    let mut dec = SequenceDecoder::new(buf).expect("decoder");
+    let len = dec.sequence().frame_len();
+    (0..dec.sequence().frame_count)
+        .map(|_| {
+            let mut out = vec![0u8; len];
+            assert!(dec.decode_next(&mut out));
+            out
+        })
+        .collect()
+}
+
+#[test]
+fn sequence_skip_matches_all_keyframes() {
+    let (w, h) = (48, 32);
+    for ch in [1u32, 3, 4] {
+        let fr = frames(w, h, ch as usize, 6);
+        let delta = encode(&fr, w, h, ch, 0);
+        let keys = encode(&fr, w, h, ch, 1);
+        assert!(delta.len() * 2 < keys.len(), "ch={ch}: {} vs {}", delta.len(), keys.len());
+        assert_eq!(decode_all(&delta), decode_all(&keys), "ch={ch}");
+    }
+}
+
+#[test]
+fn sequence_seek_replays_from_keyframe() {
+    let (w, h) = (40, 24);
+    let fr = frames(w, h, 3, 7);
+    let buf = encode(&fr, w, h, 3, 3);
+    let all = decode_all(&buf);
+
+    let mut dec = SequenceDecoder::new(&buf).expect("decoder");
+    assert_eq!(dec.sequence().frame(1).kind, FRAME_DELTA);
+    let mut out = vec![0u8; dec.sequence().frame_len()];
+    for &k in &[5usize, 2, 6, 0] {
+        assert!(dec.seek(k));
+        assert!(dec.decode_next(&mut out));
+        assert_eq!(out, all[k], "frame {k}");
+    }
+    assert!(!dec.seek(7));
+}
+
+#[test]
+fn plain_decode_returns_first_frame() {
+    let (w, h) = (17, 9);
+    let fr = frames(w, h, 4, 2);
+    let buf = encode(&fr, w, h, 4, 0);
+    let mut px = vec![0u8; w * h * 4];
+    let (mut ow, mut oh, mut oc) = (0, 0, 0);
+    assert!(decoder::decode(&buf, &mut px, &mut ow, &mut oh, &mut oc, None));
+    assert_eq!((ow, oh, oc), (w as u32, h as u32, 4));
+    assert_eq!(px, decode_all(&buf)[0]);
+}
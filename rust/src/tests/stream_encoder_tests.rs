@@ -0,0 +1,55 @@
+use crate::bitstream::Sink;
+use crate::stream_encoder::StreamEncoder;
+use super::{image, one_shot};
+
+/// Append-only sink: the encoder has to hold the luma plane until finish.
+struct AppendOnly(Vec<u8>);
+
+impl Sink for AppendOnly {
+    fn write(&mut self, data: &[u8]) -> bool {
+        self.0.extend_from_slice(data);
+        true
+    }
+}
+
+#[test]
+fn streamed_encode_matches_one_shot() {
+    for &(w, h) in &[(1, 1), (17, 9), (37, 21), (64, 48), (130, 33)] {
+        for ch in [1usize, 3, 4] {
+            let img = image(w, h, ch, 32);
+            let expect = one_shot(&img, w, h, ch, 80);
+            // Uneven pushes that straddle band boundaries, with padded rows.
+            let stride = w * ch + 3;
+            let mut padded = vec![0xAAu8; stride * h];
+            for y in 0..h {
+                padded[y * stride..y * stride + w * ch].copy_from_slice(&img[y * w * ch..(y + 1) * w * ch]);
+            }
+            let mut enc = StreamEncoder::new(Vec::new(), w, h, ch, 80).unwrap();
+            let mut y = 0;
+            for step in [5usize, 1, 11, 16, 7].iter().cycle() {
+                let n = (*step).min(h - y);
+                assert!(enc.push_rows(&padded[y * stride..], n, stride));
+                y += n;
+                if y == h {
+                    break;
+                }
+            }
+            assert_eq!(enc.finish().unwrap(), expect, "{w}x{h}x{ch}");
+
+            let mut enc = StreamEncoder::new(AppendOnly(Vec::new()), w, h, ch, 80).unwrap();
+            assert!(enc.push_rows(&img, h, w * ch));
+            assert_eq!(enc.finish().unwrap().0, expect, "{w}x{h}x{ch} append-only");
+        }
+    }
+}
+
+#[test]
+fn streamed_encode_checks_row_count() {
+    let img = image(20, 20, 3, 32);
+    let mut enc = StreamEncoder::new(Vec::new(), 20, 20, 3, 80).unwrap();
+    assert!(enc.push_rows(&img, 19, 60));
+    assert_eq!(enc.rows_remaining(), 1);
+    assert!(!enc.push_rows(&img, 2, 60));
+    assert!(enc.finish().is_none());
+    assert!(StreamEncoder::new(Vec::new(), 20, 20, 2, 80).is_none());
+}
@@ -0,0 +1,142 @@
+use crate::decoder;
+use crate::encoder;
+use crate::lossless;
+use crate::sequence;
+use crate::stream::StreamDecoder;
+use super::image;
+
+fn encode(kind: &str, img: &[u8], w: usize, h: usize, icc: Option<&[u8]>) -> Vec<u8> {
+    let mut out = vec![0u8; w * h * 4 * 2 + 4096];
+    let mut pos = 0;
+    if let Some(ch) = kind.strip_prefix("rle").map(|c| c.parse::<usize>().unwrap()) {
+        // v2/v3 are planar RLE, i.e. one v1 payload per channel under a single header.
+        let mut buf = encoder::header_bytes(if ch == 3 { 2 } else { 3 }, w, h, 85).to_vec();
+        for c in 0..ch {
+            let plane: Vec<u8> = img.iter().skip(c).step_by(ch).copied().collect();
+            buf.extend_from_slice(&encode("gray", &plane, w, h, None)[12..]);
+        }
+        return buf;
+    }
+    match kind {
+        "gray" => encoder::encode_grayscale(img, w, h, 85, &mut out, &mut pos),
+        "rgb" => encoder::encode_rgb_ycbcr(img, w, h, 85, &mut out, &mut pos, icc),
+        "rgba" => encoder::encode_rgba_ycbcr(img, w, h, 85, &mut out, &mut pos, icc),
+        "rgb_chunked" => encoder::encode_rgb_chunked(img, w, h, 85, &mut out, &mut pos, icc),
+        "rgba_chunked" => encoder::encode_rgba_chunked(img, w, h, 85, &mut out, &mut pos, icc),
+        _ => assert!(lossless::encode(img, w, h, (img.len() / (w * h)) as u32, &mut out, &mut pos, icc)),
+    }
+    out.truncate(pos as usize);
+    out
+}
+
+/// Feed `buf` in `step`-byte pieces, reading at most `max_rows` after each feed.
+/// Returns the image and the number of rows read before the last piece.
+fn stream(buf: &[u8], step: usize, max_rows: usize) -> (Vec<u8>, usize) {
+    let mut dec = StreamDecoder::new();
+    let mut px = Vec::new();
+    let mut early = 0;
+    let mut row = Vec::new();
+    for (i, piece) in buf.chunks(step).enumerate() {
+        assert!(dec.feed(piece), "feed failed at piece {i}");
+        if let Some((w, _, ch)) = dec.info() {
+            row.resize(w as usize * ch as usize * max_rows, 0);
+            loop {
+                let n = dec.read_rows(&mut row, max_rows).expect("read_rows");
+                if n == 0 {
+                    break;
+                }
+                px.extend_from_slice(&row[..n * w as usize * ch as usize]);
+            }
+        }
+        if (i + 1) * step < buf.len() {
+            early = dec.rows_read();
+        }
+    }
+    assert!(dec.is_finished());
+    (px, early)
+}
+
+#[test]
+fn stream_matches_full_decode() {
+    let (w, h) = (53, 70);
+    for kind in ["rgb", "rgba", "rgb_chunked", "rgba_chunked", "lossless3", "lossless4", "gray", "rle3", "rle4"] {
+        let ch = match kind {
+            "gray" => 1,
+            _ if kind.contains('4') || kind.starts_with("rgba") => 4,
+            _ => 3,
+        };
+        let img = image(w, h, ch, 24);
+        let buf = encode(kind, &img, w, h, Some(b"icc"));
+        let mut full = vec![0u8; w * h * ch];
+        let (mut ow, mut oh, mut oc) = (0, 0, 0);
+        assert!(decoder::decode(&buf, &mut full, &mut ow, &mut oh, &mut oc, None), "{kind}");
+        for (step, max_rows) in [(1, 3), (97, 16), (buf.len(), 1000)] {
+            let (px, _) = stream(&buf, step, max_rows);
+            assert!(px == full, "{kind} step={step}");
+        }
+    }
+}
+
+#[test]
+fn stream_emits_rows_before_the_upload_ends() {
+    let (w, h) = (256, 256);
+    let img = image(w, h, 3, 200);
+    for kind in ["rgb", "lossless", "rle3"] {
+        let buf = encode(kind, &img, w, h, None);
+        let (_, early) = stream(&buf, 256, 64);
+        assert!(early >= h / 2, "{kind}: only {early} rows before the last piece");
+    }
+}
+
+#[test]
+fn stream_holds_earlier_planes_compressed() {
+    // Fed without reading, the decoder holds little more than the compressed
+    // stream; read as it arrives, the bytes still undecoded plus one band per
+    // plane. Either way well under one decoded plane of this tall image.
+    let (w, h) = (64, 1024);
+    for kind in ["rgb", "rgba", "rgba_chunked"] {
+        let ch = if kind.starts_with("rgba") { 4 } else { 3 };
+        let buf = encode(kind, &image(w, h, ch, 24), w, h, None);
+        let mut out = vec![0u8; w * h * ch];
+        let mut dec = StreamDecoder::new();
+        for piece in buf.chunks(256) {
+            assert!(dec.feed(piece));
+        }
+        assert!(dec.held_bytes() <= 2 * buf.len(), "{kind}: {} held", dec.held_bytes());
+        assert_eq!(dec.read_rows(&mut out, h), Some(h));
+
+        let mut dec = StreamDecoder::new();
+        let mut peak = 0;
+        for piece in buf.chunks(256) {
+            assert!(dec.feed(piece));
+            while dec.read_rows(&mut out, h).unwrap() > 0 {}
+            peak = peak.max(dec.held_bytes());
+        }
+        assert!(dec.is_finished());
+        assert!(peak < w * h / 2, "{kind}: peak {peak} held");
+    }
+}
+
+#[test]
+fn stream_rejects_bad_input() {
+    let mut dec = StreamDecoder::new();
+    assert!(!dec.feed(b"XX"));
+    assert!(dec.read_rows(&mut [0u8; 16], 1).is_none());
+
+    // Sequences (v21) are not streamable.
+    let mut dec = StreamDecoder::new();
+    assert!(!dec.feed(&[b'B', b'G', sequence::BG_VERSION_SEQUENCE, 8, 0, 0, 0, 8, 0, 0, 0, 85]));
+
+    // A plane payload that ends early is corruption once its band reaches the end.
+    let (w, h) = (32, 32);
+    let mut buf = encode("rgb", &image(w, h, 3, 24), w, h, None);
+    let y_len = u32::from_le_bytes(buf[12..16].try_into().unwrap()) as usize;
+    buf.truncate(16 + y_len / 2);
+    let tail = buf.len() - 16;
+    buf[12..16].copy_from_slice(&(tail as u32).to_le_bytes());
+    buf.extend_from_slice(&[0u8; 16]);
+    let mut dec = StreamDecoder::new();
+    assert!(dec.feed(&buf), "plane data is only decoded with its band");
+    assert!(dec.read_rows(&mut vec![0u8; w * h * 3], h).is_none());
+    assert!(!dec.feed(&[0u8; 16]));
+}
@@ -0,0 +1,152 @@
+use crate::decoder;
+use crate::encoder;
+use crate::lossless;
+use crate::sequence::SequenceEncoder;
+use crate::validate::validate;
+use super::image;
+
+fn finish(mut buf: Vec<u8>, pos: i32) -> Vec<u8> {
+    buf.truncate(pos as usize);
+    buf
+}
+
+/// One stream of every layout: v1 RLE, v18/v19 Huffman, v20 chunked, v21 sequence, v22 lossless.
+fn streams(icc: Option<&[u8]>) -> Vec<(&'static str, Vec<u8>)> {
+    let (w, h) = (37, 21);
+    let mut out = Vec::new();
+    let mut pos = 0;
+    let mut buf = vec![0u8; 1 << 16];
+    encoder::encode_grayscale(&image(w, h, 1, 24), w, h, 80, &mut buf, &mut pos);
+    out.push(("v1", finish(buf, pos)));
+    for (name, ch) in [("v18", 3usize), ("v19", 4)] {
+        let (mut buf, mut pos) = (vec![0u8; 1 << 16], 0);
+        if ch == 4 {
+            encoder::encode_rgba_ycbcr(&image(w, h, 4, 24), w, h, 80, &mut buf, &mut pos, icc);
+        } else {
+            encoder::encode_rgb_ycbcr(&image(w, h, 3, 24), w, h, 80, &mut buf, &mut pos, icc);
+        }
+        out.push((name, finish(buf, pos)));
+    }
+    let (mut buf, mut pos) = (vec![0u8; 1 << 16], 0);
+    encoder::encode_rgb_chunked(&image(w, h, 3, 24), w, h, 80, &mut buf, &mut pos, icc);
+    out.push(("v20", finish(buf, pos)));
+    let mut seq = SequenceEncoder::new(w, h, 3, 80, 2).unwrap();
+    for f in 0..3 {
+        let mut img = image(w, h, 3, 24);
+        img[f * 30..f * 30 + 30].fill(255);
+        assert!(seq.push_frame(&img));
+    }
+    let (mut buf, mut pos) = (vec![0u8; seq.encoded_len()], 0);
+    seq.write(&mut buf, &mut pos);
+    out.push(("v21", buf));
+    let (mut buf, mut pos) = (vec![0u8; lossless::max_encoded_len(w, h, 3) + 64], 0);
+    assert!(lossless::encode(&image(w, h, 3, 24), w, h, 3, &mut buf, &mut pos, icc));
+    out.push(("v22", finish(buf, pos)));
+    out
+}
+
+#[test]
+fn every_version_validates_and_every_truncation_fails() {
+    for (name, buf) in streams(None) {
+        assert_eq!(validate(&buf), Ok(()), "{name}");
+        for cut in 0..buf.len() {
+            let err = validate(&buf[..cut]).expect_err(name);
+            assert!(err.offset <= cut, "{name} cut {cut}: offset {} ({})", err.offset, err.reason);
+        }
+    }
+    let icc = [7u8; 40];
+    for (name, mut buf) in streams(Some(&icc)) {
+        assert_eq!(validate(&buf), Ok(()), "{name} + ICC");
+        buf.push(0);
+        let err = validate(&buf).expect_err(name);
+        assert!(err.offset <= buf.len() - 1, "{name}: {err:?}");
+    }
+}
+
+#[test]
+fn errors_point_at_the_damage() {
+    let all = streams(None);
+    let v18 = &all[1].1;
+    let y_len = u32::from_le_bytes(v18[12..16].try_into().unwrap()) as usize;
+
+    let mut buf = v18.clone();
+    buf[12..16].copy_from_slice(&u32::MAX.to_le_bytes());
+    assert_eq!(validate(&buf).unwrap_err().offset, 12);
+
+    // A run of 1 bits is no valid Huffman code.
+    let mut buf = v18.clone();
+    let at = 16 + y_len / 2;
+    buf[at..at + 8].fill(0xFF);
+    let err = validate(&buf).unwrap_err();
+    assert!(err.offset + 3 >= at && err.offset < at + 8, "{err:?} vs {at}");
+
+    // Bytes past the last block of the final plane.
+    let mut buf = v18.clone();
+    let (cb_at, end) = (16 + y_len, v18.len());
+    let cr_at = cb_at + 4 + u32::from_le_bytes(v18[cb_at..cb_at + 4].try_into().unwrap()) as usize;
+    let cr_len = u32::from_le_bytes(v18[cr_at..cr_at + 4].try_into().unwrap());
+    buf[cr_at..cr_at + 4].copy_from_slice(&(cr_len + 2).to_le_bytes());
+    buf.extend_from_slice(&[0x00, 0x00]);
+    let err = validate(&buf).unwrap_err();
+    assert_eq!(err.reason, "unused bytes at end of plane");
+    assert!(err.offset == end - 1 || err.offset == end, "{err:?}");
+
+    let mut buf = all[4].1.clone();
+    let first = u64::from_le_bytes(buf[276..284].try_into().unwrap()) as usize;
+    buf[first] = 9;
+    assert_eq!(validate(&buf).unwrap_err().offset, first);
+
+    let mut buf = all[5].1.clone();
+    buf[12] = 2;
+    assert_eq!(validate(&buf).unwrap_err().offset, 12);
+}
+
+#[test]
+fn valid_streams_decode() {
+    // Damage anywhere in a v19 stream: whatever validates must decode.
+    let buf = &streams(None)[2].1;
+    let mut out = vec![0u8; 37 * 21 * 4];
+    let (mut w, mut h, mut ch) = (0, 0, 0);
+    for i in (0..buf.len()).step_by(3) {
+        for flip in [0x01u8, 0x40, 0xFF] {
+            let mut bad = buf.clone();
+            bad[i] ^= flip;
+            if validate(&bad).is_ok() {
+                assert!(decoder::decode(&bad, &mut out, &mut w, &mut h, &mut ch, None), "byte {i} ^ {flip:#x}");
+            }
+        }
+    }
+}
+
+#[test]
+fn unpaired_quant_tables_fail() {
+    let v20 = &streams(None)[3].1;
+    let toc = crate::container::read_toc(v20).unwrap();
+    let entry = |tag| crate::container::CONTAINER_HEADER_SIZE
+        + toc.iter().position(|c| c.tag == crate::container::TAG_QUANT && c.info == tag).unwrap() * crate::container::TOC_ENTRY_SIZE;
+    let (luma, chroma) = (entry(crate::container::QUANT_TABLE_LUMA), entry(crate::container::QUANT_TABLE_CHROMA));
+    // Relabel the chroma table as a second luma table, or drop it by renaming its tag.
+    let mut relabeled = v20.clone();
+    relabeled[chroma + 12..chroma + 16].copy_from_slice(&7u32.to_le_bytes());
+    let mut dropped = v20.clone();
+    dropped[chroma..chroma + 4].copy_from_slice(b"XXXX");
+    for bad in [relabeled, dropped] {
+        let err = validate(&bad).unwrap_err();
+        assert_eq!(err.reason, "unpaired quant tables");
+        assert!(err.offset == luma || err.offset == chroma, "{err:?}");
+    }
+    // Whatever validates after a bit flip in the TOC must decode.
+    let end = crate::container::toc_size(v20).unwrap();
+    let (mut w, mut h, mut ch) = (0, 0, 0);
+    for i in 0..end {
+        for bit in 0..8 {
+            let mut bad = v20.clone();
+            bad[i] ^= 1 << bit;
+            if validate(&bad).is_ok() {
+                let dim = |at: usize| u32::from_le_bytes(bad[at..at + 4].try_into().unwrap()) as usize;
+                let mut out = vec![0u8; dim(3) * dim(7) * 4];
+                assert!(decoder::decode(&bad, &mut out, &mut w, &mut h, &mut ch, None), "byte {i} bit {bit}");
+            }
+        }
+    }
+}
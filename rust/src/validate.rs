@@ -0,0 +1,183 @@
+//! Structural validation of .bg streams, for rejecting corrupt or truncated files
+//! without decoding them.
+//!
+//! Checks the header, every plane length (or TOC / frame index entry), every
+//! entropy-coded symbol, block counts, coefficient ranges and the trailer.
+//! Dequant, IDCT and color conversion are skipped; Huffman planes are walked
+//! symbol by symbol without building blocks, concurrently. Lossless (v22) strips
+//! are the exception: their adaptive Rice coding depends on reconstructed samples,
+//! so each strip is decoded into scratch memory.
+
+use crate::container::{self, Container};
+use crate::decoder::{self, PlaneProfile};
+use crate::huffman;
+use crate::lossless;
+use crate::sequence;
+use rayon::prelude::*;
+
+const HEADER_SIZE: usize = 3 + 4 + 4 + 1;
+const EOB_RUN: u8 = 0xFF;
+
+/// Why a stream is invalid and the byte offset where parsing stopped.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct Invalid {
+    pub offset: usize,
+    pub reason: &'static str,
+}
+
+impl Invalid {
+    pub(crate) fn at(offset: usize, reason: &'static str) -> Self {
+        Self { offset, reason }
+    }
+}
+
+/// Check that `buffer` is one complete, well-formed .bg stream (any version).
+pub fn validate(buffer: &[u8]) -> Result<(), Invalid> {
+    if buffer.len() < 3 {
+        return Err(Invalid::at(buffer.len(), "truncated header"));
+    }
+    if buffer[0] != b'B' || buffer[1] != b'G' {
+        return Err(Invalid::at(0, "bad magic"));
+    }
+    let version = buffer[2];
+    let end = match version {
+        1..=19 => validate_basic(buffer, version)?,
+        container::BG_VERSION_CHUNKED => return validate_chunked(buffer),
+        sequence::BG_VERSION_SEQUENCE => return sequence::validate(buffer),
+        lossless::BG_VERSION_LOSSLESS => lossless::validate(buffer)?,
+        _ => return Err(Invalid::at(2, "unsupported version")),
+    };
+    validate_trailer(buffer, end)
+}
+
+/// Width and height from a standard 12-byte header, checked against the decoder limits.
+pub(crate) fn header_dimensions(buffer: &[u8], header_size: usize) -> Result<(usize, usize), Invalid> {
+    if buffer.len() < header_size {
+        return Err(Invalid::at(buffer.len(), "truncated header"));
+    }
+    let w = u32::from_le_bytes(buffer[3..7].try_into().unwrap());
+    let h = u32::from_le_bytes(buffer[7..11].try_into().unwrap());
+    if w == 0 || h == 0 || w > 65536 || h > 65536 {
+        return Err(Invalid::at(3, "bad image dimensions"));
+    }
+    Ok((w as usize, h as usize))
+}
+
+/// After the last plane: nothing, or one ICC trailer reaching the end of the stream.
+fn validate_trailer(buffer: &[u8], pos: usize) -> Result<(), Invalid> {
+    if pos == buffer.len() {
+        return Ok(());
+    }
+    match decoder::parse_icc_trailer(buffer, pos) {
+        Some((_, end)) if end == buffer.len() => Ok(()),
+        Some((_, end)) => Err(Invalid::at(end, "trailing bytes after stream")),
+        None => Err(Invalid::at(pos, "malformed trailer")),
+    }
+}
+
+/// v1..v19: header + RLE or length-prefixed Huffman planes. Returns the end of the last plane.
+fn validate_basic(buffer: &[u8], version: u8) -> Result<usize, Invalid> {
+    let (w, h) = header_dimensions(buffer, HEADER_SIZE)?;
+    if version <= 3 {
+        let channels = [1, 3, 4][version as usize - 1];
+        let n = ((w + 7) / 8) * ((h + 7) / 8);
+        let mut pos = HEADER_SIZE;
+        for _ in 0..channels {
+            pos = validate_rle_plane(buffer, pos, n)?;
+        }
+        return Ok(pos);
+    }
+    let p = decoder::plane_profile(version).ok_or(Invalid::at(2, "unsupported version"))?;
+    let mut planes = Vec::with_capacity(p.channels());
+    let mut pos = HEADER_SIZE;
+    for _ in 0..p.channels() {
+        if pos + 4 > buffer.len() {
+            return Err(Invalid::at(pos, "truncated plane length"));
+        }
+        let len = u32::from_le_bytes(buffer[pos..pos + 4].try_into().unwrap()) as usize;
+        let end = (pos + 4).checked_add(len).filter(|&e| e <= buffer.len());
+        let end = end.ok_or(Invalid::at(pos, "plane length past end of stream"))?;
+        planes.push((pos + 4, &buffer[pos + 4..end]));
+        pos = end;
+    }
+    validate_huffman_planes(&planes, w, h, p)?;
+    Ok(pos)
+}
+
+/// RLE blocks: i16 DC, then (run, level) triples up to the (0xFF, 0) end of block.
+fn validate_rle_plane(buffer: &[u8], mut pos: usize, n_blocks: usize) -> Result<usize, Invalid> {
+    for _ in 0..n_blocks {
+        if pos + 2 > buffer.len() {
+            return Err(Invalid::at(pos, "truncated plane"));
+        }
+        pos += 2;
+        let mut ac_idx = 1usize;
+        loop {
+            let t = buffer.get(pos..pos + 3).ok_or(Invalid::at(pos, "truncated plane"))?;
+            if t[0] == EOB_RUN && t[1] == 0 && t[2] == 0 {
+                pos += 3;
+                break;
+            }
+            ac_idx += t[0] as usize + 1;
+            if ac_idx > 64 {
+                return Err(Invalid::at(pos, "AC run past end of block"));
+            }
+            pos += 3;
+        }
+    }
+    Ok(pos)
+}
+
+/// Walk Y/Cb/Cr[/A] plane payloads (`(stream offset, payload)`) concurrently and
+/// report the first error in plane order.
+pub(crate) fn validate_huffman_planes(planes: &[(usize, &[u8])], w: usize, h: usize, p: &PlaneProfile) -> Result<(), Invalid> {
+    let luma_blocks = ((w + 7) / 8) * ((h + 7) / 8);
+    let chroma_blocks = (((w + 1) / 2 + 7) / 8) * (((h + 1) / 2 + 7) / 8);
+    let results: Vec<Result<(), Invalid>> = planes
+        .par_iter()
+        .enumerate()
+        .map(|(i, &(base, data))| {
+            let is_chroma = i == 1 || i == 2;
+            let n = if is_chroma { chroma_blocks } else { luma_blocks };
+            huffman::validate_plane_payload(data, n, is_chroma, is_chroma && p.use_chroma_ac, p.use_dc_delta)
+                .map_err(|(at, reason)| Invalid::at(base + at, reason))
+        })
+        .collect();
+    results.into_iter().collect()
+}
+
+/// v20: header, TOC bounds, quant table chunks and every plane chunk.
+fn validate_chunked(buffer: &[u8]) -> Result<(), Invalid> {
+    if buffer.len() < container::CONTAINER_HEADER_SIZE {
+        return Err(Invalid::at(buffer.len(), "truncated header"));
+    }
+    let (w, h) = header_dimensions(buffer, container::CONTAINER_HEADER_SIZE)?;
+    let toc = container::read_toc(buffer).ok_or(Invalid::at(buffer.len(), "truncated TOC"))?;
+    let mut end = container::toc_size(buffer).unwrap_or(0);
+    for (i, c) in toc.iter().enumerate() {
+        let entry = container::CONTAINER_HEADER_SIZE + i * container::TOC_ENTRY_SIZE;
+        let chunk_end = (c.offset as usize).checked_add(c.length as usize).filter(|&e| e <= buffer.len());
+        end = end.max(chunk_end.ok_or(Invalid::at(entry, "chunk past end of stream"))?);
+        if c.tag == container::TAG_QUANT && container::parse_quant_table(&buffer[c.offset as usize..][..c.length as usize]).is_none() {
+            return Err(Invalid::at(c.offset as usize, "bad quant table"));
+        }
+    }
+    let p = decoder::plane_profile(buffer[12]).ok_or(Invalid::at(12, "unknown plane profile"))?;
+    let c = Container::parse(buffer).ok_or(Invalid::at(0, "bad container"))?;
+    // Same rule as decode: luma and chroma tables are stored together or not at all.
+    if decoder::container_quant_tables(&c, c.quality).is_none() {
+        let at = toc.iter().position(|k| k.tag == container::TAG_QUANT).unwrap_or(0);
+        return Err(Invalid::at(container::CONTAINER_HEADER_SIZE + at * container::TOC_ENTRY_SIZE, "unpaired quant tables"));
+    }
+    let mut planes = Vec::with_capacity(p.channels());
+    for idx in 0..p.channels() as u32 {
+        let chunk = c.chunks.iter().find(|k| k.tag == container::TAG_PLANE && k.info == idx);
+        let chunk = chunk.ok_or(Invalid::at(container::CONTAINER_HEADER_SIZE, "missing plane chunk"))?;
+        planes.push((chunk.offset as usize, c.find(container::TAG_PLANE, idx).unwrap()));
+    }
+    validate_huffman_planes(&planes, w, h, p)?;
+    if end != buffer.len() {
+        return Err(Invalid::at(end, "trailing bytes after stream"));
+    }
+    Ok(())
+}
@@ -22,6 +22,11 @@ echo "=== Decode ==="
 $BIN -d -i tests/out/mini.bg -o tests/out/mini_decoded.pgm -y
 test -f tests/out/mini_decoded.pgm || { echo "Decode failed"; exit 1; }
 
+echo "=== Verify ==="
+$BIN verify tests/out/mini.bg || { echo "Verify rejected a valid file"; exit 1; }
+head -c 20 tests/out/mini.bg > tests/out/mini_cut.bg
+if $BIN verify tests/out/mini_cut.bg 2>/dev/null; then echo "Verify accepted a truncated file"; exit 1; fi
+
 echo "=== Round-trip ==="
 $BIN -cd -i tests/out/mini.pgm -o tests/out/mini_rt.pgm -y -m
 test -f tests/out/mini_rt.pgm || { echo "Round-trip failed"; exit 1; }